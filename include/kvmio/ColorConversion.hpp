@@ -0,0 +1,22 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+
+#include <common/defines.h> // for u8, u32
+
+#include <span> // for std::span<>
+
+namespace kvmio
+{
+	// CPU NV12 (full resolution Y plane followed by the half resolution interleaved CbCr plane) to B8G8R8A8, BT.709 full range,
+	// the same conversion as the YCbCr sampler of the Vulkan present engine; for the platforms without a hardware converter.
+	// Rows of the destination are dstStride bytes apart, so it can write straight into a surface shared with the display server
+	KVMIO_API void ConvertNV12ToBGRA(std::span<const u8> nv12, u32 width, u32 height, u8* dst, u32 dstStride);
+	// Same as above for a band of rows of the planes (height must be even and the band must start on an even row), both planes are srcStride wide
+	KVMIO_API void ConvertNV12ToBGRA(const u8* yPlane, const u8* uvPlane, u32 srcStride, u32 width, u32 height, u8* dst, u32 dstStride);
+
+	// The inverse, B8G8R8A8 to NV12 (BT.709 full range, each CbCr sample being the average of its 2x2 block), for the capturing side.
+	// Converts a rectangle of even position and size: the pointers are to its top-left pixel, so only the damaged areas of a frame need converting.
+	// Uses SSE2 where available
+	KVMIO_API void ConvertBGRAToNV12(const u8* src, u32 srcStride, u32 width, u32 height, u8* yPlane, u8* uvPlane, u32 dstStride);
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+
+#include <common/defines.h> // for u8, u32, s32, u64
+
+#include <span> // for std::span<>
+#include <vector> // for std::vector<>
+#include <memory> // for std::shared_ptr<>
+#include <mutex> // for std::mutex
+#include <atomic> // for std::atomic<>
+
+namespace kvmio
+{
+	// Image of the remote cursor, drawn on top of the frames instead of being baked into them
+	struct CursorShape
+	{
+		u32 width;
+		u32 height;
+		// The pixel of the shape which is placed at the cursor position
+		u32 hotspotX;
+		u32 hotspotY;
+		// B8G8R8A8 with straight (not premultiplied) alpha, tightly packed rows
+		std::span<const u8> pixels;
+	};
+
+	// In pixels of the frame, may lie partially (or entirely) outside of it
+	struct CursorRect
+	{
+		s32 x;
+		s32 y;
+		u32 width;
+		u32 height;
+	};
+
+	// FNV-1a over the size, the hotspot and the pixels; identifies the shape for CursorOverlay::selectShape()
+	KVMIO_API u64 HashCursorShape(const CursorShape& shape);
+
+	// Cursor plane state, written at the input rate (from local input or position messages) and read by the renderer once per refresh,
+	// so moving the cursor never needs a new frame to be captured, converted and uploaded
+	class KVMIO_API CursorOverlay
+	{
+	public:
+		// Larger shapes are rejected
+		static constexpr u32 MaxShapeSize = 256;
+		// Shapes kept for selectShape(), the least recently used one is evicted beyond this
+		static constexpr u32 CacheSize = 16;
+
+		struct Shape
+		{
+			u64 hash;
+			u32 width;
+			u32 height;
+			u32 hotspotX;
+			u32 hotspotY;
+			std::vector<u8> pixels;
+		};
+
+		struct State
+		{
+			// Changes whenever anything below changes
+			u32 version;
+			bool isVisible;
+			s32 x;
+			s32 y;
+			// Null until a shape has been set
+			std::shared_ptr<const Shape> shape;
+
+			// Area covered by the shape, all zero if there is nothing to draw
+			CursorRect getRect() const noexcept;
+		};
+
+	private:
+		u32 m_frameWidth;
+		u32 m_frameHeight;
+		mutable std::mutex m_mutex;
+		// Least recently used first
+		std::vector<std::shared_ptr<const Shape>> m_cachedShapes;
+		std::shared_ptr<const Shape> m_shape;
+		s32 m_x;
+		s32 m_y;
+		bool m_isVisible;
+		std::atomic<u32> m_version;
+
+		void selectCachedShape(std::size_t index);
+
+	public:
+		CursorOverlay(u32 frameWidth, u32 frameHeight);
+
+		// Not copyable and Not movable
+		CursorOverlay(CursorOverlay&) = delete;
+		CursorOverlay(CursorOverlay&&) = delete;
+
+		// Thread-safe, copies the pixels (only if the shape isn't cached already) and returns its hash
+		u64 setShape(const CursorShape& shape);
+		// Thread-safe, returns false if no shape with this hash is cached, in which case the pixels have to be sent with setShape()
+		bool selectShape(u64 hash);
+		// Thread-safe, in pixels of the frame
+		void setPosition(s32 x, s32 y);
+		// Thread-safe, for relative (e.g. raw input) motion; the result is clamped to the frame
+		void movePosition(s32 dx, s32 dy);
+		// Thread-safe
+		void setVisible(bool isVisible);
+
+		// Cheap enough to be polled on every iteration of a render loop
+		u32 getVersion() const noexcept { return m_version.load(std::memory_order_acquire); }
+		State getState() const;
+	};
+
+	// Draws the cursor into a CPU B8G8R8A8 surface, keeping the pixels underneath so that it can be moved without redrawing the frame
+	class KVMIO_API SoftwareCursor
+	{
+	private:
+		std::vector<u8> m_savedPixels;
+		// Clipped to the surface
+		CursorRect m_savedRect;
+		u32 m_drawnVersion;
+
+	public:
+		SoftwareCursor();
+
+		// The surface has been overwritten (e.g. by a new frame), so there is nothing to restore
+		void invalidate();
+		// Puts back the pixels underneath the previously drawn cursor, returns the (clipped) area they cover
+		CursorRect restore(u8* pixels, u32 width, u32 height);
+		// Blends the cursor at its current position, returns the (clipped) area it covers
+		CursorRect draw(u8* pixels, u32 width, u32 height, const CursorOverlay::State& state);
+
+		u32 getDrawnVersion() const noexcept { return m_drawnVersion; }
+		// Area of the surface the cursor is currently drawn over
+		const CursorRect& getDrawnRect() const noexcept { return m_savedRect; }
+	};
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Win32/Win32RawInput.hpp> // for Win32::KeyboardInput and Win32::MouseInput
+#include <kvmio/InputEventRing.hpp>
+
+#include <common/defines.h>
+#include <common/Event.hpp>
+
+#include <linux/input.h> // for KEY_MAX
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kvmio::Evdev
+{
+	/*
+		Keyboards and mice read straight from the kernel's evdev nodes (/dev/input/event*), below any window system.
+
+		An evdev node reports a packet of input_event values (EV_KEY, EV_REL, ...) terminated by a SYN_REPORT, which is what
+		Raw Input reports as a single RAWMOUSE/RAWKEYBOARD: the key events are decoded into one Win32::KeyboardInput each and the
+		pointer events of a packet into one Win32::MouseInput, so the rest of the code needs not care where the input came from.
+
+		The nodes need read permission, usually given by the 'input' group.
+	*/
+
+	struct DeviceInfo
+	{
+		std::string path;
+		std::string name;
+		// Has letter keys
+		bool isKeyboard;
+		// Has relative X/Y axes
+		bool isMouse;
+	};
+
+	// Timestamps are in microseconds of CLOCK_MONOTONIC, taken by the kernel when the packet was reported
+	struct KeyboardEvent
+	{
+		Win32::KeyboardInput input;
+		u64 timestamp;
+		// As returned by EvdevInput::addDevice()
+		u32 device;
+	};
+
+	struct MouseEvent
+	{
+		Win32::MouseInput input;
+		u64 timestamp;
+		u32 device;
+	};
+
+	KVMIO_API std::vector<DeviceInfo> EnumerateDevices();
+	KVMIO_API void DisplayDeviceList();
+
+	// Reads any number of devices from a single epoll loop, draining each ready device with batched reads,
+	// so a 8000 Hz mouse costs an epoll_wait() and a read() per wake up rather than a message per event
+	class KVMIO_API EvdevInput
+	{
+	private:
+		struct Device
+		{
+			s32 fd;
+			std::string path;
+			bool isGrabbed;
+			// Set on SYN_DROPPED, the events are ignored up to the next SYN_REPORT as the kernel's buffer overflowed,
+			// which then reads the key state again
+			bool isDropping;
+			// The pointer events of the packet being read
+			Win32::MouseInput pendingMouseInput;
+			bool isMousePending;
+			bool isAltPressed;
+			// The keys and buttons published as pressed and not released yet, a bit per code as EVIOCGKEY reports them
+			unsigned long heldKeys[(KEY_MAX + 1) / (sizeof(unsigned long) * 8) + 1];
+		};
+
+		s32 m_epoll;
+		// Wakes pollEvents() up from another thread
+		s32 m_wakeUpEvent;
+		std::vector<Device> m_devices;
+
+		com::Event<com::no_publish_ptr_t, KeyboardEvent> m_keyboardEvent;
+		com::Event<com::no_publish_ptr_t, MouseEvent> m_mouseEvent;
+		// Not owned, null unless set with setInputEventRing()
+		InputEventRing* m_inputEventRing;
+
+		void closeDevice(u32 index);
+		// Returns false once the device is gone (i.e. unplugged)
+		bool readDevice(u32 index);
+		void publishKey(u32 index, u16 code, s32 value, u64 timestamp);
+		// Called at the SYN_REPORT ending a drop, releases what was held and isn't anymore
+		void syncKeys(u32 index, u64 timestamp);
+
+	public:
+		EvdevInput();
+
+		// Not copyable and not movable
+		EvdevInput(EvdevInput&) = delete;
+		EvdevInput(EvdevInput&&) = delete;
+
+		~EvdevInput();
+
+		// Grabbing gives the device to this process only, for a KVM session whose input must not reach the local desktop as well.
+		// Returns the device's index (reported along with its events) or u32(-1) if it could not be opened
+		u32 addDevice(std::string_view path, bool isGrab = false);
+		// Waits at most timeout milliseconds (forever if u32(-1)) for any device to be readable and publishes everything read from them
+		void pollEvents(u32 timeout);
+		// Thread-safe, makes a waiting pollEvents() return
+		void wakeUp();
+
+		com::Event<com::no_publish_ptr_t, KeyboardEvent>& getKeyboardEvent() noexcept { return m_keyboardEvent; }
+		com::Event<com::no_publish_ptr_t, MouseEvent>& getMouseEvent() noexcept { return m_mouseEvent; }
+		// Everything published is pushed into the ring as well (with the kernel's timestamps), by the thread calling pollEvents();
+		// the device indices are not carried over
+		void setInputEventRing(InputEventRing* ring) noexcept { m_inputEventRing = ring; }
+	};
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Win32/Win32RawInput.hpp> // for Win32::KeyboardInput and Win32::MouseInput
+
+#include <common/defines.h>
+
+#include <linux/input.h> // for input_event
+
+#include <bitset>
+#include <string_view>
+#include <vector>
+
+namespace kvmio::Evdev
+{
+	// A virtual keyboard and mouse created through /dev/uinput, which delivers the decoded input on the target side
+	// as if it came from real devices. The inputs are queued and written to the kernel with a single write() per flush(),
+	// each of them followed by its SYN_REPORT, so one frame's worth of input is one syscall.
+	// The creating process needs write access to /dev/uinput
+	class KVMIO_API UinputSink
+	{
+	private:
+		s32 m_fd;
+		bool m_isAbsolute;
+		u32 m_width;
+		u32 m_height;
+		// Pointer position in absolute mode, relative motion moves it (clamped to the screen) rather than the kernel's pointer.
+		// In relative mode, the position of the last input with isMoveAbsolute
+		s32 m_x;
+		s32 m_y;
+		// Relative mode only, false until an input with isMoveAbsolute has given a position to move from
+		bool m_isPositionKnown;
+		std::vector<input_event> m_events;
+		// To release whatever is still held when the session ends
+		std::bitset<KEY_CNT> m_pressedKeys;
+
+		void push(u16 type, u16 code, s32 value);
+		void pushButton(u16 code, bool isTransition, Win32::KeyStatus status);
+		// Clamped to the screen, without the SYN_REPORT
+		void pushPosition(s32 x, s32 y);
+
+	public:
+		// In absolute mode the pointer is an ABS_X/ABS_Y device of width x height, which the desktop maps onto the screen
+		// without any acceleration, so the remote and local cursors can not drift apart
+		UinputSink(std::string_view name = "kvmio virtual input", bool isAbsolute = false, u32 width = 1920, u32 height = 1080);
+
+		// Not copyable and not movable
+		UinputSink(UinputSink&) = delete;
+		UinputSink(UinputSink&&) = delete;
+
+		// Releases the held keys and buttons before destroying the device
+		~UinputSink();
+
+		// Queue up, nothing is written until flush()
+		void keyboard(const Win32::KeyboardInput& input);
+		// In absolute mode, an input with isMoveAbsolute has its movement as the pointer position, in Raw Input's normalized
+		// 0 to 65535 coordinates (read as unsigned) which are scaled to width x height.
+		// In relative mode, they move the pointer by the difference with the previous absolute input's position
+		void mouse(const Win32::MouseInput& input);
+		void moveTo(s32 x, s32 y);
+		void releaseAll();
+		// Writes everything queued since the last flush
+		void flush();
+
+		bool isAbsolute() const noexcept { return m_isAbsolute; }
+	};
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+
+#include <common/defines.h> // for u64, f64
+
+#include <array> // for std::array<>
+#include <mutex> // for std::mutex
+#include <span> // for std::span<>
+
+namespace kvmio
+{
+	// Timings of a single frame in the display path, all durations are in milliseconds.
+	// A negative value means the measurement isn't available (e.g. the device doesn't support timestamp queries)
+	struct FrameTimings
+	{
+		u64 frameIndex;
+
+		/* CPU timestamps */
+		// Acquiring the next swapchain image (including waiting for it)
+		f64 acquire;
+		// Copying the frame into the host visible staging buffer
+		f64 copy;
+		// From vkQueueSubmit until the GPU signals the fence
+		f64 submit;
+		// The vkQueuePresentKHR call
+		f64 present;
+
+		/* GPU timestamps (VkQueryPool) */
+		// Layout transition of the sampled image before the upload
+		f64 gpuBarrier;
+		// Buffer to image copy
+		f64 gpuUpload;
+		// Layout transition, render pass and the draw
+		f64 gpuDraw;
+
+		// From queueing the present until the image is actually on the screen (VK_KHR_present_wait)
+		f64 display;
+
+		// Counts the frames given to submitFrame() from 1, the one this frame displays (0 if only the cursor has been redrawn)
+		u64 submitIndex;
+		// When the image was seen on the screen, in microseconds of the steady clock (as GetInputTimestamp()); 0 if not measured
+		u64 displayTimestamp;
+	};
+
+	struct Percentiles
+	{
+		f64 p50;
+		f64 p99;
+	};
+
+	// Of any set of samples, reorders them; -1 for both if there are none
+	KVMIO_API Percentiles GetPercentiles(std::span<f64> samples);
+
+	struct FrameTimingStatistics
+	{
+		// Number of frames recorded so far, the percentiles are computed over the last FrameTimingRecorder::WindowSize frames only
+		u64 frameCount;
+		Percentiles acquire;
+		Percentiles copy;
+		Percentiles submit;
+		Percentiles present;
+		Percentiles gpuBarrier;
+		Percentiles gpuUpload;
+		Percentiles gpuDraw;
+		Percentiles display;
+	};
+
+	// Keeps a rolling window of per-frame timings and computes percentiles over it
+	// Thread-safe, record() is called by the render thread while getStatistics() can be called from anywhere
+	class KVMIO_API FrameTimingRecorder
+	{
+	public:
+		static constexpr u32 WindowSize = 512;
+
+	private:
+		// Ring of samples for one metric, negative (unavailable) samples are not stored
+		class SampleWindow
+		{
+		private:
+			std::array<f64, WindowSize> m_samples;
+			u32 m_count;
+			u32 m_head;
+		public:
+			SampleWindow() : m_count(0), m_head(0) { }
+			void add(f64 sample);
+			Percentiles getPercentiles() const;
+		};
+
+		mutable std::mutex m_mutex;
+		u64 m_frameCount;
+		SampleWindow m_acquire;
+		SampleWindow m_copy;
+		SampleWindow m_submit;
+		SampleWindow m_present;
+		SampleWindow m_gpuBarrier;
+		SampleWindow m_gpuUpload;
+		SampleWindow m_gpuDraw;
+		SampleWindow m_display;
+
+	public:
+		FrameTimingRecorder() : m_frameCount(0) { }
+
+		void record(const FrameTimings& timings);
+		FrameTimingStatistics getStatistics() const;
+	};
+}
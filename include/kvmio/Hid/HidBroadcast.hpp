@@ -0,0 +1,142 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Hid/HidReportEncoder.hpp>
+#include <kvmio/InputEventRing.hpp>
+#include <kvmio/Win32/Win32RawInput.hpp> // for Win32::KeyboardInput and Win32::MouseInput
+
+#include <common/defines.h>
+
+#include <atomic> // for std::atomic<>
+#include <mutex> // for std::mutex
+#include <string> // for std::string
+#include <string_view> // for std::string_view
+#include <thread> // for std::thread
+#include <vector> // for std::vector<>
+
+namespace kvmio::Hid
+{
+	/*
+		Types the same input into any number of targets at once (i.e. a BIOS setting changed on a rack of servers, or a login
+		on all their consoles), each target being a keyboard and a mouse endpoint which take one report per write():
+		the /dev/hidgN nodes of a USB gadget plugged into the target, or SOCK_SEQPACKET sockets to an agent forwarding to one.
+
+		The input is encoded once: the reports go into a log per endpoint type, and every target has its own position
+		(its queue) in the logs, so the bytes written to all the targets are the same ones. A single thread drives all the targets
+		from an epoll loop, writing whatever each one has pending whenever it is writable, so a target which is slow or gone
+		never delays the others. One which falls a whole log behind skips to the current state: its keyboard gets the latest report
+		(the held keys, in full), its mouse the held buttons without the movements it missed.
+	*/
+
+	struct HidTargetStatistics
+	{
+		std::string name;
+		// Written to the target
+		u64 reportCount;
+		// Queued, not written yet
+		u32 pendingCount;
+		// Times it fell behind and skipped to the current state
+		u32 overflowCount;
+		// False once writing to either endpoint has failed (i.e. the gadget's host went away)
+		bool isConnected;
+	};
+
+	class KVMIO_API HidBroadcast
+	{
+	public:
+		typedef u32 TargetId;
+		static constexpr TargetId InvalidTarget = static_cast<TargetId>(-1);
+
+	private:
+		// The reports of one endpoint type, written once and read by every target
+		struct ReportLog
+		{
+			std::vector<HidReport> reports;
+			u64 mask;
+			// Reports ever appended, the latest one is at (head - 1) & mask
+			u64 head;
+		};
+
+		struct Endpoint
+		{
+			s32 fd;
+			// Written with send(MSG_NOSIGNAL), so a closed peer is an error rather than a SIGPIPE
+			bool isSocket;
+			// Position in the log, the target's queue is from here to the log's head
+			u64 cursor;
+			// Cleared when a write() would block, set again when epoll reports it writable
+			bool isWritable;
+			// The report at the cursor is sent without its movements (a mouse skipping to the current state)
+			bool isStateOnly;
+		};
+
+		struct Target
+		{
+			std::string name;
+			Endpoint keyboard;
+			Endpoint mouse;
+			u64 reportCount;
+			u32 overflowCount;
+			bool isConnected;
+			bool isRemoved;
+		};
+
+		s32 m_epoll;
+		// Wakes the forwarding thread up
+		s32 m_wakeUpEvent;
+		// Set by the producer when it has written m_wakeUpEvent, so a burst of input costs a single write()
+		std::atomic<bool> m_isWakeUpPending;
+		std::atomic<bool> m_isRunning;
+
+		/* Producer to forwarding thread */
+		InputEventRing m_inputEventRing;
+
+		/* Forwarding thread */
+		HidReportEncoder m_encoder;
+		std::vector<InputEvent> m_inputEvents;
+		std::vector<HidReport> m_reports;
+
+		// Guards the targets (added and removed from any thread) and the logs, the forwarding thread holds it while writing
+		// to the targets, which never blocks
+		std::mutex m_mutex;
+		ReportLog m_keyboardLog;
+		ReportLog m_mouseLog;
+		// Indexed by the target ids, the removed ones are left with their endpoints closed
+		std::vector<Target> m_targets;
+		std::thread m_thread;
+
+		void wakeUp();
+		void append(const HidReport& report);
+		// Called with the lock held, writes what the endpoint has pending until it would block, returns false if writing failed
+		bool writeEndpoint(Target& target, Endpoint& endpoint, const ReportLog& log, bool isMouse);
+		void closeTarget(TargetId id);
+		void forward();
+		void run();
+
+	public:
+		// The logs hold logCapacity reports of each type (rounded up to a power of two), as much as a target can fall behind
+		HidBroadcast(HidKeyboardMode keyboardMode = HidKeyboardMode::Boot, HidMouseMode mouseMode = HidMouseMode::Boot,
+						u32 logCapacity = 4096, u32 inputCapacity = 4096);
+
+		// Not copyable and not movable
+		HidBroadcast(HidBroadcast&) = delete;
+		HidBroadcast(HidBroadcast&&) = delete;
+
+		// Releases the held keys and buttons on the targets (as far as they take it without blocking), then closes them
+		~HidBroadcast();
+
+		/* Any thread */
+		// Takes the ownership of the fds (either can be -1 if the target has no such endpoint), which are made non-blocking.
+		// The target gets the input from now on, starting with the current state
+		TargetId addTarget(std::string_view name, s32 keyboardFd, s32 mouseFd);
+		// Opens the gadget's nodes, i.e. /dev/hidg0 and /dev/hidg1; returns InvalidTarget if either can't be opened
+		TargetId addGadgetTarget(std::string_view keyboardPath, std::string_view mousePath);
+		void removeTarget(TargetId id);
+		std::vector<HidTargetStatistics> getStatistics();
+
+		/* Producer, a single thread (i.e. the one decoding the input); never blocks */
+		void keyboard(const Win32::KeyboardInput& input);
+		void mouse(const Win32::MouseInput& input);
+		u64 getDroppedInputCount() const noexcept { return m_inputEventRing.getDroppedCount(); }
+	};
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Win32/Win32RawInput.hpp> // for Win32::KeyboardInput and Win32::MouseInput
+
+#include <common/defines.h>
+
+#include <array> // for std::array<>
+#include <bitset> // for std::bitset<>
+#include <span> // for std::span<>
+#include <vector> // for std::vector<>
+
+namespace kvmio::Hid
+{
+	/*
+		Turns the decoded input into the USB HID input reports a gadget (i.e. /dev/hidg0 and /dev/hidg1 of the Linux USB gadget
+		framework) sends to the target, which then sees an ordinary keyboard and mouse, down to its BIOS.
+
+		The encoder keeps the state of the keys and buttons and reports changes only: the inputs of a frame are merged into
+		as few reports as still reproduce them, i.e. a key pressed and released within the frame takes two reports, but any number
+		of keys pressed together (or mouse movements between two button transitions) take one, and a report identical to
+		the previous one is never sent.
+	*/
+
+	enum class HidKeyboardMode : u8
+	{
+		// 8 bytes: modifiers, reserved, 6 key usages; the boot protocol, understood by any BIOS
+		Boot,
+		// 30 bytes: modifiers, a bitmap of the usages 0x00-0xE7; no rollover limit, needs an OS that parses the report descriptor
+		NKRO
+	};
+
+	enum class HidMouseMode : u8
+	{
+		// 4 bytes: buttons, X, Y, wheel; the boot protocol's 3 bytes with the wheel appended
+		Boot,
+		// 5 bytes: the same with the horizontal wheel (AC Pan) appended
+		BootWithPan
+	};
+
+	enum class HidReportType : u8
+	{
+		Keyboard,
+		Mouse
+	};
+
+	struct HidReport
+	{
+		static constexpr u32 MaxSize = 30;
+
+		HidReportType type;
+		u8 size;
+		std::array<u8, MaxSize> data;
+
+		std::span<const u8> getBytes() const noexcept { return { data.data(), size }; }
+	};
+
+	// The report descriptors matching the reports, for the gadget's configuration
+	KVMIO_API std::span<const u8> GetKeyboardReportDescriptor(HidKeyboardMode mode);
+	KVMIO_API std::span<const u8> GetMouseReportDescriptor(HidMouseMode mode);
+
+	class KVMIO_API HidReportEncoder
+	{
+	private:
+		HidKeyboardMode m_keyboardMode;
+		HidMouseMode m_mouseMode;
+
+		/* Keyboard */
+		// Modifier bits as in byte 0 of the report, left Ctrl in bit 0 to right GUI in bit 7
+		u8 m_modifiers;
+		std::bitset<256> m_keys;
+		// Press order of m_keys, a boot report holds the first 6 of them
+		std::vector<u8> m_heldKeys;
+		// Changed since the last report, changing any of them again needs a report in between
+		u8 m_changedModifiers;
+		std::bitset<256> m_changedKeys;
+		// A key has been pressed since the last report
+		bool m_isKeyPressPending;
+		std::array<u8, HidReport::MaxSize> m_lastKeyboardReport;
+
+		/* Mouse */
+		// Left, right, middle, 4 and 5 from bit 0
+		u8 m_buttons;
+		u8 m_changedButtons;
+		u8 m_lastButtons;
+		// Not reported yet, more than a report can hold is split over several
+		s32 m_deltaX;
+		s32 m_deltaY;
+		s32 m_wheel;
+		s32 m_pan;
+
+		std::vector<HidReport> m_reports;
+
+		// Append a report of the current state unless it is identical to the previous one
+		void emitKeyboard();
+		void emitMouse();
+		void setButton(u8 bit, bool isTransition, Win32::KeyStatus status);
+
+	public:
+		HidReportEncoder(HidKeyboardMode keyboardMode = HidKeyboardMode::Boot, HidMouseMode mouseMode = HidMouseMode::Boot);
+
+		// Queue up, nothing is reported until flush()
+		void keyboard(const Win32::KeyboardInput& input);
+		// The boot protocol is relative, the absolute inputs only have their buttons and wheels reported
+		void mouse(const Win32::MouseInput& input);
+		void releaseAll();
+		// Appends the reports of everything queued since the last flush to 'reports', in the order they are to be sent,
+		// and returns their number
+		u32 flush(std::vector<HidReport>& reports);
+
+		HidKeyboardMode getKeyboardMode() const noexcept { return m_keyboardMode; }
+		HidMouseMode getMouseMode() const noexcept { return m_mouseMode; }
+	};
+}
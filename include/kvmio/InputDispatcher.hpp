@@ -0,0 +1,145 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/InputEventRing.hpp> // for kvmio::InputEvent
+#include <kvmio/KeyChordEngine.hpp> // for kvmio::KeyChordEngine::ChordId
+#include <kvmio/Win32/Win32RawInput.hpp> // for Win32::KeyboardInput and Win32::MouseInput
+
+#include <common/defines.h>
+
+#include <array> // for std::array<>
+#include <atomic> // for std::atomic<>
+#include <condition_variable> // for std::condition_variable
+#include <functional> // for std::function<>
+#include <memory> // for std::unique_ptr<>
+#include <mutex> // for std::mutex
+#include <span> // for std::span<>
+#include <thread> // for std::thread
+#include <vector> // for std::vector<>
+
+namespace kvmio
+{
+	// What happens to an input published to a subscriber whose queue is full
+	enum class DispatchOverflow : u8
+	{
+		// A mouse event is merged into the latest one queued if they can be reported as one (see TryCoalesceInputEvent()),
+		// anything else is dropped. Keyboard events never merge, so it is the same as Drop for them
+		Coalesce,
+		// The input is dropped, unless it is a key release: the oldest key press queued is dropped instead
+		Drop
+	};
+
+	struct DispatchStatistics
+	{
+		// Queued, not delivered yet
+		u32 pendingCount;
+		u64 deliveredCount;
+		u64 coalescedCount;
+		u64 droppedCount;
+	};
+
+	// Calls the input subscribers on a worker thread of its own instead of on the thread decoding the input (i.e. in WindowProc),
+	// so a slow subscriber (i.e. one writing to a socket) never holds up the message loop.
+	// Every subscriber has a bounded queue of its own and gets its inputs in the order they were published; one which can't keep up
+	// loses inputs (as its overflow policy says) without any effect on the others' queues.
+	// The worker takes a batch from each subscriber in turn, a subscriber blocking in its callback still delays the others' deliveries
+	class KVMIO_API InputDispatcher
+	{
+	public:
+		typedef u32 SubscriptionId;
+		static constexpr SubscriptionId InvalidSubscription = static_cast<SubscriptionId>(-1);
+
+		using MouseCallback = std::function<void(const Win32::MouseInput& input)>;
+		using KeyboardCallback = std::function<void(const Win32::KeyboardInput& input)>;
+		// The keys held when the combination matched, in press order
+		using KeyCombinationCallback = std::function<void(const std::vector<Win32::KeyboardInput>& keys)>;
+
+	private:
+		// Delivered to one subscriber without taking the lock again
+		static constexpr u32 BatchSize = 64;
+
+		enum class SubscriberType : u8
+		{
+			Mouse,
+			Keyboard,
+			KeyCombination
+		};
+
+		struct HeldKeys
+		{
+			u32 count;
+			std::array<Win32::KeyboardInput, KeyChordEngine::MaxHeldKeys> keys;
+		};
+
+		struct Subscriber
+		{
+			SubscriberType type;
+			DispatchOverflow overflow;
+			KeyChordEngine::ChordId chord;
+			MouseCallback mouseCallback;
+			KeyboardCallback keyboardCallback;
+			KeyCombinationCallback keyCombinationCallback;
+			// A ring of 'capacity' entries in one of them, depending on the type
+			std::vector<InputEvent> events;
+			std::vector<HeldKeys> keyCombinations;
+			u32 capacity;
+			u32 head;
+			u32 count;
+			u64 deliveredCount;
+			u64 coalescedCount;
+			u64 droppedCount;
+			// Checked by the worker between the callbacks of a batch; if set from the callback itself, the worker destroys it afterwards
+			std::atomic<bool> isRemoved;
+		};
+
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		// Notified whenever the worker is done with a batch, for unsubscribe() to wait on
+		std::condition_variable m_deliveredCondition;
+		// Indexed by the subscription ids, null once unsubscribed
+		std::vector<std::unique_ptr<Subscriber>> m_subscribers;
+		// Read without the lock by the publishers, nothing is published while it is zero
+		std::atomic<u32> m_subscriberCount;
+		u32 m_pendingCount;
+		// The subscriber whose batch the worker is delivering
+		SubscriptionId m_delivering;
+		bool m_isStop;
+		// Started on the first subscription
+		std::thread m_thread;
+
+		SubscriptionId addSubscriber(std::unique_ptr<Subscriber> subscriber, u32 capacity);
+		// Called with the lock held
+		// Drops the oldest keyboard press queued, returns false if there is none
+		bool evictOldestPress(Subscriber& subscriber);
+		void enqueue(Subscriber& subscriber, const InputEvent& event);
+		void enqueue(Subscriber& subscriber, std::span<const Win32::KeyboardInput> keys);
+		void run();
+
+	public:
+		InputDispatcher();
+
+		// Not copyable and not movable
+		InputDispatcher(InputDispatcher&) = delete;
+		InputDispatcher(InputDispatcher&&) = delete;
+
+		// Stops the worker, the inputs still queued are not delivered
+		~InputDispatcher();
+
+		/* Any thread */
+		SubscriptionId subscribeMouse(MouseCallback callback, u32 capacity = 1024, DispatchOverflow overflow = DispatchOverflow::Coalesce);
+		// A subscriber whose queue is full loses presses, never releases: a release takes the place of the oldest press queued,
+		// so it may miss a key stroke but never sees a key held which has been released. The dropped count tells when it fell behind
+		SubscriptionId subscribeKeyboard(KeyboardCallback callback, u32 capacity = 256, DispatchOverflow overflow = DispatchOverflow::Drop);
+		// The chord is registered with the KeyChordEngine of the publisher, see Win32Window::subscribeKeyCombinationAsync()
+		SubscriptionId subscribeKeyCombination(KeyChordEngine::ChordId chord, KeyCombinationCallback callback, u32 capacity = 16,
+													DispatchOverflow overflow = DispatchOverflow::Drop);
+		// The callback is not called anymore once this returns (unless called from the callback itself, which then finishes its batch)
+		void unsubscribe(SubscriptionId id);
+		DispatchStatistics getStatistics(SubscriptionId id);
+
+		/* Publisher, the thread decoding the input; never waits for a subscriber */
+		void publishMouse(const Win32::MouseInput& input, u64 timestamp);
+		void publishKeyboard(const Win32::KeyboardInput& input, u64 timestamp);
+		void publishKeyCombination(KeyChordEngine::ChordId chord, std::span<const Win32::KeyboardInput> keys);
+	};
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Types.hpp> // for kvmio::WindowEventType
+#include <kvmio/Win32/Win32RawInput.hpp> // for Win32::KeyboardInput and Win32::MouseInput
+
+#include <common/defines.h> // for u32, u64
+
+#include <atomic> // for std::atomic<>
+#include <memory> // for std::unique_ptr<>
+#include <span> // for std::span<>
+
+namespace kvmio
+{
+	// Microseconds of the monotonic clock the input timestamps are taken from (CLOCK_MONOTONIC on Linux, the same as evdev's)
+	KVMIO_API u64 GetInputTimestamp() noexcept;
+
+	struct InputEvent
+	{
+		WindowEventType type;
+		// As GetInputTimestamp(), for a coalesced mouse event the timestamp of the latest one merged into it
+		u64 timestamp;
+		union
+		{
+			Win32::KeyboardInput keyboard;
+			Win32::MouseInput mouse;
+			struct
+			{
+				u32 width;
+				u32 height;
+			} resize;
+		};
+	};
+
+	// Merges 'next' into 'into' if both are mouse events that can be reported as one, as InputEventRing::drain() does,
+	// returns false (leaving 'into' as is) otherwise
+	KVMIO_API bool TryCoalesceInputEvent(InputEvent& into, const InputEvent& next) noexcept;
+
+	// A fixed-size, lock-free single producer single consumer ring of input events: the thread decoding the input pushes,
+	// another (i.e. the one forwarding it over the network) drains in batches, so neither ever waits for the other.
+	// The ring never grows, an event pushed into a full ring is dropped (and counted)
+	class KVMIO_API InputEventRing
+	{
+	private:
+		std::unique_ptr<InputEvent[]> m_events;
+		u32 m_mask;
+		// Written by the producer only; on cache lines of their own so the two threads don't keep invalidating each other's
+		alignas(64) std::atomic<u64> m_head;
+		std::atomic<u64> m_droppedCount;
+		// Written by the consumer only
+		alignas(64) std::atomic<u64> m_tail;
+
+	public:
+		// The capacity is rounded up to a power of two
+		InputEventRing(u32 capacity = 4096);
+
+		// Not copyable and not movable
+		InputEventRing(InputEventRing&) = delete;
+		InputEventRing(InputEventRing&&) = delete;
+
+		/* Producer */
+		// Returns false if the ring is full
+		bool push(const InputEvent& event) noexcept;
+		bool pushKeyboard(const Win32::KeyboardInput& input, u64 timestamp) noexcept;
+		bool pushMouse(const Win32::MouseInput& input, u64 timestamp) noexcept;
+		bool pushResize(u32 width, u32 height, u64 timestamp) noexcept;
+
+		/* Consumer */
+		// Moves up to events.size() events out of the ring, in the order they were pushed, and returns their number.
+		// With isCoalesce, runs of mouse events without a button transition are merged into one: relative movements and wheel ticks
+		// are summed (as long as they fit in the 16 bits), absolute movements take the latest position
+		u32 drain(std::span<InputEvent> events, bool isCoalesce = false) noexcept;
+
+		/* Any thread */
+		bool isEmpty() const noexcept { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+		u32 getCapacity() const noexcept { return m_mask + 1; }
+		u64 getDroppedCount() const noexcept { return m_droppedCount.load(std::memory_order_relaxed); }
+	};
+}
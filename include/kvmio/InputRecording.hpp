@@ -0,0 +1,99 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/InputEventRing.hpp> // for kvmio::InputEvent
+#include <kvmio/FrameTimings.hpp> // for kvmio::Percentiles
+
+#include <common/defines.h>
+
+#include <functional> // for std::function<>
+#include <memory> // for std::unique_ptr<>
+#include <span> // for std::span<>
+#include <string> // for std::string
+#include <string_view> // for std::string_view
+#include <vector> // for std::vector<>
+
+namespace kvmio
+{
+	/*
+		A recorded input session is a small header followed by the decoded InputEvent values as they are in memory,
+		so recording one is a copy into a memory-mapped file and replaying one reads them in place.
+		The layout of InputEvent is that of the build, a recording is only read back by a build with the same event size.
+	*/
+
+	// Platform specific handles of a mapped file, defined in the source
+	struct MappedFile;
+
+	// Thread-compatible, i.e. called from the thread draining the input (or decoding it) only
+	class KVMIO_API InputRecorder
+	{
+	private:
+		std::string m_path;
+		std::unique_ptr<MappedFile> m_file;
+		u64 m_eventCount;
+		// Events the mapping has room for, it is doubled when they run out
+		u64 m_capacity;
+		std::vector<InputEvent> m_batch;
+
+		void grow(u64 capacity);
+
+	public:
+		// Creates (or truncates) the file
+		InputRecorder(std::string_view path, u32 initialCapacity = 65536);
+
+		// Not copyable and not movable
+		InputRecorder(InputRecorder&) = delete;
+		InputRecorder(InputRecorder&&) = delete;
+
+		// Closes the file if still open
+		~InputRecorder();
+
+		void record(const InputEvent& event);
+		void record(std::span<const InputEvent> events);
+		// Drains the ring into the file and returns the number of events recorded
+		u32 recordFrom(InputEventRing& ring);
+		// Writes the event count into the header and trims the file to the recorded events, nothing can be recorded afterwards
+		void close();
+
+		u64 getEventCount() const noexcept { return m_eventCount; }
+	};
+
+	struct ReplayStatistics
+	{
+		u64 eventCount;
+		// Seconds, from the first dispatch until the last one has returned
+		f64 elapsed;
+		f64 eventsPerSecond;
+		// Microseconds spent in the dispatch callback per event
+		Percentiles dispatchLatency;
+		f64 maxDispatchLatency;
+		// Microseconds an event was dispatched after its (scaled) time in the recording, zero when replaying as fast as possible
+		Percentiles lateness;
+	};
+
+	class KVMIO_API InputReplayer
+	{
+	public:
+		using Dispatch = std::function<void(const InputEvent&)>;
+
+	private:
+		std::string m_path;
+		std::unique_ptr<MappedFile> m_file;
+		std::span<const InputEvent> m_events;
+
+	public:
+		InputReplayer(std::string_view path);
+
+		// Not copyable and not movable
+		InputReplayer(InputReplayer&) = delete;
+		InputReplayer(InputReplayer&&) = delete;
+
+		~InputReplayer();
+
+		// Dispatches every event on the calling thread (i.e. to Win32Window::dispatchInput() from the thread running its message loop).
+		// A speed of 1 keeps the recorded timing, N replays N times faster and 0 as fast as possible
+		ReplayStatistics replay(const Dispatch& dispatch, f64 speed = 1.0);
+
+		std::span<const InputEvent> getEvents() const noexcept { return m_events; }
+	};
+}
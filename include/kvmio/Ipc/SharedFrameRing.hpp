@@ -0,0 +1,91 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Window.hpp> // for kvmio::Window
+
+#include <common/defines.h>
+
+#include <span>
+#include <atomic>
+#include <cstddef> // for std::size_t
+
+namespace kvmio::Ipc
+{
+	/*
+		Ring of frame slots in a memfd shared between processes (e.g. capture, encode and display run separately), so a frame
+		crosses the process boundary without being copied: the producer writes straight into a slot and the consumer reads it in place.
+
+		The fd is handed over a Unix socket (SendFd/ReceiveFd), the other process maps the same memory. Slots change hands through
+		atomic compare-and-swaps on their state, a submit bumps a futex word the consumer sleeps on.
+
+		One producer and one consumer: the consumer always gets the latest submitted frame, the older ones which it did not get to
+		are dropped (i.e. freed for the producer), and the producer never waits, it takes over the oldest unread frame if no slot is free.
+	*/
+
+	struct Slot
+	{
+		u32 index;
+		std::span<u8> data;
+		u64 sequence;
+		// In microseconds of CLOCK_MONOTONIC (steady_clock), set by submitFrame(), comparable across processes
+		u64 timestamp;
+	};
+
+	class KVMIO_API SharedFrameRing
+	{
+	public:
+		struct Header;
+		struct SlotHeader;
+
+	private:
+		s32 m_fd;
+		u8* m_memory;
+		std::size_t m_size;
+		Header* m_header;
+		SlotHeader* m_slots;
+		std::size_t m_dataOffset;
+		std::size_t m_slotStride;
+		bool m_isProducer;
+		// Sequence of the last frame acquired by the consumer
+		u64 m_lastSequence;
+
+		void map();
+
+	public:
+		// Creates the ring (the producer's side), slotCount must be at least 3: one being written, one being read and one submitted
+		SharedFrameRing(u32 slotCount, u32 slotSize, u32 width, u32 height);
+		// Maps a ring received from the producer (the consumer's side), takes the ownership of the fd
+		explicit SharedFrameRing(s32 fd);
+
+		// Not copyable and not movable
+		SharedFrameRing(SharedFrameRing&) = delete;
+		SharedFrameRing(SharedFrameRing&&) = delete;
+
+		~SharedFrameRing();
+
+		// Producer, never blocks
+		Slot acquireFrame();
+		void submitFrame(Slot& slot, u32 size);
+
+		// Consumer, waits at most timeout milliseconds for a frame newer than the last one acquired, returns false if there was none
+		bool acquireLatestFrame(u32 timeout, Slot& slot);
+		void releaseFrame(Slot& slot);
+		// Presents every frame in place (present() reads it straight from the shared memory) until isLoop() returns false
+		void stream(Window& window, const Window::Predicate& isLoop);
+
+		// To be sent to the consumer, stays owned by this ring
+		s32 getFd() const noexcept { return m_fd; }
+		u32 getSlotCount() const noexcept;
+		u32 getSlotSize() const noexcept;
+		u32 getWidth() const noexcept;
+		u32 getHeight() const noexcept;
+		// Submitted by the producer, and dropped (i.e. overwritten before the consumer got to them)
+		u64 getSubmittedCount() const noexcept;
+		u64 getDroppedCount() const noexcept;
+	};
+
+	// Passes the fd over a connected Unix domain socket (SCM_RIGHTS), returns false on failure
+	KVMIO_API bool SendFd(s32 socket, s32 fd);
+	// Returns -1 on failure
+	KVMIO_API s32 ReceiveFd(s32 socket);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+
+#include <common/defines.h>
+
+#include <bitset>
+#include <vector>
+#include <unordered_map>
+#include <span>
+#include <chrono>
+
+namespace kvmio
+{
+	// Matches hotkeys against the keys being held, at a cost independent of the number of registered ones:
+	// the held keys are kept as a 256 bit set along with two hashes updated on every transition, one of the set and one of the press order,
+	// each looked up in its own table; a sequence is a walk down a trie whose edges are the set hashes of its steps.
+	// Keys are Windows virtual key codes (Win32::KeyCode), onKey() does no heap allocation
+	class KVMIO_API KeyChordEngine
+	{
+	public:
+		typedef u32 ChordId;
+		static constexpr ChordId InvalidChord = static_cast<ChordId>(-1);
+		// Beyond this many keys held at once the extra ones are ignored
+		static constexpr u32 MaxHeldKeys = 16;
+
+		enum class ChordType : u8
+		{
+			// The keys must have been pressed in the given order (e.g. Ctrl, then Alt, then Delete)
+			Ordered,
+			// Any order, as long as exactly these keys are held
+			Unordered
+		};
+
+	private:
+		typedef std::bitset<256> KeySet;
+
+		struct Chord
+		{
+			ChordType type;
+			std::vector<u8> keys;
+		};
+
+		struct SequenceNode
+		{
+			// The held keys of the step leading to this node, to tell hash collisions apart
+			KeySet keys;
+			// Indexed by the set hash of the next step
+			std::unordered_map<u64, u32> children;
+			// The sequence ending at this node, if any
+			ChordId chord;
+		};
+
+		std::vector<Chord> m_chords;
+		std::unordered_map<u64, ChordId> m_orderedChords;
+		std::unordered_map<u64, ChordId> m_unorderedChords;
+		// m_sequenceNodes[0] is the root
+		std::vector<SequenceNode> m_sequenceNodes;
+		u32 m_sequenceNode;
+		std::chrono::steady_clock::time_point m_sequenceStepTime;
+		std::chrono::milliseconds m_sequenceTimeout;
+
+		KeySet m_pressedKeys;
+		// Zobrist hash, the XOR of the held keys' random values
+		u64 m_setHash;
+		// In press order
+		u8 m_heldKeys[MaxHeldKeys];
+		// m_orderHashes[i] is the order hash of the first i held keys
+		u64 m_orderHashes[MaxHeldKeys + 1];
+		u32 m_heldKeyCount;
+
+		bool isOrderedMatch(const Chord& chord) const;
+		bool isUnorderedMatch(const Chord& chord) const;
+		ChordId advanceSequence(u8 virtualKey);
+
+	public:
+		KeyChordEngine(std::chrono::milliseconds sequenceTimeout = std::chrono::milliseconds(1000));
+
+		ChordId addChord(std::span<const u8> keys, ChordType type = ChordType::Ordered);
+		// Each step is an unordered chord, to be held one after the other (e.g. Ctrl+K then Ctrl+C) with at most the sequence timeout
+		// in between; pressing a modifier (Shift, Ctrl, Alt or Windows) in between the steps doesn't break the sequence
+		ChordId addSequence(std::span<const std::vector<u8>> steps);
+
+		// To be called for every key transition, returns the chord (or sequence) completed by this press, if any.
+		// Ordered chords are matched first, then the unordered ones and then the sequences
+		ChordId onKey(u8 virtualKey, bool isPressed);
+		// Forgets the held keys and any sequence in progress, e.g. on losing the focus
+		void reset();
+
+		bool isPressed(u8 virtualKey) const noexcept { return m_pressedKeys.test(virtualKey); }
+		// In press order
+		std::span<const u8> getHeldKeys() const noexcept { return { m_heldKeys, m_heldKeyCount }; }
+	};
+}
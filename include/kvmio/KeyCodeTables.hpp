@@ -0,0 +1,263 @@
+#pragma once
+
+#include <common/defines.h> // for u8, u16, u32
+
+#include <array> // for std::array<>
+#include <span> // for std::span<>
+
+namespace kvmio
+{
+	/*
+		Translation between the four ways a key is named along the input path: the Windows virtual key and the PS/2 set 1 make code
+		that Raw Input reports, the Linux evdev key code (KEY_*) and the USB HID usage a forwarding target expects.
+
+		Each translation is a dense table, indexed by the source code and generated at compile time from the single list below,
+		so a lookup is one indexed load; the round trips are checked with static_assert at the end of this file.
+	*/
+
+	// A zero is "not mapped" in every column
+	struct KeyCode
+	{
+		// Linux KEY_*
+		u16 evdevCode;
+		// PS/2 set 1 make code, without the prefix
+		u8 makeCode;
+		// 0xE0, 0xE1 or 0
+		u8 prefix;
+		// Windows virtual key code, the generic one for Shift, Ctrl and Alt as Raw Input reports them
+		u8 virtualKey;
+		// Usage ID on the HID Keyboard/Keypad page (0x07), zero for the media keys as they are on the Consumer page instead
+		u8 hidUsage;
+
+		constexpr bool operator==(const KeyCode&) const = default;
+	};
+
+	// Evdev key codes below 89 are the set 1 make codes themselves, the rest are the extended keys
+	inline constexpr KeyCode gKeyCodes[] =
+	{
+		{ 1, 0x01, 0, 0x1B, 0x29 }, // KEY_ESC
+		{ 2, 0x02, 0, 0x31, 0x1E }, // KEY_1
+		{ 3, 0x03, 0, 0x32, 0x1F }, // KEY_2
+		{ 4, 0x04, 0, 0x33, 0x20 }, // KEY_3
+		{ 5, 0x05, 0, 0x34, 0x21 }, // KEY_4
+		{ 6, 0x06, 0, 0x35, 0x22 }, // KEY_5
+		{ 7, 0x07, 0, 0x36, 0x23 }, // KEY_6
+		{ 8, 0x08, 0, 0x37, 0x24 }, // KEY_7
+		{ 9, 0x09, 0, 0x38, 0x25 }, // KEY_8
+		{ 10, 0x0A, 0, 0x39, 0x26 }, // KEY_9
+		{ 11, 0x0B, 0, 0x30, 0x27 }, // KEY_0
+		{ 12, 0x0C, 0, 0xBD, 0x2D }, // KEY_MINUS
+		{ 13, 0x0D, 0, 0xBB, 0x2E }, // KEY_EQUAL
+		{ 14, 0x0E, 0, 0x08, 0x2A }, // KEY_BACKSPACE
+		{ 15, 0x0F, 0, 0x09, 0x2B }, // KEY_TAB
+		{ 16, 0x10, 0, 0x51, 0x14 }, // KEY_Q
+		{ 17, 0x11, 0, 0x57, 0x1A }, // KEY_W
+		{ 18, 0x12, 0, 0x45, 0x08 }, // KEY_E
+		{ 19, 0x13, 0, 0x52, 0x15 }, // KEY_R
+		{ 20, 0x14, 0, 0x54, 0x17 }, // KEY_T
+		{ 21, 0x15, 0, 0x59, 0x1C }, // KEY_Y
+		{ 22, 0x16, 0, 0x55, 0x18 }, // KEY_U
+		{ 23, 0x17, 0, 0x49, 0x0C }, // KEY_I
+		{ 24, 0x18, 0, 0x4F, 0x12 }, // KEY_O
+		{ 25, 0x19, 0, 0x50, 0x13 }, // KEY_P
+		{ 26, 0x1A, 0, 0xDB, 0x2F }, // KEY_LEFTBRACE
+		{ 27, 0x1B, 0, 0xDD, 0x30 }, // KEY_RIGHTBRACE
+		{ 28, 0x1C, 0, 0x0D, 0x28 }, // KEY_ENTER
+		{ 29, 0x1D, 0, 0x11, 0xE0 }, // KEY_LEFTCTRL
+		{ 30, 0x1E, 0, 0x41, 0x04 }, // KEY_A
+		{ 31, 0x1F, 0, 0x53, 0x16 }, // KEY_S
+		{ 32, 0x20, 0, 0x44, 0x07 }, // KEY_D
+		{ 33, 0x21, 0, 0x46, 0x09 }, // KEY_F
+		{ 34, 0x22, 0, 0x47, 0x0A }, // KEY_G
+		{ 35, 0x23, 0, 0x48, 0x0B }, // KEY_H
+		{ 36, 0x24, 0, 0x4A, 0x0D }, // KEY_J
+		{ 37, 0x25, 0, 0x4B, 0x0E }, // KEY_K
+		{ 38, 0x26, 0, 0x4C, 0x0F }, // KEY_L
+		{ 39, 0x27, 0, 0xBA, 0x33 }, // KEY_SEMICOLON
+		{ 40, 0x28, 0, 0xDE, 0x34 }, // KEY_APOSTROPHE
+		{ 41, 0x29, 0, 0xC0, 0x35 }, // KEY_GRAVE
+		{ 42, 0x2A, 0, 0x10, 0xE1 }, // KEY_LEFTSHIFT
+		{ 43, 0x2B, 0, 0xDC, 0x31 }, // KEY_BACKSLASH
+		{ 44, 0x2C, 0, 0x5A, 0x1D }, // KEY_Z
+		{ 45, 0x2D, 0, 0x58, 0x1B }, // KEY_X
+		{ 46, 0x2E, 0, 0x43, 0x06 }, // KEY_C
+		{ 47, 0x2F, 0, 0x56, 0x19 }, // KEY_V
+		{ 48, 0x30, 0, 0x42, 0x05 }, // KEY_B
+		{ 49, 0x31, 0, 0x4E, 0x11 }, // KEY_N
+		{ 50, 0x32, 0, 0x4D, 0x10 }, // KEY_M
+		{ 51, 0x33, 0, 0xBC, 0x36 }, // KEY_COMMA
+		{ 52, 0x34, 0, 0xBE, 0x37 }, // KEY_DOT
+		{ 53, 0x35, 0, 0xBF, 0x38 }, // KEY_SLASH
+		{ 54, 0x36, 0, 0x10, 0xE5 }, // KEY_RIGHTSHIFT
+		{ 55, 0x37, 0, 0x6A, 0x55 }, // KEY_KPASTERISK
+		{ 56, 0x38, 0, 0x12, 0xE2 }, // KEY_LEFTALT
+		{ 57, 0x39, 0, 0x20, 0x2C }, // KEY_SPACE
+		{ 58, 0x3A, 0, 0x14, 0x39 }, // KEY_CAPSLOCK
+		{ 59, 0x3B, 0, 0x70, 0x3A }, // KEY_F1
+		{ 60, 0x3C, 0, 0x71, 0x3B }, // KEY_F2
+		{ 61, 0x3D, 0, 0x72, 0x3C }, // KEY_F3
+		{ 62, 0x3E, 0, 0x73, 0x3D }, // KEY_F4
+		{ 63, 0x3F, 0, 0x74, 0x3E }, // KEY_F5
+		{ 64, 0x40, 0, 0x75, 0x3F }, // KEY_F6
+		{ 65, 0x41, 0, 0x76, 0x40 }, // KEY_F7
+		{ 66, 0x42, 0, 0x77, 0x41 }, // KEY_F8
+		{ 67, 0x43, 0, 0x78, 0x42 }, // KEY_F9
+		{ 68, 0x44, 0, 0x79, 0x43 }, // KEY_F10
+		{ 69, 0x45, 0, 0x90, 0x53 }, // KEY_NUMLOCK
+		{ 70, 0x46, 0, 0x91, 0x47 }, // KEY_SCROLLLOCK
+		{ 71, 0x47, 0, 0x67, 0x5F }, // KEY_KP7
+		{ 72, 0x48, 0, 0x68, 0x60 }, // KEY_KP8
+		{ 73, 0x49, 0, 0x69, 0x61 }, // KEY_KP9
+		{ 74, 0x4A, 0, 0x6D, 0x56 }, // KEY_KPMINUS
+		{ 75, 0x4B, 0, 0x64, 0x5C }, // KEY_KP4
+		{ 76, 0x4C, 0, 0x65, 0x5D }, // KEY_KP5
+		{ 77, 0x4D, 0, 0x66, 0x5E }, // KEY_KP6
+		{ 78, 0x4E, 0, 0x6B, 0x57 }, // KEY_KPPLUS
+		{ 79, 0x4F, 0, 0x61, 0x59 }, // KEY_KP1
+		{ 80, 0x50, 0, 0x62, 0x5A }, // KEY_KP2
+		{ 81, 0x51, 0, 0x63, 0x5B }, // KEY_KP3
+		{ 82, 0x52, 0, 0x60, 0x62 }, // KEY_KP0
+		{ 83, 0x53, 0, 0x6E, 0x63 }, // KEY_KPDOT
+		{ 86, 0x56, 0, 0xE2, 0x64 }, // KEY_102ND
+		{ 87, 0x57, 0, 0x7A, 0x44 }, // KEY_F11
+		{ 88, 0x58, 0, 0x7B, 0x45 }, // KEY_F12
+		{ 96, 0x1C, 0xE0, 0x0D, 0x58 }, // KEY_KPENTER
+		{ 97, 0x1D, 0xE0, 0x11, 0xE4 }, // KEY_RIGHTCTRL
+		{ 98, 0x35, 0xE0, 0x6F, 0x54 }, // KEY_KPSLASH
+		{ 99, 0x37, 0xE0, 0x2C, 0x46 }, // KEY_SYSRQ
+		{ 100, 0x38, 0xE0, 0x12, 0xE6 }, // KEY_RIGHTALT
+		{ 102, 0x47, 0xE0, 0x24, 0x4A }, // KEY_HOME
+		{ 103, 0x48, 0xE0, 0x26, 0x52 }, // KEY_UP
+		{ 104, 0x49, 0xE0, 0x21, 0x4B }, // KEY_PAGEUP
+		{ 105, 0x4B, 0xE0, 0x25, 0x50 }, // KEY_LEFT
+		{ 106, 0x4D, 0xE0, 0x27, 0x4F }, // KEY_RIGHT
+		{ 107, 0x4F, 0xE0, 0x23, 0x4D }, // KEY_END
+		{ 108, 0x50, 0xE0, 0x28, 0x51 }, // KEY_DOWN
+		{ 109, 0x51, 0xE0, 0x22, 0x4E }, // KEY_PAGEDOWN
+		{ 110, 0x52, 0xE0, 0x2D, 0x49 }, // KEY_INSERT
+		{ 111, 0x53, 0xE0, 0x2E, 0x4C }, // KEY_DELETE
+		{ 113, 0x20, 0xE0, 0xAD, 0x7F }, // KEY_MUTE
+		{ 114, 0x2E, 0xE0, 0xAE, 0x81 }, // KEY_VOLUMEDOWN
+		{ 115, 0x30, 0xE0, 0xAF, 0x80 }, // KEY_VOLUMEUP
+		{ 119, 0x1D, 0xE1, 0x13, 0x48 }, // KEY_PAUSE
+		{ 125, 0x5B, 0xE0, 0x5B, 0xE3 }, // KEY_LEFTMETA
+		{ 126, 0x5C, 0xE0, 0x5C, 0xE7 }, // KEY_RIGHTMETA
+		{ 127, 0x5D, 0xE0, 0x5D, 0x65 }, // KEY_COMPOSE
+		{ 163, 0x19, 0xE0, 0xB0, 0x00 }, // KEY_NEXTSONG
+		{ 165, 0x10, 0xE0, 0xB1, 0x00 }, // KEY_PREVIOUSSONG
+		{ 164, 0x22, 0xE0, 0xB3, 0x00 }, // KEY_PLAYPAUSE
+		{ 166, 0x24, 0xE0, 0xB2, 0x00 }, // KEY_STOPCD
+		{ 183, 0x64, 0, 0x7C, 0x68 }, // KEY_F13
+		{ 184, 0x65, 0, 0x7D, 0x69 }, // KEY_F14
+		{ 185, 0x66, 0, 0x7E, 0x6A }, // KEY_F15
+		{ 186, 0x67, 0, 0x7F, 0x6B }, // KEY_F16
+		{ 187, 0x68, 0, 0x80, 0x6C }, // KEY_F17
+		{ 188, 0x69, 0, 0x81, 0x6D }, // KEY_F18
+		{ 189, 0x6A, 0, 0x82, 0x6E }, // KEY_F19
+		{ 190, 0x6B, 0, 0x83, 0x6F }, // KEY_F20
+		{ 191, 0x6C, 0, 0x84, 0x70 }, // KEY_F21
+		{ 192, 0x6D, 0, 0x85, 0x71 }, // KEY_F22
+		{ 193, 0x6E, 0, 0x86, 0x72 }, // KEY_F23
+		{ 194, 0x76, 0, 0x87, 0x73 }, // KEY_F24
+	};
+
+	namespace Internal
+	{
+		// The make codes with the E0 prefix follow the plain ones, then those with E1 (only Pause is)
+		constexpr u32 GetMakeCodeIndex(u32 makeCode, u8 prefix) noexcept
+		{
+			return ((prefix == 0xE0) ? 0x80 : ((prefix == 0xE1) ? 0x100 : 0)) | (makeCode & 0x7F);
+		}
+
+		template<std::size_t N, typename IndexFunction>
+		constexpr std::array<KeyCode, N> GenerateKeyCodeTable(IndexFunction getIndex, bool isFirstWins = false) noexcept
+		{
+			std::array<KeyCode, N> table { };
+			for(const KeyCode& key : gKeyCodes)
+			{
+				const u32 index = getIndex(key);
+				if((index == 0) || (isFirstWins && (table[index].virtualKey != 0)))
+					continue;
+				table[index] = key;
+			}
+			return table;
+		}
+
+		inline constexpr std::array<KeyCode, 256> gKeyCodesByEvdev = GenerateKeyCodeTable<256>([](const KeyCode& key) -> u32 { return key.evdevCode; });
+		inline constexpr std::array<KeyCode, 384> gKeyCodesByMakeCode = GenerateKeyCodeTable<384>([](const KeyCode& key) { return GetMakeCodeIndex(key.makeCode, key.prefix); });
+		// Both Shift, Ctrl, Alt and Enter keys share a virtual key, it translates to the left (or main) one
+		inline constexpr std::array<KeyCode, 256> gKeyCodesByVirtualKey = GenerateKeyCodeTable<256>([](const KeyCode& key) -> u32 { return key.virtualKey; }, true);
+		inline constexpr std::array<KeyCode, 256> gKeyCodesByHidUsage = GenerateKeyCodeTable<256>([](const KeyCode& key) -> u32 { return key.hidUsage; });
+	}
+
+	// The functions below return an all-zero KeyCode for the unmapped keys
+
+	constexpr const KeyCode& GetKeyCodeFromEvdev(u16 code) noexcept
+	{
+		return Internal::gKeyCodesByEvdev[code & 0xFF].evdevCode == code ? Internal::gKeyCodesByEvdev[code & 0xFF] : Internal::gKeyCodesByEvdev[0];
+	}
+
+	// Takes the make code as Win32::KeyboardInput holds it (i.e. with the prefix in the upper bytes)
+	constexpr const KeyCode& GetKeyCodeFromMakeCode(u32 makeCode, bool isExtended0, bool isExtended1) noexcept
+	{
+		return Internal::gKeyCodesByMakeCode[Internal::GetMakeCodeIndex(makeCode, isExtended0 ? 0xE0 : (isExtended1 ? 0xE1 : 0))];
+	}
+
+	constexpr const KeyCode& GetKeyCodeFromVirtualKey(u8 virtualKey) noexcept
+	{
+		return Internal::gKeyCodesByVirtualKey[virtualKey];
+	}
+
+	constexpr const KeyCode& GetKeyCodeFromHidUsage(u8 usage) noexcept
+	{
+		return Internal::gKeyCodesByHidUsage[usage];
+	}
+
+	// A dense index of a make code with its prefix, below KeyIndexCount; unlike the virtual key it tells the left and right Shift
+	// (Ctrl, Alt) and both Enter keys apart, i.e. to keep the state of each physical key
+	inline constexpr u32 KeyIndexCount = 384;
+	constexpr u32 GetKeyIndex(u32 makeCode, bool isExtended0, bool isExtended1) noexcept
+	{
+		return Internal::GetMakeCodeIndex(makeCode, isExtended0 ? 0xE0 : (isExtended1 ? 0xE1 : 0));
+	}
+
+	// Every mapped key, i.e. for declaring the keys of a virtual device
+	constexpr std::span<const KeyCode> GetKeyCodes() noexcept
+	{
+		return gKeyCodes;
+	}
+
+	namespace Internal
+	{
+		constexpr bool IsKeyCodeTableConsistent() noexcept
+		{
+			for(const KeyCode& key : gKeyCodes)
+			{
+				if((key.evdevCode == 0) || (key.evdevCode > 0xFF) || (key.makeCode == 0) || (key.makeCode > 0x7F) || (key.virtualKey == 0))
+					return false;
+				if((key.evdevCode < 89) && ((key.prefix != 0) || (key.evdevCode != key.makeCode)))
+					return false;
+				// A key found from each of its codes is the key itself, so no two keys share an evdev code, a make code or an HID usage
+				if(GetKeyCodeFromEvdev(key.evdevCode) != key)
+					return false;
+				if(GetKeyCodeFromMakeCode(key.makeCode, key.prefix == 0xE0, key.prefix == 0xE1) != key)
+					return false;
+				if((key.hidUsage != 0) && (GetKeyCodeFromHidUsage(key.hidUsage) != key))
+					return false;
+				if(GetKeyCodeFromVirtualKey(key.virtualKey).virtualKey != key.virtualKey)
+					return false;
+				// Whichever key a shared virtual key translates to, it has to come back to the same virtual key
+				const KeyCode& fromVirtualKey = GetKeyCodeFromVirtualKey(key.virtualKey);
+				if(GetKeyCodeFromMakeCode(fromVirtualKey.makeCode, fromVirtualKey.prefix == 0xE0, fromVirtualKey.prefix == 0xE1).virtualKey != key.virtualKey)
+					return false;
+			}
+			return true;
+		}
+	}
+
+	static_assert(Internal::IsKeyCodeTableConsistent(), "The key code tables do not round trip");
+	static_assert(GetKeyCodeFromEvdev(0x100).evdevCode == 0, "Evdev codes past the table must not alias");
+	static_assert(GetKeyCodeFromMakeCode(0xE01D, true, false).evdevCode == 97, "Right Ctrl is E0 1D");
+	static_assert(GetKeyCodeFromMakeCode(0x1D, false, true).hidUsage == 0x48, "Pause is E1 1D");
+	static_assert(GetKeyCodeFromVirtualKey(0x10).evdevCode == 42, "The generic Shift is the left one");
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <kvmio/Window.hpp>
+#include <kvmio/FrameTimings.hpp> // for kvmio::Percentiles
+#include <kvmio/Win32/Win32RawInput.hpp> // for Win32::KeyboardInput
+
+#include <common/defines.h>
+
+#include <atomic> // for std::atomic<>
+#include <condition_variable> // for std::condition_variable
+#include <functional> // for std::function<>
+#include <mutex> // for std::mutex
+#include <span> // for std::span<>
+#include <string> // for std::string
+#include <string_view> // for std::string_view
+#include <thread> // for std::thread
+#include <vector> // for std::vector<>
+
+namespace kvmio
+{
+	/*
+		Input-to-photon latency: a synthetic key press is injected into the input path (i.e. through a UinputSink or an HID gadget
+		to a real target, or to a LoopbackTarget) and the frames presented afterwards are watched for the change it makes
+		in a probe region of the screen (i.e. a terminal's cursor, or a small app flipping a square between black and white).
+
+		The harness sits between the frame source and the window: every frame goes through its present(), which measures the luma
+		of the probe region before handing the frame on. That gives the time until the change reached the window; the time until it
+		reached the screen is known once the window reports when the frame carrying it was displayed, see onFrameDisplayed().
+	*/
+
+	struct LatencyStatistics
+	{
+		// As passed to measure(), i.e. the present profile, the queueing policy and the conversion path under test
+		std::string configuration;
+		u32 sampleCount;
+		// Injections whose change never showed up within the timeout
+		u32 missedCount;
+		// Milliseconds from the injection until the frame showing it was presented to the window
+		Percentiles inputToPresent;
+		f64 maxInputToPresent;
+		// Milliseconds from the injection until that frame was on the screen, -1 if the window didn't report it
+		Percentiles inputToDisplay;
+		f64 maxInputToDisplay;
+	};
+
+	KVMIO_API void DisplayLatencyStatistics(std::span<const LatencyStatistics> statistics);
+
+	// Forwards everything to the wrapped window; the frames must be NV12 of width x height
+	class KVMIO_API LatencyHarness : public Window
+	{
+	public:
+		using Inject = std::function<void(const Win32::KeyboardInput& input)>;
+
+	private:
+		enum class ProbeState : u8
+		{
+			Idle,
+			// An input has been injected, waiting for the probe region to change
+			Armed,
+			// The change has been presented, waiting for its frame to be displayed
+			Presented,
+			Displayed
+		};
+
+		Window& m_window;
+		const u32 m_width;
+		const u32 m_height;
+		const SnapshotRegion m_probe;
+		const f64 m_threshold;
+
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		ProbeState m_state;
+		// Mean luma of the probe region in the latest frame, and in the one on the window when the input was injected
+		f64 m_probeLuma;
+		f64 m_baselineLuma;
+		// Counts the frames presented through the harness from 1, as the windows count them
+		u64 m_presentCount;
+		u64 m_changePresentIndex;
+		u64 m_changePresentTimestamp;
+		u64 m_changeDisplayTimestamp;
+		std::atomic<bool> m_isDisplayReported;
+
+		f64 getProbeLuma(const u8* yPlane, u32 stride) const;
+		void probe(const u8* yPlane, u32 stride);
+
+	public:
+		// The probe region changes when its mean luma (0 to 255) moves by more than the threshold
+		LatencyHarness(Window& window, const SnapshotRegion& probe, u32 width = 1920, u32 height = 1080, f64 threshold = 32.0);
+
+		// Not copyable and not movable
+		LatencyHarness(LatencyHarness&) = delete;
+		LatencyHarness(LatencyHarness&&) = delete;
+
+		// Implementation of Window
+		virtual void setFrameFormat(FrameFormat frameFormat) override { Window::setFrameFormat(frameFormat); m_window.setFrameFormat(frameFormat); }
+		virtual bool isShouldClose() override { return m_window.isShouldClose(); }
+		virtual void setFullScreen(bool isFullScreen) override { m_window.setFullScreen(isFullScreen); }
+		virtual void show() override { m_window.show(); }
+		virtual void runGameLoop() override { m_window.runGameLoop(); }
+		virtual void runGameLoop(u32 frameRate, const Predicate& isLoop = [] { return true; }) override { m_window.runGameLoop(frameRate, isLoop); }
+		virtual void present(std::span<const u8> frameData) override;
+		virtual void presentPlanes(const FramePlanes& planes) override;
+		virtual void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback) override { m_window.requestSnapshot(region, format, callback); }
+		virtual CursorOverlay& getCursorOverlay() override { return m_window.getCursorOverlay(); }
+
+		// Thread-safe, called with the frames the window has put on the screen: VulkanWindow's FrameTimings::submitIndex and
+		// displayTimestamp (with VK_KHR_present_wait), or NullWindow's ConsumedFrame::presentIndex and consumeTime
+		void onFrameDisplayed(u64 presentIndex, u64 displayTimestamp);
+		// Injects sampleCount key presses (each followed by its release), interval milliseconds apart, on the calling thread
+		// and waits at most timeout milliseconds for each to show up
+		LatencyStatistics measure(std::string_view configuration, const Inject& inject, u32 sampleCount = 100, u32 interval = 100, u32 timeout = 1000);
+	};
+
+	// Stands in for a target machine: produces NV12 frames at a fixed rate, as a capture device would, and flips the probe region
+	// between black and white on every key press it receives, so the harness can be run end-to-end without any hardware
+	class KVMIO_API LoopbackTarget
+	{
+	private:
+		Window& m_window;
+		const u32 m_width;
+		const u32 m_height;
+		const SnapshotRegion m_probe;
+		const u32 m_frameRate;
+		std::atomic<u32> m_pressCount;
+		std::atomic<bool> m_isRunning;
+		std::thread m_thread;
+
+		void run();
+
+	public:
+		LoopbackTarget(Window& window, const SnapshotRegion& probe, u32 width = 1920, u32 height = 1080, u32 frameRate = 60);
+
+		// Not copyable and not movable
+		LoopbackTarget(LoopbackTarget&) = delete;
+		LoopbackTarget(LoopbackTarget&&) = delete;
+
+		// Stops producing frames
+		~LoopbackTarget();
+
+		// Thread-safe, i.e. a LatencyHarness::Inject
+		void keyboard(const Win32::KeyboardInput& input);
+	};
+}
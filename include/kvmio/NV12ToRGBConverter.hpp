@@ -1,15 +1,23 @@
-#include <KVMIO/defines.hpp>
+#pragma once
+
+#include <kvmio/defines.hpp>
 
 #include <common/defines.h>
+#include <common/platform.h>
 
-#include <mfidl.h>
-#include <mfreadwrite.h>
+#ifdef PLATFORM_WINDOWS
+#	include <mfidl.h>
+#	include <mfreadwrite.h>
+#else
+#	include <vector> // for std::vector<>
+#endif // PLATFORM_WINDOWS
 
 namespace kvmio
 {
 	class NV12ToRGBConverter
 	{
 	private:
+		#ifdef PLATFORM_WINDOWS
 		IMFMediaType* m_inputMediaType;
 		IMFMediaType* m_outputMediaType;
 		IMFMediaBuffer* m_inputMediaBuffer;
@@ -17,6 +25,10 @@ namespace kvmio
 		IMFSample* m_inputSample;
 		IMFSample* m_outputSample;
 		IMFTransform* m_colorConverter;
+		#else
+		// Media Foundation's color converter isn't available, ConvertNV12ToBGRA() writes into this instead
+		std::vector<u8> m_rgbData;
+		#endif // PLATFORM_WINDOWS
 		u32 m_width;
 		u32 m_height;
 		u32 m_frameRateNum;
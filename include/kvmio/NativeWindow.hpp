@@ -6,6 +6,14 @@
 #	include <kvmio/Win32Window.hpp>
 #	define KVMIO_NATIVE_WINDOW_NAME Win32Window
 #	define KVMIO_NATIVE_WINDOW kvmio::KVMIO_NATIVE_WINDOW_NAME
+#elif defined(PLATFORM_LINUX) && defined(KVMIO_USE_WAYLAND)
+#	include <kvmio/WaylandWindow.hpp>
+#	define KVMIO_NATIVE_WINDOW_NAME WaylandWindow
+#	define KVMIO_NATIVE_WINDOW kvmio::KVMIO_NATIVE_WINDOW_NAME
+#elif defined(PLATFORM_LINUX)
+#	include <kvmio/X11Window.hpp>
+#	define KVMIO_NATIVE_WINDOW_NAME X11Window
+#	define KVMIO_NATIVE_WINDOW kvmio::KVMIO_NATIVE_WINDOW_NAME
 #endif
 
 namespace kvmio
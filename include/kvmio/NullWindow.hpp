@@ -0,0 +1,128 @@
+#pragma once
+
+#include <kvmio/Window.hpp>
+
+#include <common/DynamicPool.hpp>
+#include <common/Event.hpp>
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <utility>
+
+namespace kvmio
+{
+	// Window without any window system: frames go through the same pooling, conversion, queueing and pacing as the native windows
+	// but end up in an in-memory surface, which is handed to the consumed frame event instead of being shown.
+	// For load tests, recording processes on servers and measuring the pipeline's throughput on hosts without a display
+	class KVMIO_API NullWindow : public Window
+	{
+	public:
+		struct ConsumedFrame
+		{
+			// Counts the consumed frames, from 0
+			u64 index;
+			// Counts the presented frames, from 1, the one consumed (the others presented since the previous one have been dropped)
+			u64 presentIndex;
+			u32 width;
+			u32 height;
+			// B8G8R8A8 with the cursor drawn over it, only valid for the duration of the callback
+			std::span<const u8> pixels;
+			std::chrono::steady_clock::time_point presentTime;
+			std::chrono::steady_clock::time_point consumeTime;
+		};
+
+		struct Statistics
+		{
+			u64 presentedCount;
+			u64 consumedCount;
+			// Superseded by a later frame before being consumed
+			u64 droppedCount;
+			// Since the first present()
+			f64 elapsedTime;
+			// Averages over the consumed frames, in milliseconds
+			f64 averageLatency;
+			f64 maxLatency;
+		};
+
+	private:
+		using Clock = std::chrono::steady_clock;
+		using DataPool = com::DynamicPool<std::span<u8>>;
+		struct QueuedFrame
+		{
+			DataPool::ElementType data;
+			u64 presentIndex;
+			Clock::time_point presentTime;
+		};
+
+		const u32 m_width;
+		const u32 m_height;
+		u32 m_rgbFrameSize;
+		std::mutex m_pooledFramesMutex;
+		std::unique_ptr<DataPool> m_pooledFrames;
+		std::mutex m_queueMutex;
+		std::condition_variable m_queueCondition;
+		std::deque<QueuedFrame> m_queuedFrames;
+		std::atomic<bool> m_isWindowShouldClose;
+
+		CursorOverlay m_cursorOverlay;
+		// The in-memory surface, only touched by the thread running the loop
+		std::vector<u8> m_surface;
+		SoftwareCursor m_softwareCursor;
+		bool m_isSurfaceValid;
+
+		// Snapshots are taken from the frame on the surface, which goes back to m_pooledFrames once it is neither consumed nor referred to by a snapshot
+		SnapshotSource m_snapshotSource;
+
+		std::atomic<u64> m_presentedCount;
+		std::atomic<u64> m_consumedCount;
+		std::atomic<u64> m_droppedCount;
+		std::atomic<Clock::rep> m_firstPresentTime;
+		// Guards the latency sums, written once per consumed frame
+		mutable std::mutex m_statisticsMutex;
+		f64 m_latencySum;
+		f64 m_maxLatency;
+
+		com::Event<com::no_publish_ptr_t, ConsumedFrame> m_consumedFrameEvent;
+
+		void setDisplayedFrame(DataPool::ElementType& frame);
+		// Takes the latest queued frame (the older ones are dropped) onto the surface, returns false if there was none (or the window is closing)
+		bool consume(bool isBlock);
+		// Redraws the cursor over the surface if it has changed since it was drawn
+		void updateCursor();
+
+	public:
+		NullWindow(u32 width = 1920, u32 height = 1080);
+
+		// Not copyable and not movable
+		NullWindow(NullWindow&) = delete;
+		NullWindow(NullWindow&&) = delete;
+
+		~NullWindow();
+
+		// Implementation of Window
+		virtual bool isShouldClose() override { return m_isWindowShouldClose; }
+		virtual void setFullScreen(bool) override { }
+		virtual void show() override { }
+		// Consumes every frame as soon as it is presented, until close()
+		virtual void runGameLoop() override;
+		// Consumes the latest frame once per 1 / frameRate seconds
+		virtual void runGameLoop(u32 frameRate, const Predicate& isLoop = [] { return true; }) override;
+		virtual void present(std::span<const u8> frameData) override;
+		virtual void presentPlanes(const FramePlanes& planes) override;
+		virtual void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback) override;
+		virtual CursorOverlay& getCursorOverlay() override { return m_cursorOverlay; }
+
+		// Thread-safe, makes runGameLoop() return
+		void close();
+		// Published on the thread running the loop
+		com::Event<com::no_publish_ptr_t, ConsumedFrame>& getConsumedFrameEvent() noexcept { return m_consumedFrameEvent; }
+		// Thread-safe
+		Statistics getStatistics() const;
+		std::pair<u32, u32> getClientSize() const { return { m_width, m_height }; }
+	};
+}
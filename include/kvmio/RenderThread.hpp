@@ -0,0 +1,48 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+
+#include <common/defines.h> // for u32, u64
+
+#include <functional> // for std::function<>
+#include <thread> // for std::thread
+#include <atomic> // for std::atomic<>
+#include <utility> // for std::pair<>
+
+namespace kvmio
+{
+	// Runs a render loop on a thread of its own while the window's thread keeps pumping messages, so that keyboard and mouse
+	// handling never waits on a fence, an acquire or a vsync. Resize and close reach the render loop through lock-free atomics:
+	// only the latest client size matters, so it is a single packed value rather than a queue
+	class KVMIO_API RenderThread
+	{
+	public:
+		using Loop = std::function<void(void)>;
+	private:
+		// Width in the upper 32 bits, height in the lower 32 bits
+		std::atomic<u64> m_extent;
+		std::atomic<bool> m_isRunning;
+		std::thread m_thread;
+
+	public:
+		RenderThread(u32 width, u32 height);
+
+		// Not copyable and Not movable
+		RenderThread(RenderThread&) = delete;
+		RenderThread(RenderThread&&) = delete;
+
+		// Stops the loop (if still running) and waits for it
+		~RenderThread();
+
+		// Called from the window's thread
+		void setExtent(u32 width, u32 height) noexcept { m_extent.store((static_cast<u64>(width) << 32) | height, std::memory_order_release); }
+		// Called from any thread
+		std::pair<u32, u32> getExtent() const noexcept;
+		// The loop is expected to return soon after isRunning() turns false
+		void start(Loop loop);
+		// Blocks until the loop has returned, at most about one frame
+		void stop();
+		// Polled by the loop on every iteration
+		bool isRunning() const noexcept { return m_isRunning.load(std::memory_order_acquire); }
+	};
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+
+#include <common/defines.h> // for u8, u32
+
+#include <functional> // for std::function<>
+#include <span> // for std::span<>
+#include <vector> // for std::vector<>
+#include <deque> // for std::deque<>
+#include <memory> // for std::shared_ptr<>, std::unique_ptr<>
+#include <thread> // for std::thread
+#include <mutex> // for std::mutex
+#include <condition_variable> // for std::condition_variable
+
+namespace kvmio
+{
+	enum class SnapshotFormat : u8
+	{
+		// 4 bytes per pixel, in this byte order
+		BGRA,
+		RGBA,
+		// 1 byte per pixel, BT.709 luma
+		Gray
+	};
+
+	// Pixel layout of the frame a snapshot is taken from
+	enum class SnapshotSourceFormat : u8
+	{
+		BGRA,
+		NV12
+	};
+
+	// In pixels of the frame (not of the window's client area); a zero width or height selects the whole frame
+	struct SnapshotRegion
+	{
+		u32 x;
+		u32 y;
+		u32 width;
+		u32 height;
+	};
+
+	struct Snapshot
+	{
+		SnapshotFormat format;
+		// The requested region clipped to the frame, both are 0 if nothing of it was inside the frame
+		u32 width;
+		u32 height;
+		// Tightly packed rows, only valid for the duration of the callback
+		std::span<const u8> pixels;
+	};
+
+	using SnapshotCallback = std::function<void(const Snapshot& snapshot)>;
+
+	constexpr u32 GetSnapshotFormatPixelSize(SnapshotFormat format) noexcept { return (format == SnapshotFormat::Gray) ? 1 : 4; }
+
+	// Clips the region to a width x height frame, also resolves the whole-frame (zero-sized) region
+	KVMIO_API SnapshotRegion ClipSnapshotRegion(const SnapshotRegion& region, u32 width, u32 height);
+
+	// Converts the (already clipped) region of the source frame into tightly packed pixels of the given format
+	KVMIO_API void ConvertSnapshot(std::span<const u8> source, SnapshotSourceFormat sourceFormat, u32 sourceWidth, u32 sourceHeight,
+									const SnapshotRegion& region, SnapshotFormat format, std::vector<u8>& pixels);
+
+	// Runs the conversion and the callbacks of snapshots on its own thread, so that they never hold up the presentation
+	class KVMIO_API SnapshotWorker
+	{
+	public:
+		using Job = std::function<void(void)>;
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque<Job> m_jobs;
+		bool m_isStop;
+		std::thread m_thread;
+		// Reused across snapshots to avoid allocating for every one of them
+		std::vector<u8> m_pixels;
+
+		void run();
+
+	public:
+		SnapshotWorker();
+
+		// Not copyable and Not movable
+		SnapshotWorker(SnapshotWorker&) = delete;
+		SnapshotWorker(SnapshotWorker&&) = delete;
+
+		// Completes the jobs already posted before returning
+		~SnapshotWorker();
+
+		// Thread-safe
+		void post(Job&& job);
+		// Converts and delivers the snapshot, only call it from a job
+		void deliver(std::span<const u8> source, SnapshotSourceFormat sourceFormat, u32 sourceWidth, u32 sourceHeight,
+						const SnapshotRegion& region, SnapshotFormat format, const SnapshotCallback& callback);
+	};
+
+	// The displayed frame of a window (or of a feed) which snapshots are taken from: it is shared (by reference count) with the snapshots
+	// being taken from it, and the snapshots requested before the first frame are taken from that one once it is set.
+	// Must be destroyed before whatever the frames go back to once released (i.e. a pool)
+	class KVMIO_API SnapshotSource
+	{
+	private:
+		struct Frame
+		{
+			// Keeps the pixels valid, i.e. a pooled frame which goes back to its pool once released
+			std::shared_ptr<const void> owner;
+			std::span<const u8> pixels;
+			SnapshotSourceFormat format;
+			u32 width;
+			u32 height;
+		};
+		struct Request
+		{
+			SnapshotRegion region;
+			SnapshotFormat format;
+			SnapshotCallback callback;
+		};
+
+		std::mutex m_mutex;
+		Frame m_frame;
+		// Requested before the first frame
+		std::vector<Request> m_pendingRequests;
+		SnapshotWorker* m_worker;
+		// Created on the first request unless a worker was given, declared last as it must be destroyed before the frames it may still refer to
+		std::unique_ptr<SnapshotWorker> m_ownWorker;
+
+		void post(const Frame& frame, Request&& request);
+
+	public:
+		// The snapshots run on the worker if one is given (i.e. shared by the feeds of a wall, it must outlive this),
+		// otherwise on a worker of its own
+		explicit SnapshotSource(SnapshotWorker* worker = nullptr);
+
+		// Not copyable and Not movable
+		SnapshotSource(SnapshotSource&) = delete;
+		SnapshotSource(SnapshotSource&&) = delete;
+
+		// Thread-safe; the previous frame is released here unless a snapshot still refers to it
+		void setFrame(std::shared_ptr<const void> owner, std::span<const u8> pixels, SnapshotSourceFormat format, u32 width, u32 height);
+		// Thread-safe and never blocks
+		void request(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback);
+	};
+}
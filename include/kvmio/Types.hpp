@@ -13,6 +13,15 @@ namespace kvmio
 		YUYV
 	};
 
+	enum class PresentProfile : u8
+	{
+		// FIFO with 3 swapchain images, never tears but may queue up to 3 vblanks worth of frames
+		Throughput,
+		// MAILBOX (or IMMEDIATE) with the fewest swapchain images; with VK_KHR_present_wait each frame is started
+		// just-in-time before the next vblank so the latest captured frame makes it to the screen
+		Latency
+	};
+
 	enum class WindowEventType : u8
 	{
 		KeyboardInput,
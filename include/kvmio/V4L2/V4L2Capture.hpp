@@ -0,0 +1,88 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Window.hpp> // for kvmio::FramePlanes and kvmio::Window
+
+#include <common/defines.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <utility> // for std::pair<>
+
+namespace kvmio::V4L2
+{
+	// A frame still owned by the driver's buffer, which goes back to the capture queue as soon as the last reference to it is released
+	struct CapturedFrame
+	{
+		// Points into the mmap-ed buffer, rows are bytesperline apart
+		FramePlanes planes;
+		u32 bufferIndex;
+		// Counted by the driver, a gap means frames have been dropped
+		u32 sequence;
+		// In microseconds of CLOCK_MONOTONIC, when the driver captured the frame
+		u64 timestamp;
+	};
+
+	// Streams NV12 frames out of a V4L2 capture device (HDMI capture cards, or vivid/v4l2loopback for testing)
+	// through VIDIOC_REQBUFS mmap buffers: a frame is read straight from the driver's buffer by Window::presentPlanes(),
+	// i.e. converted (or copied) into the window's pooled (or staging) memory without any intermediate copy.
+	// The buffers can also be exported as DMABUFs for importing them into another device
+	class KVMIO_API V4L2Capture
+	{
+	private:
+		struct Buffer
+		{
+			u8* data;
+			std::size_t size;
+			// -1 unless exported
+			s32 dmaBufFd;
+		};
+
+		std::string m_path;
+		s32 m_fd;
+		u32 m_width;
+		u32 m_height;
+		u32 m_bytesPerLine;
+		std::vector<Buffer> m_buffers;
+		// Read by the threads releasing frames
+		std::atomic<bool> m_isStreaming;
+
+		// Guards the queue (VIDIOC_QBUF/VIDIOC_DQBUF are thread-safe, the count is not)
+		std::mutex m_queueMutex;
+		std::condition_variable m_queueCondition;
+		// Buffers owned by the driver, nothing can be dequeued (or polled for) while there is none
+		u32 m_queuedCount;
+
+		void queueBuffer(u32 index);
+
+	public:
+		// Negotiates NV12 at width x height (the driver may pick the closest size it supports, see getSize())
+		// and the frame rate if the driver supports setting it
+		V4L2Capture(std::string_view path, u32 width = 1920, u32 height = 1080, u32 frameRate = 60, u32 bufferCount = 4, bool isExportDmaBuf = false);
+
+		// Not copyable and not movable
+		V4L2Capture(V4L2Capture&) = delete;
+		V4L2Capture(V4L2Capture&&) = delete;
+
+		// The frames must all have been released by now
+		~V4L2Capture();
+
+		void start();
+		void stop();
+		// Waits at most timeout milliseconds for a frame, returns null if there was none
+		std::shared_ptr<const CapturedFrame> dequeue(u32 timeout);
+		// Presents every captured frame to the window, each buffer is requeued as soon as present returns
+		void stream(Window& window, const Window::Predicate& isLoop);
+
+		std::pair<u32, u32> getSize() const noexcept { return { m_width, m_height }; }
+		u32 getBytesPerLine() const noexcept { return m_bytesPerLine; }
+		u32 getBufferCount() const noexcept { return static_cast<u32>(m_buffers.size()); }
+		// -1 unless constructed with isExportDmaBuf
+		s32 getDmaBufFd(u32 bufferIndex) const noexcept { return m_buffers[bufferIndex].dmaBufFd; }
+	};
+}
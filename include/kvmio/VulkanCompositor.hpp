@@ -0,0 +1,131 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Snapshot.hpp>
+
+#include <PlayVk/PlayVk.h>
+
+#include <common/defines.h> // for u32
+#include <common/DynamicPool.hpp>
+
+#include <functional> // for std::function<>
+#include <span> // for std::span<>
+#include <mutex> // for std::mutex
+#include <condition_variable> // for std::condition_variable
+#include <optional> // for std::optional<>
+#include <memory> // for std::unique_ptr<>, std::shared_ptr<>
+#include <utility> // for std::pair<>
+#include <vector> // for std::vector<>
+
+namespace kvmio
+{
+	// Video wall: many feeds (e.g. 16 to 64 target servers) tiled into a single swapchain, all sharing one VkDevice.
+	// Every feed has its own sampled image with a full mip chain, only the feeds which received a new frame are uploaded,
+	// and all the tiles are composited with one command buffer per refresh by blitting the mip level closest to the tile size
+	class KVMIO_API VulkanCompositor
+	{
+	public:
+		using VkSurfaceKHRCreateCallback = std::function<VkSurfaceKHR(VkInstance&)>;
+		// Returns the current drawable (client area) size of the target surface
+		using ExtentCallback = std::function<std::pair<u32, u32>(void)>;
+		// Called once every iteration of the render loop, returning false breaks the loop
+		using IterationCallback = std::function<bool(void)>;
+	private:
+		using DataPool = com::DynamicPool<std::span<u8>>;
+
+		struct Feed
+		{
+			// B8G8R8A8, all mip levels rest in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL between frames
+			VkImage image;
+			VkDeviceMemory memory;
+			/* Guarded by m_feedsMutex */
+			// Latest submitted frame which hasn't been uploaded yet
+			std::optional<DataPool::ElementType> pendingFrame;
+			// Thread-safe on its own, keeps the uploaded frame (instead of recycling it right away) for snapshots to refer to
+			std::unique_ptr<SnapshotSource> snapshotSource;
+		};
+
+		VkSurfaceKHRCreateCallback m_surfaceCreateCallback;
+		ExtentCallback m_extentCallback;
+		u32 m_feedCount;
+		u32 m_feedWidth;
+		u32 m_feedHeight;
+		u32 m_feedFrameSize;
+		u32 m_mipLevelCount;
+		u32 m_columnCount;
+		u32 m_rowCount;
+		u32 m_width;
+		u32 m_height;
+
+		VkInstance m_vkInstance;
+		VkSurfaceKHR m_vkSurface;
+		VkPhysicalDevice m_vkPhysicalDevice;
+		VkDevice m_vkDevice;
+		uint32_t m_queueFamilyIndices[2];
+		VkQueue m_vkGraphicsQueue;
+		VkQueue m_vkPresentQueue;
+		VkPresentModeKHR m_vkPresentMode;
+		u32 m_requestedImageCount;
+		VkSwapchainKHR m_vkSwapchain;
+		std::vector<VkImage> m_vkSwapchainImages;
+		VkCommandPool m_vkCommandPool;
+		VkCommandBuffer* m_vkCommandBuffer;
+		VkSemaphore m_vkImageAvailableSemaphore;
+		VkSemaphore m_vkRenderFinishSemaphore;
+		VkFence m_vkFence;
+		// Host visible staging buffer with room for COMPOSITOR_MAX_UPLOADS_PER_FRAME feed frames
+		PvkBuffer m_pvkStagingBuffer;
+		void* m_stagingPtr;
+
+		std::mutex m_pooledFramesMutex;
+		std::unique_ptr<DataPool> m_pooledFrames;
+		std::mutex m_feedsMutex;
+		std::vector<Feed> m_feeds;
+		// Number of feeds with a pendingFrame, guarded by m_feedsMutex
+		u32 m_pendingFeedCount;
+		// Notified when m_pendingFeedCount leaves zero, the render loop waits on it while the wall doesn't change
+		std::condition_variable m_pendingFeedCondition;
+		// Feed to start uploading from in the next frame, so that all feeds get their turn when more than the per-frame budget changed
+		u32 m_nextUploadFeed;
+		// The tiles have to be drawn again even though no feed changed, e.g. after the swapchain has been recreated
+		bool m_isLayoutDirty;
+
+		// Shared by the feeds' snapshot sources, destroyed before them (and the frames it may still refer to)
+		std::unique_ptr<SnapshotWorker> m_snapshotWorker;
+
+		void createSwapchain();
+		void destroySwapchain();
+		void recreateSwapchain();
+		void createFeedImages();
+		void returnFrame(DataPool::ElementType& frame);
+		// Called from the render thread once the frame has been copied into the staging buffer
+		void setDisplayedFrame(u32 feedIndex, DataPool::ElementType& frame);
+		// Records the upload (and mip generation) of the feeds with a pending frame, returns the number of feeds uploaded
+		u32 recordUploads(VkCommandBuffer commandBuffer);
+		void recordComposition(VkCommandBuffer commandBuffer, VkImage swapchainImage);
+		void renderFrame();
+
+	public:
+		// Every feed receives frames of feedWidth x feedHeight B8G8R8A8 pixels
+		VulkanCompositor(const VkSurfaceKHRCreateCallback& surfaceCreateCallback, const ExtentCallback& extentCallback, u32 feedCount, u32 feedWidth = 1920, u32 feedHeight = 1080);
+
+		// Not copyable and Not movable
+		VulkanCompositor(VulkanCompositor&) = delete;
+		VulkanCompositor(VulkanCompositor&&) = delete;
+
+		~VulkanCompositor();
+
+		u32 getFeedCount() const noexcept { return m_feedCount; }
+		u32 getFeedWidth() const noexcept { return m_feedWidth; }
+		u32 getFeedHeight() const noexcept { return m_feedHeight; }
+		// Size of a frame expected by submitFeedFrame(), in bytes
+		u32 getFeedFrameSize() const noexcept { return m_feedFrameSize; }
+		// Thread-safe, only the latest frame of each feed is kept until the next refresh
+		void submitFeedFrame(u32 feedIndex, std::span<const u8> frameData);
+		// Thread-safe and never blocks, the snapshot is taken from the frame of the feed currently on the wall
+		void requestFeedSnapshot(u32 feedIndex, const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback);
+		// A frameRate of zero refreshes as soon as a feed changes. The loop sleeps while nothing changed, checking the callback
+		// at least every 10 milliseconds
+		void runGameLoop(u32 frameRate, const IterationCallback& iterationCallback);
+	};
+}
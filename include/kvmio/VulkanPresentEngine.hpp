@@ -1,6 +1,30 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Types.hpp> // for kvmio::PresentProfile
+#include <kvmio/FrameTimings.hpp>
+#include <kvmio/Snapshot.hpp>
+#include <kvmio/Cursor.hpp>
+#include <kvmio/Window.hpp> // for kvmio::FramePlanes
+
 #include <PlayVk/PlayVk.h>
 
+#include <common/defines.h> // for u32
+#include <common/DynamicPool.hpp>
+#include <common/Event.hpp>
+
 #include <functional> // for std::function<>
+#include <span> // for std::span<>
+#include <thread> // for std::thread
+#include <mutex> // for std::mutex
+#include <condition_variable> // for std::condition_variable
+#include <atomic> // for std::atomic<>
+#include <optional> // for std::optional<>
+#include <memory> // for std::unique_ptr<>
+#include <utility> // for std::pair<>
+#include <chrono> // for std::chrono::high_resolution_clock
+#include <deque> // for std::deque<>
+#include <vector> // for std::vector<>
 
 namespace kvmio
 {
@@ -8,7 +32,44 @@ namespace kvmio
 	{
 	public:
 		using VkSurfaceKHRCreateCallback = std::function<VkSurfaceKHR(VkInstance&)>;
+		// Returns the current drawable (client area) size of the target surface
+		using ExtentCallback = std::function<std::pair<u32, u32>(void)>;
+		// Called once every iteration of the render loop (even when the engine is not ready yet), returning false breaks the loop
+		using IterationCallback = std::function<bool(void)>;
+		// Called from the render thread with the tightly packed B8G8R8A8 pixels of every frame rendered offscreen
+		using ReadbackCallback = std::function<void(std::span<const u8> pixels, u32 width, u32 height)>;
 	private:
+		VkSurfaceKHRCreateCallback m_surfaceCreateCallback;
+		ExtentCallback m_extentCallback;
+
+		// Offscreen (headless) mode, the frames are rendered into m_offscreenImages instead of a swapchain
+		bool m_isOffscreen;
+		ReadbackCallback m_readbackCallback;
+		u32 m_offscreenImageIndex;
+		std::vector<PvkImage> m_offscreenImages;
+		std::vector<VkImageView> m_offscreenImageViews;
+		// Only created if there is a ReadbackCallback, one for each offscreen image
+		std::vector<PvkBuffer> m_readbackBuffers;
+		std::vector<void*> m_readbackPtrs;
+
+		u32 m_width;
+		u32 m_height;
+		PresentProfile m_profile;
+		VkPresentModeKHR m_vkPresentMode;
+		u32 m_requestedImageCount;
+		// Actual number of swapchain images, can be more than requested
+		u32 m_imageCount;
+
+		// VK_KHR_present_id and VK_KHR_present_wait, enabled whenever supported to measure the display time of frames;
+		// frame pacing is only done with PresentProfile::Latency
+		bool m_isPresentWait;
+		PFN_vkWaitForPresentKHR m_vkWaitForPresentKHR;
+		u64 m_presentId;
+		std::chrono::high_resolution_clock::time_point m_lastPresentTime;
+		// Running estimates (in milliseconds) of the display refresh interval and of the time it takes to upload and render a frame
+		f64 m_refreshInterval;
+		f64 m_frameCost;
+
 		VkInstance m_vkInstance;
 		VkSurfaceKHR m_vkSurface;
 		VkPhysicalDevice m_vkPhysicalDevice;
@@ -40,13 +101,150 @@ namespace kvmio
 		VkPipelineLayout m_vkPipelineLayout;
 		VkPipeline m_vkPipeline;
 
+		// GPU timestamps, PRESENT_ENGINE_TIMESTAMP_COUNT queries for each swapchain image's command buffer
+		bool m_isTimestamps;
+		VkQueryPool m_vkQueryPool;
+		f64 m_timestampPeriod;
+		u64 m_timestampMask;
+
+		struct PendingFrameTimings
+		{
+			u64 presentId;
+			std::chrono::high_resolution_clock::time_point presentTime;
+			FrameTimings timings;
+		};
+		u64 m_frameIndex;
+		// Frames whose presentation hasn't been observed yet, their timings are published once it is (or once too many pile up)
+		std::deque<PendingFrameTimings> m_pendingFrameTimings;
+		FrameTimingRecorder m_frameTimingRecorder;
+		com::Event<com::no_publish_ptr_t, FrameTimings> m_frameTimingsEvent;
+
+		// Vulkan objects are created on this thread so that the window can be shown (and polled) while the driver is still loading
+		std::thread m_initThread;
+		std::atomic<bool> m_isReady;
+
+		// Frames submitted with submitFrame() are copied into pooled buffers and only the latest one is kept,
+		// so frames arriving before the engine is ready are buffered (and stale ones recycled) without blocking the producer
+		using DataPool = com::DynamicPool<std::span<u8>>;
+		u32 m_frameSize;
+		std::mutex m_pooledFramesMutex;
+		std::unique_ptr<DataPool> m_pooledFrames;
+		std::optional<DataPool::ElementType> m_latestFrame;
+		// Notified by submitFrame(), an unpaced render loop (frameRate = 0) waits on it for the next frame
+		std::condition_variable m_latestFrameCondition;
+		// Both guarded by m_pooledFramesMutex, see FrameTimings::submitIndex
+		u64 m_submitCount;
+		u64 m_latestSubmitIndex;
+
+		// Snapshots are copied out of the sampled image into a ring of host visible buffers by the render thread,
+		// converted and delivered on m_snapshotWorker once the copy's fence is signalled; nothing is allocated until the first request
+		struct SnapshotRequest
+		{
+			SnapshotRegion region;
+			SnapshotFormat format;
+			SnapshotCallback callback;
+		};
+		struct SnapshotSlot
+		{
+			PvkBuffer buffer;
+			void* mapPtr;
+			VkCommandBuffer commandBuffer;
+			VkFence fence;
+			// The copy has been submitted but its completion hasn't been observed yet
+			bool isInFlight;
+			// Set from the submission of the copy until the worker is done with the buffer
+			std::atomic<bool> isBusy;
+			SnapshotRequest request;
+			// Area of the sampled image in the buffer, for NV12 it is aligned to the chroma subsampling and may be larger than requested
+			SnapshotRegion copiedRegion;
+		};
+		std::mutex m_snapshotRequestsMutex;
+		std::deque<SnapshotRequest> m_snapshotRequests;
+		// Lets the render thread skip the lock when there is nothing to do
+		std::atomic<u32> m_snapshotRequestCount;
+		std::unique_ptr<SnapshotSlot[]> m_snapshotSlots;
+		std::unique_ptr<SnapshotWorker> m_snapshotWorker;
+		// Whether the sampled image holds a frame yet
+		bool m_isImageValid;
+
+		// Cursor plane: every shape is uploaded once into an image of its own (cached by hash) and drawn as a second, alpha blended quad
+		// in the render pass, so moving the cursor only re-records the command buffers and draws the frame already in the sampled image again
+		struct CursorImage
+		{
+			// 0 if the image hasn't been created yet
+			u64 hash;
+			PvkImage image;
+			VkImageView imageView;
+			VkDescriptorSet descriptorSet;
+			// For the least recently used one to be replaced
+			u64 lastUse;
+		};
+		// What the command buffer of a swapchain (or offscreen) image has been recorded with
+		struct RecordedCommandBuffer
+		{
+			bool isUpload;
+			u32 cursorVersion;
+		};
+		const CursorOverlay* m_cursorOverlay;
+		// The cursor state as of the last refresh
+		CursorOverlay::State m_cursorState;
+		// Index into m_cursorImages, or -1 if there is no cursor to draw
+		s32 m_cursorImageIndex;
+		u64 m_cursorUseCount;
+		std::vector<CursorImage> m_cursorImages;
+		VkSampler m_vkCursorSampler;
+		VkDescriptorPool m_vkCursorDescriptorPool;
+		VkDescriptorSetLayout m_vkCursorDescriptorSetLayout;
+		VkPipelineLayout m_vkCursorPipelineLayout;
+		VkPipeline m_vkCursorPipeline;
+		PvkBuffer m_pvkCursorBuffer;
+		void* m_cursorMapPtr;
+		VkCommandBuffer* m_vkCursorCommandBuffer;
+		std::vector<RecordedCommandBuffer> m_recordedCommandBuffers;
+
+		void initialize();
+		// Blocks until the previous frame is on the screen and then sleeps until it is just about time to render the next one
+		void paceFrame();
+		void readGpuTimestamps(u32 imageIndex, FrameTimings& timings);
+		void publishFrameTimings(const FrameTimings& timings);
+		// Publishes the pending frame timings whose presentation has completed, or all of them if isFlush is true
+		void publishPresentedFrameTimings(bool isFlush = false);
+		void transitionSwapchainImagesToPresentLayout();
+		void createOffscreenImages();
+		void destroyOffscreenImages();
 		void destroyWindowRelatedVkObjects();
 		void createWindowRelatedVkObjects();
 		void recordCommandBuffers();
+		// Records the upload of the staging buffer (or not, to draw the frame already in the sampled image again) and the draws
+		void recordCommandBuffer(u32 index, bool isUpload);
+		void createCursorObjects();
+		void destroyCursorObjects();
+		// Takes the latest cursor state, uploading its shape if it isn't cached yet; returns true if it has changed since the last refresh
+		bool updateCursor();
+		s32 getCursorImage(const CursorOverlay::Shape& shape);
 		void recreate();
+		std::optional<DataPool::ElementType> takeLatestFrame(u64& submitIndex);
+		void returnFrame(DataPool::ElementType& frame);
+		// Makes the filled pooled frame the latest one, recycling the previous one if it hasn't been taken
+		void setLatestFrame(DataPool::ElementType& frame);
+		// Uploads the frame (or draws the previous one again if frame is NULL) and executes the command buffer of the image, waits for its completion
+		void renderFrame(u32 imageIndex, DataPool::ElementType* frame, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore, FrameTimings& timings);
+		void renderOffscreenFrame();
+		void createSnapshotSlots();
+		void destroySnapshotSlots();
+		// Both run on the render thread and never wait on the GPU
+		void collectCompletedSnapshots();
+		void submitSnapshots();
+		void submitSnapshotCopy(SnapshotSlot& slot);
+
+		VulkanPresentEngine(const VkSurfaceKHRCreateCallback& surfaceCreateCallback, const ExtentCallback& extentCallback, const ReadbackCallback& readbackCallback, PresentProfile profile);
 
 	public:
-		VulkanPresentEngine(const VkSurfaceKHRCreateCallback& surfaceCreateCallback);
+		// Returns immediately, the Vulkan objects are created asynchronously on a background thread
+		VulkanPresentEngine(const VkSurfaceKHRCreateCallback& surfaceCreateCallback, const ExtentCallback& extentCallback, PresentProfile profile = PresentProfile::Throughput);
+		// Offscreen (headless) engine, needs neither a window nor a surface; extentCallback gives the size of the rendered images
+		// and the optional readbackCallback receives every rendered frame for verification
+		VulkanPresentEngine(const ExtentCallback& extentCallback, const ReadbackCallback& readbackCallback = { }, PresentProfile profile = PresentProfile::Throughput);
 
 		// Not copyable and Not movable
 		VulkanPresentEngine(VulkanPresentEngine&) = delete;
@@ -54,8 +252,30 @@ namespace kvmio
 
 		~VulkanPresentEngine();
 
+		bool isReady() const noexcept { return m_isReady.load(std::memory_order_acquire); }
+		bool isOffscreen() const noexcept { return m_isOffscreen; }
+		PresentProfile getPresentProfile() const noexcept { return m_profile; }
+		// Blocks the calling thread until the background initialization is complete
+		void waitUntilReady();
+		// Size of a frame expected by submitFrame(), in bytes
+		u32 getFrameSize() const noexcept { return m_frameSize; }
+		// Thread-safe, can be called before the engine is ready
+		void submitFrame(std::span<const u8> frameData);
+		// Same as submitFrame() for an NV12 frame with padded rows, read straight into the pooled frame
+		// (and converted on the way unless USE_VULKAN_FOR_COLOR_SPACE_CONVERSION, where the YCbCr sampler does it)
+		void submitFramePlanes(const FramePlanes& planes);
 		void* getBufferPtr() const noexcept { return m_mapPtr; }
-		void runGameLoop(u32 frameRate);
-		void runGameLoop(u32 frameRate, std::atomic<bool>& isLoop);
+		// Thread-safe and never blocks, the region is in pixels of the submitted frames and the callback is invoked on a worker thread
+		// once the sampled image has been copied out (after the next render loop iteration at the earliest)
+		void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback);
+		// The cursor drawn over the frames, polled by the render loop on every refresh; must be called before runGameLoop()
+		void setCursorOverlay(const CursorOverlay* cursorOverlay) noexcept { m_cursorOverlay = cursorOverlay; }
+		// Published from the render thread once for every rendered frame
+		com::Event<com::no_publish_ptr_t, FrameTimings>& getFrameTimingsEvent() noexcept { return m_frameTimingsEvent; }
+		// Thread-safe, p50/p99 over the last FrameTimingRecorder::WindowSize frames
+		FrameTimingStatistics getFrameTimingStatistics() const { return m_frameTimingRecorder.getStatistics(); }
+		// frameRate = 0 renders every submitted frame as soon as possible (only sensible offscreen, where nothing blocks on vblank).
+		// Blocks until the engine is ready, and sleeps while there is nothing to render
+		void runGameLoop(u32 frameRate, const IterationCallback& iterationCallback);
 	};
 }
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+
+#include <PlayVk/PlayVk.h>
+
+// Window system integration for the Vulkan renderers, resolved at compile time from the native window backend (see NativeWindow.hpp)
+namespace kvmio
+{
+	class NativeWindow;
+
+	// VK_KHR_win32_surface, VK_KHR_xlib_surface or VK_KHR_wayland_surface; the instance needs VK_KHR_surface along with it
+	KVMIO_API const char* GetNativeSurfaceExtensionName();
+	// Exits the process on failure
+	KVMIO_API VkSurfaceKHR CreateNativeSurface(VkInstance instance, NativeWindow& window);
+}
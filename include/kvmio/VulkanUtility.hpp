@@ -0,0 +1,23 @@
+#pragma once
+
+#include <kvmio/Types.hpp> // for kvmio::PresentProfile
+
+#include <PlayVk/PlayVk.h>
+
+#include <common/defines.h> // for u32, u64
+
+// Device selection and presentation helpers shared by the Vulkan renderers (VulkanPresentEngine and VulkanCompositor)
+namespace kvmio
+{
+	bool IsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
+	// Exits the process if there is no suitable device; surface = VK_NULL_HANDLE selects a device for offscreen rendering
+	VkPhysicalDevice SelectPhysicalDevice(VkInstance instance, VkSurfaceKHR surface, VkFormat format, VkColorSpaceKHR colorSpace, bool isYcbcrConversion);
+	VkPresentModeKHR SelectPresentMode(VkPhysicalDevice device, VkSurfaceKHR surface, PresentProfile profile);
+	// Clamps the preferred swapchain image count to what the surface supports
+	u32 SelectImageCount(VkPhysicalDevice device, VkSurfaceKHR surface, u32 preferredImageCount);
+	// VK_KHR_present_id and VK_KHR_present_wait
+	bool IsPresentWaitSupported(VkPhysicalDevice device);
+	VkDevice CreateLogicalDevice(VkPhysicalDevice physicalDevice, const uint32_t queueFamilyIndices[2], bool isSwapchain, bool isYcbcrConversion, bool isPresentWait);
+	// Returns false if the swapchain is out of date or suboptimal and has to be recreated
+	bool QueuePresent(VkQueue queue, VkSwapchainKHR swapchain, u32 imageIndex, u32 waitSemaphoreCount, const VkSemaphore* waitSemaphores, u64 presentId);
+}
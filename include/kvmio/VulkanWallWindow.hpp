@@ -0,0 +1,55 @@
+#pragma once
+
+#include <kvmio/NativeWindow.hpp>
+
+#include <kvmio/VulkanCompositor.hpp>
+#include <kvmio/VulkanSurface.hpp>
+#include <kvmio/NV12ToRGBConverter.hpp>
+#include <kvmio/RenderThread.hpp>
+
+#include <memory> // for std::unique_ptr<>
+#include <mutex> // for std::mutex
+#include <vector> // for std::vector<>
+
+namespace kvmio
+{
+	// Shows many feeds at once (one per target server) as a grid of tiles in a single window
+	class KVMIO_API VulkanWallWindow : public NativeWindow
+	{
+	private:
+		// One per feed, so the feeds are converted in parallel; the lock only serializes the frames of the same feed
+		struct FeedConverter
+		{
+			std::mutex mutex;
+			// Created on the feed's first frame, a wall rarely has all its feeds connected
+			std::unique_ptr<NV12ToRGBConverter> converter;
+		};
+
+		// The compositor's render loop runs on it, runGameLoop() only pumps the window messages
+		RenderThread m_renderThread;
+		std::unique_ptr<VulkanCompositor> m_vkCompositor;
+		std::vector<std::unique_ptr<FeedConverter>> m_feedConverters;
+		// Never drawn, see getCursorOverlay()
+		CursorOverlay m_cursorOverlay;
+	public:
+		// Every feed receives NV12 frames of feedWidth x feedHeight pixels
+		VulkanWallWindow(u32 width, u32 height, std::string_view title, u32 feedCount, u32 feedWidth = 1920, u32 feedHeight = 1080);
+		~VulkanWallWindow();
+
+		u32 getFeedCount() const noexcept { return m_vkCompositor->getFeedCount(); }
+		// Thread-safe, frameData is a NV12 frame of the feed size given at construction
+		void presentFeed(u32 feedIndex, std::span<const u8> frameData);
+		// Thread-safe and never blocks, same as requestSnapshot() but for any feed
+		void requestFeedSnapshot(u32 feedIndex, const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback);
+
+		// Overrides
+		virtual void runGameLoop() override;
+		virtual void runGameLoop(u32 frameRate, const Predicate& isLoop = [] { return true; }) override;
+		// Presents to the first feed
+		virtual void present(std::span<const u8> frameData) override;
+		virtual void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback) override;
+		// The wall has no cursor: the tiles show the feeds as they are, whatever is set on this overlay is never drawn
+		virtual CursorOverlay& getCursorOverlay() override { return m_cursorOverlay; }
+	};
+
+}
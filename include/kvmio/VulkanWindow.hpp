@@ -3,6 +3,9 @@
 #include <kvmio/NativeWindow.hpp>
 
 #include <kvmio/VulkanPresentEngine.hpp>
+#include <kvmio/VulkanSurface.hpp>
+#include <kvmio/NV12ToRGBConverter.hpp>
+#include <kvmio/RenderThread.hpp>
 
 #include <memory> // for std::unique_ptr<>
 
@@ -11,14 +14,29 @@ namespace kvmio
 	class KVMIO_API VulkanWindow : public NativeWindow
 	{
 	private:
+		// The engine's render loop runs on it, runGameLoop() only pumps the window messages
+		RenderThread m_renderThread;
 		std::unique_ptr<VulkanPresentEngine> m_vkPresentEngine;
+		#ifndef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+		std::mutex m_converterMutex;
+		std::unique_ptr<NV12ToRGBConverter> m_nv12ToRGBConverter;
+		#endif
 	public:
-		VulkanWindow(u32 width, u32 height, std::string_view title);
+		// The window is usable (shown, polled, presented to) right away, the Vulkan engine initializes in the background
+		VulkanWindow(u32 width, u32 height, std::string_view title, PresentProfile presentProfile = PresentProfile::Throughput);
 		~VulkanWindow();
 
+		bool isEngineReady() const noexcept { return m_vkPresentEngine->isReady(); }
+		com::Event<com::no_publish_ptr_t, FrameTimings>& getFrameTimingsEvent() noexcept { return m_vkPresentEngine->getFrameTimingsEvent(); }
+		FrameTimingStatistics getFrameTimingStatistics() const { return m_vkPresentEngine->getFrameTimingStatistics(); }
+
 		// Overrides
 		virtual void runGameLoop() override;
 		virtual void runGameLoop(u32 frameRate, const Predicate& isLoop = [] { return true; }) override;
+		virtual void present(std::span<const u8> frameData) override;
+		// The padded rows are read straight into the engine's pooled frame, without repacking them first
+		virtual void presentPlanes(const FramePlanes& planes) override;
+		virtual void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback) override;
 	};
 
 }
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <common/defines.h> // for u8, u32, u64, s32
+
+#include <wayland-client.h>
+
+#include <vector>
+#include <mutex>
+
+namespace kvmio::Wayland
+{
+	// A few wl_buffers (XRGB8888 or ARGB8888, i.e. B8G8R8(A8) in memory) carved out of one memfd backed wl_shm_pool, the frames are converted straight into them.
+	// A buffer goes Free -> Writing (a presenting thread owns it) -> Ready (the latest complete frame) -> Attached (the compositor owns it until wl_buffer.release);
+	// a Ready buffer which hasn't been attached yet is taken back for writing if nothing else is free, i.e. stale frames are dropped instead of queued
+	class KVMIO_API WaylandBufferRing
+	{
+	private:
+		enum class State : u8
+		{
+			Free,
+			Writing,
+			Ready,
+			Attached
+		};
+		struct Buffer
+		{
+			wl_buffer* handle;
+			u8* pixels;
+			State state;
+			// The frame the pixels hold, 0 if none (or if they are only partially written)
+			u64 serial;
+		};
+		s32 m_fd;
+		u8* m_memory;
+		std::size_t m_size;
+		wl_shm_pool* m_pool;
+		const u32 m_width;
+		const u32 m_height;
+		std::mutex m_mutex;
+		std::vector<Buffer> m_buffers;
+		s32 m_readyIndex;
+
+		static void OnRelease(void* userData, wl_buffer* buffer);
+
+	public:
+		WaylandBufferRing(wl_shm* shm, u32 width, u32 height, u32 count, u32 format = WL_SHM_FORMAT_XRGB8888);
+
+		// Not copyable and Not movable
+		WaylandBufferRing(WaylandBufferRing&) = delete;
+		WaylandBufferRing(WaylandBufferRing&&) = delete;
+
+		~WaylandBufferRing();
+
+		// Thread-safe, returns -1 if every buffer is held by the compositor, otherwise the caller owns the returned buffer until markReady() or cancel()
+		s32 acquire();
+		// Thread-safe, the buffer replaces the previous ready one (which becomes free again)
+		void markReady(s32 index, u64 serial);
+		// Thread-safe, gives back an acquired buffer whose pixels haven't been touched
+		void cancel(s32 index);
+		// Thread-safe, returns -1 if no frame is ready, otherwise the buffer is attached until the compositor releases it
+		s32 takeReady();
+
+		u8* getPixels(s32 index) { return m_buffers[index].pixels; }
+		// Only meaningful for a buffer the caller owns
+		u64 getSerial(s32 index) const { return m_buffers[index].serial; }
+		wl_buffer* getHandle(s32 index) { return m_buffers[index].handle; }
+		u32 getStride() const noexcept { return m_width * 4; }
+		u32 getWidth() const noexcept { return m_width; }
+		u32 getHeight() const noexcept { return m_height; }
+	};
+}
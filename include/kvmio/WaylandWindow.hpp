@@ -0,0 +1,136 @@
+#pragma once
+
+#include <kvmio/Window.hpp>
+#include <kvmio/Wayland/WaylandBufferRing.hpp>
+
+#include <wayland-client.h>
+#include <xdg-shell-client-protocol.h>
+
+#include <array>
+#include <bitset>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace kvmio
+{
+	// Window of the Linux workstations running a Wayland compositor, without going through Xwayland.
+	// present() converts straight into a wl_shm buffer, only the bands of rows which changed since the frame already in that buffer,
+	// and only the bands which changed since the frame on the screen are damaged. Commits are paced by wl_surface.frame callbacks.
+	// The cursor is a desynchronized subsurface of its own, so moving it never commits a frame
+	class KVMIO_API WaylandWindow : public Window
+	{
+	public:
+		// Rows of the frame compared and damaged together
+		static constexpr u32 DamageBandHeight = 16;
+		static constexpr u32 MaxDamageBands = 128;
+		// Frames of damage remembered, a buffer which last held an older frame is converted entirely
+		static constexpr u32 DamageHistorySize = 8;
+		static constexpr u32 BufferCount = 3;
+
+	private:
+		using DamageBands = std::bitset<MaxDamageBands>;
+
+		wl_display* m_display;
+		wl_registry* m_registry;
+		wl_compositor* m_compositor;
+		wl_subcompositor* m_subcompositor;
+		wl_shm* m_shm;
+		xdg_wm_base* m_wmBase;
+		wl_surface* m_surface;
+		xdg_surface* m_xdgSurface;
+		xdg_toplevel* m_toplevel;
+		// Non-null while the compositor hasn't asked for the next frame yet
+		wl_callback* m_frameCallback;
+		// Written by present() to wake the event loop up when a frame is ready
+		s32 m_wakeFd;
+		bool m_isConfigured;
+		bool m_isAttached;
+		u32 m_width;
+		u32 m_height;
+		bool m_isFullScreen;
+		std::atomic<bool> m_isWindowShouldClose;
+		std::atomic<bool> m_isDestroyed;
+
+		std::unique_ptr<Wayland::WaylandBufferRing> m_buffers;
+		// Serializes present()
+		std::mutex m_presentMutex;
+		u64 m_frameSerial;
+		// Bands which changed from frame n - 1 to frame n, at n % DamageHistorySize
+		std::array<DamageBands, DamageHistorySize> m_damageHistory;
+		// Guards the ready buffer along with its damage, so that a commit never takes one without the other
+		std::mutex m_damageMutex;
+		// Bands which changed since the frame on the screen
+		DamageBands m_pendingDamage;
+
+		// The latest presented NV12 frame, compared against by the next one; only touched by the presenting thread
+		std::shared_ptr<std::vector<u8>> m_displayedFrame;
+		// Reused for the next frame if no snapshot refers to it anymore
+		std::shared_ptr<std::vector<u8>> m_spareFrame;
+		// Shares the latest presented frame with the snapshots being taken from it
+		SnapshotSource m_snapshotSource;
+
+		CursorOverlay m_cursorOverlay;
+		// Only touched by the thread running the event loop
+		wl_surface* m_cursorSurface;
+		wl_subsurface* m_cursorSubsurface;
+		std::unique_ptr<Wayland::WaylandBufferRing> m_cursorBuffers;
+		u32 m_cursorVersion;
+		u64 m_cursorShapeHash;
+		bool m_isCursorAttached;
+
+		static void OnRegistryGlobal(void* userData, wl_registry* registry, uint32_t name, const char* interface, uint32_t version);
+		static void OnRegistryGlobalRemove(void* userData, wl_registry* registry, uint32_t name);
+		static void OnPing(void* userData, xdg_wm_base* wmBase, uint32_t serial);
+		static void OnSurfaceConfigure(void* userData, xdg_surface* xdgSurface, uint32_t serial);
+		static void OnToplevelConfigure(void* userData, xdg_toplevel* toplevel, int32_t width, int32_t height, wl_array* states);
+		static void OnToplevelClose(void* userData, xdg_toplevel* toplevel);
+		static void OnFrameDone(void* userData, wl_callback* callback, uint32_t time);
+
+		// Idempotent
+		void _destroy();
+		DamageBands getChangedBands(std::span<const u8> frameData) const;
+		void setDisplayedFrame(std::span<const u8> frameData);
+		// Attaches the ready buffer (if any) unless the compositor hasn't asked for the next frame yet
+		void commitFrame();
+		void updateCursor();
+		void dispatchEvents(s32 timeout);
+
+	public:
+		WaylandWindow(u32 width, u32 height, std::string_view title);
+
+		// Not copyable and not movable
+		WaylandWindow(WaylandWindow&) = delete;
+		WaylandWindow(WaylandWindow&&) = delete;
+
+		~WaylandWindow();
+
+		// Implementation of Window
+		virtual bool isShouldClose() override { return shouldClose(); }
+		virtual void setFullScreen(bool isFullScreen) override;
+		virtual void show() override;
+		virtual void runGameLoop() override;
+		virtual void runGameLoop(u32 frameRate, const Predicate& isLoop = [] { return true; }) override;
+		virtual void present(std::span<const u8> frameData) override;
+		virtual void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback) override;
+		virtual CursorOverlay& getCursorOverlay() override { return m_cursorOverlay; }
+
+		wl_display* getNativeDisplay() { return m_display; }
+		wl_surface* getNativeHandle() { return m_surface; }
+
+		bool isFullScreen() const noexcept { return m_isFullScreen; }
+		bool shouldClose();
+		void pollEvents(bool isBlock = true);
+		// Sleeps until an event arrives, a frame is presented or the timeout elapses, and then dispatches all the queued events
+		void waitEvents(u32 timeout);
+		// The size the compositor has configured the window with; the frames are shown 1:1 (Wayland clients can't resize themselves)
+		std::pair<u32, u32> getSize() const;
+		u32 getWidth() const { return getSize().first; }
+		u32 getHeight() const { return getSize().second; }
+		std::pair<u32, u32> getClientSize() const { return getSize(); }
+		u32 getClientWidth() const { return getClientSize().first; }
+		u32 getClientHeight() const { return getClientSize().second; }
+	};
+}
@@ -2,12 +2,16 @@
 
 #include <kvmio/defines.hpp>
 #include <common/defines.h>
+#include <common/platform.h>
 #include <vector>
 
-#ifndef WIN32_LEAN_AND_MEAN
-#	define WIN32_LEAN_AND_MEAN
-# 	include <Windows.h>
-#endif
+// The input model below is shared with the other platforms' input backends, only the Raw Input functions need Windows
+#ifdef PLATFORM_WINDOWS
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+# 		include <Windows.h>
+#	endif
+#endif // PLATFORM_WINDOWS
 
 namespace kvmio::Win32
 {
@@ -127,6 +131,7 @@ namespace kvmio::Win32
 		bool isVirtualDesktop;
 	};
 
+#ifdef PLATFORM_WINDOWS
 	KVMIO_API KeyboardInput DecodeRawKeyboardInput(RAWKEYBOARD* rawKeyboard);
 	KVMIO_API void DumpKeyboardInput(const KeyboardInput* keyboardInput);
 
@@ -152,4 +157,5 @@ namespace kvmio::Win32
 
 	KVMIO_API void DisplayRawInputDeviceList();
 	KVMIO_API void RegisterRawInputDevices(std::vector<RawInputDeviceType> deviceTypes);
+#endif // PLATFORM_WINDOWS
 }
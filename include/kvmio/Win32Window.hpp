@@ -3,6 +3,10 @@
 #include <kvmio/Window.hpp>
 #include <kvmio/Win32/Win32.hpp>
 #include <kvmio/NV12ToRGBConverter.hpp>
+#include <kvmio/KeyChordEngine.hpp>
+#include <kvmio/KeyCodeTables.hpp>
+#include <kvmio/InputEventRing.hpp>
+#include <kvmio/InputDispatcher.hpp>
 
 #include <common/Event.hpp>
 #include <common/DynamicPool.hpp>
@@ -16,6 +20,9 @@
 #endif // PLATFORM_WINDOWS
 
 #include <unordered_map>
+#include <array>
+#include <bitset>
+#include <deque>
 #include <vector>
 #include <mutex>
 #include <atomic>
@@ -59,9 +66,15 @@ namespace kvmio
 			RECT windowRect;
 		} m_beforeFullScreenInfo;
 
-		std::unordered_map<u32, Win32::KeyStatus> m_pressedKeys;
-		std::vector<std::pair<KeyComb, com::Event<com::no_publish_ptr_t, KeyInputComb>>> m_keyCombs;
+		KeyChordEngine m_keyChords;
+		// Indexed by the chord ids of m_keyChords; a deque, so the references handed out by createKeyCombinationEvent() stay valid
+		std::deque<com::Event<com::no_publish_ptr_t, KeyInputComb>> m_keyCombEvents;
+		// The held keys in press order, as m_keyChords has them; reserved up front, so the keyboard path never allocates
 		std::vector<Win32::KeyboardInput> m_curKeyComb;
+		// By GetKeyIndex(), to tell an auto-repeat from a press
+		std::bitset<KeyIndexCount> m_pressedKeys;
+		// The held keys reported with each virtual key, the two keys of a pair (i.e. both Shift keys) share one
+		std::array<u8, 256> m_virtualKeyHeldCounts;
 		bool m_isLocked;
 		bool m_isWindowShouldClose;
 		std::atomic<bool> m_isDestroyed;
@@ -72,13 +85,37 @@ namespace kvmio
 		std::unique_ptr<DataPool> m_pooledFrames;
 		com::ProducerConsumerBuffer<DataPool::ElementType> m_inFlightFramesBuffer;
 
+		// Snapshots are taken from the frame on the screen, which goes back to m_pooledFrames once it is neither displayed nor referred to by a snapshot
+		SnapshotSource m_snapshotSource;
+
 		std::unique_ptr<NV12ToRGBConverter> m_nv12ToRGBConverter;
 
+		CursorOverlay m_cursorOverlay;
+		// Only touched by the thread running the message loop
+		SoftwareCursor m_softwareCursor;
+		// The draw surface holds a frame, so it can be painted (and the cursor drawn over it) without a new one
+		bool m_isSurfaceValid;
+
 		com::Event<com::no_publish_ptr_t, Win32::MouseInput> m_mouseEvent;
 		com::Event<com::no_publish_ptr_t, Win32::KeyboardInput>  m_keyboardEvent;
+		// Not owned, null unless set with setInputEventRing()
+		InputEventRing* m_inputEventRing;
+		// The asynchronous subscribers, its worker is started on the first one
+		InputDispatcher m_inputDispatcher;
 
 		// Idempotent
 		void _destroy();
+		// Registers the combination with m_keyChords, the same combination registered again gets the same chord
+		KeyChordEngine::ChordId addKeyCombination(const KeyComb& keyComb);
+		void setDisplayedFrame(DataPool::ElementType& frame);
+		// Invalidates the area under the drawn cursor and under its new position if the cursor has changed since it was drawn
+		void invalidateCursor();
+		// Called from WM_PAINT
+		void paint(const PAINTSTRUCT& paintStruct);
+		// The decoded input of WM_INPUT: key combinations first, then the input event ring, the asynchronous subscribers and the events,
+		// which all skip the press completing a combination
+		void dispatchMouseInput(const Win32::MouseInput& mouseInput);
+		void dispatchKeyboardInput(const Win32::KeyboardInput& keyboardInput);
 
 	public:
 		typedef Internal_HookHandle HookHandle;
@@ -109,6 +146,8 @@ namespace kvmio
 		virtual void runGameLoop() override;
 		virtual void runGameLoop(u32 frameRate, const Predicate& isLoop = [] { return true; }) override;
 		virtual void present(std::span<const u8> frameData) override;
+		virtual void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback) override;
+		virtual CursorOverlay& getCursorOverlay() override { return m_cursorOverlay; }
 
 		Internal_WindowHandle getNativeHandle() { return m_handle; }
 	
@@ -119,6 +158,8 @@ namespace kvmio
 		void lock(bool isLock) { showCursor(!isLock); }
 		void showCursor(bool isShow);
 		void pollEvents(bool isBlock = true);
+		// Sleeps until a message arrives (or the timeout elapses) and then dispatches all the queued ones
+		void waitEvents(u32 timeout);
 		void setMouseCapture();
 		void releaseMouseCapture();
 		void setSize(u32 width, u32 height);
@@ -141,5 +182,18 @@ namespace kvmio
 		decltype(auto) getMouseEvent() { return m_mouseEvent; }
 		decltype(auto) getKeyboardEvent() { return m_keyboardEvent; }
 		com::Event<com::no_publish_ptr_t, KeyInputComb>& createKeyCombinationEvent(const KeyComb& keyComb);
+		// The subscribers of the dispatcher are called on its worker thread instead of in WindowProc, each from a bounded queue of its own,
+		// so they can take as long as they like without holding up the message loop (painting, resizing) or the other subscribers' input
+		InputDispatcher& getInputDispatcher() noexcept { return m_inputDispatcher; }
+		// The asynchronous counterpart of createKeyCombinationEvent(), likewise on the thread running the message loop;
+		// unsubscribed with getInputDispatcher().unsubscribe()
+		InputDispatcher::SubscriptionId subscribeKeyCombinationAsync(const KeyComb& keyComb, InputDispatcher::KeyCombinationCallback callback,
+																		u32 capacity = 16, DispatchOverflow overflow = DispatchOverflow::Drop);
+		// The decoded input (and the resizes) are pushed into the ring as well, by the thread running the message loop;
+		// must outlive the window or be reset to null first
+		void setInputEventRing(InputEventRing* ring) noexcept { m_inputEventRing = ring; }
+		// Feeds an input through the same path as WM_INPUT does (i.e. to replay a recorded session), on the thread running the message loop;
+		// the resizes are ignored
+		void dispatchInput(const InputEvent& event);
 	};
 }
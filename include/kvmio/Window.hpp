@@ -1,14 +1,28 @@
 #pragma once
 
 #include <kvmio/defines.hpp>
-#include <kvmio/types.hpp> // for kvmio::FrameFormat
+#include <kvmio/Types.hpp> // for kvmio::FrameFormat
+#include <kvmio/Snapshot.hpp>
+#include <kvmio/Cursor.hpp>
 
 #include <span> // for std::span<>
 #include <string_view> // for std::string_view
 #include <functional> // for std::functicon
+#include <vector> // for std::vector<>
+#include <cstring> // for std::memcpy
 
 namespace kvmio
 {
+	// An NV12 frame whose rows may be padded (i.e. as a capture device lays it out), both planes have the same stride
+	struct FramePlanes
+	{
+		const u8* yPlane;
+		const u8* uvPlane;
+		u32 stride;
+		u32 width;
+		u32 height;
+	};
+
 	class KVMIO_API Window
 	{
 	public:
@@ -34,5 +48,27 @@ namespace kvmio
 		virtual void runGameLoop(u32 frameRate, const Predicate& isLoop = [] { return true; }) = 0;
 		// Thread-safe, can be called from another thread, i.e. runGameLoop() can be a different thread than this.
 		virtual void present(std::span<const u8> frameData) = 0;
+		// Same as present(), the windows converting on the CPU read the padded rows directly; the others get them repacked here
+		virtual void presentPlanes(const FramePlanes& planes)
+		{
+			const std::size_t planeSize = static_cast<std::size_t>(planes.width) * planes.height;
+			if((planes.stride == planes.width) && (planes.uvPlane == (planes.yPlane + planeSize)))
+			{
+				present({ planes.yPlane, planeSize + planeSize / 2 });
+				return;
+			}
+			thread_local std::vector<u8> packedFrame;
+			packedFrame.resize(planeSize + planeSize / 2);
+			for(u32 y = 0; y < planes.height; y++)
+				std::memcpy(packedFrame.data() + static_cast<std::size_t>(y) * planes.width, planes.yPlane + static_cast<std::size_t>(y) * planes.stride, planes.width);
+			for(u32 y = 0; y < (planes.height / 2); y++)
+				std::memcpy(packedFrame.data() + planeSize + static_cast<std::size_t>(y) * planes.width, planes.uvPlane + static_cast<std::size_t>(y) * planes.stride, planes.width);
+			present(packedFrame);
+		}
+		// Thread-safe and never blocks, the callback is invoked later (on a worker thread) with the region of the latest presented frame,
+		// or of the first one if nothing has been presented yet
+		virtual void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback) = 0;
+		// The remote cursor, drawn over the presented frames and updated independently of them
+		virtual CursorOverlay& getCursorOverlay() = 0;
 	};
 }
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <common/defines.h> // for u8, u32, s32
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include <utility>
+
+namespace kvmio::X11
+{
+	// B8G8R8A8 image in a System V shared memory segment attached to the X server (MIT-SHM), the counterpart of Win32DrawSurface:
+	// put() only sends a request referring to the segment, the pixels never go through the socket.
+	// Falls back to a plain XImage (copied through the socket by XPutImage) if the server has no MIT-SHM, e.g. over ssh -X
+	class KVMIO_API X11DrawSurface
+	{
+	private:
+		Display* m_display;
+		::Window m_window;
+		GC m_gc;
+		XImage* m_image;
+		XShmSegmentInfo m_shmInfo;
+		bool m_isShm;
+		// First event code of the extension, the completion event of put() is m_shmEventBase + ShmCompletion
+		s32 m_shmEventBase;
+		// The server reads the segment asynchronously, so the pixels mustn't be written until the completion event arrives
+		bool m_isPutPending;
+		const u32 m_width;
+		const u32 m_height;
+
+		bool createShmImage(Visual* visual, u32 depth);
+
+	public:
+		X11DrawSurface(Display* display, ::Window window, u32 width, u32 height);
+
+		// Not copyable and Not movable
+		X11DrawSurface(X11DrawSurface&) = delete;
+		X11DrawSurface(X11DrawSurface&&) = delete;
+
+		~X11DrawSurface();
+
+		u8* getPixels();
+		std::pair<u32, u32> getSize() const;
+		u32 getStride() const;
+		u32 getBufferSize() const;
+		bool isShm() const noexcept { return m_isShm; }
+
+		// Copies the area of the surface to the same area of the window
+		void put(s32 x, s32 y, u32 width, u32 height);
+		// False while the server may still be reading the pixels of the last put()
+		bool isWritable() const noexcept { return !m_isPutPending; }
+		// Returns true if the event was the completion of put() (and has been consumed)
+		bool handleEvent(const XEvent& event);
+	};
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <kvmio/defines.hpp>
+#include <kvmio/Window.hpp> // for Window::Predicate
+
+#include <common/defines.h>
+#include <common/Event.hpp>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xdamage.h>
+
+#include <span>
+#include <vector>
+#include <utility>
+
+namespace kvmio::X11
+{
+	// Area of a frame which changed since the previous one, always of even position and size (i.e. whole NV12 blocks)
+	struct DamageRect
+	{
+		u32 x;
+		u32 y;
+		u32 width;
+		u32 height;
+	};
+
+	struct ScreenFrame
+	{
+		// The whole screen as tightly packed NV12, only valid for the duration of the callback;
+		// the areas outside the damage are the same as in the previous frame
+		std::span<const u8> nv12;
+		u32 width;
+		u32 height;
+		std::span<const DamageRect> damage;
+		u64 sequence;
+		// In microseconds of steady_clock, when the screen was read
+		u64 timestamp;
+	};
+
+	// Grabs the screen of an X server on the sending side, for the same pipeline the viewer consumes.
+	// XDamage tells which areas changed: only those are read back (XShmGetImage into a shared memory segment) and converted to NV12,
+	// so an idle desktop costs a poll() on the connection and a burst costs in proportion to the area it changed.
+	// Without XDamage every frame is a full one, without MIT-SHM the pixels are copied through the connection (XGetImage)
+	class KVMIO_API X11ScreenCapture
+	{
+	private:
+		Display* m_display;
+		::Window m_root;
+		u32 m_width;
+		u32 m_height;
+		Visual* m_visual;
+		u32 m_depth;
+
+		XImage* m_image;
+		XShmSegmentInfo m_shmInfo;
+		bool m_isShm;
+
+		bool m_isDamageSupported;
+		s32 m_damageEventBase;
+		Damage m_damage;
+		XserverRegion m_damageRegion;
+		// A notify has arrived since the damage was last taken
+		bool m_isDamaged;
+
+		std::vector<u8> m_frame;
+		std::vector<DamageRect> m_damageRects;
+		u64 m_sequence;
+
+		com::Event<com::no_publish_ptr_t, ScreenFrame> m_frameEvent;
+
+		bool createShmImage();
+		// Dispatches the queued events, any damage notify among them sets m_isDamaged
+		void processEvents();
+		// Moves the accumulated damage into m_damageRects
+		void takeDamage();
+		void readRect(const DamageRect& rect);
+
+	public:
+		// NULL for $DISPLAY
+		X11ScreenCapture(const char* displayName = NULL);
+
+		// Not copyable and not movable
+		X11ScreenCapture(X11ScreenCapture&) = delete;
+		X11ScreenCapture(X11ScreenCapture&&) = delete;
+
+		~X11ScreenCapture();
+
+		// Waits at most timeout milliseconds for the screen to change, then reads, converts and publishes the changed areas.
+		// Returns false if nothing changed
+		bool capture(u32 timeout);
+		// Captures at most frameRate frames per second, the changes in between are merged into the next frame
+		void run(u32 frameRate, const Window::Predicate& isLoop);
+
+		std::pair<u32, u32> getSize() const noexcept { return { m_width, m_height }; }
+		com::Event<com::no_publish_ptr_t, ScreenFrame>& getFrameEvent() noexcept { return m_frameEvent; }
+	};
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <kvmio/Window.hpp>
+#include <kvmio/X11/X11DrawSurface.hpp>
+
+#include <common/DynamicPool.hpp>
+#include <common/ProducerConsumerBuffer.hpp>
+
+#include <X11/Xlib.h>
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace kvmio
+{
+	// Window of the Linux workstations running an X server (or Xvfb), presents through a MIT-SHM X11DrawSurface
+	class KVMIO_API X11Window : public Window
+	{
+	private:
+		Display* m_display;
+		::Window m_handle;
+		Atom m_wmDeleteWindow;
+		Atom m_netWmState;
+		Atom m_netWmStateFullScreen;
+		std::unique_ptr<X11::X11DrawSurface> m_drawSurface;
+		u32 m_width;
+		u32 m_height;
+		bool m_isMapped;
+		bool m_isFullScreen;
+		std::atomic<bool> m_isWindowShouldClose;
+		std::atomic<bool> m_isDestroyed;
+
+		u32 m_rgbFrameSize;
+		using DataPool = com::DynamicPool<std::span<u8>>;
+		std::mutex m_pooledFramesMutex;
+		std::unique_ptr<DataPool> m_pooledFrames;
+		com::ProducerConsumerBuffer<DataPool::ElementType> m_inFlightFramesBuffer;
+
+		// Snapshots are taken from the frame on the screen, which goes back to m_pooledFrames once it is neither displayed nor referred to by a snapshot
+		SnapshotSource m_snapshotSource;
+
+		CursorOverlay m_cursorOverlay;
+		// Only touched by the thread running the event loop
+		SoftwareCursor m_softwareCursor;
+		// The draw surface holds a frame, so it can be painted (and the cursor drawn over it) without a new one
+		bool m_isSurfaceValid;
+		// Set at the frame rate, a queued frame (if any) is taken by the next paint()
+		bool m_isFrameDue;
+		// Bounding box of the area of the window which has to be put again, in pixels of the surface
+		CursorRect m_damage;
+
+		// Idempotent
+		void _destroy();
+		void setDisplayedFrame(DataPool::ElementType& frame);
+		void addDamage(const CursorRect& rect);
+		// Damages the area under the drawn cursor and under its new position if the cursor has changed since it was drawn
+		void invalidateCursor();
+		// Takes the latest frame if one is due, redraws the cursor and puts the damaged area, unless the server is still reading the surface
+		void paint();
+		void handleEvent(XEvent& event);
+
+	public:
+		X11Window(u32 width, u32 height, std::string_view title);
+
+		// Not copyable and not movable
+		X11Window(X11Window&) = delete;
+		X11Window(X11Window&&) = delete;
+
+		~X11Window();
+
+		// Implementation of Window
+		virtual bool isShouldClose() override { return shouldClose(); }
+		virtual void setFullScreen(bool isFullScreen) override;
+		virtual void show() override;
+		virtual void runGameLoop() override;
+		virtual void runGameLoop(u32 frameRate, const Predicate& isLoop = [] { return true; }) override;
+		virtual void present(std::span<const u8> frameData) override;
+		virtual void presentPlanes(const FramePlanes& planes) override;
+		virtual void requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback) override;
+		virtual CursorOverlay& getCursorOverlay() override { return m_cursorOverlay; }
+
+		Display* getNativeDisplay() { return m_display; }
+		::Window getNativeHandle() { return m_handle; }
+
+		bool isFullScreen() const noexcept { return m_isFullScreen; }
+		bool shouldClose();
+		void pollEvents(bool isBlock = true);
+		// Sleeps until an event arrives (or the timeout elapses) and then handles all the queued ones
+		void waitEvents(u32 timeout);
+		void setSize(u32 width, u32 height);
+		std::pair<u32, u32> getSize() const;
+		u32 getWidth() const { return getSize().first; }
+		u32 getHeight() const { return getSize().second; }
+		// X11 windows have no non-client area of their own, the decorations belong to the window manager
+		std::pair<u32, u32> getClientSize() const { return getSize(); }
+		u32 getClientWidth() const { return getClientSize().first; }
+		u32 getClientHeight() const { return getClientSize().second; }
+		void setPosition(s32 x, s32 y);
+		void setSizeAndPosition(s32 x, s32 y, u32 width, u32 height);
+	};
+}
@@ -0,0 +1,165 @@
+#include <kvmio/ColorConversion.hpp>
+
+#include <libassert/assert.hpp>
+
+#include <algorithm> // for std::clamp
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#	define KVMIO_COLOR_CONVERSION_SSE2
+#endif
+
+// 2.14 fixed point BT.709 coefficients of BGRA to NV12, in B, G, R order; the chroma ones sum to 0 so that grey maps to 128 exactly
+#define Y_COEFFICIENTS 1183, 11718, 3483
+#define CB_COEFFICIENTS 8192, -6314, -1878
+#define CR_COEFFICIENTS -750, -7442, 8192
+
+namespace kvmio
+{
+	static inline u8 ClampToByte(s32 value)
+	{
+		return static_cast<u8>(std::clamp<s32>(value, 0, 255));
+	}
+
+	void ConvertNV12ToBGRA(std::span<const u8> nv12, u32 width, u32 height, u8* dst, u32 dstStride)
+	{
+		DEBUG_ASSERT(nv12.size() >= ((static_cast<std::size_t>(width) * height * 3) >> 1));
+		ConvertNV12ToBGRA(nv12.data(), nv12.data() + static_cast<std::size_t>(width) * height, width, width, height, dst, dstStride);
+	}
+
+	void ConvertNV12ToBGRA(const u8* yPlane, const u8* uvPlane, u32 srcStride, u32 width, u32 height, u8* dst, u32 dstStride)
+	{
+		DEBUG_ASSERT(((width & 1) == 0) && ((height & 1) == 0), "NV12 frames have even dimensions");
+		DEBUG_ASSERT((srcStride >= width) && (dstStride >= (width * 4)));
+		// Each CbCr sample covers a 2x2 block, so its contribution is computed once for the 4 pixels
+		for(u32 y = 0; y < height; y += 2)
+		{
+			const u8* yRows[2] = { yPlane + static_cast<std::size_t>(y) * srcStride, yPlane + static_cast<std::size_t>(y + 1) * srcStride };
+			const u8* uvRow = uvPlane + static_cast<std::size_t>(y >> 1) * srcStride;
+			u8* dstRows[2] = { dst + static_cast<std::size_t>(y) * dstStride, dst + static_cast<std::size_t>(y + 1) * dstStride };
+			for(u32 x = 0; x < width; x += 2)
+			{
+				// 16.16 fixed point
+				const s32 cb = uvRow[x] - 128;
+				const s32 cr = uvRow[x + 1] - 128;
+				const s32 rOffset = (103206 * cr) >> 16;
+				const s32 gOffset = (12276 * cb + 30678 * cr) >> 16;
+				const s32 bOffset = (121609 * cb) >> 16;
+				for(u32 row = 0; row < 2; row++)
+				{
+					for(u32 i = 0; i < 2; i++)
+					{
+						const s32 luma = yRows[row][x + i];
+						u8* pixel = dstRows[row] + (x + i) * 4;
+						pixel[0] = ClampToByte(luma + bOffset);
+						pixel[1] = ClampToByte(luma - gOffset);
+						pixel[2] = ClampToByte(luma + rOffset);
+						pixel[3] = 255;
+					}
+				}
+			}
+		}
+	}
+
+	static inline void ConvertBGRAToNV12Block(const u8* srcRows[2], u32 x, u8* yRows[2], u8* uvRow)
+	{
+		static constexpr s32 yCoefficients[3] = { Y_COEFFICIENTS };
+		static constexpr s32 cbCoefficients[3] = { CB_COEFFICIENTS };
+		static constexpr s32 crCoefficients[3] = { CR_COEFFICIENTS };
+		s32 sums[3] = { 0, 0, 0 };
+		for(u32 row = 0; row < 2; row++)
+		{
+			for(u32 i = 0; i < 2; i++)
+			{
+				const u8* pixel = srcRows[row] + (x + i) * 4;
+				yRows[row][x + i] = static_cast<u8>((pixel[0] * yCoefficients[0] + pixel[1] * yCoefficients[1] + pixel[2] * yCoefficients[2] + 8192) >> 14);
+				for(u32 c = 0; c < 3; c++)
+					sums[c] += pixel[c];
+			}
+		}
+		// The sums are of 4 pixels, hence 16 bits of shift instead of 14
+		uvRow[x] = ClampToByte(((sums[0] * cbCoefficients[0] + sums[1] * cbCoefficients[1] + sums[2] * cbCoefficients[2] + 32768) >> 16) + 128);
+		uvRow[x + 1] = ClampToByte(((sums[0] * crCoefficients[0] + sums[1] * crCoefficients[1] + sums[2] * crCoefficients[2] + 32768) >> 16) + 128);
+	}
+
+#ifdef KVMIO_COLOR_CONVERSION_SSE2
+	// Sums the pairs of 32 bit lanes which _mm_madd_epi16() leaves for each pixel (B * cB + G * cG and R * cR + A * 0),
+	// and packs the results of both vectors in lanes 0 to 3
+	static inline __m128i SumPixelPairs(__m128i lo, __m128i hi)
+	{
+		lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+		hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_unpacklo_epi64(_mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 3, 2, 0)), _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 3, 2, 0)));
+	}
+
+	// 4 pixels to their 4 luma values, as 32 bit lanes
+	static inline __m128i LumaOf4(__m128i pixels, __m128i coefficients)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coefficients);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coefficients);
+		return _mm_srai_epi32(_mm_add_epi32(SumPixelPairs(lo, hi), _mm_set1_epi32(8192)), 14);
+	}
+
+	// 4 pixels of 2 rows (i.e. two 2x2 blocks) to Cb0, Cr0, Cb1, Cr1 as 32 bit lanes
+	static inline __m128i ChromaOf2x4(__m128i pixels0, __m128i pixels1, __m128i cbCoefficients, __m128i crCoefficients)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		// Vertical sums, then the horizontal ones of each 2x2 block: B G R A of both blocks, in 16 bits
+		__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(pixels0, zero), _mm_unpacklo_epi8(pixels1, zero));
+		__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(pixels0, zero), _mm_unpackhi_epi8(pixels1, zero));
+		lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+		hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+		const __m128i sums = _mm_unpacklo_epi64(lo, hi);
+		const __m128i rounding = _mm_set1_epi32(32768);
+		const __m128i offset = _mm_set1_epi32(128);
+		__m128i cb = _mm_madd_epi16(sums, cbCoefficients);
+		__m128i cr = _mm_madd_epi16(sums, crCoefficients);
+		// Lanes 0 and 2 hold the blocks' values after the pair sums
+		cb = _mm_add_epi32(cb, _mm_shuffle_epi32(cb, _MM_SHUFFLE(2, 3, 0, 1)));
+		cr = _mm_add_epi32(cr, _mm_shuffle_epi32(cr, _MM_SHUFFLE(2, 3, 0, 1)));
+		cb = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(cb, rounding), 16), offset);
+		cr = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(cr, rounding), 16), offset);
+		cb = _mm_shuffle_epi32(cb, _MM_SHUFFLE(3, 3, 2, 0));
+		cr = _mm_shuffle_epi32(cr, _MM_SHUFFLE(3, 3, 2, 0));
+		return _mm_unpacklo_epi32(cb, cr);
+	}
+#endif // KVMIO_COLOR_CONVERSION_SSE2
+
+	void ConvertBGRAToNV12(const u8* src, u32 srcStride, u32 width, u32 height, u8* yPlane, u8* uvPlane, u32 dstStride)
+	{
+		DEBUG_ASSERT(((width & 1) == 0) && ((height & 1) == 0), "NV12 blocks have even dimensions");
+		DEBUG_ASSERT((srcStride >= (width * 4)) && (dstStride >= width));
+#ifdef KVMIO_COLOR_CONVERSION_SSE2
+		const __m128i yCoefficients = _mm_setr_epi16(Y_COEFFICIENTS, 0, Y_COEFFICIENTS, 0);
+		const __m128i cbCoefficients = _mm_setr_epi16(CB_COEFFICIENTS, 0, CB_COEFFICIENTS, 0);
+		const __m128i crCoefficients = _mm_setr_epi16(CR_COEFFICIENTS, 0, CR_COEFFICIENTS, 0);
+#endif // KVMIO_COLOR_CONVERSION_SSE2
+		for(u32 y = 0; y < height; y += 2)
+		{
+			const u8* srcRows[2] = { src + static_cast<std::size_t>(y) * srcStride, src + static_cast<std::size_t>(y + 1) * srcStride };
+			u8* yRows[2] = { yPlane + static_cast<std::size_t>(y) * dstStride, yPlane + static_cast<std::size_t>(y + 1) * dstStride };
+			u8* uvRow = uvPlane + static_cast<std::size_t>(y >> 1) * dstStride;
+			u32 x = 0;
+#ifdef KVMIO_COLOR_CONVERSION_SSE2
+			// 8 pixels of both rows at once: 16 luma values and 4 CbCr pairs
+			for(; (x + 8) <= width; x += 8)
+			{
+				__m128i pixels[2][2];
+				for(u32 row = 0; row < 2; row++)
+				{
+					pixels[row][0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcRows[row] + x * 4));
+					pixels[row][1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcRows[row] + x * 4 + 16));
+					const __m128i luma = _mm_packs_epi32(LumaOf4(pixels[row][0], yCoefficients), LumaOf4(pixels[row][1], yCoefficients));
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(yRows[row] + x), _mm_packus_epi16(luma, luma));
+				}
+				const __m128i chroma = _mm_packs_epi32(ChromaOf2x4(pixels[0][0], pixels[1][0], cbCoefficients, crCoefficients),
+														ChromaOf2x4(pixels[0][1], pixels[1][1], cbCoefficients, crCoefficients));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(uvRow + x), _mm_packus_epi16(chroma, chroma));
+			}
+#endif // KVMIO_COLOR_CONVERSION_SSE2
+			for(; x < width; x += 2)
+				ConvertBGRAToNV12Block(srcRows, x, yRows, uvRow);
+		}
+	}
+}
@@ -0,0 +1,189 @@
+#include <kvmio/Cursor.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm> // for std::min, std::max, std::clamp, std::find_if
+#include <cstring> // for std::memcpy
+
+namespace kvmio
+{
+	static u64 HashBytes(u64 hash, const u8* bytes, std::size_t size)
+	{
+		for(std::size_t i = 0; i < size; i++)
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		return hash;
+	}
+
+	u64 HashCursorShape(const CursorShape& shape)
+	{
+		const u32 header[4] = { shape.width, shape.height, shape.hotspotX, shape.hotspotY };
+		u64 hash = HashBytes(0xcbf29ce484222325ull, reinterpret_cast<const u8*>(header), sizeof(header));
+		return HashBytes(hash, shape.pixels.data(), shape.pixels.size());
+	}
+
+	CursorRect CursorOverlay::State::getRect() const noexcept
+	{
+		if(!isVisible || !shape)
+			return { 0, 0, 0, 0 };
+		return { x - static_cast<s32>(shape->hotspotX), y - static_cast<s32>(shape->hotspotY), shape->width, shape->height };
+	}
+
+	CursorOverlay::CursorOverlay(u32 frameWidth, u32 frameHeight) :
+										m_frameWidth(frameWidth),
+										m_frameHeight(frameHeight),
+										m_x(0),
+										m_y(0),
+										m_isVisible(true),
+										m_version(0)
+	{
+	}
+
+	void CursorOverlay::selectCachedShape(std::size_t index)
+	{
+		// Move it to the most recently used end
+		std::shared_ptr<const Shape> shape = std::move(m_cachedShapes[index]);
+		m_cachedShapes.erase(m_cachedShapes.begin() + index);
+		m_cachedShapes.push_back(shape);
+		if(m_shape != shape)
+		{
+			m_shape = std::move(shape);
+			m_version.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	u64 CursorOverlay::setShape(const CursorShape& shape)
+	{
+		if((shape.width == 0) || (shape.height == 0) || (shape.width > MaxShapeSize) || (shape.height > MaxShapeSize)
+			|| (shape.pixels.size() < (static_cast<std::size_t>(shape.width) * shape.height * 4)))
+		{
+			spdlog::error("Invalid cursor shape of {}x{} with {} bytes, ignored", shape.width, shape.height, shape.pixels.size());
+			return 0;
+		}
+		const u64 hash = HashCursorShape(shape);
+		if(selectShape(hash))
+			return hash;
+
+		auto newShape = std::make_shared<Shape>();
+		newShape->hash = hash;
+		newShape->width = shape.width;
+		newShape->height = shape.height;
+		newShape->hotspotX = std::min(shape.hotspotX, shape.width - 1);
+		newShape->hotspotY = std::min(shape.hotspotY, shape.height - 1);
+		newShape->pixels.assign(shape.pixels.begin(), shape.pixels.begin() + static_cast<std::size_t>(shape.width) * shape.height * 4);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_cachedShapes.size() >= CacheSize)
+			m_cachedShapes.erase(m_cachedShapes.begin());
+		m_cachedShapes.push_back(std::move(newShape));
+		selectCachedShape(m_cachedShapes.size() - 1);
+		return hash;
+	}
+
+	bool CursorOverlay::selectShape(u64 hash)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = std::find_if(m_cachedShapes.begin(), m_cachedShapes.end(), [hash](const std::shared_ptr<const Shape>& shape) { return shape->hash == hash; });
+		if(it == m_cachedShapes.end())
+			return false;
+		selectCachedShape(static_cast<std::size_t>(it - m_cachedShapes.begin()));
+		return true;
+	}
+
+	void CursorOverlay::setPosition(s32 x, s32 y)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if((x == m_x) && (y == m_y))
+			return;
+		m_x = x;
+		m_y = y;
+		m_version.fetch_add(1, std::memory_order_release);
+	}
+
+	void CursorOverlay::movePosition(s32 dx, s32 dy)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		s32 x = std::clamp<s32>(m_x + dx, 0, static_cast<s32>(m_frameWidth) - 1);
+		s32 y = std::clamp<s32>(m_y + dy, 0, static_cast<s32>(m_frameHeight) - 1);
+		if((x == m_x) && (y == m_y))
+			return;
+		m_x = x;
+		m_y = y;
+		m_version.fetch_add(1, std::memory_order_release);
+	}
+
+	void CursorOverlay::setVisible(bool isVisible)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(isVisible == m_isVisible)
+			return;
+		m_isVisible = isVisible;
+		m_version.fetch_add(1, std::memory_order_release);
+	}
+
+	CursorOverlay::State CursorOverlay::getState() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return { m_version.load(std::memory_order_relaxed), m_isVisible, m_x, m_y, m_shape };
+	}
+
+	static CursorRect ClipCursorRect(const CursorRect& rect, u32 width, u32 height)
+	{
+		s32 left = std::max<s32>(rect.x, 0);
+		s32 top = std::max<s32>(rect.y, 0);
+		s32 right = std::min<s32>(rect.x + static_cast<s32>(rect.width), static_cast<s32>(width));
+		s32 bottom = std::min<s32>(rect.y + static_cast<s32>(rect.height), static_cast<s32>(height));
+		if((left >= right) || (top >= bottom))
+			return { 0, 0, 0, 0 };
+		return { left, top, static_cast<u32>(right - left), static_cast<u32>(bottom - top) };
+	}
+
+	SoftwareCursor::SoftwareCursor() : m_savedRect { 0, 0, 0, 0 }, m_drawnVersion(0)
+	{
+	}
+
+	void SoftwareCursor::invalidate()
+	{
+		m_savedRect = { 0, 0, 0, 0 };
+	}
+
+	CursorRect SoftwareCursor::restore(u8* pixels, u32 width, [[maybe_unused]] u32 height)
+	{
+		CursorRect rect = m_savedRect;
+		DEBUG_ASSERT(((rect.x + rect.width) <= width) && ((rect.y + rect.height) <= height));
+		const std::size_t rowSize = static_cast<std::size_t>(rect.width) * 4;
+		for(u32 y = 0; y < rect.height; y++)
+			std::memcpy(pixels + ((static_cast<std::size_t>(rect.y) + y) * width + rect.x) * 4, m_savedPixels.data() + y * rowSize, rowSize);
+		m_savedRect = { 0, 0, 0, 0 };
+		return rect;
+	}
+
+	CursorRect SoftwareCursor::draw(u8* pixels, u32 width, u32 height, const CursorOverlay::State& state)
+	{
+		DEBUG_ASSERT(m_savedRect.width == 0, "restore() must be called before drawing again");
+		m_drawnVersion = state.version;
+		const CursorRect shapeRect = state.getRect();
+		const CursorRect rect = ClipCursorRect(shapeRect, width, height);
+		if(rect.width == 0)
+			return rect;
+
+		const std::size_t rowSize = static_cast<std::size_t>(rect.width) * 4;
+		m_savedPixels.resize(rowSize * rect.height);
+		for(u32 y = 0; y < rect.height; y++)
+		{
+			u8* dst = pixels + ((static_cast<std::size_t>(rect.y) + y) * width + rect.x) * 4;
+			std::memcpy(m_savedPixels.data() + y * rowSize, dst, rowSize);
+			const u8* src = state.shape->pixels.data() + ((static_cast<std::size_t>(rect.y - shapeRect.y) + y) * shapeRect.width + (rect.x - shapeRect.x)) * 4;
+			for(u32 x = 0; x < rect.width; x++, src += 4, dst += 4)
+			{
+				const u32 alpha = src[3];
+				if(alpha == 0)
+					continue;
+				for(u32 c = 0; c < 3; c++)
+					dst[c] = static_cast<u8>((src[c] * alpha + dst[c] * (255 - alpha) + 127) / 255);
+			}
+		}
+		m_savedRect = rect;
+		return rect;
+	}
+}
@@ -4,6 +4,13 @@
 #	include <strsafe.h>
 #endif // PLATFORM_WINDOWS
 
+#ifdef PLATFORM_LINUX
+#	include <spdlog/spdlog.h>
+#	include <cerrno>
+#	include <cstring>
+#	include <cstdlib>
+#endif // PLATFORM_LINUX
+
 namespace kvmio
 {
 
@@ -45,7 +52,8 @@ KVMIO_API void __Internal_ErrorExit(LPTSTR lpszFunction, u32 lineNumber, const c
 #ifdef PLATFORM_LINUX
 KVMIO_API void __Internal_ErrorExit(const char* errorFunctionName, u32 lineNumber, const char* functionName, const char* fileName)
 {
-    debug_log("Error: ", lineNumber, lineNumber, functioName, fileName, "error occured in the function: %s", errorFunctionName);
+    int error = errno;
+    spdlog::critical("{} failed with error {}: {}, at {}, {}, {}", errorFunctionName, error, std::strerror(error), lineNumber, functionName, fileName);
     exit(-1);
 }
 #endif // Linux
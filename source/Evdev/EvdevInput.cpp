@@ -0,0 +1,368 @@
+#include <kvmio/Evdev/EvdevInput.hpp>
+#include <kvmio/KeyCodeTables.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm> // for std::clamp, std::sort
+#include <filesystem>
+#include <iterator> // for std::size
+#include <ctime> // for CLOCK_MONOTONIC
+#include <cerrno> // for errno
+#include <cstring> // for std::strerror
+
+// Number of input_event values read at once, a SYN_REPORT packet of a mouse is 3 to 6 of them
+#define EVDEV_INPUT_READ_BATCH_SIZE 128
+#define EVDEV_INPUT_MAX_EPOLL_EVENTS 16
+
+// The key code tables are platform-neutral and list the evdev codes by value
+static_assert((kvmio::GetKeyCodeFromEvdev(KEY_ESC).makeCode == 0x01) && (kvmio::GetKeyCodeFromEvdev(KEY_KPENTER).prefix == 0xE0)
+	&& (kvmio::GetKeyCodeFromEvdev(KEY_PAUSE).prefix == 0xE1) && (kvmio::GetKeyCodeFromEvdev(KEY_RIGHTMETA).virtualKey == 0x5C)
+	&& (kvmio::GetKeyCodeFromEvdev(KEY_STOPCD).virtualKey == 0xB2) && (kvmio::GetKeyCodeFromEvdev(KEY_F24).virtualKey == 0x87));
+
+namespace kvmio::Evdev
+{
+	template<typename T, std::size_t N>
+	static bool TestBit(const T (&bits)[N], u32 bit)
+	{
+		constexpr u32 bitsPerElement = sizeof(T) * 8;
+		return ((bit / bitsPerElement) < N) && ((bits[bit / bitsPerElement] >> (bit % bitsPerElement)) & 1);
+	}
+
+	static DeviceInfo QueryDevice(s32 fd, std::string path)
+	{
+		DeviceInfo info { std::move(path), { }, false, false };
+		char name[256] = { };
+		if(ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) >= 0)
+			info.name = name;
+		unsigned long keyBits[(KEY_MAX + 1) / (sizeof(unsigned long) * 8) + 1] = { };
+		unsigned long relBits[(REL_MAX + 1) / (sizeof(unsigned long) * 8) + 1] = { };
+		ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits);
+		ioctl(fd, EVIOCGBIT(EV_REL, sizeof(relBits)), relBits);
+		info.isKeyboard = TestBit(keyBits, KEY_A) && TestBit(keyBits, KEY_Z);
+		info.isMouse = TestBit(relBits, REL_X) && TestBit(relBits, REL_Y);
+		return info;
+	}
+
+	KVMIO_API std::vector<DeviceInfo> EnumerateDevices()
+	{
+		std::vector<DeviceInfo> devices;
+		std::error_code error;
+		for(const auto& entry : std::filesystem::directory_iterator("/dev/input", error))
+		{
+			std::string path = entry.path().string();
+			if(entry.path().filename().string().rfind("event", 0) != 0)
+				continue;
+			s32 fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+			if(fd < 0)
+			{
+				spdlog::warn("Unable to open {}: {}", path, std::strerror(errno));
+				continue;
+			}
+			devices.push_back(QueryDevice(fd, std::move(path)));
+			close(fd);
+		}
+		std::sort(devices.begin(), devices.end(), [](const DeviceInfo& a, const DeviceInfo& b) { return a.path < b.path; });
+		return devices;
+	}
+
+	KVMIO_API void DisplayDeviceList()
+	{
+		auto devices = EnumerateDevices();
+		spdlog::info("Evdev Device Count: {}", devices.size());
+		for(const DeviceInfo& device : devices)
+		{
+			spdlog::info("\tDevice Path: {}\n"
+						   "\t\tName: {}, Keyboard: {}, Mouse: {}", device.path, device.name, device.isKeyboard, device.isMouse);
+		}
+	}
+
+	EvdevInput::EvdevInput() : m_inputEventRing(nullptr)
+	{
+		m_epoll = epoll_create1(EPOLL_CLOEXEC);
+		if(m_epoll < 0)
+			kvmio_Internal_ErrorExit("epoll_create1");
+		m_wakeUpEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(m_wakeUpEvent < 0)
+			kvmio_Internal_ErrorExit("eventfd");
+		epoll_event event { };
+		event.events = EPOLLIN;
+		event.data.u32 = static_cast<u32>(-1);
+		if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeUpEvent, &event) < 0)
+			kvmio_Internal_ErrorExit("epoll_ctl");
+	}
+
+	EvdevInput::~EvdevInput()
+	{
+		for(u32 i = 0; i < m_devices.size(); i++)
+			closeDevice(i);
+		close(m_wakeUpEvent);
+		close(m_epoll);
+	}
+
+	u32 EvdevInput::addDevice(std::string_view path, bool isGrab)
+	{
+		std::string pathStr { path };
+		s32 fd = open(pathStr.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if(fd < 0)
+		{
+			spdlog::error("Unable to open {}: {}", pathStr, std::strerror(errno));
+			return static_cast<u32>(-1);
+		}
+		// The timestamps are compared with the rest of the pipeline's, which are steady_clock (i.e. CLOCK_MONOTONIC) ones
+		s32 clockId = CLOCK_MONOTONIC;
+		if(ioctl(fd, EVIOCSCLOCKID, &clockId) < 0)
+			spdlog::warn("Unable to set the clock of {} to CLOCK_MONOTONIC, its timestamps are CLOCK_REALTIME ones", pathStr);
+		if(isGrab && (ioctl(fd, EVIOCGRAB, 1) < 0))
+		{
+			spdlog::error("Unable to grab {}: {}", pathStr, std::strerror(errno));
+			close(fd);
+			return static_cast<u32>(-1);
+		}
+
+		u32 index = static_cast<u32>(m_devices.size());
+		epoll_event event { };
+		event.events = EPOLLIN;
+		event.data.u32 = index;
+		if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+			kvmio_Internal_ErrorExit("epoll_ctl");
+
+		Device device { };
+		device.fd = fd;
+		device.path = std::move(pathStr);
+		device.isGrabbed = isGrab;
+		m_devices.push_back(std::move(device));
+		spdlog::info("Evdev device {} opened as {}{}", m_devices.back().path, index, isGrab ? ", grabbed" : "");
+		return index;
+	}
+
+	void EvdevInput::closeDevice(u32 index)
+	{
+		Device& device = m_devices[index];
+		if(device.fd < 0)
+			return;
+		epoll_ctl(m_epoll, EPOLL_CTL_DEL, device.fd, NULL);
+		if(device.isGrabbed)
+			ioctl(device.fd, EVIOCGRAB, 0);
+		close(device.fd);
+		device.fd = -1;
+	}
+
+	void EvdevInput::wakeUp()
+	{
+		u64 value = 1;
+		[[maybe_unused]] auto result = write(m_wakeUpEvent, &value, sizeof(value));
+	}
+
+	void EvdevInput::pollEvents(u32 timeout)
+	{
+		epoll_event events[EVDEV_INPUT_MAX_EPOLL_EVENTS];
+		s32 count = epoll_wait(m_epoll, events, EVDEV_INPUT_MAX_EPOLL_EVENTS, (timeout == static_cast<u32>(-1)) ? -1 : static_cast<s32>(timeout));
+		if(count < 0)
+		{
+			if(errno != EINTR)
+				kvmio_Internal_ErrorExit("epoll_wait");
+			return;
+		}
+		for(s32 i = 0; i < count; i++)
+		{
+			u32 index = events[i].data.u32;
+			if(index == static_cast<u32>(-1))
+			{
+				u64 value;
+				[[maybe_unused]] auto result = read(m_wakeUpEvent, &value, sizeof(value));
+				continue;
+			}
+			if(!readDevice(index))
+			{
+				spdlog::warn("Evdev device {} ({}) is gone", index, m_devices[index].path);
+				closeDevice(index);
+			}
+		}
+	}
+
+	static u64 GetTimestamp(const input_event& event)
+	{
+		return static_cast<u64>(event.input_event_sec) * 1000000 + static_cast<u64>(event.input_event_usec);
+	}
+
+	// Each button of Win32::MouseInput is an unnamed struct of its own
+	template<typename Button>
+	static void SetButton(Win32::MouseInput& input, Button& button, s32 value)
+	{
+		input.isAnyButton = true;
+		button.isTransition = true;
+		button.status = (value != 0) ? Win32::KeyStatus::Pressed : Win32::KeyStatus::Released;
+	}
+
+	template<std::size_t N>
+	static void SetBit(unsigned long (&bits)[N], u32 bit, bool isSet)
+	{
+		constexpr u32 bitsPerElement = sizeof(unsigned long) * 8;
+		const unsigned long mask = 1UL << (bit % bitsPerElement);
+		if(isSet)
+			bits[bit / bitsPerElement] |= mask;
+		else
+			bits[bit / bitsPerElement] &= ~mask;
+	}
+
+	void EvdevInput::publishKey(u32 index, u16 code, s32 value, u64 timestamp)
+	{
+		Device& device = m_devices[index];
+		const KeyCode& mapping = GetKeyCodeFromEvdev(code);
+		if(mapping.virtualKey == 0)
+			return;
+		if((code == KEY_LEFTALT) || (code == KEY_RIGHTALT))
+			device.isAltPressed = (value != 0);
+
+		Win32::KeyboardInput input = { };
+		input.makeCode = mapping.makeCode;
+		input.virtualKey = mapping.virtualKey;
+		// Auto repeats (value 2) are make codes as well, as Raw Input reports them
+		input.keyStatus = (value != 0) ? Win32::KeyStatus::Pressed : Win32::KeyStatus::Released;
+		input.isExtended0 = mapping.prefix == 0xE0;
+		input.isExtended1 = mapping.prefix == 0xE1;
+		// WM_SYSKEYDOWN
+		input.isAltorF10 = (value != 0) && (device.isAltPressed || (code == KEY_F10));
+		// The same layout as DecodeRawKeyboardInput()
+		if(input.isExtended0)
+			input.makeCode |= (static_cast<u32>(0xE0) << 8);
+		else if(input.isExtended1)
+			input.makeCode |= (static_cast<u32>(0xE0) << 16);
+		if(m_inputEventRing != nullptr)
+			m_inputEventRing->pushKeyboard(input, timestamp);
+		m_keyboardEvent.publish({ input, timestamp, index });
+	}
+
+	void EvdevInput::syncKeys(u32 index, u64 timestamp)
+	{
+		Device& device = m_devices[index];
+		unsigned long keyState[(KEY_MAX + 1) / (sizeof(unsigned long) * 8) + 1] = { };
+		if(ioctl(device.fd, EVIOCGKEY(sizeof(keyState)), keyState) < 0)
+		{
+			spdlog::warn("Unable to get the key state of {}: {}", device.path, std::strerror(errno));
+			return;
+		}
+		// A key pressed during the drop and still held comes with its next auto repeat, only the releases are missing
+		Win32::MouseInput mouseInput = { };
+		constexpr u32 bitsPerElement = sizeof(unsigned long) * 8;
+		for(u32 i = 0; i < std::size(keyState); ++i)
+		{
+			unsigned long released = device.heldKeys[i] & ~keyState[i];
+			device.heldKeys[i] &= keyState[i];
+			for(u32 bit = 0; released != 0; ++bit, released >>= 1)
+			{
+				if((released & 1) == 0)
+					continue;
+				const u16 code = static_cast<u16>(i * bitsPerElement + bit);
+				switch(code)
+				{
+					case BTN_LEFT: SetButton(mouseInput, mouseInput.leftButton, 0); break;
+					case BTN_RIGHT: SetButton(mouseInput, mouseInput.rightButton, 0); break;
+					case BTN_MIDDLE: SetButton(mouseInput, mouseInput.middleButton, 0); break;
+					case BTN_SIDE: SetButton(mouseInput, mouseInput.browseForwardButton, 0); break;
+					case BTN_EXTRA: SetButton(mouseInput, mouseInput.browseBackwardButton, 0); break;
+					default: publishKey(index, code, 0, timestamp); break;
+				}
+			}
+		}
+		if(mouseInput.isAnyButton)
+		{
+			if(m_inputEventRing != nullptr)
+				m_inputEventRing->pushMouse(mouseInput, timestamp);
+			m_mouseEvent.publish({ mouseInput, timestamp, index });
+		}
+	}
+
+	bool EvdevInput::readDevice(u32 index)
+	{
+		Device& device = m_devices[index];
+		input_event events[EVDEV_INPUT_READ_BATCH_SIZE];
+		while(true)
+		{
+			ssize_t size = read(device.fd, events, sizeof(events));
+			if(size < 0)
+			{
+				if((errno == EAGAIN) || (errno == EINTR))
+					return true;
+				return false;
+			}
+			const std::size_t count = static_cast<std::size_t>(size) / sizeof(input_event);
+			for(std::size_t i = 0; i < count; i++)
+			{
+				const input_event& event = events[i];
+				if(event.type == EV_SYN)
+				{
+					if(event.code == SYN_DROPPED)
+					{
+						// The rest of the packet is lost, so is its pointer motion
+						device.isDropping = true;
+						device.isMousePending = false;
+						device.pendingMouseInput = { };
+					}
+					else if(event.code == SYN_REPORT)
+					{
+						const u64 timestamp = GetTimestamp(event);
+						if(device.isDropping)
+							syncKeys(index, timestamp);
+						else if(device.isMousePending)
+						{
+							if(m_inputEventRing != nullptr)
+								m_inputEventRing->pushMouse(device.pendingMouseInput, timestamp);
+							m_mouseEvent.publish({ device.pendingMouseInput, timestamp, index });
+						}
+						device.isDropping = false;
+						device.isMousePending = false;
+						device.pendingMouseInput = { };
+					}
+					continue;
+				}
+				if(device.isDropping)
+					continue;
+
+				Win32::MouseInput& mouseInput = device.pendingMouseInput;
+				if(event.type == EV_REL)
+				{
+					switch(event.code)
+					{
+						case REL_X: mouseInput.movement.x = static_cast<s16>(std::clamp<s32>(mouseInput.movement.x + event.value, INT16_MIN, INT16_MAX)); break;
+						case REL_Y: mouseInput.movement.y = static_cast<s16>(std::clamp<s32>(mouseInput.movement.y + event.value, INT16_MIN, INT16_MAX)); break;
+						// The vertical wheel is isWheelX/wheel.x in the Raw Input model (RI_MOUSE_WHEEL), in notches
+						case REL_WHEEL: mouseInput.isWheelX = true; mouseInput.wheel.x = static_cast<s16>(mouseInput.wheel.x + event.value); break;
+						case REL_HWHEEL: mouseInput.isWheelY = true; mouseInput.wheel.y = static_cast<s16>(mouseInput.wheel.y + event.value); break;
+						// The high resolution wheel events duplicate REL_WHEEL/REL_HWHEEL
+						default: continue;
+					}
+					mouseInput.isMoveRelative = true;
+					device.isMousePending = true;
+				}
+				else if(event.type == EV_KEY)
+				{
+					SetBit(device.heldKeys, event.code, event.value != 0);
+					switch(event.code)
+					{
+						case BTN_LEFT: SetButton(mouseInput, mouseInput.leftButton, event.value); device.isMousePending = true; continue;
+						case BTN_RIGHT: SetButton(mouseInput, mouseInput.rightButton, event.value); device.isMousePending = true; continue;
+						case BTN_MIDDLE: SetButton(mouseInput, mouseInput.middleButton, event.value); device.isMousePending = true; continue;
+						// Buttons 4 and 5, as RI_MOUSE_BUTTON_4/5 are decoded
+						case BTN_SIDE: SetButton(mouseInput, mouseInput.browseForwardButton, event.value); device.isMousePending = true; continue;
+						case BTN_EXTRA: SetButton(mouseInput, mouseInput.browseBackwardButton, event.value); device.isMousePending = true; continue;
+						default: break;
+					}
+					publishKey(index, event.code, event.value, GetTimestamp(event));
+				}
+			}
+			// A short read means the kernel's buffer has been drained, there is no need for another read() to see EAGAIN
+			if(count < EVDEV_INPUT_READ_BATCH_SIZE)
+				return true;
+		}
+	}
+}
@@ -0,0 +1,221 @@
+#include <kvmio/Evdev/UinputSink.hpp>
+#include <kvmio/KeyCodeTables.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm> // for std::clamp, std::min
+#include <utility> // for std::pair<>
+#include <cerrno> // for errno
+#include <cstring> // for std::strerror
+
+// Enough for a frame of input without reallocating, an input is at most 8 events with its SYN_REPORT
+#define UINPUT_SINK_RESERVED_EVENT_COUNT 256
+
+namespace kvmio::Evdev
+{
+	UinputSink::UinputSink(std::string_view name, bool isAbsolute, u32 width, u32 height) :
+											m_isAbsolute(isAbsolute),
+											m_width(width),
+											m_height(height),
+											m_x(0),
+											m_y(0),
+											m_isPositionKnown(false)
+	{
+		m_fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if(m_fd < 0)
+			kvmio_Internal_ErrorExit("open /dev/uinput");
+
+		ioctl(m_fd, UI_SET_EVBIT, EV_SYN);
+		ioctl(m_fd, UI_SET_EVBIT, EV_KEY);
+		for(const KeyCode& key : GetKeyCodes())
+			ioctl(m_fd, UI_SET_KEYBIT, key.evdevCode);
+		for(u16 button : { BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, BTN_SIDE, BTN_EXTRA })
+			ioctl(m_fd, UI_SET_KEYBIT, button);
+
+		// The wheels are relative in both modes
+		ioctl(m_fd, UI_SET_EVBIT, EV_REL);
+		ioctl(m_fd, UI_SET_RELBIT, REL_WHEEL);
+		ioctl(m_fd, UI_SET_RELBIT, REL_HWHEEL);
+		if(isAbsolute)
+		{
+			ioctl(m_fd, UI_SET_EVBIT, EV_ABS);
+			for(auto [code, size] : { std::pair<u16, u32> { ABS_X, width }, std::pair<u16, u32> { ABS_Y, height } })
+			{
+				uinput_abs_setup absSetup { };
+				absSetup.code = code;
+				absSetup.absinfo.minimum = 0;
+				absSetup.absinfo.maximum = static_cast<s32>(size) - 1;
+				if(ioctl(m_fd, UI_ABS_SETUP, &absSetup) < 0)
+					kvmio_Internal_ErrorExit("ioctl UI_ABS_SETUP");
+			}
+		}
+		else
+		{
+			ioctl(m_fd, UI_SET_RELBIT, REL_X);
+			ioctl(m_fd, UI_SET_RELBIT, REL_Y);
+		}
+
+		uinput_setup setup { };
+		setup.id.bustype = BUS_VIRTUAL;
+		setup.id.version = 1;
+		std::memcpy(setup.name, name.data(), std::min(name.size(), sizeof(setup.name) - 1));
+		if(ioctl(m_fd, UI_DEV_SETUP, &setup) < 0)
+			kvmio_Internal_ErrorExit("ioctl UI_DEV_SETUP");
+		if(ioctl(m_fd, UI_DEV_CREATE) < 0)
+			kvmio_Internal_ErrorExit("ioctl UI_DEV_CREATE");
+		m_events.reserve(UINPUT_SINK_RESERVED_EVENT_COUNT);
+		spdlog::info("Uinput device \"{}\" created, {} pointer", name, isAbsolute ? "absolute" : "relative");
+	}
+
+	UinputSink::~UinputSink()
+	{
+		releaseAll();
+		flush();
+		ioctl(m_fd, UI_DEV_DESTROY);
+		close(m_fd);
+	}
+
+	void UinputSink::push(u16 type, u16 code, s32 value)
+	{
+		// The kernel stamps the events as they are written
+		input_event event { };
+		event.type = type;
+		event.code = code;
+		event.value = value;
+		m_events.push_back(event);
+	}
+
+	void UinputSink::keyboard(const Win32::KeyboardInput& input)
+	{
+		const KeyCode& key = GetKeyCodeFromMakeCode(input.makeCode, input.isExtended0, input.isExtended1);
+		if(key.evdevCode == 0)
+		{
+			spdlog::debug("No evdev key for the make code {:#x}, ignored", input.makeCode);
+			return;
+		}
+		const bool isPressed = input.keyStatus == Win32::KeyStatus::Pressed;
+		// Repeats of a held key are reported as such, the desktop's own auto repeat is driven by the first press
+		push(EV_KEY, key.evdevCode, isPressed ? (m_pressedKeys.test(key.evdevCode) ? 2 : 1) : 0);
+		push(EV_SYN, SYN_REPORT, 0);
+		m_pressedKeys.set(key.evdevCode, isPressed);
+	}
+
+	void UinputSink::pushButton(u16 code, bool isTransition, Win32::KeyStatus status)
+	{
+		if(!isTransition)
+			return;
+		const bool isPressed = status == Win32::KeyStatus::Pressed;
+		push(EV_KEY, code, isPressed ? 1 : 0);
+		m_pressedKeys.set(code, isPressed);
+	}
+
+	static s32 ScaleAbsolute(s16 coordinate, u32 size)
+	{
+		// 0 to 65535 across the desktop as Raw Input reports it, the s16 movement holds the same 16 bits
+		return static_cast<s32>(static_cast<u64>(static_cast<u16>(coordinate)) * (size - 1) / 65535);
+	}
+
+	void UinputSink::mouse(const Win32::MouseInput& input)
+	{
+		const std::size_t eventCount = m_events.size();
+		if(m_isAbsolute)
+		{
+			if(input.isMoveAbsolute)
+				pushPosition(ScaleAbsolute(input.movement.x, m_width), ScaleAbsolute(input.movement.y, m_height));
+			else if((input.movement.x != 0) || (input.movement.y != 0))
+				pushPosition(m_x + input.movement.x, m_y + input.movement.y);
+		}
+		else if(input.isMoveAbsolute)
+		{
+			// Moved by the difference with the previous position, the first one only tells where the pointer is
+			const s32 x = ScaleAbsolute(input.movement.x, m_width);
+			const s32 y = ScaleAbsolute(input.movement.y, m_height);
+			if(m_isPositionKnown && (x != m_x))
+				push(EV_REL, REL_X, x - m_x);
+			if(m_isPositionKnown && (y != m_y))
+				push(EV_REL, REL_Y, y - m_y);
+			m_x = x;
+			m_y = y;
+			m_isPositionKnown = true;
+		}
+		else
+		{
+			if(input.movement.x != 0)
+				push(EV_REL, REL_X, input.movement.x);
+			if(input.movement.y != 0)
+				push(EV_REL, REL_Y, input.movement.y);
+		}
+		// The vertical wheel is isWheelX/wheel.x in the Raw Input model
+		if(input.isWheelX && (input.wheel.x != 0))
+			push(EV_REL, REL_WHEEL, input.wheel.x);
+		if(input.isWheelY && (input.wheel.y != 0))
+			push(EV_REL, REL_HWHEEL, input.wheel.y);
+		if(input.isAnyButton)
+		{
+			pushButton(BTN_LEFT, input.leftButton.isTransition, input.leftButton.status);
+			pushButton(BTN_RIGHT, input.rightButton.isTransition, input.rightButton.status);
+			pushButton(BTN_MIDDLE, input.middleButton.isTransition, input.middleButton.status);
+			pushButton(BTN_SIDE, input.browseForwardButton.isTransition, input.browseForwardButton.status);
+			pushButton(BTN_EXTRA, input.browseBackwardButton.isTransition, input.browseBackwardButton.status);
+		}
+		// Nothing to report for an empty input, not even a SYN_REPORT
+		if(m_events.size() != eventCount)
+			push(EV_SYN, SYN_REPORT, 0);
+	}
+
+	void UinputSink::moveTo(s32 x, s32 y)
+	{
+		DEBUG_ASSERT(m_isAbsolute, "moveTo() is for the absolute mode only");
+		const std::size_t eventCount = m_events.size();
+		pushPosition(x, y);
+		if(m_events.size() != eventCount)
+			push(EV_SYN, SYN_REPORT, 0);
+	}
+
+	void UinputSink::pushPosition(s32 x, s32 y)
+	{
+		x = std::clamp<s32>(x, 0, static_cast<s32>(m_width) - 1);
+		y = std::clamp<s32>(y, 0, static_cast<s32>(m_height) - 1);
+		// The kernel drops unchanged absolute values anyway
+		if(x != m_x)
+			push(EV_ABS, ABS_X, x);
+		if(y != m_y)
+			push(EV_ABS, ABS_Y, y);
+		m_x = x;
+		m_y = y;
+	}
+
+	void UinputSink::releaseAll()
+	{
+		if(m_pressedKeys.none())
+			return;
+		for(std::size_t code = 0; code < m_pressedKeys.size(); code++)
+		{
+			if(m_pressedKeys.test(code))
+				push(EV_KEY, static_cast<u16>(code), 0);
+		}
+		push(EV_SYN, SYN_REPORT, 0);
+		m_pressedKeys.reset();
+	}
+
+	void UinputSink::flush()
+	{
+		if(m_events.empty())
+			return;
+		DEBUG_ASSERT((m_events.back().type == EV_SYN) && (m_events.back().code == SYN_REPORT));
+		const std::size_t size = m_events.size() * sizeof(input_event);
+		ssize_t result = write(m_fd, m_events.data(), size);
+		if(result < 0)
+			spdlog::error("Unable to write {} events to the uinput device: {}", m_events.size(), std::strerror(errno));
+		else if(static_cast<std::size_t>(result) != size)
+			spdlog::error("Only {} of {} bytes written to the uinput device", result, size);
+		m_events.clear();
+	}
+}
@@ -0,0 +1,70 @@
+#include <kvmio/FrameTimings.hpp>
+
+#include <algorithm> // for std::min, std::nth_element, std::copy
+
+namespace kvmio
+{
+	Percentiles GetPercentiles(std::span<f64> samples)
+	{
+		if(samples.empty())
+			return { -1.0, -1.0 };
+		auto percentile = [&samples](u32 p) -> f64
+		{
+			const std::size_t index = std::min<std::size_t>((samples.size() * p) / 100, samples.size() - 1);
+			std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+			return samples[index];
+		};
+		Percentiles percentiles;
+		percentiles.p50 = percentile(50);
+		percentiles.p99 = percentile(99);
+		return percentiles;
+	}
+
+	void FrameTimingRecorder::SampleWindow::add(f64 sample)
+	{
+		if(sample < 0)
+			return;
+		m_samples[m_head] = sample;
+		m_head = (m_head + 1) % WindowSize;
+		if(m_count < WindowSize)
+			++m_count;
+	}
+
+	Percentiles FrameTimingRecorder::SampleWindow::getPercentiles() const
+	{
+		// The samples aren't ordered by time anymore once the ring wraps around, but that doesn't matter for the percentiles
+		std::array<f64, WindowSize> sorted;
+		std::copy(m_samples.begin(), m_samples.begin() + m_count, sorted.begin());
+		return GetPercentiles({ sorted.data(), m_count });
+	}
+
+	void FrameTimingRecorder::record(const FrameTimings& timings)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_frameCount;
+		m_acquire.add(timings.acquire);
+		m_copy.add(timings.copy);
+		m_submit.add(timings.submit);
+		m_present.add(timings.present);
+		m_gpuBarrier.add(timings.gpuBarrier);
+		m_gpuUpload.add(timings.gpuUpload);
+		m_gpuDraw.add(timings.gpuDraw);
+		m_display.add(timings.display);
+	}
+
+	FrameTimingStatistics FrameTimingRecorder::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		FrameTimingStatistics statistics;
+		statistics.frameCount = m_frameCount;
+		statistics.acquire = m_acquire.getPercentiles();
+		statistics.copy = m_copy.getPercentiles();
+		statistics.submit = m_submit.getPercentiles();
+		statistics.present = m_present.getPercentiles();
+		statistics.gpuBarrier = m_gpuBarrier.getPercentiles();
+		statistics.gpuUpload = m_gpuUpload.getPercentiles();
+		statistics.gpuDraw = m_gpuDraw.getPercentiles();
+		statistics.display = m_display.getPercentiles();
+		return statistics;
+	}
+}
@@ -0,0 +1,316 @@
+#include <kvmio/Hid/HidBroadcast.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm> // for std::min, std::fill
+#include <cerrno> // for errno
+#include <cstring> // for std::strerror
+
+#define HID_BROADCAST_MAX_EPOLL_EVENTS 64
+// Input events drained from the ring at once
+#define HID_BROADCAST_INPUT_BATCH_SIZE 256
+#define HID_BROADCAST_WAKE_UP static_cast<u64>(-1)
+
+namespace kvmio::Hid
+{
+	static void InitializeLog(std::vector<HidReport>& reports, u64& mask, u64& head, u32 capacity)
+	{
+		u32 size = 1;
+		while(size < capacity)
+			size <<= 1;
+		reports.resize(size);
+		mask = size - 1;
+		head = 0;
+	}
+
+	HidBroadcast::HidBroadcast(HidKeyboardMode keyboardMode, HidMouseMode mouseMode, u32 logCapacity, u32 inputCapacity) :
+															m_isWakeUpPending(false),
+															m_isRunning(true),
+															m_inputEventRing(inputCapacity),
+															m_encoder(keyboardMode, mouseMode)
+	{
+		InitializeLog(m_keyboardLog.reports, m_keyboardLog.mask, m_keyboardLog.head, logCapacity);
+		InitializeLog(m_mouseLog.reports, m_mouseLog.mask, m_mouseLog.head, logCapacity);
+		m_inputEvents.resize(HID_BROADCAST_INPUT_BATCH_SIZE);
+		m_reports.reserve(HID_BROADCAST_INPUT_BATCH_SIZE);
+
+		m_epoll = epoll_create1(EPOLL_CLOEXEC);
+		if(m_epoll < 0)
+			kvmio_Internal_ErrorExit("epoll_create1");
+		m_wakeUpEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(m_wakeUpEvent < 0)
+			kvmio_Internal_ErrorExit("eventfd");
+		epoll_event event { };
+		event.events = EPOLLIN;
+		event.data.u64 = HID_BROADCAST_WAKE_UP;
+		if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeUpEvent, &event) < 0)
+			kvmio_Internal_ErrorExit("epoll_ctl");
+
+		m_thread = std::thread(&HidBroadcast::run, this);
+	}
+
+	HidBroadcast::~HidBroadcast()
+	{
+		m_isRunning.store(false);
+		u64 value = 1;
+		[[maybe_unused]] auto result = write(m_wakeUpEvent, &value, sizeof(value));
+		m_thread.join();
+
+		// What is still in the ring goes out first, then the releases
+		forward();
+		m_encoder.releaseAll();
+		forward();
+		for(TargetId id = 0; id < m_targets.size(); ++id)
+			closeTarget(id);
+		close(m_wakeUpEvent);
+		close(m_epoll);
+	}
+
+	void HidBroadcast::wakeUp()
+	{
+		// Cleared by the forwarding thread before it drains the ring, so an input pushed after the drain wakes it up again
+		if(m_isWakeUpPending.exchange(true))
+			return;
+		u64 value = 1;
+		[[maybe_unused]] auto result = write(m_wakeUpEvent, &value, sizeof(value));
+	}
+
+	void HidBroadcast::keyboard(const Win32::KeyboardInput& input)
+	{
+		m_inputEventRing.pushKeyboard(input, GetInputTimestamp());
+		wakeUp();
+	}
+
+	void HidBroadcast::mouse(const Win32::MouseInput& input)
+	{
+		m_inputEventRing.pushMouse(input, GetInputTimestamp());
+		wakeUp();
+	}
+
+	HidBroadcast::TargetId HidBroadcast::addTarget(std::string_view name, s32 keyboardFd, s32 mouseFd)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const TargetId id = static_cast<TargetId>(m_targets.size());
+		// Starts at the latest report, which is the current state in full for a keyboard and has its buttons sent alone for a mouse
+		auto makeEndpoint = [this, id](s32 fd, const ReportLog& log, bool isMouse) -> Endpoint
+		{
+			Endpoint endpoint { };
+			endpoint.fd = fd;
+			endpoint.cursor = (log.head > 0) ? (log.head - 1) : 0;
+			endpoint.isWritable = true;
+			endpoint.isStateOnly = isMouse && (log.head > 0);
+			if(fd < 0)
+				return endpoint;
+			struct stat status;
+			endpoint.isSocket = (fstat(fd, &status) == 0) && S_ISSOCK(status.st_mode);
+			if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+				kvmio_Internal_ErrorExit("fcntl");
+			// Edge-triggered, an event only comes after a write() would have blocked
+			epoll_event event { };
+			event.events = EPOLLOUT | EPOLLET;
+			event.data.u64 = (static_cast<u64>(id) << 1) | (isMouse ? 1 : 0);
+			if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+				kvmio_Internal_ErrorExit("epoll_ctl");
+			return endpoint;
+		};
+
+		Target target { };
+		target.name = name;
+		target.keyboard = makeEndpoint(keyboardFd, m_keyboardLog, false);
+		target.mouse = makeEndpoint(mouseFd, m_mouseLog, true);
+		target.isConnected = true;
+		m_targets.push_back(std::move(target));
+		spdlog::info("HID target {} added as {}", m_targets.back().name, id);
+		// Gets the current state right away
+		u64 value = 1;
+		[[maybe_unused]] auto result = write(m_wakeUpEvent, &value, sizeof(value));
+		return id;
+	}
+
+	HidBroadcast::TargetId HidBroadcast::addGadgetTarget(std::string_view keyboardPath, std::string_view mousePath)
+	{
+		std::string keyboardPathStr { keyboardPath };
+		std::string mousePathStr { mousePath };
+		s32 keyboardFd = open(keyboardPathStr.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if(keyboardFd < 0)
+		{
+			spdlog::error("Unable to open {}: {}", keyboardPathStr, std::strerror(errno));
+			return InvalidTarget;
+		}
+		s32 mouseFd = open(mousePathStr.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if(mouseFd < 0)
+		{
+			spdlog::error("Unable to open {}: {}", mousePathStr, std::strerror(errno));
+			close(keyboardFd);
+			return InvalidTarget;
+		}
+		return addTarget(keyboardPathStr, keyboardFd, mouseFd);
+	}
+
+	void HidBroadcast::closeTarget(TargetId id)
+	{
+		Target& target = m_targets[id];
+		for(Endpoint* endpoint : { &target.keyboard, &target.mouse })
+		{
+			if(endpoint->fd < 0)
+				continue;
+			epoll_ctl(m_epoll, EPOLL_CTL_DEL, endpoint->fd, NULL);
+			close(endpoint->fd);
+			endpoint->fd = -1;
+		}
+		target.isConnected = false;
+	}
+
+	void HidBroadcast::removeTarget(TargetId id)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if((id >= m_targets.size()) || m_targets[id].isRemoved)
+		{
+			spdlog::warn("Removing an unknown HID target {}", id);
+			return;
+		}
+		closeTarget(id);
+		m_targets[id].isRemoved = true;
+		spdlog::info("HID target {} ({}) removed", id, m_targets[id].name);
+	}
+
+	std::vector<HidTargetStatistics> HidBroadcast::getStatistics()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto getPendingCount = [](const Endpoint& endpoint, const ReportLog& log) -> u32
+		{
+			if(endpoint.fd < 0)
+				return 0;
+			return static_cast<u32>(std::min<u64>(log.head - endpoint.cursor, log.reports.size()));
+		};
+		std::vector<HidTargetStatistics> statistics;
+		for(const Target& target : m_targets)
+		{
+			if(target.isRemoved)
+				continue;
+			statistics.push_back({ target.name, target.reportCount,
+									getPendingCount(target.keyboard, m_keyboardLog) + getPendingCount(target.mouse, m_mouseLog),
+									target.overflowCount, target.isConnected });
+		}
+		return statistics;
+	}
+
+	void HidBroadcast::append(const HidReport& report)
+	{
+		ReportLog& log = (report.type == HidReportType::Keyboard) ? m_keyboardLog : m_mouseLog;
+		log.reports[log.head & log.mask] = report;
+		++log.head;
+	}
+
+	bool HidBroadcast::writeEndpoint(Target& target, Endpoint& endpoint, const ReportLog& log, bool isMouse)
+	{
+		if((endpoint.fd < 0) || !endpoint.isWritable)
+			return true;
+		// The reports from the cursor on have been overwritten
+		if((log.head - endpoint.cursor) > log.reports.size())
+		{
+			++target.overflowCount;
+			endpoint.cursor = log.head - 1;
+			endpoint.isStateOnly = isMouse;
+		}
+		while(endpoint.cursor != log.head)
+		{
+			HidReport report = log.reports[endpoint.cursor & log.mask];
+			if(endpoint.isStateOnly)
+				std::fill(report.data.begin() + 1, report.data.begin() + report.size, 0);
+			ssize_t result = endpoint.isSocket ? send(endpoint.fd, report.data.data(), report.size, MSG_NOSIGNAL)
+												: write(endpoint.fd, report.data.data(), report.size);
+			if(result < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				{
+					endpoint.isWritable = false;
+					return true;
+				}
+				return false;
+			}
+			endpoint.isStateOnly = false;
+			++endpoint.cursor;
+			++target.reportCount;
+		}
+		return true;
+	}
+
+	void HidBroadcast::forward()
+	{
+		// Encoded once, whatever the number of targets
+		m_isWakeUpPending.store(false);
+		m_reports.clear();
+		u32 count;
+		while((count = m_inputEventRing.drain(m_inputEvents, true)) > 0)
+		{
+			for(u32 i = 0; i < count; ++i)
+			{
+				const InputEvent& event = m_inputEvents[i];
+				if(event.type == WindowEventType::KeyboardInput)
+					m_encoder.keyboard(event.keyboard);
+				else if(event.type == WindowEventType::MouseInput)
+					m_encoder.mouse(event.mouse);
+			}
+		}
+		m_encoder.flush(m_reports);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(const HidReport& report : m_reports)
+			append(report);
+		// Each target takes whatever it has pending in one go, up to the point it would block
+		for(TargetId id = 0; id < m_targets.size(); ++id)
+		{
+			Target& target = m_targets[id];
+			if(!target.isConnected)
+				continue;
+			if(!writeEndpoint(target, target.keyboard, m_keyboardLog, false) || !writeEndpoint(target, target.mouse, m_mouseLog, true))
+			{
+				spdlog::warn("HID target {} ({}) is gone: {}", id, target.name, std::strerror(errno));
+				closeTarget(id);
+			}
+		}
+	}
+
+	void HidBroadcast::run()
+	{
+		epoll_event events[HID_BROADCAST_MAX_EPOLL_EVENTS];
+		while(m_isRunning.load(std::memory_order_relaxed))
+		{
+			s32 count = epoll_wait(m_epoll, events, HID_BROADCAST_MAX_EPOLL_EVENTS, -1);
+			if(count < 0)
+			{
+				if(errno != EINTR)
+					kvmio_Internal_ErrorExit("epoll_wait");
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for(s32 i = 0; i < count; i++)
+				{
+					if(events[i].data.u64 == HID_BROADCAST_WAKE_UP)
+					{
+						u64 value;
+						[[maybe_unused]] auto result = read(m_wakeUpEvent, &value, sizeof(value));
+						continue;
+					}
+					// An error or hang up is writable as well, the next write() finds out
+					const TargetId id = static_cast<TargetId>(events[i].data.u64 >> 1);
+					if(id < m_targets.size())
+						((events[i].data.u64 & 1) ? m_targets[id].mouse : m_targets[id].keyboard).isWritable = true;
+				}
+			}
+			forward();
+		}
+	}
+}
@@ -0,0 +1,260 @@
+#include <kvmio/Hid/HidReportEncoder.hpp>
+#include <kvmio/KeyCodeTables.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm> // for std::clamp, std::find, std::copy, std::fill_n
+
+// Reported in every key slot of a boot report when more keys are held than it can hold
+#define HID_USAGE_ERROR_ROLL_OVER 0x01
+#define HID_USAGE_LEFT_CONTROL 0xE0
+#define HID_BOOT_KEY_COUNT 6
+
+namespace kvmio::Hid
+{
+	// HID 1.11, Appendix B.1, with the key usages up to Right GUI
+	static constexpr u8 gBootKeyboardReportDescriptor[] =
+	{
+		0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+		// Modifiers
+		0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+		// Reserved
+		0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+		// LEDs and their padding
+		0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+		0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+		// Keys
+		0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x26, 0xE7, 0x00, 0x05, 0x07, 0x19, 0x00, 0x2A, 0xE7, 0x00, 0x81, 0x00,
+		0xC0
+	};
+
+	static constexpr u8 gNKROKeyboardReportDescriptor[] =
+	{
+		0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+		// Modifiers
+		0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+		// LEDs and their padding
+		0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+		0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+		// A bit for each of the usages 0x00-0xE7
+		0x05, 0x07, 0x19, 0x00, 0x2A, 0xE7, 0x00, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x96, 0xE8, 0x00, 0x81, 0x02,
+		0xC0
+	};
+
+	static constexpr u8 gBootMouseReportDescriptor[] =
+	{
+		0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00,
+		// 5 buttons and their padding
+		0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05, 0x75, 0x01, 0x81, 0x02,
+		0x95, 0x01, 0x75, 0x03, 0x81, 0x01,
+		// X, Y and the wheel, relative
+		0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x03, 0x81, 0x06,
+		0xC0, 0xC0
+	};
+
+	static constexpr u8 gBootWithPanMouseReportDescriptor[] =
+	{
+		0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00,
+		0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05, 0x75, 0x01, 0x81, 0x02,
+		0x95, 0x01, 0x75, 0x03, 0x81, 0x01,
+		0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x03, 0x81, 0x06,
+		// AC Pan (Consumer page), relative
+		0x05, 0x0C, 0x0A, 0x38, 0x02, 0x95, 0x01, 0x81, 0x06,
+		0xC0, 0xC0
+	};
+
+	KVMIO_API std::span<const u8> GetKeyboardReportDescriptor(HidKeyboardMode mode)
+	{
+		if(mode == HidKeyboardMode::NKRO)
+			return gNKROKeyboardReportDescriptor;
+		return gBootKeyboardReportDescriptor;
+	}
+
+	KVMIO_API std::span<const u8> GetMouseReportDescriptor(HidMouseMode mode)
+	{
+		if(mode == HidMouseMode::BootWithPan)
+			return gBootWithPanMouseReportDescriptor;
+		return gBootMouseReportDescriptor;
+	}
+
+	HidReportEncoder::HidReportEncoder(HidKeyboardMode keyboardMode, HidMouseMode mouseMode) :
+														m_keyboardMode(keyboardMode),
+														m_mouseMode(mouseMode),
+														m_modifiers(0),
+														m_changedModifiers(0),
+														m_isKeyPressPending(false),
+														m_lastKeyboardReport { },
+														m_buttons(0),
+														m_changedButtons(0),
+														m_lastButtons(0),
+														m_deltaX(0),
+														m_deltaY(0),
+														m_wheel(0),
+														m_pan(0)
+	{
+		m_heldKeys.reserve(m_keys.size());
+		// A frame of input rarely takes more
+		m_reports.reserve(64);
+	}
+
+	void HidReportEncoder::emitKeyboard()
+	{
+		m_changedModifiers = 0;
+		m_changedKeys.reset();
+		m_isKeyPressPending = false;
+
+		HidReport report { HidReportType::Keyboard, 0, { } };
+		report.data[0] = m_modifiers;
+		if(m_keyboardMode == HidKeyboardMode::Boot)
+		{
+			report.size = 8;
+			if(m_heldKeys.size() > HID_BOOT_KEY_COUNT)
+				std::fill_n(report.data.begin() + 2, HID_BOOT_KEY_COUNT, HID_USAGE_ERROR_ROLL_OVER);
+			else
+				std::copy(m_heldKeys.begin(), m_heldKeys.end(), report.data.begin() + 2);
+		}
+		else
+		{
+			report.size = 30;
+			for(u8 usage : m_heldKeys)
+				report.data[1 + (usage >> 3)] |= static_cast<u8>(1u << (usage & 7));
+		}
+		if(report.data == m_lastKeyboardReport)
+			return;
+		m_lastKeyboardReport = report.data;
+		m_reports.push_back(report);
+	}
+
+	void HidReportEncoder::keyboard(const Win32::KeyboardInput& input)
+	{
+		const KeyCode& key = GetKeyCodeFromMakeCode(input.makeCode, input.isExtended0, input.isExtended1);
+		if(key.hidUsage == 0)
+		{
+			spdlog::debug("No HID usage for the make code {:#x}, ignored", input.makeCode);
+			return;
+		}
+		const bool isPressed = input.keyStatus == Win32::KeyStatus::Pressed;
+		const u8 usage = key.hidUsage;
+
+		if(usage >= HID_USAGE_LEFT_CONTROL)
+		{
+			const u8 bit = static_cast<u8>(1u << (usage - HID_USAGE_LEFT_CONTROL));
+			// Repeats of a held key change nothing
+			if(((m_modifiers & bit) != 0) == isPressed)
+				return;
+			// The target applies the modifiers of a report before its keys, so a modifier changed after a key has to wait for the next report
+			if(((m_changedModifiers & bit) != 0) || m_changedKeys.any())
+				emitKeyboard();
+			m_modifiers ^= bit;
+			m_changedModifiers |= bit;
+			return;
+		}
+
+		if(m_keys.test(usage) == isPressed)
+			return;
+		// A key changed twice needs the state in between reported; and a bitmap doesn't tell in which order two keys were pressed
+		if(m_changedKeys.test(usage) || (isPressed && m_isKeyPressPending && (m_keyboardMode == HidKeyboardMode::NKRO)))
+			emitKeyboard();
+		m_keys.set(usage, isPressed);
+		m_changedKeys.set(usage);
+		if(isPressed)
+		{
+			m_heldKeys.push_back(usage);
+			m_isKeyPressPending = true;
+		}
+		else
+			m_heldKeys.erase(std::find(m_heldKeys.begin(), m_heldKeys.end(), usage));
+	}
+
+	void HidReportEncoder::emitMouse()
+	{
+		m_changedButtons = 0;
+		const u32 size = (m_mouseMode == HidMouseMode::BootWithPan) ? 5 : 4;
+		// The movement beyond what fits in a report (-127 to 127) is carried over to the next ones
+		do
+		{
+			const s32 x = std::clamp(m_deltaX, -127, 127);
+			const s32 y = std::clamp(m_deltaY, -127, 127);
+			const s32 wheel = std::clamp(m_wheel, -127, 127);
+			const s32 pan = std::clamp(m_pan, -127, 127);
+			if((x == 0) && (y == 0) && (wheel == 0) && (pan == 0) && (m_buttons == m_lastButtons))
+				return;
+			HidReport report { HidReportType::Mouse, static_cast<u8>(size), { } };
+			report.data[0] = m_buttons;
+			report.data[1] = static_cast<u8>(static_cast<s8>(x));
+			report.data[2] = static_cast<u8>(static_cast<s8>(y));
+			report.data[3] = static_cast<u8>(static_cast<s8>(wheel));
+			report.data[4] = static_cast<u8>(static_cast<s8>(pan));
+			m_reports.push_back(report);
+			m_lastButtons = m_buttons;
+			m_deltaX -= x;
+			m_deltaY -= y;
+			m_wheel -= wheel;
+			m_pan -= pan;
+		} while((m_deltaX != 0) || (m_deltaY != 0) || (m_wheel != 0) || (m_pan != 0));
+	}
+
+	void HidReportEncoder::setButton(u8 bit, bool isTransition, Win32::KeyStatus status)
+	{
+		if(!isTransition)
+			return;
+		const bool isPressed = status == Win32::KeyStatus::Pressed;
+		if(((m_buttons & bit) != 0) == isPressed)
+			return;
+		// The movement so far happened before the transition (i.e. a click lands where the pointer was moved to),
+		// and a button changed twice needs the state in between reported
+		if(((m_changedButtons & bit) != 0) || (m_deltaX != 0) || (m_deltaY != 0) || (m_wheel != 0) || (m_pan != 0))
+			emitMouse();
+		m_buttons ^= bit;
+		m_changedButtons |= bit;
+	}
+
+	void HidReportEncoder::mouse(const Win32::MouseInput& input)
+	{
+		// Likewise, the movement after a transition must not be reported along with it (i.e. a drag ends where it was released)
+		const bool isMove = (!input.isMoveAbsolute && ((input.movement.x != 0) || (input.movement.y != 0))) || input.isWheelX || input.isWheelY;
+		if(isMove && (m_changedButtons != 0))
+			emitMouse();
+		if(!input.isMoveAbsolute)
+		{
+			m_deltaX += input.movement.x;
+			m_deltaY += input.movement.y;
+		}
+		// The vertical wheel is isWheelX/wheel.x in the Raw Input model, both are in notches already
+		if(input.isWheelX)
+			m_wheel += input.wheel.x;
+		if(input.isWheelY && (m_mouseMode == HidMouseMode::BootWithPan))
+			m_pan += input.wheel.y;
+		if(input.isAnyButton)
+		{
+			setButton(1 << 0, input.leftButton.isTransition, input.leftButton.status);
+			setButton(1 << 1, input.rightButton.isTransition, input.rightButton.status);
+			setButton(1 << 2, input.middleButton.isTransition, input.middleButton.status);
+			setButton(1 << 3, input.browseForwardButton.isTransition, input.browseForwardButton.status);
+			setButton(1 << 4, input.browseBackwardButton.isTransition, input.browseBackwardButton.status);
+		}
+	}
+
+	void HidReportEncoder::releaseAll()
+	{
+		// Whatever is pending is reported first, it may well be the press of a key being released here
+		emitKeyboard();
+		emitMouse();
+		m_modifiers = 0;
+		m_keys.reset();
+		m_heldKeys.clear();
+		m_buttons = 0;
+		emitKeyboard();
+		emitMouse();
+	}
+
+	u32 HidReportEncoder::flush(std::vector<HidReport>& reports)
+	{
+		emitKeyboard();
+		emitMouse();
+		const u32 count = static_cast<u32>(m_reports.size());
+		reports.insert(reports.end(), m_reports.begin(), m_reports.end());
+		m_reports.clear();
+		return count;
+	}
+}
@@ -0,0 +1,289 @@
+#include <kvmio/InputDispatcher.hpp>
+
+#include <spdlog/spdlog.h>
+#include <libassert/assert.hpp>
+
+#include <algorithm> // for std::min, std::max, std::copy_n
+
+namespace kvmio
+{
+	InputDispatcher::InputDispatcher() : m_subscriberCount(0), m_pendingCount(0), m_delivering(InvalidSubscription), m_isStop(false)
+	{
+	}
+
+	InputDispatcher::~InputDispatcher()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isStop = true;
+		}
+		m_condition.notify_one();
+		if(m_thread.joinable())
+			m_thread.join();
+	}
+
+	InputDispatcher::SubscriptionId InputDispatcher::addSubscriber(std::unique_ptr<Subscriber> subscriber, u32 capacity)
+	{
+		subscriber->capacity = std::max(capacity, 1u);
+		subscriber->head = 0;
+		subscriber->count = 0;
+		subscriber->deliveredCount = 0;
+		subscriber->coalescedCount = 0;
+		subscriber->droppedCount = 0;
+		subscriber->isRemoved.store(false, std::memory_order_relaxed);
+		// Allocated here, so publishing never does
+		if(subscriber->type == SubscriberType::KeyCombination)
+			subscriber->keyCombinations.resize(subscriber->capacity);
+		else
+			subscriber->events.resize(subscriber->capacity);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(!m_thread.joinable())
+			m_thread = std::thread(&InputDispatcher::run, this);
+		const SubscriptionId id = static_cast<SubscriptionId>(m_subscribers.size());
+		m_subscribers.push_back(std::move(subscriber));
+		m_subscriberCount.fetch_add(1, std::memory_order_relaxed);
+		return id;
+	}
+
+	InputDispatcher::SubscriptionId InputDispatcher::subscribeMouse(MouseCallback callback, u32 capacity, DispatchOverflow overflow)
+	{
+		auto subscriber = std::make_unique<Subscriber>();
+		subscriber->type = SubscriberType::Mouse;
+		subscriber->overflow = overflow;
+		subscriber->chord = KeyChordEngine::InvalidChord;
+		subscriber->mouseCallback = std::move(callback);
+		return addSubscriber(std::move(subscriber), capacity);
+	}
+
+	InputDispatcher::SubscriptionId InputDispatcher::subscribeKeyboard(KeyboardCallback callback, u32 capacity, DispatchOverflow overflow)
+	{
+		auto subscriber = std::make_unique<Subscriber>();
+		subscriber->type = SubscriberType::Keyboard;
+		subscriber->overflow = overflow;
+		subscriber->chord = KeyChordEngine::InvalidChord;
+		subscriber->keyboardCallback = std::move(callback);
+		return addSubscriber(std::move(subscriber), capacity);
+	}
+
+	InputDispatcher::SubscriptionId InputDispatcher::subscribeKeyCombination(KeyChordEngine::ChordId chord, KeyCombinationCallback callback, u32 capacity, DispatchOverflow overflow)
+	{
+		auto subscriber = std::make_unique<Subscriber>();
+		subscriber->type = SubscriberType::KeyCombination;
+		subscriber->overflow = overflow;
+		subscriber->chord = chord;
+		subscriber->keyCombinationCallback = std::move(callback);
+		return addSubscriber(std::move(subscriber), capacity);
+	}
+
+	void InputDispatcher::unsubscribe(SubscriptionId id)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if((id >= m_subscribers.size()) || !m_subscribers[id] || m_subscribers[id]->isRemoved.load(std::memory_order_relaxed))
+		{
+			spdlog::warn("Unsubscribing an unknown input subscription {}", id);
+			return;
+		}
+		Subscriber& subscriber = *m_subscribers[id];
+		m_pendingCount -= subscriber.count;
+		subscriber.count = 0;
+		subscriber.isRemoved.store(true, std::memory_order_relaxed);
+		m_subscriberCount.fetch_sub(1, std::memory_order_relaxed);
+		if(m_delivering == id)
+		{
+			// From its own callback, the worker destroys it once the batch is done
+			if(std::this_thread::get_id() == m_thread.get_id())
+				return;
+			m_deliveredCondition.wait(lock, [this, id] { return m_delivering != id; });
+		}
+		m_subscribers[id].reset();
+	}
+
+	DispatchStatistics InputDispatcher::getStatistics(SubscriptionId id)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		DEBUG_ASSERT((id < m_subscribers.size()) && m_subscribers[id]);
+		const Subscriber& subscriber = *m_subscribers[id];
+		return { subscriber.count, subscriber.deliveredCount, subscriber.coalescedCount, subscriber.droppedCount };
+	}
+
+	bool InputDispatcher::evictOldestPress(Subscriber& subscriber)
+	{
+		for(u32 i = 0; i < subscriber.count; ++i)
+		{
+			const InputEvent& event = subscriber.events[(subscriber.head + i) % subscriber.capacity];
+			if((event.type != WindowEventType::KeyboardInput) || (event.keyboard.keyStatus != Win32::KeyStatus::Pressed))
+				continue;
+			// The ones queued after it move up by one, so the order is kept
+			for(u32 j = i + 1; j < subscriber.count; ++j)
+				subscriber.events[(subscriber.head + j - 1) % subscriber.capacity] = subscriber.events[(subscriber.head + j) % subscriber.capacity];
+			--subscriber.count;
+			--m_pendingCount;
+			++subscriber.droppedCount;
+			return true;
+		}
+		return false;
+	}
+
+	void InputDispatcher::enqueue(Subscriber& subscriber, const InputEvent& event)
+	{
+		if(subscriber.count == subscriber.capacity)
+		{
+			InputEvent& latest = subscriber.events[(subscriber.head + subscriber.count - 1) % subscriber.capacity];
+			if((subscriber.overflow == DispatchOverflow::Coalesce) && TryCoalesceInputEvent(latest, event))
+			{
+				++subscriber.coalescedCount;
+				return;
+			}
+			// A dropped release would leave the key held on the subscriber's side, a press makes room for it instead
+			const bool isRelease = (event.type == WindowEventType::KeyboardInput) && (event.keyboard.keyStatus == Win32::KeyStatus::Released);
+			if(!isRelease || !evictOldestPress(subscriber))
+			{
+				++subscriber.droppedCount;
+				return;
+			}
+		}
+		subscriber.events[(subscriber.head + subscriber.count) % subscriber.capacity] = event;
+		++subscriber.count;
+		++m_pendingCount;
+	}
+
+	void InputDispatcher::enqueue(Subscriber& subscriber, std::span<const Win32::KeyboardInput> keys)
+	{
+		// A key combination has nothing to be merged into
+		if(subscriber.count == subscriber.capacity)
+		{
+			++subscriber.droppedCount;
+			return;
+		}
+		HeldKeys& heldKeys = subscriber.keyCombinations[(subscriber.head + subscriber.count) % subscriber.capacity];
+		heldKeys.count = static_cast<u32>(std::min<std::size_t>(keys.size(), heldKeys.keys.size()));
+		std::copy_n(keys.begin(), heldKeys.count, heldKeys.keys.begin());
+		++subscriber.count;
+		++m_pendingCount;
+	}
+
+	void InputDispatcher::publishMouse(const Win32::MouseInput& input, u64 timestamp)
+	{
+		if(m_subscriberCount.load(std::memory_order_relaxed) == 0)
+			return;
+		InputEvent event;
+		event.type = WindowEventType::MouseInput;
+		event.timestamp = timestamp;
+		event.mouse = input;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for(auto& subscriber : m_subscribers)
+				if(subscriber && !subscriber->isRemoved.load(std::memory_order_relaxed) && (subscriber->type == SubscriberType::Mouse))
+					enqueue(*subscriber, event);
+		}
+		m_condition.notify_one();
+	}
+
+	void InputDispatcher::publishKeyboard(const Win32::KeyboardInput& input, u64 timestamp)
+	{
+		if(m_subscriberCount.load(std::memory_order_relaxed) == 0)
+			return;
+		InputEvent event;
+		event.type = WindowEventType::KeyboardInput;
+		event.timestamp = timestamp;
+		event.keyboard = input;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for(auto& subscriber : m_subscribers)
+				if(subscriber && !subscriber->isRemoved.load(std::memory_order_relaxed) && (subscriber->type == SubscriberType::Keyboard))
+					enqueue(*subscriber, event);
+		}
+		m_condition.notify_one();
+	}
+
+	void InputDispatcher::publishKeyCombination(KeyChordEngine::ChordId chord, std::span<const Win32::KeyboardInput> keys)
+	{
+		if(m_subscriberCount.load(std::memory_order_relaxed) == 0)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for(auto& subscriber : m_subscribers)
+				if(subscriber && !subscriber->isRemoved.load(std::memory_order_relaxed) && (subscriber->type == SubscriberType::KeyCombination) && (subscriber->chord == chord))
+					enqueue(*subscriber, keys);
+		}
+		m_condition.notify_one();
+	}
+
+	void InputDispatcher::run()
+	{
+		std::vector<InputEvent> events;
+		events.reserve(BatchSize);
+		std::vector<HeldKeys> keyCombinations;
+		keyCombinations.reserve(BatchSize);
+		std::vector<Win32::KeyboardInput> keys;
+		keys.reserve(KeyChordEngine::MaxHeldKeys);
+
+		// Round robin over the subscribers, so a flooded one can't starve the others
+		SubscriptionId next = 0;
+		while(true)
+		{
+			Subscriber* subscriber = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_isStop || (m_pendingCount > 0); });
+				if(m_isStop)
+					return;
+				const SubscriptionId count = static_cast<SubscriptionId>(m_subscribers.size());
+				for(SubscriptionId i = 0; i < count; ++i)
+				{
+					const SubscriptionId id = (next + i) % count;
+					if(m_subscribers[id] && (m_subscribers[id]->count > 0))
+					{
+						subscriber = m_subscribers[id].get();
+						m_delivering = id;
+						next = id + 1;
+						break;
+					}
+				}
+				DEBUG_ASSERT(subscriber != nullptr);
+				const u32 batchSize = std::min(subscriber->count, BatchSize);
+				events.clear();
+				keyCombinations.clear();
+				for(u32 i = 0; i < batchSize; ++i)
+				{
+					const u32 index = (subscriber->head + i) % subscriber->capacity;
+					if(subscriber->type == SubscriberType::KeyCombination)
+						keyCombinations.push_back(subscriber->keyCombinations[index]);
+					else
+						events.push_back(subscriber->events[index]);
+				}
+				subscriber->head = (subscriber->head + batchSize) % subscriber->capacity;
+				subscriber->count -= batchSize;
+				subscriber->deliveredCount += batchSize;
+				m_pendingCount -= batchSize;
+			}
+
+			// Without the lock, the publisher keeps queueing meanwhile
+			for(const InputEvent& event : events)
+			{
+				if(subscriber->isRemoved.load(std::memory_order_relaxed))
+					break;
+				if(event.type == WindowEventType::MouseInput)
+					subscriber->mouseCallback(event.mouse);
+				else
+					subscriber->keyboardCallback(event.keyboard);
+			}
+			for(const HeldKeys& heldKeys : keyCombinations)
+			{
+				if(subscriber->isRemoved.load(std::memory_order_relaxed))
+					break;
+				keys.assign(heldKeys.keys.begin(), heldKeys.keys.begin() + heldKeys.count);
+				subscriber->keyCombinationCallback(keys);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if(subscriber->isRemoved.load(std::memory_order_relaxed))
+					m_subscribers[m_delivering].reset();
+				m_delivering = InvalidSubscription;
+			}
+			m_deliveredCondition.notify_all();
+		}
+	}
+}
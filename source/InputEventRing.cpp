@@ -0,0 +1,119 @@
+#include <kvmio/InputEventRing.hpp>
+
+#include <chrono> // for std::chrono::steady_clock
+#include <limits> // for std::numeric_limits<>
+
+namespace kvmio
+{
+	u64 GetInputTimestamp() noexcept
+	{
+		return static_cast<u64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	InputEventRing::InputEventRing(u32 capacity) : m_head(0), m_droppedCount(0), m_tail(0)
+	{
+		u32 size = 1;
+		while(size < capacity)
+			size <<= 1;
+		m_events = std::make_unique<InputEvent[]>(size);
+		m_mask = size - 1;
+	}
+
+	bool InputEventRing::push(const InputEvent& event) noexcept
+	{
+		const u64 head = m_head.load(std::memory_order_relaxed);
+		if((head - m_tail.load(std::memory_order_acquire)) > m_mask)
+		{
+			m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		m_events[head & m_mask] = event;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool InputEventRing::pushKeyboard(const Win32::KeyboardInput& input, u64 timestamp) noexcept
+	{
+		InputEvent event;
+		event.type = WindowEventType::KeyboardInput;
+		event.timestamp = timestamp;
+		event.keyboard = input;
+		return push(event);
+	}
+
+	bool InputEventRing::pushMouse(const Win32::MouseInput& input, u64 timestamp) noexcept
+	{
+		InputEvent event;
+		event.type = WindowEventType::MouseInput;
+		event.timestamp = timestamp;
+		event.mouse = input;
+		return push(event);
+	}
+
+	bool InputEventRing::pushResize(u32 width, u32 height, u64 timestamp) noexcept
+	{
+		InputEvent event;
+		event.type = WindowEventType::Resize;
+		event.timestamp = timestamp;
+		event.resize = { width, height };
+		return push(event);
+	}
+
+	static bool IsFitS16(s32 value) noexcept
+	{
+		return (value >= std::numeric_limits<s16>::min()) && (value <= std::numeric_limits<s16>::max());
+	}
+
+	bool TryCoalesceInputEvent(InputEvent& into, const InputEvent& next) noexcept
+	{
+		if((into.type != WindowEventType::MouseInput) || (next.type != WindowEventType::MouseInput))
+			return false;
+		Win32::MouseInput& a = into.mouse;
+		const Win32::MouseInput& b = next.mouse;
+		// A button transition orders the movements around it, the remote side must see the pointer where it was when it happened
+		if(a.isAnyButton || b.isAnyButton)
+			return false;
+		if((a.isMoveAbsolute != b.isMoveAbsolute) || (a.isMoveRelative != b.isMoveRelative) || (a.isVirtualDesktop != b.isVirtualDesktop))
+			return false;
+
+		// An absolute packet's movement is a position (0 to 65535), the later one stands. isMoveRelative can't tell them apart,
+		// DecodeRawMouseInput() sets it for every packet as MOUSE_MOVE_RELATIVE is 0
+		s32 moveX = b.movement.x, moveY = b.movement.y;
+		if(!a.isMoveAbsolute && a.isMoveRelative)
+		{
+			moveX += a.movement.x;
+			moveY += a.movement.y;
+		}
+		const s32 wheelX = static_cast<s32>(a.wheel.x) + b.wheel.x;
+		const s32 wheelY = static_cast<s32>(a.wheel.y) + b.wheel.y;
+		if(!IsFitS16(moveX) || !IsFitS16(moveY) || !IsFitS16(wheelX) || !IsFitS16(wheelY))
+			return false;
+
+		a.movement = { static_cast<s16>(moveX), static_cast<s16>(moveY) };
+		a.wheel = { static_cast<s16>(wheelX), static_cast<s16>(wheelY) };
+		a.isWheelX = a.isWheelX || b.isWheelX;
+		a.isWheelY = a.isWheelY || b.isWheelY;
+		into.timestamp = next.timestamp;
+		return true;
+	}
+
+	u32 InputEventRing::drain(std::span<InputEvent> events, bool isCoalesce) noexcept
+	{
+		if(events.empty())
+			return 0;
+		u64 tail = m_tail.load(std::memory_order_relaxed);
+		const u64 head = m_head.load(std::memory_order_acquire);
+		u32 count = 0;
+		for(; tail != head; ++tail)
+		{
+			const InputEvent& event = m_events[tail & m_mask];
+			if(isCoalesce && (count > 0) && TryCoalesceInputEvent(events[count - 1], event))
+				continue;
+			if(count == events.size())
+				break;
+			events[count++] = event;
+		}
+		m_tail.store(tail, std::memory_order_release);
+		return count;
+	}
+}
@@ -0,0 +1,306 @@
+#include <kvmio/InputRecording.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <common/platform.h>
+
+#include <spdlog/spdlog.h>
+#include <libassert/assert.hpp>
+
+#ifdef PLATFORM_LINUX
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <cerrno> // for errno
+#endif // PLATFORM_LINUX
+
+#include <algorithm> // for std::min, std::max, std::max_element
+#include <chrono> // for std::chrono::steady_clock
+#include <cstring> // for std::memcpy, std::strerror
+#include <thread> // for std::this_thread::sleep_until
+#include <type_traits> // for std::is_trivially_copyable_v<>
+
+// "KVIR", little endian
+#define INPUT_RECORDING_MAGIC 0x5249564B
+#define INPUT_RECORDING_VERSION 1
+// Events recorded from a ring in one go
+#define INPUT_RECORDING_BATCH_SIZE 256
+
+namespace kvmio
+{
+	static_assert(std::is_trivially_copyable_v<InputEvent>, "InputEvent is copied to and from the file as it is");
+
+	struct RecordingHeader
+	{
+		u32 magic;
+		u32 version;
+		// sizeof(InputEvent) of the recording build
+		u32 eventSize;
+		u32 reserved;
+		// Kept up to date while recording, so a recording survives the recorder's crash
+		u64 eventCount;
+		u64 reserved1;
+	};
+
+	struct MappedFile
+	{
+#ifdef PLATFORM_WINDOWS
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#else
+		s32 fd = -1;
+#endif // PLATFORM_WINDOWS
+		bool isWritable = false;
+		u8* data = nullptr;
+		u64 size = 0;
+	};
+
+	// The writable files are created (or truncated), the others must exist; returns the file's size
+	static u64 OpenFile(MappedFile& file, const std::string& path, bool isWritable)
+	{
+		file.isWritable = isWritable;
+#ifdef PLATFORM_WINDOWS
+		file.file = CreateFileA(path.c_str(), GENERIC_READ | (isWritable ? GENERIC_WRITE : 0), FILE_SHARE_READ, NULL,
+									isWritable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if(file.file == INVALID_HANDLE_VALUE)
+		{
+			spdlog::critical("Unable to open {}: error {}", path, GetLastError());
+			exit(-1);
+		}
+		LARGE_INTEGER size { };
+		if(GetFileSizeEx(file.file, &size) == 0)
+			kvmio_Internal_ErrorExit("GetFileSizeEx");
+		return static_cast<u64>(size.QuadPart);
+#else
+		file.fd = open(path.c_str(), isWritable ? (O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+		if(file.fd < 0)
+		{
+			spdlog::critical("Unable to open {}: {}", path, std::strerror(errno));
+			exit(-1);
+		}
+		struct stat status { };
+		if(fstat(file.fd, &status) < 0)
+			kvmio_Internal_ErrorExit("fstat");
+		return static_cast<u64>(status.st_size);
+#endif // PLATFORM_WINDOWS
+	}
+
+	// Maps the first 'size' bytes, a writable file grows to them
+	static void MapFile(MappedFile& file, u64 size)
+	{
+#ifdef PLATFORM_WINDOWS
+		file.mapping = CreateFileMappingA(file.file, NULL, file.isWritable ? PAGE_READWRITE : PAGE_READONLY, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), NULL);
+		if(file.mapping == NULL)
+			kvmio_Internal_ErrorExit("CreateFileMappingA");
+		file.data = reinterpret_cast<u8*>(MapViewOfFile(file.mapping, file.isWritable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size));
+		if(file.data == NULL)
+			kvmio_Internal_ErrorExit("MapViewOfFile");
+#else
+		if(file.isWritable && (ftruncate(file.fd, static_cast<off_t>(size)) < 0))
+			kvmio_Internal_ErrorExit("ftruncate");
+		void* data = mmap(nullptr, size, PROT_READ | (file.isWritable ? PROT_WRITE : 0), MAP_SHARED, file.fd, 0);
+		if(data == MAP_FAILED)
+			kvmio_Internal_ErrorExit("mmap");
+		file.data = reinterpret_cast<u8*>(data);
+#endif // PLATFORM_WINDOWS
+		file.size = size;
+	}
+
+	static void UnmapFile(MappedFile& file)
+	{
+		if(file.data == nullptr)
+			return;
+#ifdef PLATFORM_WINDOWS
+		UnmapViewOfFile(file.data);
+		CloseHandle(file.mapping);
+		file.mapping = NULL;
+#else
+		munmap(file.data, file.size);
+#endif // PLATFORM_WINDOWS
+		file.data = nullptr;
+		file.size = 0;
+	}
+
+	// A writable file is trimmed to 'size' bytes first
+	static void CloseFile(MappedFile& file, u64 size)
+	{
+		UnmapFile(file);
+#ifdef PLATFORM_WINDOWS
+		if(file.isWritable)
+		{
+			LARGE_INTEGER end { };
+			end.QuadPart = static_cast<LONGLONG>(size);
+			if((SetFilePointerEx(file.file, end, NULL, FILE_BEGIN) == 0) || (SetEndOfFile(file.file) == 0))
+				spdlog::error("Unable to trim the recording: error {}", GetLastError());
+		}
+		CloseHandle(file.file);
+		file.file = INVALID_HANDLE_VALUE;
+#else
+		if(file.isWritable && (ftruncate(file.fd, static_cast<off_t>(size)) < 0))
+			spdlog::error("Unable to trim the recording: {}", std::strerror(errno));
+		close(file.fd);
+		file.fd = -1;
+#endif // PLATFORM_WINDOWS
+	}
+
+	InputRecorder::InputRecorder(std::string_view path, u32 initialCapacity) :
+											m_path(path),
+											m_file(std::make_unique<MappedFile>()),
+											m_eventCount(0),
+											m_capacity(std::max<u32>(initialCapacity, 1)),
+											m_batch(INPUT_RECORDING_BATCH_SIZE)
+	{
+		OpenFile(*m_file, m_path, true);
+		MapFile(*m_file, sizeof(RecordingHeader) + m_capacity * sizeof(InputEvent));
+		RecordingHeader header { };
+		header.magic = INPUT_RECORDING_MAGIC;
+		header.version = INPUT_RECORDING_VERSION;
+		header.eventSize = sizeof(InputEvent);
+		std::memcpy(m_file->data, &header, sizeof(header));
+	}
+
+	InputRecorder::~InputRecorder()
+	{
+		close();
+	}
+
+	void InputRecorder::grow(u64 capacity)
+	{
+		UnmapFile(*m_file);
+		MapFile(*m_file, sizeof(RecordingHeader) + capacity * sizeof(InputEvent));
+		m_capacity = capacity;
+	}
+
+	void InputRecorder::record(const InputEvent& event)
+	{
+		record({ &event, 1 });
+	}
+
+	void InputRecorder::record(std::span<const InputEvent> events)
+	{
+		DEBUG_ASSERT(m_file, "The recording has been closed");
+		if(events.empty())
+			return;
+		if((m_eventCount + events.size()) > m_capacity)
+		{
+			u64 capacity = m_capacity;
+			while(capacity < (m_eventCount + events.size()))
+				capacity *= 2;
+			grow(capacity);
+		}
+		std::memcpy(m_file->data + sizeof(RecordingHeader) + m_eventCount * sizeof(InputEvent), events.data(), events.size_bytes());
+		m_eventCount += events.size();
+		reinterpret_cast<RecordingHeader*>(m_file->data)->eventCount = m_eventCount;
+	}
+
+	u32 InputRecorder::recordFrom(InputEventRing& ring)
+	{
+		u32 recordedCount = 0;
+		u32 count;
+		do
+		{
+			count = ring.drain(m_batch);
+			record({ m_batch.data(), count });
+			recordedCount += count;
+		} while(count == m_batch.size());
+		return recordedCount;
+	}
+
+	void InputRecorder::close()
+	{
+		if(!m_file)
+			return;
+		CloseFile(*m_file, sizeof(RecordingHeader) + m_eventCount * sizeof(InputEvent));
+		m_file.reset();
+		spdlog::info("Recorded {} input events to {}", m_eventCount, m_path);
+	}
+
+	InputReplayer::InputReplayer(std::string_view path) : m_path(path), m_file(std::make_unique<MappedFile>())
+	{
+		const u64 size = OpenFile(*m_file, m_path, false);
+		if(size < sizeof(RecordingHeader))
+		{
+			spdlog::critical("{} is not an input recording", m_path);
+			exit(-1);
+		}
+		MapFile(*m_file, size);
+		RecordingHeader header;
+		std::memcpy(&header, m_file->data, sizeof(header));
+		if((header.magic != INPUT_RECORDING_MAGIC) || (header.version != INPUT_RECORDING_VERSION))
+		{
+			spdlog::critical("{} is not an input recording", m_path);
+			exit(-1);
+		}
+		if(header.eventSize != sizeof(InputEvent))
+		{
+			spdlog::critical("{} has been recorded with events of {} bytes, this build's are {} bytes", m_path, header.eventSize, sizeof(InputEvent));
+			exit(-1);
+		}
+		// The count of a recording that was never closed is that of its last complete write
+		const u64 eventCount = std::min<u64>(header.eventCount, (size - sizeof(RecordingHeader)) / sizeof(InputEvent));
+		m_events = { reinterpret_cast<const InputEvent*>(m_file->data + sizeof(RecordingHeader)), static_cast<std::size_t>(eventCount) };
+	}
+
+	InputReplayer::~InputReplayer()
+	{
+		CloseFile(*m_file, 0);
+	}
+
+	// Sleeps for all but the last millisecond, which the schedulers' granularity would overshoot, and spins for that one
+	static void WaitUntil(std::chrono::steady_clock::time_point time)
+	{
+		const auto sleepTime = time - std::chrono::milliseconds(1);
+		if(std::chrono::steady_clock::now() < sleepTime)
+			std::this_thread::sleep_until(sleepTime);
+		while(std::chrono::steady_clock::now() < time)
+			std::this_thread::yield();
+	}
+
+	ReplayStatistics InputReplayer::replay(const Dispatch& dispatch, f64 speed)
+	{
+		using Clock = std::chrono::steady_clock;
+		using Microseconds = std::chrono::duration<f64, std::micro>;
+
+		ReplayStatistics statistics { };
+		statistics.eventCount = m_events.size();
+		if(m_events.empty())
+		{
+			statistics.dispatchLatency = { -1.0, -1.0 };
+			statistics.maxDispatchLatency = -1.0;
+			statistics.lateness = { -1.0, -1.0 };
+			return statistics;
+		}
+
+		std::vector<f64> dispatchLatencies;
+		dispatchLatencies.reserve(m_events.size());
+		std::vector<f64> lateness;
+		if(speed > 0)
+			lateness.reserve(m_events.size());
+
+		const u64 firstTimestamp = m_events.front().timestamp;
+		const Clock::time_point start = Clock::now();
+		for(const InputEvent& event : m_events)
+		{
+			if(speed > 0)
+			{
+				const u64 offset = (event.timestamp > firstTimestamp) ? (event.timestamp - firstTimestamp) : 0;
+				const Clock::time_point time = start + std::chrono::duration_cast<Clock::duration>(Microseconds(static_cast<f64>(offset) / speed));
+				WaitUntil(time);
+				lateness.push_back(Microseconds(Clock::now() - time).count());
+			}
+			const Clock::time_point dispatchStart = Clock::now();
+			dispatch(event);
+			dispatchLatencies.push_back(Microseconds(Clock::now() - dispatchStart).count());
+		}
+		statistics.elapsed = std::chrono::duration<f64>(Clock::now() - start).count();
+		statistics.eventsPerSecond = (statistics.elapsed > 0) ? (static_cast<f64>(m_events.size()) / statistics.elapsed) : 0.0;
+		statistics.maxDispatchLatency = *std::max_element(dispatchLatencies.begin(), dispatchLatencies.end());
+		statistics.dispatchLatency = GetPercentiles(dispatchLatencies);
+		statistics.lateness = (speed > 0) ? GetPercentiles(lateness) : Percentiles { 0.0, 0.0 };
+
+		spdlog::info("Replayed {} input events from {} in {:.3f} s ({:.0f} events/s), dispatch p50 {:.2f} us, p99 {:.2f} us, max {:.2f} us",
+						statistics.eventCount, m_path, statistics.elapsed, statistics.eventsPerSecond,
+						statistics.dispatchLatency.p50, statistics.dispatchLatency.p99, statistics.maxDispatchLatency);
+		return statistics;
+	}
+}
@@ -0,0 +1,339 @@
+#include <kvmio/Ipc/SharedFrameRing.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <new> // for placement new
+#include <climits> // for INT_MAX
+#include <cerrno> // for errno
+#include <cstring> // for std::memcpy
+
+#define SHARED_FRAME_RING_MAGIC 0x524D564Bu // "KVMR"
+#define SHARED_FRAME_RING_VERSION 1
+// Slots start on page boundaries, so a slot can be handed to anything expecting page aligned memory
+#define SHARED_FRAME_RING_ALIGNMENT 4096
+// How long stream() waits for a frame before checking the predicate again, in milliseconds
+#define SHARED_FRAME_RING_STREAM_TIMEOUT 100
+
+namespace kvmio::Ipc
+{
+	// The atomics are shared by processes, which only works for the lock-free ones
+	static_assert(std::atomic<u32>::is_always_lock_free && std::atomic<u64>::is_always_lock_free);
+	// The futex is the address of the atomic
+	static_assert(sizeof(std::atomic<u32>) == sizeof(u32));
+
+	enum SlotState : u32
+	{
+		SlotState_Free = 0,
+		SlotState_Writing,
+		SlotState_Ready,
+		SlotState_Reading
+	};
+
+	struct SharedFrameRing::Header
+	{
+		u32 magic;
+		u32 version;
+		u32 slotCount;
+		u32 slotSize;
+		u32 width;
+		u32 height;
+		// Incremented by every submit, the consumer sleeps on it
+		alignas(64) std::atomic<u32> futexWord;
+		std::atomic<u64> sequence;
+		std::atomic<u64> droppedCount;
+	};
+
+	// A cache line each, so the producer and the consumer don't contend on the slots they aren't using
+	struct alignas(64) SharedFrameRing::SlotHeader
+	{
+		std::atomic<u32> state;
+		u32 size;
+		// Compared by the other side while the slot is being written
+		std::atomic<u64> sequence;
+		u64 timestamp;
+	};
+
+	static std::size_t AlignUp(std::size_t value, std::size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	static u64 GetTimestamp()
+	{
+		return static_cast<u64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	SharedFrameRing::SharedFrameRing(u32 slotCount, u32 slotSize, u32 width, u32 height) :
+											m_memory(NULL),
+											m_isProducer(true),
+											m_lastSequence(0)
+	{
+		DEBUG_ASSERT(slotCount >= 3, "A slot being written, one being read and one submitted");
+		m_dataOffset = AlignUp(sizeof(Header) + sizeof(SlotHeader) * slotCount, SHARED_FRAME_RING_ALIGNMENT);
+		m_slotStride = AlignUp(slotSize, SHARED_FRAME_RING_ALIGNMENT);
+		m_size = m_dataOffset + m_slotStride * slotCount;
+
+		m_fd = memfd_create("kvmio-frame-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if(m_fd < 0)
+			kvmio_Internal_ErrorExit("memfd_create");
+		if(ftruncate(m_fd, static_cast<off_t>(m_size)) < 0)
+			kvmio_Internal_ErrorExit("ftruncate");
+		// The consumer can rely on the size: the memory can't be taken away from under its mapping (which would SIGBUS)
+		if(fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+			kvmio_Internal_ErrorExit("fcntl F_ADD_SEALS");
+		map();
+
+		// The memory is zeroed, i.e. all the slots are free
+		m_header = new(m_memory) Header { SHARED_FRAME_RING_MAGIC, SHARED_FRAME_RING_VERSION, slotCount, slotSize, width, height, { 0 }, { 0 }, { 0 } };
+		m_slots = reinterpret_cast<SlotHeader*>(m_memory + sizeof(Header));
+		for(u32 i = 0; i < slotCount; i++)
+			new(&m_slots[i]) SlotHeader { { SlotState_Free }, 0, { 0 }, 0 };
+		spdlog::info("Shared frame ring of {} slots of {} bytes created ({} bytes)", slotCount, slotSize, m_size);
+	}
+
+	SharedFrameRing::SharedFrameRing(s32 fd) :
+											m_fd(fd),
+											m_memory(NULL),
+											m_isProducer(false),
+											m_lastSequence(0)
+	{
+		struct stat status;
+		if(fstat(m_fd, &status) < 0)
+			kvmio_Internal_ErrorExit("fstat");
+		const s32 seals = fcntl(m_fd, F_GET_SEALS);
+		if((seals < 0) || !HAS_FLAG(seals, F_SEAL_SHRINK))
+		{
+			spdlog::critical("The shared frame ring is not sealed against shrinking");
+			exit(-1);
+		}
+		m_size = static_cast<std::size_t>(status.st_size);
+		if(m_size < sizeof(Header))
+		{
+			spdlog::critical("The shared frame ring is too small ({} bytes)", m_size);
+			exit(-1);
+		}
+		map();
+
+		m_header = reinterpret_cast<Header*>(m_memory);
+		if((m_header->magic != SHARED_FRAME_RING_MAGIC) || (m_header->version != SHARED_FRAME_RING_VERSION))
+		{
+			spdlog::critical("Not a shared frame ring (or of another version)");
+			exit(-1);
+		}
+		m_dataOffset = AlignUp(sizeof(Header) + sizeof(SlotHeader) * m_header->slotCount, SHARED_FRAME_RING_ALIGNMENT);
+		m_slotStride = AlignUp(m_header->slotSize, SHARED_FRAME_RING_ALIGNMENT);
+		if((m_dataOffset + m_slotStride * m_header->slotCount) > m_size)
+		{
+			spdlog::critical("The shared frame ring is smaller than its {} slots of {} bytes", m_header->slotCount, m_header->slotSize);
+			exit(-1);
+		}
+		m_slots = reinterpret_cast<SlotHeader*>(m_memory + sizeof(Header));
+		// Only the frames submitted from now on
+		m_lastSequence = m_header->sequence.load(std::memory_order_acquire);
+	}
+
+	void SharedFrameRing::map()
+	{
+		void* memory = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if(memory == MAP_FAILED)
+			kvmio_Internal_ErrorExit("mmap");
+		m_memory = static_cast<u8*>(memory);
+	}
+
+	SharedFrameRing::~SharedFrameRing()
+	{
+		munmap(m_memory, m_size);
+		close(m_fd);
+	}
+
+	u32 SharedFrameRing::getSlotCount() const noexcept { return m_header->slotCount; }
+	u32 SharedFrameRing::getSlotSize() const noexcept { return m_header->slotSize; }
+	u32 SharedFrameRing::getWidth() const noexcept { return m_header->width; }
+	u32 SharedFrameRing::getHeight() const noexcept { return m_header->height; }
+	u64 SharedFrameRing::getSubmittedCount() const noexcept { return m_header->sequence.load(std::memory_order_relaxed); }
+	u64 SharedFrameRing::getDroppedCount() const noexcept { return m_header->droppedCount.load(std::memory_order_relaxed); }
+
+	Slot SharedFrameRing::acquireFrame()
+	{
+		DEBUG_ASSERT(m_isProducer);
+		const u32 slotCount = m_header->slotCount;
+		while(true)
+		{
+			for(u32 i = 0; i < slotCount; i++)
+			{
+				u32 state = SlotState_Free;
+				if(m_slots[i].state.compare_exchange_strong(state, SlotState_Writing, std::memory_order_acquire))
+					return { i, { m_memory + m_dataOffset + m_slotStride * i, m_header->slotSize }, 0, 0 };
+			}
+			// Nothing free, the oldest submitted frame which the consumer hasn't taken is overwritten
+			u32 oldest = slotCount;
+			for(u32 i = 0; i < slotCount; i++)
+			{
+				if((m_slots[i].state.load(std::memory_order_acquire) == SlotState_Ready) && ((oldest == slotCount) || (m_slots[i].sequence.load(std::memory_order_relaxed) < m_slots[oldest].sequence.load(std::memory_order_relaxed))))
+					oldest = i;
+			}
+			if(oldest == slotCount)
+				continue;
+			u32 state = SlotState_Ready;
+			// Fails if the consumer took it meanwhile
+			if(m_slots[oldest].state.compare_exchange_strong(state, SlotState_Writing, std::memory_order_acquire))
+			{
+				m_header->droppedCount.fetch_add(1, std::memory_order_relaxed);
+				return { oldest, { m_memory + m_dataOffset + m_slotStride * oldest, m_header->slotSize }, 0, 0 };
+			}
+		}
+	}
+
+	void SharedFrameRing::submitFrame(Slot& slot, u32 size)
+	{
+		DEBUG_ASSERT(m_isProducer && (size <= m_header->slotSize));
+		SlotHeader& slotHeader = m_slots[slot.index];
+		DEBUG_ASSERT(slotHeader.state.load(std::memory_order_relaxed) == SlotState_Writing);
+		slot.sequence = m_header->sequence.load(std::memory_order_relaxed) + 1;
+		slot.timestamp = GetTimestamp();
+		slotHeader.size = size;
+		slotHeader.sequence.store(slot.sequence, std::memory_order_relaxed);
+		slotHeader.timestamp = slot.timestamp;
+		// Publishes the frame's data along with the header fields
+		slotHeader.state.store(SlotState_Ready, std::memory_order_release);
+		m_header->sequence.store(slot.sequence, std::memory_order_release);
+		m_header->futexWord.fetch_add(1, std::memory_order_release);
+		// Not FUTEX_PRIVATE_FLAG, the waiter is in another process
+		syscall(SYS_futex, reinterpret_cast<u32*>(&m_header->futexWord), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	}
+
+	bool SharedFrameRing::acquireLatestFrame(u32 timeout, Slot& slot)
+	{
+		DEBUG_ASSERT(!m_isProducer);
+		const u32 slotCount = m_header->slotCount;
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		while(true)
+		{
+			// Read before looking at the slots, so a submit in between makes the wait below return right away
+			const u32 futexWord = m_header->futexWord.load(std::memory_order_acquire);
+			u32 latest = slotCount;
+			for(u32 i = 0; i < slotCount; i++)
+			{
+				if((m_slots[i].state.load(std::memory_order_acquire) == SlotState_Ready) && (m_slots[i].sequence.load(std::memory_order_relaxed) > m_lastSequence)
+					&& ((latest == slotCount) || (m_slots[i].sequence.load(std::memory_order_relaxed) > m_slots[latest].sequence.load(std::memory_order_relaxed))))
+					latest = i;
+			}
+			if(latest != slotCount)
+			{
+				u32 state = SlotState_Ready;
+				// Fails if the producer took it over meanwhile, it is looked for again
+				if(!m_slots[latest].state.compare_exchange_strong(state, SlotState_Reading, std::memory_order_acquire))
+					continue;
+				// Read again now that the slot can't change: it may have been overwritten and resubmitted before the exchange
+				const SlotHeader& slotHeader = m_slots[latest];
+				slot = { latest, { m_memory + m_dataOffset + m_slotStride * latest, slotHeader.size }, slotHeader.sequence.load(std::memory_order_relaxed), slotHeader.timestamp };
+				m_lastSequence = slot.sequence;
+				// The older frames are dropped, back to the producer
+				for(u32 i = 0; i < slotCount; i++)
+				{
+					state = SlotState_Ready;
+					// Held while its sequence is checked, the producer could otherwise overwrite it with a newer frame in between
+					if((i == latest) || !m_slots[i].state.compare_exchange_strong(state, SlotState_Reading, std::memory_order_acquire))
+						continue;
+					if(m_slots[i].sequence.load(std::memory_order_relaxed) < m_lastSequence)
+					{
+						m_slots[i].state.store(SlotState_Free, std::memory_order_release);
+						m_header->droppedCount.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+						m_slots[i].state.store(SlotState_Ready, std::memory_order_release);
+				}
+				return true;
+			}
+
+			auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if(remaining <= 0)
+				return false;
+			timespec timeSpec { static_cast<time_t>(remaining / 1000000000), static_cast<long>(remaining % 1000000000) };
+			if((syscall(SYS_futex, reinterpret_cast<u32*>(&m_header->futexWord), FUTEX_WAIT, futexWord, &timeSpec, NULL, 0) < 0)
+				&& (errno != EAGAIN) && (errno != EINTR) && (errno != ETIMEDOUT))
+				kvmio_Internal_ErrorExit("futex");
+		}
+	}
+
+	void SharedFrameRing::releaseFrame(Slot& slot)
+	{
+		DEBUG_ASSERT(!m_isProducer && (m_slots[slot.index].state.load(std::memory_order_relaxed) == SlotState_Reading));
+		m_slots[slot.index].state.store(SlotState_Free, std::memory_order_release);
+		slot.data = { };
+	}
+
+	void SharedFrameRing::stream(Window& window, const Window::Predicate& isLoop)
+	{
+		Slot slot;
+		while(isLoop())
+		{
+			if(!acquireLatestFrame(SHARED_FRAME_RING_STREAM_TIMEOUT, slot))
+				continue;
+			// present() converts (or copies) the frame before returning, the slot goes back to the producer right after
+			window.present(slot.data);
+			releaseFrame(slot);
+		}
+	}
+
+	KVMIO_API bool SendFd(s32 socket, s32 fd)
+	{
+		// At least a byte of data has to go along with the ancillary data
+		char byte = 0;
+		iovec iov { &byte, 1 };
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(s32))] = { };
+		msghdr message { };
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		cmsghdr* controlMessage = CMSG_FIRSTHDR(&message);
+		controlMessage->cmsg_level = SOL_SOCKET;
+		controlMessage->cmsg_type = SCM_RIGHTS;
+		controlMessage->cmsg_len = CMSG_LEN(sizeof(s32));
+		std::memcpy(CMSG_DATA(controlMessage), &fd, sizeof(s32));
+		if(sendmsg(socket, &message, MSG_NOSIGNAL) < 0)
+		{
+			spdlog::error("Unable to send the fd {}: {}", fd, std::strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	KVMIO_API s32 ReceiveFd(s32 socket)
+	{
+		char byte;
+		iovec iov { &byte, 1 };
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(s32))] = { };
+		msghdr message { };
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		if(recvmsg(socket, &message, MSG_CMSG_CLOEXEC) <= 0)
+		{
+			spdlog::error("Unable to receive an fd: {}", std::strerror(errno));
+			return -1;
+		}
+		cmsghdr* controlMessage = CMSG_FIRSTHDR(&message);
+		if((controlMessage == NULL) || (controlMessage->cmsg_level != SOL_SOCKET) || (controlMessage->cmsg_type != SCM_RIGHTS))
+		{
+			spdlog::error("No fd came along with the message");
+			return -1;
+		}
+		s32 fd;
+		std::memcpy(&fd, CMSG_DATA(controlMessage), sizeof(s32));
+		return fd;
+	}
+}
@@ -0,0 +1,228 @@
+#include <kvmio/KeyChordEngine.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <algorithm> // for std::equal
+
+namespace kvmio
+{
+	static constexpr u64 SplitMix64(u64 x)
+	{
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	// A random value per key, the hash of a set of keys is the XOR of theirs
+	static constexpr std::array<u64, 256> gZobristKeys = []()
+	{
+		std::array<u64, 256> keys { };
+		for(u32 i = 0; i < keys.size(); i++)
+			keys[i] = SplitMix64(i);
+		return keys;
+	}();
+
+	static constexpr u64 OrderHashSeed = 0xcbf29ce484222325ull;
+
+	static inline u64 MixOrderHash(u64 hash, u8 key)
+	{
+		return (hash ^ gZobristKeys[key]) * 0x100000001b3ull;
+	}
+
+	static bool IsModifierKey(u8 virtualKey)
+	{
+		switch(virtualKey)
+		{
+			// VK_SHIFT, VK_CONTROL, VK_MENU, VK_LWIN, VK_RWIN and VK_LSHIFT to VK_RMENU
+			case 0x10: case 0x11: case 0x12: case 0x5B: case 0x5C:
+			case 0xA0: case 0xA1: case 0xA2: case 0xA3: case 0xA4: case 0xA5:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	KeyChordEngine::KeyChordEngine(std::chrono::milliseconds sequenceTimeout) :
+											m_sequenceNode(0),
+											m_sequenceTimeout(sequenceTimeout),
+											m_setHash(0),
+											m_heldKeyCount(0)
+	{
+		m_sequenceNodes.push_back({ { }, { }, InvalidChord });
+		m_orderHashes[0] = OrderHashSeed;
+	}
+
+	KeyChordEngine::ChordId KeyChordEngine::addChord(std::span<const u8> keys, ChordType type)
+	{
+		DEBUG_ASSERT(!keys.empty() && (keys.size() <= MaxHeldKeys));
+		u64 hash = (type == ChordType::Ordered) ? OrderHashSeed : 0;
+		KeySet keySet;
+		for(u8 key : keys)
+		{
+			DEBUG_ASSERT(!keySet.test(key), "A key can only appear once in a chord");
+			keySet.set(key);
+			hash = (type == ChordType::Ordered) ? MixOrderHash(hash, key) : (hash ^ gZobristKeys[key]);
+		}
+		auto& chords = (type == ChordType::Ordered) ? m_orderedChords : m_unorderedChords;
+		auto it = chords.find(hash);
+		if(it != chords.end())
+		{
+			const Chord& chord = m_chords[it->second];
+			KeySet chordKeySet;
+			for(u8 key : chord.keys)
+				chordKeySet.set(key);
+			// The same chord registered again is the same one
+			if((type == ChordType::Ordered) ? std::equal(chord.keys.begin(), chord.keys.end(), keys.begin(), keys.end()) : (chordKeySet == keySet))
+				return it->second;
+			spdlog::error("Hash collision between two key chords, the latter is ignored");
+			return InvalidChord;
+		}
+		ChordId id = static_cast<ChordId>(m_chords.size());
+		m_chords.push_back({ type, { keys.begin(), keys.end() } });
+		chords.insert({ hash, id });
+		return id;
+	}
+
+	KeyChordEngine::ChordId KeyChordEngine::addSequence(std::span<const std::vector<u8>> steps)
+	{
+		DEBUG_ASSERT(!steps.empty());
+		u32 node = 0;
+		for(const std::vector<u8>& step : steps)
+		{
+			KeySet keySet;
+			u64 hash = 0;
+			for(u8 key : step)
+			{
+				keySet.set(key);
+				hash ^= gZobristKeys[key];
+			}
+			auto it = m_sequenceNodes[node].children.find(hash);
+			if(it == m_sequenceNodes[node].children.end())
+			{
+				u32 child = static_cast<u32>(m_sequenceNodes.size());
+				m_sequenceNodes.push_back({ keySet, { }, InvalidChord });
+				m_sequenceNodes[node].children.insert({ hash, child });
+				node = child;
+			}
+			else if(m_sequenceNodes[it->second].keys != keySet)
+			{
+				spdlog::error("Hash collision between two key sequence steps, the sequence is ignored");
+				return InvalidChord;
+			}
+			else
+				node = it->second;
+		}
+		if(m_sequenceNodes[node].chord != InvalidChord)
+			return m_sequenceNodes[node].chord;
+		// Sequences share the ids of the chords, the entry holds the last step
+		ChordId id = static_cast<ChordId>(m_chords.size());
+		m_chords.push_back({ ChordType::Unordered, steps.back() });
+		m_sequenceNodes[node].chord = id;
+		return id;
+	}
+
+	bool KeyChordEngine::isOrderedMatch(const Chord& chord) const
+	{
+		return std::equal(chord.keys.begin(), chord.keys.end(), m_heldKeys, m_heldKeys + m_heldKeyCount);
+	}
+
+	bool KeyChordEngine::isUnorderedMatch(const Chord& chord) const
+	{
+		if(chord.keys.size() != m_pressedKeys.count())
+			return false;
+		for(u8 key : chord.keys)
+		{
+			if(!m_pressedKeys.test(key))
+				return false;
+		}
+		return true;
+	}
+
+	KeyChordEngine::ChordId KeyChordEngine::advanceSequence(u8 virtualKey)
+	{
+		if(m_sequenceNodes.size() == 1)
+			return InvalidChord;
+		const auto time = std::chrono::steady_clock::now();
+		if((m_sequenceNode != 0) && ((time - m_sequenceStepTime) > m_sequenceTimeout))
+			m_sequenceNode = 0;
+
+		// From the current node and then from the root, i.e. a sequence starting over from its first step
+		for(u32 node : { m_sequenceNode, 0u })
+		{
+			const SequenceNode& current = m_sequenceNodes[node];
+			auto it = current.children.find(m_setHash);
+			if((it == current.children.end()) || (m_sequenceNodes[it->second].keys != m_pressedKeys))
+			{
+				if(node == 0)
+					break;
+				// Getting the modifiers of the next step down
+				if(IsModifierKey(virtualKey))
+					return InvalidChord;
+				continue;
+			}
+			const SequenceNode& child = m_sequenceNodes[it->second];
+			m_sequenceStepTime = time;
+			// Back to the root once a sequence completes, unless a longer one goes on from there
+			m_sequenceNode = child.children.empty() ? 0 : it->second;
+			return child.chord;
+		}
+		m_sequenceNode = 0;
+		return InvalidChord;
+	}
+
+	KeyChordEngine::ChordId KeyChordEngine::onKey(u8 virtualKey, bool isPressed)
+	{
+		if(isPressed)
+		{
+			// Auto repeat
+			if(m_pressedKeys.test(virtualKey))
+				return InvalidChord;
+			m_pressedKeys.set(virtualKey);
+			m_setHash ^= gZobristKeys[virtualKey];
+			if(m_heldKeyCount < MaxHeldKeys)
+			{
+				m_heldKeys[m_heldKeyCount] = virtualKey;
+				m_orderHashes[m_heldKeyCount + 1] = MixOrderHash(m_orderHashes[m_heldKeyCount], virtualKey);
+				m_heldKeyCount++;
+			}
+
+			auto it = m_orderedChords.find(m_orderHashes[m_heldKeyCount]);
+			if((it != m_orderedChords.end()) && isOrderedMatch(m_chords[it->second]))
+				return it->second;
+			it = m_unorderedChords.find(m_setHash);
+			if((it != m_unorderedChords.end()) && isUnorderedMatch(m_chords[it->second]))
+				return it->second;
+			return advanceSequence(virtualKey);
+		}
+
+		if(!m_pressedKeys.test(virtualKey))
+			return InvalidChord;
+		m_pressedKeys.reset(virtualKey);
+		m_setHash ^= gZobristKeys[virtualKey];
+		// The keys pressed after it keep their order, their order hashes are recomputed (at most MaxHeldKeys of them)
+		for(u32 i = 0; i < m_heldKeyCount; i++)
+		{
+			if(m_heldKeys[i] != virtualKey)
+				continue;
+			for(u32 j = i + 1; j < m_heldKeyCount; j++)
+			{
+				m_heldKeys[j - 1] = m_heldKeys[j];
+				m_orderHashes[j] = MixOrderHash(m_orderHashes[j - 1], m_heldKeys[j - 1]);
+			}
+			m_heldKeyCount--;
+			break;
+		}
+		return InvalidChord;
+	}
+
+	void KeyChordEngine::reset()
+	{
+		m_pressedKeys.reset();
+		m_setHash = 0;
+		m_heldKeyCount = 0;
+		m_sequenceNode = 0;
+	}
+}
@@ -0,0 +1,213 @@
+#include <kvmio/LatencyHarness.hpp>
+#include <kvmio/InputEventRing.hpp> // for kvmio::GetInputTimestamp()
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm> // for std::min, std::max_element, std::fill_n
+#include <chrono> // for std::chrono::steady_clock
+#include <cmath> // for std::abs
+
+// F24: on every keyboard layout, and bound to nothing on the targets
+#define PROBE_KEY_MAKE_CODE 0x76
+#define PROBE_KEY_VIRTUAL_KEY 0x87
+// NV12 video range
+#define LUMA_BLACK 16
+#define LUMA_WHITE 235
+#define CHROMA_NEUTRAL 128
+
+namespace kvmio
+{
+	KVMIO_API void DisplayLatencyStatistics(std::span<const LatencyStatistics> statistics)
+	{
+		for(const LatencyStatistics& stats : statistics)
+		{
+			spdlog::info("{}: {} samples, {} missed", stats.configuration, stats.sampleCount, stats.missedCount);
+			spdlog::info("\tinput to present: p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms", stats.inputToPresent.p50, stats.inputToPresent.p99, stats.maxInputToPresent);
+			if(stats.maxInputToDisplay < 0)
+				spdlog::info("\tinput to display: not measured");
+			else
+				spdlog::info("\tinput to display: p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms", stats.inputToDisplay.p50, stats.inputToDisplay.p99, stats.maxInputToDisplay);
+		}
+	}
+
+	LatencyHarness::LatencyHarness(Window& window, const SnapshotRegion& probe, u32 width, u32 height, f64 threshold) :
+														m_window(window),
+														m_width(width),
+														m_height(height),
+														m_probe(probe),
+														m_threshold(threshold),
+														m_state(ProbeState::Idle),
+														m_probeLuma(0),
+														m_baselineLuma(0),
+														m_presentCount(0),
+														m_changePresentIndex(0),
+														m_changePresentTimestamp(0),
+														m_changeDisplayTimestamp(0),
+														m_isDisplayReported(false)
+	{
+	}
+
+	f64 LatencyHarness::getProbeLuma(const u8* yPlane, u32 stride) const
+	{
+		const u32 left = std::min(m_probe.x, m_width);
+		const u32 right = std::min(m_probe.x + m_probe.width, m_width);
+		const u32 top = std::min(m_probe.y, m_height);
+		const u32 bottom = std::min(m_probe.y + m_probe.height, m_height);
+		if((left == right) || (top == bottom))
+			return 0;
+		u64 sum = 0;
+		for(u32 y = top; y < bottom; ++y)
+		{
+			const u8* row = yPlane + static_cast<std::size_t>(y) * stride;
+			for(u32 x = left; x < right; ++x)
+				sum += row[x];
+		}
+		return static_cast<f64>(sum) / static_cast<f64>(static_cast<u64>(right - left) * (bottom - top));
+	}
+
+	void LatencyHarness::probe(const u8* yPlane, u32 stride)
+	{
+		const f64 luma = getProbeLuma(yPlane, stride);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_presentCount;
+		m_probeLuma = luma;
+		if((m_state != ProbeState::Armed) || (std::abs(luma - m_baselineLuma) <= m_threshold))
+			return;
+		// Taken before the frame is handed on, so the window's own present time is part of input to display only
+		m_changePresentTimestamp = GetInputTimestamp();
+		m_changePresentIndex = m_presentCount;
+		m_state = ProbeState::Presented;
+		m_condition.notify_all();
+	}
+
+	void LatencyHarness::present(std::span<const u8> frameData)
+	{
+		if(frameData.size() >= static_cast<std::size_t>(m_width) * m_height)
+			probe(frameData.data(), m_width);
+		m_window.present(frameData);
+	}
+
+	void LatencyHarness::presentPlanes(const FramePlanes& planes)
+	{
+		probe(planes.yPlane, planes.stride);
+		m_window.presentPlanes(planes);
+	}
+
+	void LatencyHarness::onFrameDisplayed(u64 presentIndex, u64 displayTimestamp)
+	{
+		m_isDisplayReported.store(true, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		// Frames may be dropped (i.e. by a mailbox present mode), a later one shows the change as well
+		if((m_state != ProbeState::Presented) || (presentIndex < m_changePresentIndex))
+			return;
+		m_changeDisplayTimestamp = displayTimestamp;
+		m_state = ProbeState::Displayed;
+		m_condition.notify_all();
+	}
+
+	LatencyStatistics LatencyHarness::measure(std::string_view configuration, const Inject& inject, u32 sampleCount, u32 interval, u32 timeout)
+	{
+		std::vector<f64> inputToPresent;
+		std::vector<f64> inputToDisplay;
+		inputToPresent.reserve(sampleCount);
+		inputToDisplay.reserve(sampleCount);
+
+		Win32::KeyboardInput input { };
+		input.makeCode = PROBE_KEY_MAKE_CODE;
+		input.virtualKey = PROBE_KEY_VIRTUAL_KEY;
+
+		LatencyStatistics statistics { };
+		statistics.configuration = configuration;
+		statistics.sampleCount = sampleCount;
+		for(u32 i = 0; i < sampleCount; ++i)
+		{
+			// Lets the previous change settle, so the baseline is the frame the target shows when the input arrives
+			std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+			u64 injectTimestamp;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_baselineLuma = m_probeLuma;
+				// Before arming, a change probed right after can't be timestamped earlier than the input
+				injectTimestamp = GetInputTimestamp();
+				m_state = ProbeState::Armed;
+			}
+			input.keyStatus = Win32::KeyStatus::Pressed;
+			inject(input);
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+				if(!m_condition.wait_until(lock, deadline, [this] { return m_state != ProbeState::Armed; }))
+					++statistics.missedCount;
+				else
+				{
+					inputToPresent.push_back(static_cast<f64>(m_changePresentTimestamp - injectTimestamp) / 1000.0);
+					// A window which never reported a displayed frame isn't waited for
+					if(m_isDisplayReported.load(std::memory_order_relaxed)
+						&& m_condition.wait_until(lock, deadline, [this] { return m_state == ProbeState::Displayed; }))
+						inputToDisplay.push_back(static_cast<f64>(m_changeDisplayTimestamp - injectTimestamp) / 1000.0);
+				}
+				m_state = ProbeState::Idle;
+			}
+
+			input.keyStatus = Win32::KeyStatus::Released;
+			inject(input);
+		}
+
+		statistics.maxInputToPresent = inputToPresent.empty() ? -1.0 : *std::max_element(inputToPresent.begin(), inputToPresent.end());
+		statistics.maxInputToDisplay = inputToDisplay.empty() ? -1.0 : *std::max_element(inputToDisplay.begin(), inputToDisplay.end());
+		statistics.inputToPresent = GetPercentiles(inputToPresent);
+		statistics.inputToDisplay = GetPercentiles(inputToDisplay);
+		spdlog::debug("Latency measured for {}: {} of {} samples missed", statistics.configuration, statistics.missedCount, sampleCount);
+		return statistics;
+	}
+
+	LoopbackTarget::LoopbackTarget(Window& window, const SnapshotRegion& probe, u32 width, u32 height, u32 frameRate) :
+														m_window(window),
+														m_width(width),
+														m_height(height),
+														m_probe(probe),
+														m_frameRate(frameRate),
+														m_pressCount(0),
+														m_isRunning(true),
+														m_thread(&LoopbackTarget::run, this)
+	{
+	}
+
+	LoopbackTarget::~LoopbackTarget()
+	{
+		m_isRunning.store(false, std::memory_order_relaxed);
+		m_thread.join();
+	}
+
+	void LoopbackTarget::keyboard(const Win32::KeyboardInput& input)
+	{
+		if(input.keyStatus == Win32::KeyStatus::Pressed)
+			m_pressCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void LoopbackTarget::run()
+	{
+		const std::size_t lumaSize = static_cast<std::size_t>(m_width) * m_height;
+		std::vector<u8> frame(lumaSize + lumaSize / 2, CHROMA_NEUTRAL);
+		std::fill_n(frame.begin(), lumaSize, LUMA_BLACK);
+
+		const u32 left = std::min(m_probe.x, m_width);
+		const u32 right = std::min(m_probe.x + m_probe.width, m_width);
+		const u32 top = std::min(m_probe.y, m_height);
+		const u32 bottom = std::min(m_probe.y + m_probe.height, m_height);
+
+		const auto period = std::chrono::nanoseconds(1000000000 / std::max(m_frameRate, 1u));
+		auto next = std::chrono::steady_clock::now();
+		while(m_isRunning.load(std::memory_order_relaxed))
+		{
+			// The state is sampled when the frame is captured, as the press may land anywhere within a frame period
+			const u8 luma = (m_pressCount.load(std::memory_order_relaxed) & 1) ? LUMA_WHITE : LUMA_BLACK;
+			for(u32 y = top; y < bottom; ++y)
+				std::fill_n(frame.begin() + static_cast<std::size_t>(y) * m_width + left, right - left, luma);
+			m_window.present(frame);
+			next += period;
+			std::this_thread::sleep_until(next);
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#include <kvmio/NV12ToRGBConverter.hpp>
+#include <kvmio/ColorConversion.hpp>
+
+#include <libassert/assert.hpp>
+
+namespace kvmio
+{
+	NV12ToRGBConverter::NV12ToRGBConverter(u32 width, u32 height, u32 frameRateNum, u32 frameRateDen, u32 bitsPerPixel) :
+																			m_width(width),
+																			m_height(height),
+																			m_frameRateNum(frameRateNum),
+																			m_frameRateDen(frameRateDen),
+																			m_bitsPerPixel(bitsPerPixel),
+																			m_inputSampleSize((width * height * 3) >> 1),
+																			m_outputSampleSize(width * height * (bitsPerPixel >> 3)),
+																			m_isOutputMediaBufferLocked(false),
+																			m_isValid(true)
+	{
+		// Only RGB32 (B8G8R8A8 in memory), the one format the windows ask for
+		DEBUG_ASSERT(bitsPerPixel == 32);
+		m_rgbData.resize(m_outputSampleSize);
+	}
+
+	NV12ToRGBConverter::~NV12ToRGBConverter()
+	{
+	}
+
+	u8* NV12ToRGBConverter::convert(const u8* nv12Buffer, u32 nv12BufferSize)
+	{
+		DEBUG_ASSERT(nv12BufferSize == m_inputSampleSize);
+		ConvertNV12ToBGRA({ nv12Buffer, nv12BufferSize }, m_width, m_height, m_rgbData.data(), m_width * 4);
+		return m_rgbData.data();
+	}
+}
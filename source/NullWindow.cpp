@@ -0,0 +1,204 @@
+#include <kvmio/NullWindow.hpp>
+#include <kvmio/ColorConversion.hpp>
+
+#include <libassert/assert.hpp>
+
+#include <algorithm> // for std::max
+#include <cstring> // for std::memcpy
+
+namespace kvmio
+{
+	NullWindow::NullWindow(u32 width, u32 height) :
+											m_width(width),
+											m_height(height),
+											m_isWindowShouldClose(false),
+											m_cursorOverlay(width, height),
+											m_isSurfaceValid(false),
+											m_presentedCount(0),
+											m_consumedCount(0),
+											m_droppedCount(0),
+											m_firstPresentTime(0),
+											m_latencySum(0),
+											m_maxLatency(0)
+	{
+		m_rgbFrameSize = width * height * 4;
+		m_surface.resize(m_rgbFrameSize);
+
+		m_pooledFrames = std::make_unique<DataPool>([this]()
+		{
+			u8* data = new u8[m_rgbFrameSize];
+			return std::span <u8> { data, m_rgbFrameSize };
+		},
+		[](std::span<u8>& s)
+		{
+			delete[] s.data();
+		},
+		nullptr,
+		nullptr,
+		[](std::span<u8>& s1, std::span<u8>& s2) -> bool { return s1.data() == s2.data(); });
+	}
+
+	NullWindow::~NullWindow()
+	{
+		std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+		for(QueuedFrame& frame : m_queuedFrames)
+			m_pooledFrames->put(frame.data);
+		m_queuedFrames.clear();
+	}
+
+	void NullWindow::close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_isWindowShouldClose = true;
+		}
+		m_queueCondition.notify_all();
+	}
+
+	void NullWindow::runGameLoop()
+	{
+		// The cursor is only drawn along with the frames, there is nothing to wake the loop up otherwise
+		while(!isShouldClose())
+			consume(true);
+	}
+
+	void NullWindow::runGameLoop(u32 frameRate, const Predicate& isLoop)
+	{
+		const auto deltaTime = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<f64>(1.0 / frameRate));
+		auto nextFrameTime = Clock::now();
+		while(isLoop() && !isShouldClose())
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_queueMutex);
+				m_queueCondition.wait_until(lock, nextFrameTime, [this] { return m_isWindowShouldClose.load(); });
+			}
+			if(isShouldClose())
+				break;
+			// Ticks which have been missed (i.e. the consumer being slower than the frame rate) are skipped rather than caught up with
+			nextFrameTime = std::max(nextFrameTime + deltaTime, Clock::now());
+			consume(false);
+			updateCursor();
+		}
+	}
+
+	void NullWindow::present(std::span<const u8> frameData)
+	{
+		DEBUG_ASSERT(frameData.size() >= (static_cast<std::size_t>(m_width) * m_height * 3 / 2));
+		presentPlanes({ frameData.data(), frameData.data() + static_cast<std::size_t>(m_width) * m_height, m_width, m_width, m_height });
+	}
+
+	void NullWindow::presentPlanes(const FramePlanes& planes)
+	{
+		DEBUG_ASSERT((planes.width == m_width) && (planes.height == m_height));
+		if(m_isWindowShouldClose)
+			return;
+		const auto presentTime = Clock::now();
+		Clock::rep firstPresentTime = 0;
+		m_firstPresentTime.compare_exchange_strong(firstPresentTime, presentTime.time_since_epoch().count());
+
+		DataPool::ElementType dstFrameData;
+		{
+			std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+			dstFrameData = m_pooledFrames->get();
+		}
+		std::span<u8>& t = dstFrameData;
+		// On the presenting thread, as the native windows do, so that the loop only measures the copy into the surface
+		ConvertNV12ToBGRA(planes.yPlane, planes.uvPlane, planes.stride, m_width, m_height, t.data(), m_width * 4);
+		t = { t.data(), m_rgbFrameSize };
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_queuedFrames.push_back({ dstFrameData, m_presentedCount.fetch_add(1, std::memory_order_relaxed) + 1, presentTime });
+		}
+		m_queueCondition.notify_one();
+	}
+
+	bool NullWindow::consume(bool isBlock)
+	{
+		QueuedFrame frame;
+		std::vector<QueuedFrame> droppedFrames;
+		{
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			if(isBlock)
+				m_queueCondition.wait(lock, [this] { return !m_queuedFrames.empty() || m_isWindowShouldClose.load(); });
+			if(m_queuedFrames.empty())
+				return false;
+			// Only the latest frame is consumed, the ones which have been queued up behind it go back to the pool
+			frame = m_queuedFrames.back();
+			m_queuedFrames.pop_back();
+			droppedFrames.assign(m_queuedFrames.begin(), m_queuedFrames.end());
+			m_queuedFrames.clear();
+		}
+		if(!droppedFrames.empty())
+		{
+			std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+			for(QueuedFrame& droppedFrame : droppedFrames)
+				m_pooledFrames->put(droppedFrame.data);
+			m_droppedCount.fetch_add(droppedFrames.size(), std::memory_order_relaxed);
+		}
+
+		const std::span<u8>& t = frame.data;
+		DEBUG_ASSERT(t.size() == m_surface.size());
+		std::memcpy(m_surface.data(), t.data(), t.size());
+		setDisplayedFrame(frame.data);
+		// The cursor drawn over the previous frame has been overwritten along with it
+		m_softwareCursor.invalidate();
+		m_softwareCursor.draw(m_surface.data(), m_width, m_height, m_cursorOverlay.getState());
+		m_isSurfaceValid = true;
+
+		const auto consumeTime = Clock::now();
+		const f64 latency = std::chrono::duration<f64, std::milli>(consumeTime - frame.presentTime).count();
+		{
+			std::lock_guard<std::mutex> lock(m_statisticsMutex);
+			m_latencySum += latency;
+			m_maxLatency = std::max(m_maxLatency, latency);
+		}
+		const u64 index = m_consumedCount.fetch_add(1, std::memory_order_relaxed);
+		m_consumedFrameEvent.publish({ index, frame.presentIndex, m_width, m_height, m_surface, frame.presentTime, consumeTime });
+		return true;
+	}
+
+	void NullWindow::updateCursor()
+	{
+		if(!m_isSurfaceValid || (m_cursorOverlay.getVersion() == m_softwareCursor.getDrawnVersion()))
+			return;
+		m_softwareCursor.restore(m_surface.data(), m_width, m_height);
+		m_softwareCursor.draw(m_surface.data(), m_width, m_height, m_cursorOverlay.getState());
+	}
+
+	NullWindow::Statistics NullWindow::getStatistics() const
+	{
+		Statistics statistics { };
+		statistics.presentedCount = m_presentedCount.load(std::memory_order_relaxed);
+		statistics.consumedCount = m_consumedCount.load(std::memory_order_relaxed);
+		statistics.droppedCount = m_droppedCount.load(std::memory_order_relaxed);
+		const Clock::rep firstPresentTime = m_firstPresentTime.load();
+		if(firstPresentTime != 0)
+			statistics.elapsedTime = std::chrono::duration<f64>(Clock::now() - Clock::time_point(Clock::duration(firstPresentTime))).count();
+		std::lock_guard<std::mutex> lock(m_statisticsMutex);
+		if(statistics.consumedCount != 0)
+			statistics.averageLatency = m_latencySum / statistics.consumedCount;
+		statistics.maxLatency = m_maxLatency;
+		return statistics;
+	}
+
+	void NullWindow::setDisplayedFrame(DataPool::ElementType& frame)
+	{
+		std::shared_ptr<DataPool::ElementType> displayedFrame(new DataPool::ElementType(frame), [this](DataPool::ElementType* frame)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+				m_pooledFrames->put(*frame);
+			}
+			delete frame;
+		});
+		const u32 width = m_width;
+		const u32 height = m_height;
+		const std::span<u8>& pixels = *displayedFrame;
+		m_snapshotSource.setFrame(std::move(displayedFrame), pixels, SnapshotSourceFormat::BGRA, width, height);
+	}
+
+	void NullWindow::requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		m_snapshotSource.request(region, format, std::move(callback));
+	}
+}
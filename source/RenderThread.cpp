@@ -0,0 +1,35 @@
+#include <kvmio/RenderThread.hpp>
+
+#include <libassert/assert.hpp>
+
+namespace kvmio
+{
+	RenderThread::RenderThread(u32 width, u32 height) : m_extent((static_cast<u64>(width) << 32) | height), m_isRunning(false)
+	{
+	}
+
+	RenderThread::~RenderThread()
+	{
+		stop();
+	}
+
+	std::pair<u32, u32> RenderThread::getExtent() const noexcept
+	{
+		u64 extent = m_extent.load(std::memory_order_acquire);
+		return { static_cast<u32>(extent >> 32), static_cast<u32>(extent) };
+	}
+
+	void RenderThread::start(Loop loop)
+	{
+		DEBUG_ASSERT(!m_thread.joinable(), "The render loop is already running");
+		m_isRunning.store(true, std::memory_order_release);
+		m_thread = std::thread(std::move(loop));
+	}
+
+	void RenderThread::stop()
+	{
+		m_isRunning.store(false, std::memory_order_release);
+		if(m_thread.joinable())
+			m_thread.join();
+	}
+}
@@ -0,0 +1,187 @@
+#include <kvmio/Snapshot.hpp>
+
+#include <libassert/assert.hpp>
+
+#include <algorithm> // for std::min, std::clamp
+
+namespace kvmio
+{
+	SnapshotRegion ClipSnapshotRegion(const SnapshotRegion& region, u32 width, u32 height)
+	{
+		if((region.width == 0) || (region.height == 0))
+			return { 0, 0, width, height };
+		if((region.x >= width) || (region.y >= height))
+			return { 0, 0, 0, 0 };
+		return { region.x, region.y, std::min(region.width, width - region.x), std::min(region.height, height - region.y) };
+	}
+
+	static u8 ClampToByte(s32 value)
+	{
+		return static_cast<u8>(std::clamp<s32>(value, 0, 255));
+	}
+
+	// BT.709 luma weights in 8.8 fixed point
+	static u8 GetLuma(u8 r, u8 g, u8 b)
+	{
+		return static_cast<u8>((54 * r + 183 * g + 19 * b) >> 8);
+	}
+
+	static void WritePixel(u8* dst, SnapshotFormat format, u8 r, u8 g, u8 b)
+	{
+		switch(format)
+		{
+			case SnapshotFormat::BGRA: dst[0] = b; dst[1] = g; dst[2] = r; dst[3] = 255; break;
+			case SnapshotFormat::RGBA: dst[0] = r; dst[1] = g; dst[2] = b; dst[3] = 255; break;
+			case SnapshotFormat::Gray: dst[0] = GetLuma(r, g, b); break;
+		}
+	}
+
+	void ConvertSnapshot(std::span<const u8> source, SnapshotSourceFormat sourceFormat, u32 sourceWidth, u32 sourceHeight,
+							const SnapshotRegion& region, SnapshotFormat format, std::vector<u8>& pixels)
+	{
+		DEBUG_ASSERT(((region.x + region.width) <= sourceWidth) && ((region.y + region.height) <= sourceHeight));
+		const u32 pixelSize = GetSnapshotFormatPixelSize(format);
+		pixels.resize(static_cast<std::size_t>(region.width) * region.height * pixelSize);
+		u8* dst = pixels.data();
+		if(sourceFormat == SnapshotSourceFormat::BGRA)
+		{
+			DEBUG_ASSERT(source.size() >= (static_cast<std::size_t>(sourceWidth) * sourceHeight * 4));
+			for(u32 y = 0; y < region.height; y++)
+			{
+				const u8* src = source.data() + (static_cast<std::size_t>(region.y + y) * sourceWidth + region.x) * 4;
+				for(u32 x = 0; x < region.width; x++, src += 4, dst += pixelSize)
+					WritePixel(dst, format, src[2], src[1], src[0]);
+			}
+			return;
+		}
+
+		// NV12: full resolution Y plane followed by the half resolution interleaved CbCr plane
+		DEBUG_ASSERT(source.size() >= ((static_cast<std::size_t>(sourceWidth) * sourceHeight * 3) >> 1));
+		const u8* yPlane = source.data();
+		const u8* uvPlane = source.data() + static_cast<std::size_t>(sourceWidth) * sourceHeight;
+		for(u32 y = 0; y < region.height; y++)
+		{
+			const u32 sy = region.y + y;
+			const u8* yRow = yPlane + static_cast<std::size_t>(sy) * sourceWidth;
+			const u8* uvRow = uvPlane + static_cast<std::size_t>(sy >> 1) * sourceWidth;
+			for(u32 x = 0; x < region.width; x++, dst += pixelSize)
+			{
+				const u32 sx = region.x + x;
+				const s32 luma = yRow[sx];
+				if(format == SnapshotFormat::Gray)
+				{
+					dst[0] = static_cast<u8>(luma);
+					continue;
+				}
+				// BT.709 full range, same as the YCbCr sampler conversion of the Vulkan present engine; 16.16 fixed point
+				const s32 cb = uvRow[sx & ~1u] - 128;
+				const s32 cr = uvRow[(sx & ~1u) + 1] - 128;
+				const u8 r = ClampToByte(luma + ((103206 * cr) >> 16));
+				const u8 g = ClampToByte(luma - ((12276 * cb + 30678 * cr) >> 16));
+				const u8 b = ClampToByte(luma + ((121609 * cb) >> 16));
+				WritePixel(dst, format, r, g, b);
+			}
+		}
+	}
+
+	SnapshotWorker::SnapshotWorker() : m_isStop(false)
+	{
+		m_thread = std::thread(&SnapshotWorker::run, this);
+	}
+
+	SnapshotWorker::~SnapshotWorker()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isStop = true;
+		}
+		m_condition.notify_one();
+		m_thread.join();
+	}
+
+	void SnapshotWorker::post(Job&& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(std::move(job));
+		}
+		m_condition.notify_one();
+	}
+
+	void SnapshotWorker::run()
+	{
+		while(true)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this]() { return m_isStop || !m_jobs.empty(); });
+				if(m_jobs.empty())
+					return;
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	void SnapshotWorker::deliver(std::span<const u8> source, SnapshotSourceFormat sourceFormat, u32 sourceWidth, u32 sourceHeight,
+									const SnapshotRegion& region, SnapshotFormat format, const SnapshotCallback& callback)
+	{
+		ConvertSnapshot(source, sourceFormat, sourceWidth, sourceHeight, region, format, m_pixels);
+		callback({ format, region.width, region.height, { m_pixels.data(), m_pixels.size() } });
+	}
+
+	SnapshotSource::SnapshotSource(SnapshotWorker* worker) : m_frame { }, m_worker(worker)
+	{
+	}
+
+	void SnapshotSource::setFrame(std::shared_ptr<const void> owner, std::span<const u8> pixels, SnapshotSourceFormat format, u32 width, u32 height)
+	{
+		Frame frame { std::move(owner), pixels, format, width, height };
+		Frame previousFrame;
+		std::vector<Request> pendingRequests;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			previousFrame = std::move(m_frame);
+			m_frame = frame;
+			std::swap(m_pendingRequests, pendingRequests);
+		}
+		// The previous frame is released (and possibly returned to its pool) outside of the lock
+		previousFrame = { };
+		// The worker exists, the requests created it
+		for(Request& request : pendingRequests)
+			post(frame, std::move(request));
+	}
+
+	void SnapshotSource::request(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		Frame frame;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(m_worker == nullptr)
+			{
+				m_ownWorker = std::make_unique<SnapshotWorker>();
+				m_worker = m_ownWorker.get();
+			}
+			if(!m_frame.owner)
+			{
+				m_pendingRequests.push_back({ region, format, std::move(callback) });
+				return;
+			}
+			frame = m_frame;
+		}
+		post(frame, { region, format, std::move(callback) });
+	}
+
+	void SnapshotSource::post(const Frame& frame, Request&& request)
+	{
+		SnapshotWorker* worker = m_worker;
+		// Only the reference count of the frame is incremented, it is converted on the worker thread
+		worker->post([worker, frame, request = std::move(request)]()
+		{
+			worker->deliver(frame.pixels, frame.format, frame.width, frame.height, ClipSnapshotRegion(request.region, frame.width, frame.height),
+							request.format, request.callback);
+		});
+	}
+}
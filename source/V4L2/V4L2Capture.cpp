@@ -0,0 +1,270 @@
+#include <kvmio/V4L2/V4L2Capture.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm> // for std::max
+#include <chrono>
+#include <cerrno> // for errno
+#include <cstring> // for std::strerror
+
+// How long stream() waits for a frame before checking the predicate again, in milliseconds
+#define V4L2_CAPTURE_STREAM_TIMEOUT 100
+
+namespace kvmio::V4L2
+{
+	// Retries on EINTR, as a signal may interrupt any of the V4L2 ioctls
+	static s32 Ioctl(s32 fd, unsigned long request, void* arg)
+	{
+		s32 result;
+		do
+		{
+			result = ioctl(fd, request, arg);
+		} while((result < 0) && (errno == EINTR));
+		return result;
+	}
+
+	static std::string FourCCToString(u32 fourCC)
+	{
+		return { static_cast<char>(fourCC & 0xFF), static_cast<char>((fourCC >> 8) & 0xFF), static_cast<char>((fourCC >> 16) & 0xFF), static_cast<char>((fourCC >> 24) & 0xFF) };
+	}
+
+	V4L2Capture::V4L2Capture(std::string_view path, u32 width, u32 height, u32 frameRate, u32 bufferCount, bool isExportDmaBuf) :
+											m_path(path),
+											m_isStreaming(false),
+											m_queuedCount(0)
+	{
+		m_fd = open(m_path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if(m_fd < 0)
+		{
+			spdlog::critical("Unable to open {}: {}", m_path, std::strerror(errno));
+			exit(-1);
+		}
+
+		v4l2_capability capability { };
+		if(Ioctl(m_fd, VIDIOC_QUERYCAP, &capability) < 0)
+			kvmio_Internal_ErrorExit("ioctl VIDIOC_QUERYCAP");
+		const u32 caps = HAS_FLAG(capability.capabilities, V4L2_CAP_DEVICE_CAPS) ? capability.device_caps : capability.capabilities;
+		if(!HAS_FLAG(caps, V4L2_CAP_VIDEO_CAPTURE) || !HAS_FLAG(caps, V4L2_CAP_STREAMING))
+		{
+			spdlog::critical("{} ({}) is not a streaming single-planar capture device", m_path, reinterpret_cast<const char*>(capability.card));
+			exit(-1);
+		}
+
+		v4l2_format format { };
+		format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		format.fmt.pix.width = width;
+		format.fmt.pix.height = height;
+		format.fmt.pix.pixelformat = V4L2_PIX_FMT_NV12;
+		format.fmt.pix.field = V4L2_FIELD_NONE;
+		if(Ioctl(m_fd, VIDIOC_S_FMT, &format) < 0)
+			kvmio_Internal_ErrorExit("ioctl VIDIOC_S_FMT");
+		// The driver adjusts the format to the closest one it supports instead of failing
+		if(format.fmt.pix.pixelformat != V4L2_PIX_FMT_NV12)
+		{
+			spdlog::critical("{} does not capture NV12, it offers {}", m_path, FourCCToString(format.fmt.pix.pixelformat));
+			exit(-1);
+		}
+		m_width = format.fmt.pix.width;
+		m_height = format.fmt.pix.height;
+		m_bytesPerLine = format.fmt.pix.bytesperline;
+		if((m_width != width) || (m_height != height))
+			spdlog::warn("{} captures {}x{} instead of {}x{}", m_path, m_width, m_height, width, height);
+
+		v4l2_streamparm streamParm { };
+		streamParm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if((Ioctl(m_fd, VIDIOC_G_PARM, &streamParm) == 0) && HAS_FLAG(streamParm.parm.capture.capability, V4L2_CAP_TIMEPERFRAME))
+		{
+			streamParm.parm.capture.timeperframe = { 1, frameRate };
+			if(Ioctl(m_fd, VIDIOC_S_PARM, &streamParm) < 0)
+				spdlog::warn("Unable to set the frame rate of {} to {}", m_path, frameRate);
+		}
+
+		v4l2_requestbuffers requestBuffers { };
+		requestBuffers.count = bufferCount;
+		requestBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		requestBuffers.memory = V4L2_MEMORY_MMAP;
+		if(Ioctl(m_fd, VIDIOC_REQBUFS, &requestBuffers) < 0)
+			kvmio_Internal_ErrorExit("ioctl VIDIOC_REQBUFS");
+		if(requestBuffers.count < 2)
+		{
+			spdlog::critical("{} gave only {} buffers", m_path, requestBuffers.count);
+			exit(-1);
+		}
+
+		m_buffers.reserve(requestBuffers.count);
+		for(u32 i = 0; i < requestBuffers.count; i++)
+		{
+			v4l2_buffer buffer { };
+			buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buffer.memory = V4L2_MEMORY_MMAP;
+			buffer.index = i;
+			if(Ioctl(m_fd, VIDIOC_QUERYBUF, &buffer) < 0)
+				kvmio_Internal_ErrorExit("ioctl VIDIOC_QUERYBUF");
+			void* data = mmap(NULL, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, buffer.m.offset);
+			if(data == MAP_FAILED)
+				kvmio_Internal_ErrorExit("mmap");
+			s32 dmaBufFd = -1;
+			if(isExportDmaBuf)
+			{
+				v4l2_exportbuffer exportBuffer { };
+				exportBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+				exportBuffer.index = i;
+				exportBuffer.flags = O_RDONLY | O_CLOEXEC;
+				if(Ioctl(m_fd, VIDIOC_EXPBUF, &exportBuffer) < 0)
+					spdlog::warn("Unable to export the buffer {} of {} as a DMABUF: {}", i, m_path, std::strerror(errno));
+				else
+					dmaBufFd = exportBuffer.fd;
+			}
+			m_buffers.push_back({ static_cast<u8*>(data), buffer.length, dmaBufFd });
+		}
+		spdlog::info("{} ({}) captures NV12 {}x{}, {} bytes per line, into {} buffers", m_path, reinterpret_cast<const char*>(capability.card),
+						m_width, m_height, m_bytesPerLine, m_buffers.size());
+	}
+
+	V4L2Capture::~V4L2Capture()
+	{
+		DEBUG_ASSERT(m_queuedCount == m_buffers.size() || !m_isStreaming, "Captured frames are still referred to");
+		stop();
+		for(Buffer& buffer : m_buffers)
+		{
+			if(buffer.dmaBufFd >= 0)
+				close(buffer.dmaBufFd);
+			munmap(buffer.data, buffer.size);
+		}
+		v4l2_requestbuffers requestBuffers { };
+		requestBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		requestBuffers.memory = V4L2_MEMORY_MMAP;
+		Ioctl(m_fd, VIDIOC_REQBUFS, &requestBuffers);
+		close(m_fd);
+	}
+
+	void V4L2Capture::queueBuffer(u32 index)
+	{
+		v4l2_buffer buffer { };
+		buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buffer.memory = V4L2_MEMORY_MMAP;
+		buffer.index = index;
+		if(Ioctl(m_fd, VIDIOC_QBUF, &buffer) < 0)
+		{
+			spdlog::error("Unable to queue the buffer {} of {}: {}", index, m_path, std::strerror(errno));
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_queuedCount++;
+		}
+		m_queueCondition.notify_one();
+	}
+
+	void V4L2Capture::start()
+	{
+		if(m_isStreaming)
+			return;
+		for(u32 i = 0; i < m_buffers.size(); i++)
+			queueBuffer(i);
+		v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if(Ioctl(m_fd, VIDIOC_STREAMON, &type) < 0)
+			kvmio_Internal_ErrorExit("ioctl VIDIOC_STREAMON");
+		m_isStreaming = true;
+	}
+
+	void V4L2Capture::stop()
+	{
+		if(!m_isStreaming)
+			return;
+		// Takes all the buffers back from the driver, whether filled or not
+		v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if(Ioctl(m_fd, VIDIOC_STREAMOFF, &type) < 0)
+			spdlog::error("Unable to stop streaming {}: {}", m_path, std::strerror(errno));
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_queuedCount = 0;
+		}
+		m_isStreaming = false;
+	}
+
+	std::shared_ptr<const CapturedFrame> V4L2Capture::dequeue(u32 timeout)
+	{
+		DEBUG_ASSERT(m_isStreaming);
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		{
+			// The driver reports an error rather than blocking when it owns no buffer, so wait for the consumer to release one first
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			if(!m_queueCondition.wait_until(lock, deadline, [this] { return m_queuedCount != 0; }))
+				return nullptr;
+		}
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		pollfd pollFd { m_fd, POLLIN, 0 };
+		s32 result = poll(&pollFd, 1, static_cast<s32>(std::max<s64>(remaining, 0)));
+		if(result <= 0)
+		{
+			if((result < 0) && (errno != EINTR))
+				kvmio_Internal_ErrorExit("poll");
+			return nullptr;
+		}
+
+		v4l2_buffer buffer { };
+		buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buffer.memory = V4L2_MEMORY_MMAP;
+		if(Ioctl(m_fd, VIDIOC_DQBUF, &buffer) < 0)
+		{
+			if(errno != EAGAIN)
+				spdlog::error("Unable to dequeue a buffer of {}: {}", m_path, std::strerror(errno));
+			return nullptr;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_queuedCount--;
+		}
+		if(HAS_FLAG(buffer.flags, V4L2_BUF_FLAG_ERROR))
+		{
+			// The data is corrupted (e.g. lost signal), the buffer goes back right away
+			queueBuffer(buffer.index);
+			return nullptr;
+		}
+
+		const Buffer& data = m_buffers[buffer.index];
+		DEBUG_ASSERT(buffer.bytesused >= (static_cast<std::size_t>(m_bytesPerLine) * m_height * 3 / 2));
+		auto* frame = new CapturedFrame { };
+		frame->planes = { data.data, data.data + static_cast<std::size_t>(m_bytesPerLine) * m_height, m_bytesPerLine, m_width, m_height };
+		frame->bufferIndex = buffer.index;
+		frame->sequence = buffer.sequence;
+		frame->timestamp = static_cast<u64>(buffer.timestamp.tv_sec) * 1000000 + static_cast<u64>(buffer.timestamp.tv_usec);
+		// The buffer is requeued by whichever thread releases the last reference
+		return std::shared_ptr<const CapturedFrame>(frame, [this](const CapturedFrame* frame)
+		{
+			if(m_isStreaming)
+				queueBuffer(frame->bufferIndex);
+			delete frame;
+		});
+	}
+
+	void V4L2Capture::stream(Window& window, const Window::Predicate& isLoop)
+	{
+		start();
+		u32 nextSequence = 0;
+		bool isFirst = true;
+		while(isLoop())
+		{
+			auto frame = dequeue(V4L2_CAPTURE_STREAM_TIMEOUT);
+			if(!frame)
+				continue;
+			if(!isFirst && (frame->sequence != nextSequence))
+				spdlog::debug("{} dropped {} frames", m_path, frame->sequence - nextSequence);
+			isFirst = false;
+			nextSequence = frame->sequence + 1;
+			// present() converts (or copies) the frame before returning, so the buffer is requeued right away
+			window.presentPlanes(frame->planes);
+		}
+		stop();
+	}
+}
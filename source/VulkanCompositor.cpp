@@ -0,0 +1,545 @@
+#include <kvmio/VulkanCompositor.hpp>
+#include <kvmio/VulkanUtility.hpp>
+#include <kvmio/VulkanSurface.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm> // for std::min, std::max, std::clamp
+#include <chrono>
+#include <cmath> // for std::sqrt, std::ceil
+#include <cstring> // for std::memcpy
+#include <thread> // for std::this_thread::sleep_until
+#include <tuple> // for std::tie
+
+#define COMPOSITOR_IMAGE_COUNT 3
+// Upload budget of a single refresh, the feeds which changed beyond it are uploaded in the next refresh(es)
+#define COMPOSITOR_MAX_UPLOADS_PER_FRAME 8
+// In pixels, between neighbouring tiles
+#define COMPOSITOR_TILE_GAP 4
+#define COMPOSITOR_FORMAT VK_FORMAT_B8G8R8A8_UNORM
+// In milliseconds, how long the render loop sleeps at most while there is nothing to draw before checking its callback again
+#define COMPOSITOR_IDLE_WAIT_TIMEOUT 10
+
+namespace kvmio
+{
+	static u32 GetMipLevelCount(u32 width, u32 height)
+	{
+		u32 count = 1;
+		while((width | height) >> count)
+			++count;
+		return count;
+	}
+
+	static u32 FindMemoryTypeIndex(VkPhysicalDevice device, u32 memoryTypeBits, VkMemoryPropertyFlags properties)
+	{
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+		for(u32 i = 0; i < memoryProperties.memoryTypeCount; i++)
+			if((memoryTypeBits & (1u << i)) && ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties))
+				return i;
+		spdlog::critical("No suitable memory type found for the feed images");
+		exit(EXIT_FAILURE);
+	}
+
+	// pvkCreateImage() doesn't take a mip level count
+	static VkImage CreateFeedImage(VkPhysicalDevice physicalDevice, VkDevice device, u32 width, u32 height, u32 mipLevelCount, VkDeviceMemory& memory)
+	{
+		VkImageCreateInfo cInfo { };
+		{
+			cInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			cInfo.imageType = VK_IMAGE_TYPE_2D;
+			cInfo.format = COMPOSITOR_FORMAT;
+			cInfo.extent = { width, height, 1 };
+			cInfo.mipLevels = mipLevelCount;
+			cInfo.arrayLayers = 1;
+			cInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			cInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			cInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			cInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			cInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		};
+		VkImage image;
+		PVK_CHECK(vkCreateImage(device, &cInfo, NULL, &image));
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(device, image, &requirements);
+		VkMemoryAllocateInfo allocInfo { };
+		{
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = requirements.size;
+			allocInfo.memoryTypeIndex = FindMemoryTypeIndex(physicalDevice, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		};
+		PVK_CHECK(vkAllocateMemory(device, &allocInfo, NULL, &memory));
+		PVK_CHECK(vkBindImageMemory(device, image, memory, 0));
+		return image;
+	}
+
+	// The tiles are blitted (not drawn) into the swapchain images, so they must be transfer destinations; pvkCreateSwapchain() doesn't allow that
+	static VkSwapchainKHR CreateSwapchain(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, u32 imageCount, u32 width, u32 height, VkPresentModeKHR presentMode, const uint32_t queueFamilyIndices[2])
+	{
+		VkSurfaceCapabilitiesKHR capabilities;
+		PVK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities));
+		if((capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0)
+		{
+			spdlog::critical("Surface doesn't support VK_IMAGE_USAGE_TRANSFER_DST_BIT swapchain images, required by the compositor");
+			exit(EXIT_FAILURE);
+		}
+
+		VkSwapchainCreateInfoKHR cInfo { };
+		{
+			cInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+			cInfo.surface = surface;
+			cInfo.minImageCount = imageCount;
+			cInfo.imageFormat = COMPOSITOR_FORMAT;
+			cInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+			cInfo.imageExtent.width = std::clamp(width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+			cInfo.imageExtent.height = std::clamp(height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+			cInfo.imageArrayLayers = 1;
+			cInfo.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			cInfo.imageSharingMode = (queueFamilyIndices[0] == queueFamilyIndices[1]) ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT;
+			cInfo.queueFamilyIndexCount = (queueFamilyIndices[0] == queueFamilyIndices[1]) ? 0 : 2;
+			cInfo.pQueueFamilyIndices = queueFamilyIndices;
+			cInfo.preTransform = capabilities.currentTransform;
+			cInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+			cInfo.presentMode = presentMode;
+			cInfo.clipped = VK_TRUE;
+			cInfo.oldSwapchain = VK_NULL_HANDLE;
+		};
+		VkSwapchainKHR swapchain;
+		PVK_CHECK(vkCreateSwapchainKHR(device, &cInfo, NULL, &swapchain));
+		return swapchain;
+	}
+
+	static VkSemaphore CreateVkSemaphore(VkDevice device)
+	{
+		VkSemaphoreCreateInfo cInfo { };
+		cInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		VkSemaphore semaphore;
+		PVK_CHECK(vkCreateSemaphore(device, &cInfo, NULL, &semaphore));
+		return semaphore;
+	}
+
+	static void CmdImageBarrier(VkCommandBuffer commandBuffer, VkImage image, u32 baseMipLevel, u32 levelCount,
+								VkImageLayout oldLayout, VkImageLayout newLayout,
+								VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+								VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
+	{
+		VkImageMemoryBarrier imageMemoryBarrier = { };
+		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageMemoryBarrier.srcAccessMask = srcAccessMask;
+		imageMemoryBarrier.dstAccessMask = dstAccessMask;
+		imageMemoryBarrier.oldLayout = oldLayout;
+		imageMemoryBarrier.newLayout = newLayout;
+		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.image = image;
+		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageMemoryBarrier.subresourceRange.baseMipLevel = baseMipLevel;
+		imageMemoryBarrier.subresourceRange.levelCount = levelCount;
+		imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+		imageMemoryBarrier.subresourceRange.layerCount = 1;
+		vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
+	}
+
+	VulkanCompositor::VulkanCompositor(const VkSurfaceKHRCreateCallback& surfaceCreateCallback, const ExtentCallback& extentCallback, u32 feedCount, u32 feedWidth, u32 feedHeight) :
+																		m_surfaceCreateCallback(surfaceCreateCallback),
+																		m_extentCallback(extentCallback),
+																		m_feedCount(feedCount),
+																		m_feedWidth(feedWidth),
+																		m_feedHeight(feedHeight),
+																		m_feedFrameSize(feedWidth * feedHeight * 4),
+																		m_mipLevelCount(GetMipLevelCount(feedWidth, feedHeight)),
+																		m_columnCount(0),
+																		m_rowCount(0),
+																		m_width(0),
+																		m_height(0),
+																		m_vkSwapchain(VK_NULL_HANDLE),
+																		m_stagingPtr(NULL),
+																		m_feeds(feedCount),
+																		m_pendingFeedCount(0),
+																		m_nextUploadFeed(0),
+																		m_isLayoutDirty(true)
+	{
+		DEBUG_ASSERT(feedCount > 0);
+		// The most square grid that fits all the feeds
+		m_columnCount = static_cast<u32>(std::ceil(std::sqrt(static_cast<f64>(feedCount))));
+		m_rowCount = (feedCount + m_columnCount - 1) / m_columnCount;
+
+		// One worker for all the feeds, it idles until a snapshot is requested
+		m_snapshotWorker = std::make_unique<SnapshotWorker>();
+		for(Feed& feed : m_feeds)
+			feed.snapshotSource = std::make_unique<SnapshotSource>(m_snapshotWorker.get());
+
+		m_pooledFrames = std::make_unique<DataPool>([this]()
+		{
+			u8* data = new u8[m_feedFrameSize];
+			return std::span <u8> { data, m_feedFrameSize };
+		},
+		[](std::span<u8>& s)
+		{
+			delete[] s.data();
+		},
+		nullptr,
+		nullptr,
+		[](std::span<u8>& s1, std::span<u8>& s2) -> bool { return s1.data() == s2.data(); });
+
+		m_vkInstance = pvkCreateVulkanInstanceWithExtensions(2, GetNativeSurfaceExtensionName(), "VK_KHR_surface");
+		m_vkSurface = m_surfaceCreateCallback(m_vkInstance);
+		m_vkPhysicalDevice = SelectPhysicalDevice(m_vkInstance, m_vkSurface, COMPOSITOR_FORMAT, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, false);
+
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(m_vkPhysicalDevice, COMPOSITOR_FORMAT, &formatProperties);
+		const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		if((formatProperties.optimalTilingFeatures & requiredFeatures) != requiredFeatures)
+		{
+			spdlog::critical("Selected physical device can't blit with linear filtering, required by the compositor");
+			exit(EXIT_FAILURE);
+		}
+
+		u32 graphicsQueueFamilyIndex = pvkFindQueueFamilyIndex(m_vkPhysicalDevice, VK_QUEUE_GRAPHICS_BIT);
+		u32 presentQueueFamilyIndex = pvkFindQueueFamilyIndexWithPresentSupport(m_vkPhysicalDevice, m_vkSurface);
+		m_queueFamilyIndices[0] = graphicsQueueFamilyIndex;
+		m_queueFamilyIndices[1] = presentQueueFamilyIndex;
+		// A wall of video feeds doesn't need to tear for latency
+		m_vkPresentMode = SelectPresentMode(m_vkPhysicalDevice, m_vkSurface, PresentProfile::Throughput);
+		m_requestedImageCount = SelectImageCount(m_vkPhysicalDevice, m_vkSurface, COMPOSITOR_IMAGE_COUNT);
+
+		m_vkDevice = CreateLogicalDevice(m_vkPhysicalDevice, m_queueFamilyIndices, true, false, false);
+		vkGetDeviceQueue(m_vkDevice, graphicsQueueFamilyIndex, 0, &m_vkGraphicsQueue);
+		vkGetDeviceQueue(m_vkDevice, presentQueueFamilyIndex, 0, &m_vkPresentQueue);
+
+		m_vkCommandPool = pvkCreateCommandPool(m_vkDevice, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, graphicsQueueFamilyIndex);
+		m_vkCommandBuffer = __pvkAllocateCommandBuffers(m_vkDevice, m_vkCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		m_vkImageAvailableSemaphore = CreateVkSemaphore(m_vkDevice);
+		m_vkRenderFinishSemaphore = CreateVkSemaphore(m_vkDevice);
+		m_vkFence = pvkCreateFence(m_vkDevice, (VkFenceCreateFlags)(0));
+
+		const u32 stagingSize = std::min<u32>(feedCount, COMPOSITOR_MAX_UPLOADS_PER_FRAME) * m_feedFrameSize;
+		m_pvkStagingBuffer = pvkCreateBuffer(m_vkPhysicalDevice, m_vkDevice, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingSize, 1, m_queueFamilyIndices);
+		PVK_CHECK(vkMapMemory(m_vkDevice, m_pvkStagingBuffer.memory, 0, stagingSize, 0, &m_stagingPtr));
+
+		createFeedImages();
+		createSwapchain();
+		spdlog::info("Vulkan Compositor: {} feeds of {}x{} in a {}x{} grid, {} mip levels", feedCount, feedWidth, feedHeight, m_columnCount, m_rowCount, m_mipLevelCount);
+	}
+
+	VulkanCompositor::~VulkanCompositor()
+	{
+		PVK_CHECK(vkDeviceWaitIdle(m_vkDevice));
+		m_snapshotWorker.reset();
+		destroySwapchain();
+		for(Feed& feed : m_feeds)
+		{
+			vkDestroyImage(m_vkDevice, feed.image, NULL);
+			vkFreeMemory(m_vkDevice, feed.memory, NULL);
+			if(feed.pendingFrame)
+				returnFrame(*feed.pendingFrame);
+			feed.snapshotSource.reset();
+		}
+		vkUnmapMemory(m_vkDevice, m_pvkStagingBuffer.memory);
+		pvkDestroyBuffer(m_vkDevice, m_pvkStagingBuffer);
+		vkDestroyFence(m_vkDevice, m_vkFence, NULL);
+		vkDestroySemaphore(m_vkDevice, m_vkRenderFinishSemaphore, NULL);
+		vkDestroySemaphore(m_vkDevice, m_vkImageAvailableSemaphore, NULL);
+		vkFreeCommandBuffers(m_vkDevice, m_vkCommandPool, 1, m_vkCommandBuffer);
+		PVK_DELETE(m_vkCommandBuffer);
+		vkDestroyCommandPool(m_vkDevice, m_vkCommandPool, NULL);
+		vkDestroyDevice(m_vkDevice, NULL);
+		vkDestroySurfaceKHR(m_vkInstance, m_vkSurface, NULL);
+		vkDestroyInstance(m_vkInstance, NULL);
+	}
+
+	void VulkanCompositor::createFeedImages()
+	{
+		// Start every feed out black, until it receives its first frame
+		VkCommandBuffer commandBuffer = *m_vkCommandBuffer;
+		pvkBeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+		for(Feed& feed : m_feeds)
+		{
+			feed.image = CreateFeedImage(m_vkPhysicalDevice, m_vkDevice, m_feedWidth, m_feedHeight, m_mipLevelCount, feed.memory);
+			CmdImageBarrier(commandBuffer, feed.image, 0, m_mipLevelCount,
+							VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+							0, VK_ACCESS_TRANSFER_WRITE_BIT,
+							VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+			VkClearColorValue clearColor { };
+			clearColor.float32[3] = 1.0f;
+			VkImageSubresourceRange range { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipLevelCount, 0, 1 };
+			vkCmdClearColorImage(commandBuffer, feed.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &range);
+			CmdImageBarrier(commandBuffer, feed.image, 0, m_mipLevelCount,
+							VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+							VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+							VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		}
+		pvkEndCommandBuffer(commandBuffer);
+		pvkSubmit(commandBuffer, m_vkGraphicsQueue, VK_NULL_HANDLE, VK_NULL_HANDLE, m_vkFence);
+		PVK_CHECK(vkWaitForFences(m_vkDevice, 1, &m_vkFence, VK_TRUE, UINT64_MAX));
+		PVK_CHECK(vkResetFences(m_vkDevice, 1, &m_vkFence));
+	}
+
+	void VulkanCompositor::createSwapchain()
+	{
+		std::tie(m_width, m_height) = m_extentCallback();
+		m_vkSwapchain = CreateSwapchain(m_vkPhysicalDevice, m_vkDevice, m_vkSurface, m_requestedImageCount, m_width, m_height, m_vkPresentMode, m_queueFamilyIndices);
+		u32 imageCount = 0;
+		PVK_CHECK(vkGetSwapchainImagesKHR(m_vkDevice, m_vkSwapchain, &imageCount, NULL));
+		m_vkSwapchainImages.resize(imageCount);
+		PVK_CHECK(vkGetSwapchainImagesKHR(m_vkDevice, m_vkSwapchain, &imageCount, m_vkSwapchainImages.data()));
+		m_isLayoutDirty = true;
+	}
+
+	void VulkanCompositor::destroySwapchain()
+	{
+		vkDestroySwapchainKHR(m_vkDevice, m_vkSwapchain, NULL);
+		m_vkSwapchainImages.clear();
+	}
+
+	void VulkanCompositor::recreateSwapchain()
+	{
+		PVK_CHECK(vkDeviceWaitIdle(m_vkDevice));
+		destroySwapchain();
+		createSwapchain();
+	}
+
+	void VulkanCompositor::submitFeedFrame(u32 feedIndex, std::span<const u8> frameData)
+	{
+		DEBUG_ASSERT(feedIndex < m_feedCount);
+		DEBUG_ASSERT(frameData.size() == m_feedFrameSize);
+		DataPool::ElementType dstFrameData;
+		{
+			std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+			dstFrameData = m_pooledFrames->get();
+		}
+		std::span<u8>& t = dstFrameData;
+		std::memcpy(t.data(), frameData.data(), std::min<std::size_t>(frameData.size(), t.size()));
+		std::optional<DataPool::ElementType> staleFrame;
+		bool isFirstPending = false;
+		{
+			std::lock_guard<std::mutex> lock(m_feedsMutex);
+			Feed& feed = m_feeds[feedIndex];
+			// Only the latest frame of a feed is worth uploading
+			if(feed.pendingFrame)
+				staleFrame = feed.pendingFrame;
+			else
+				isFirstPending = (m_pendingFeedCount++ == 0);
+			feed.pendingFrame = dstFrameData;
+		}
+		if(isFirstPending)
+			m_pendingFeedCondition.notify_one();
+		if(staleFrame)
+			returnFrame(*staleFrame);
+	}
+
+	void VulkanCompositor::returnFrame(DataPool::ElementType& frame)
+	{
+		std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+		m_pooledFrames->put(frame);
+	}
+
+	void VulkanCompositor::setDisplayedFrame(u32 feedIndex, DataPool::ElementType& frame)
+	{
+		std::shared_ptr<DataPool::ElementType> displayedFrame(new DataPool::ElementType(frame), [this](DataPool::ElementType* frame)
+		{
+			returnFrame(*frame);
+			delete frame;
+		});
+		const std::span<u8>& pixels = *displayedFrame;
+		m_feeds[feedIndex].snapshotSource->setFrame(std::move(displayedFrame), pixels, SnapshotSourceFormat::BGRA, m_feedWidth, m_feedHeight);
+	}
+
+	void VulkanCompositor::requestFeedSnapshot(u32 feedIndex, const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		DEBUG_ASSERT(feedIndex < m_feedCount);
+		m_feeds[feedIndex].snapshotSource->request(region, format, std::move(callback));
+	}
+
+	u32 VulkanCompositor::recordUploads(VkCommandBuffer commandBuffer)
+	{
+		u32 uploadFeeds[COMPOSITOR_MAX_UPLOADS_PER_FRAME];
+		DataPool::ElementType uploadFrames[COMPOSITOR_MAX_UPLOADS_PER_FRAME];
+		u32 uploadCount = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_feedsMutex);
+			const u32 startFeed = m_nextUploadFeed;
+			for(u32 i = 0; (i < m_feedCount) && (uploadCount < COMPOSITOR_MAX_UPLOADS_PER_FRAME); i++)
+			{
+				const u32 feedIndex = (startFeed + i) % m_feedCount;
+				Feed& feed = m_feeds[feedIndex];
+				if(!feed.pendingFrame)
+					continue;
+				uploadFeeds[uploadCount] = feedIndex;
+				uploadFrames[uploadCount] = *feed.pendingFrame;
+				feed.pendingFrame.reset();
+				++uploadCount;
+				m_nextUploadFeed = (feedIndex + 1) % m_feedCount;
+			}
+			m_pendingFeedCount -= uploadCount;
+		}
+
+		for(u32 i = 0; i < uploadCount; i++)
+		{
+			const VkDeviceSize stagingOffset = static_cast<VkDeviceSize>(i) * m_feedFrameSize;
+			std::span<u8>& frameData = uploadFrames[i];
+			std::memcpy(reinterpret_cast<u8*>(m_stagingPtr) + stagingOffset, frameData.data(), m_feedFrameSize);
+			setDisplayedFrame(uploadFeeds[i], uploadFrames[i]);
+
+			VkImage image = m_feeds[uploadFeeds[i]].image;
+			// The previous refresh's blits out of the image must be done before it is written again
+			CmdImageBarrier(commandBuffer, image, 0, m_mipLevelCount,
+							VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+							VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+							VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+			VkBufferImageCopy imageCopyInfo = { };
+			imageCopyInfo.bufferOffset = stagingOffset;
+			imageCopyInfo.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageCopyInfo.imageSubresource.layerCount = 1;
+			imageCopyInfo.imageExtent = { m_feedWidth, m_feedHeight, 1 };
+			vkCmdCopyBufferToImage(commandBuffer, m_pvkStagingBuffer.handle, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyInfo);
+
+			// Downscale each level into the next one, so that small tiles are blitted from a level of about their size instead of aliasing
+			for(u32 level = 1; level < m_mipLevelCount; level++)
+			{
+				CmdImageBarrier(commandBuffer, image, level - 1, 1,
+								VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+								VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+								VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+				VkImageBlit blit { };
+				blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+				blit.srcOffsets[1] = { std::max<s32>(m_feedWidth >> (level - 1), 1), std::max<s32>(m_feedHeight >> (level - 1), 1), 1 };
+				blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+				blit.dstOffsets[1] = { std::max<s32>(m_feedWidth >> level, 1), std::max<s32>(m_feedHeight >> level, 1), 1 };
+				vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+			}
+			CmdImageBarrier(commandBuffer, image, m_mipLevelCount - 1, 1,
+							VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+							VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+							VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		}
+		return uploadCount;
+	}
+
+	void VulkanCompositor::recordComposition(VkCommandBuffer commandBuffer, VkImage swapchainImage)
+	{
+		// Chained to the wait on the image available semaphore, which happens at the transfer stage
+		CmdImageBarrier(commandBuffer, swapchainImage, 0, 1,
+						VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+						0, VK_ACCESS_TRANSFER_WRITE_BIT,
+						VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		VkClearColorValue clearColor { };
+		clearColor.float32[0] = 0.1f;
+		clearColor.float32[1] = 0.1f;
+		clearColor.float32[2] = 0.1f;
+		clearColor.float32[3] = 1.0f;
+		VkImageSubresourceRange range { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdClearColorImage(commandBuffer, swapchainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &range);
+		VkMemoryBarrier memoryBarrier = { };
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+
+		const u32 cellWidth = m_width / m_columnCount;
+		const u32 cellHeight = m_height / m_rowCount;
+		if((cellWidth > COMPOSITOR_TILE_GAP) && (cellHeight > COMPOSITOR_TILE_GAP))
+		{
+			// Fit the feed into its cell keeping the aspect ratio
+			const u32 availableWidth = cellWidth - COMPOSITOR_TILE_GAP;
+			const u32 availableHeight = cellHeight - COMPOSITOR_TILE_GAP;
+			const u32 tileWidth = std::max<u32>(std::min<u64>(availableWidth, static_cast<u64>(availableHeight) * m_feedWidth / m_feedHeight), 1);
+			const u32 tileHeight = std::max<u32>(std::min<u64>(availableHeight, static_cast<u64>(availableWidth) * m_feedHeight / m_feedWidth), 1);
+			// The smallest level which is still at least as large as the tile, so the blit never downscales by 2x or more
+			u32 level = 0;
+			while(((level + 1) < m_mipLevelCount) && ((m_feedWidth >> (level + 1)) >= tileWidth) && ((m_feedHeight >> (level + 1)) >= tileHeight))
+				++level;
+
+			for(u32 i = 0; i < m_feedCount; i++)
+			{
+				const s32 x = static_cast<s32>((i % m_columnCount) * cellWidth + ((cellWidth - tileWidth) >> 1));
+				const s32 y = static_cast<s32>((i / m_columnCount) * cellHeight + ((cellHeight - tileHeight) >> 1));
+				VkImageBlit blit { };
+				blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+				blit.srcOffsets[1] = { std::max<s32>(m_feedWidth >> level, 1), std::max<s32>(m_feedHeight >> level, 1), 1 };
+				blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				blit.dstOffsets[0] = { x, y, 0 };
+				blit.dstOffsets[1] = { x + static_cast<s32>(tileWidth), y + static_cast<s32>(tileHeight), 1 };
+				vkCmdBlitImage(commandBuffer, m_feeds[i].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapchainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+			}
+		}
+
+		CmdImageBarrier(commandBuffer, swapchainImage, 0, 1,
+						VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+						VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+						VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	}
+
+	void VulkanCompositor::renderFrame()
+	{
+		u32 index;
+		VkResult result = vkAcquireNextImageKHR(m_vkDevice, m_vkSwapchain, UINT64_MAX, m_vkImageAvailableSemaphore, VK_NULL_HANDLE, &index);
+		if(result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			recreateSwapchain();
+			return;
+		}
+		if(result != VK_SUBOPTIMAL_KHR)
+			PVK_CHECK(result);
+
+		VkCommandBuffer commandBuffer = *m_vkCommandBuffer;
+		pvkBeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+			recordUploads(commandBuffer);
+			recordComposition(commandBuffer, m_vkSwapchainImages[index]);
+		pvkEndCommandBuffer(commandBuffer);
+
+		const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		VkSubmitInfo submitInfo { };
+		{
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &m_vkImageAvailableSemaphore;
+			submitInfo.pWaitDstStageMask = &waitStage;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &commandBuffer;
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &m_vkRenderFinishSemaphore;
+		};
+		PVK_CHECK(vkQueueSubmit(m_vkGraphicsQueue, 1, &submitInfo, m_vkFence));
+		// The staging buffer and the command buffer are reused by the next refresh
+		PVK_CHECK(vkWaitForFences(m_vkDevice, 1, &m_vkFence, VK_TRUE, UINT64_MAX));
+		PVK_CHECK(vkResetFences(m_vkDevice, 1, &m_vkFence));
+
+		m_isLayoutDirty = false;
+		bool isPresented = QueuePresent(m_vkPresentQueue, m_vkSwapchain, index, 1, &m_vkRenderFinishSemaphore, 0);
+		if(!isPresented || (result == VK_SUBOPTIMAL_KHR))
+			recreateSwapchain();
+	}
+
+	void VulkanCompositor::runGameLoop(u32 frameRate, const IterationCallback& iterationCallback)
+	{
+		using Clock = std::chrono::steady_clock;
+		const auto idleTimeout = std::chrono::milliseconds(COMPOSITOR_IDLE_WAIT_TIMEOUT);
+		const auto deltaTime = std::chrono::nanoseconds((frameRate == 0) ? 0 : (1000000000 / frameRate));
+		auto nextTime = Clock::now();
+		while(iterationCallback())
+		{
+			auto extent = m_extentCallback();
+			// Minimized, nothing to draw until the window is restored
+			if((extent.first == 0) || (extent.second == 0))
+			{
+				std::this_thread::sleep_for(idleTimeout);
+				continue;
+			}
+			if((extent.first != m_width) || (extent.second != m_height))
+				recreateSwapchain();
+
+			std::this_thread::sleep_until(nextTime);
+			{
+				std::unique_lock<std::mutex> lock(m_feedsMutex);
+				// Nothing changed on the wall, the last presented image stays on the screen until a feed receives a frame
+				if(!m_isLayoutDirty && !m_pendingFeedCondition.wait_for(lock, idleTimeout, [this] { return m_pendingFeedCount != 0; }))
+					continue;
+			}
+			nextTime = Clock::now() + deltaTime;
+			renderFrame();
+		}
+	}
+}
@@ -1,23 +1,56 @@
 #define COMMON_HINT_OUT_IN_ALREADY_DEFINED
 
+#include <common/platform.h>
+
 #define PVK_IMPLEMENTATION
-#define PVK_USE_WIN32_SURFACE
+#ifdef PLATFORM_WINDOWS
+#	define PVK_USE_WIN32_SURFACE
+#endif // PLATFORM_WINDOWS
 #include <PlayVk/PlayVk.h>
 
-#include <kvmio/PresentEngine.hpp>
-#include <kvmio/Win32Window.hpp>
+#include <kvmio/VulkanPresentEngine.hpp>
+#include <kvmio/VulkanUtility.hpp>
+#include <kvmio/VulkanSurface.hpp>
+#include <kvmio/ColorConversion.hpp>
 #include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
 
 #include <chrono>
+#include <cstring> // for std::memcpy
+#include <algorithm> // for std::min, std::max
+#include <thread> // for std::this_thread::sleep_for
+#include <vector>
 
 #define HDMI_CAPTURE_WIDTH 1920
 #define HDMI_CAPTURE_HEIGHT 1080
 #define PRESENT_ENGINE_IMAGE_COUNT 3
+#define PRESENT_ENGINE_LOW_LATENCY_IMAGE_COUNT 2
 #define PRESENT_ENGINE_MAX_IMAGE_INFLIGHT_COUNT 3
+// In nanoseconds
+#define PRESENT_ENGINE_PRESENT_WAIT_TIMEOUT 100000000ull
+// In milliseconds, safety margin subtracted from the just-in-time sleep to absorb scheduler jitter
+#define PRESENT_ENGINE_PACING_MARGIN 1.5
+// Begin, after the pre-upload barrier, after the upload, after the draw
+#define PRESENT_ENGINE_TIMESTAMP_COUNT 4
+// Frame timings waiting for their presentation to be observed, beyond this they are published without the display time
+#define PRESENT_ENGINE_MAX_PENDING_FRAME_TIMINGS 8
+// Readback buffers for snapshots, more requests than this wait for a buffer to be released by the worker
+#define PRESENT_ENGINE_SNAPSHOT_SLOT_COUNT 2
+// Cursor shapes kept on the GPU, the least recently used one is replaced beyond this
+#define PRESENT_ENGINE_CURSOR_CACHE_SIZE 8
+// In milliseconds, how long the render loop sleeps at most while there is nothing to render before checking its callback again
+#define PRESENT_ENGINE_IDLE_WAIT_TIMEOUT 10
+// In milliseconds, how often the render loop wakes up between two frames while a presentation is being observed
+#define PRESENT_ENGINE_PRESENT_POLL_INTERVAL 1
+#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+#	define PRESENT_ENGINE_COLOR_FORMAT VK_FORMAT_B8G8R8A8_UNORM
+#else
+#	define PRESENT_ENGINE_COLOR_FORMAT VK_FORMAT_B8G8R8A8_SRGB
+#endif
 
 namespace kvmio
 {
-	static VkRenderPass CreateRenderPass(VkDevice device)
+	static VkRenderPass CreateRenderPass(VkDevice device, VkImageLayout finalLayout)
 	{
 		VkAttachmentDescription colorAttachment { };
 		{
@@ -32,7 +65,7 @@ namespace kvmio
 			colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 			colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+			colorAttachment.finalLayout = finalLayout;
 		};
 	
 		VkAttachmentReference attachmentReference { };
@@ -151,57 +184,324 @@ namespace kvmio
 		return setLayout;
 	}
 
-	void PresentEngine::destroyWindowRelatedVkObjects()
+	// Unlike the frame's, it can't have a YCbCr conversion and mustn't repeat at the edges of the shape
+	static VkSampler CreateCursorSampler(VkDevice device)
+	{
+		VkSamplerCreateInfo cInfo { };
+		{
+			cInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			cInfo.magFilter = VK_FILTER_LINEAR;
+			cInfo.minFilter = VK_FILTER_LINEAR;
+			cInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			cInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			cInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			cInfo.maxAnisotropy = 1.0f;
+			cInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+			cInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+			cInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		};
+		VkSampler sampler;
+		PVK_CHECK(vkCreateSampler(device, &cInfo, NULL, &sampler));
+		return sampler;
+	}
+
+	static VkDescriptorPool CreateCursorDescriptorPool(VkDevice device, u32 setCount)
+	{
+		VkDescriptorPoolSize poolSize { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount };
+		VkDescriptorPoolCreateInfo cInfo { };
+		{
+			cInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			cInfo.maxSets = setCount;
+			cInfo.poolSizeCount = 1;
+			cInfo.pPoolSizes = &poolSize;
+		};
+		VkDescriptorPool pool;
+		PVK_CHECK(vkCreateDescriptorPool(device, &cInfo, NULL, &pool));
+		return pool;
+	}
+
+	// Same shaders as the frame's pipeline: sample.vert covers the whole viewport with a quad, so the (dynamic) viewport places the cursor;
+	// blending relies on sample.frag passing the sampled alpha through
+	static VkPipeline CreateCursorPipeline(VkDevice device, VkPipelineLayout layout, VkRenderPass renderPass, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule)
+	{
+		VkPipelineShaderStageCreateInfo stages[2] = { };
+		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		stages[0].module = vertShaderModule;
+		stages[0].pName = "main";
+		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		stages[1].module = fragShaderModule;
+		stages[1].pName = "main";
+
+		VkPipelineVertexInputStateCreateInfo vertexInputState { };
+		vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState { };
+		inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkPipelineViewportStateCreateInfo viewportState { };
+		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+		VkPipelineRasterizationStateCreateInfo rasterizationState { };
+		rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizationState.cullMode = VK_CULL_MODE_NONE;
+		rasterizationState.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		rasterizationState.lineWidth = 1.0f;
+		VkPipelineMultisampleStateCreateInfo multisampleState { };
+		multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		VkPipelineColorBlendAttachmentState blendAttachmentState { };
+		blendAttachmentState.blendEnable = VK_TRUE;
+		blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+		blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		VkPipelineColorBlendStateCreateInfo colorBlendState { };
+		colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlendState.attachmentCount = 1;
+		colorBlendState.pAttachments = &blendAttachmentState;
+		const VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState { };
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = 2;
+		dynamicState.pDynamicStates = dynamicStates;
+
+		VkGraphicsPipelineCreateInfo cInfo { };
+		{
+			cInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			cInfo.stageCount = 2;
+			cInfo.pStages = stages;
+			cInfo.pVertexInputState = &vertexInputState;
+			cInfo.pInputAssemblyState = &inputAssemblyState;
+			cInfo.pViewportState = &viewportState;
+			cInfo.pRasterizationState = &rasterizationState;
+			cInfo.pMultisampleState = &multisampleState;
+			cInfo.pColorBlendState = &colorBlendState;
+			cInfo.pDynamicState = &dynamicState;
+			cInfo.layout = layout;
+			cInfo.renderPass = renderPass;
+			cInfo.subpass = 0;
+		};
+		VkPipeline pipeline;
+		PVK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &cInfo, NULL, &pipeline));
+		return pipeline;
+	}
+
+	static u32 GetTimestampValidBits(VkPhysicalDevice device, u32 queueFamilyIndex)
+	{
+		u32 count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &count, NULL);
+		std::vector<VkQueueFamilyProperties> queueFamilies(count);
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &count, queueFamilies.data());
+		return (queueFamilyIndex < count) ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+	}
+
+	static VkQueryPool CreateTimestampQueryPool(VkDevice device, u32 queryCount)
+	{
+		VkQueryPoolCreateInfo cInfo { };
+		{
+			cInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			cInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			cInfo.queryCount = queryCount;
+		};
+		VkQueryPool queryPool;
+		PVK_CHECK(vkCreateQueryPool(device, &cInfo, NULL, &queryPool));
+		return queryPool;
+	}
+
+	static f64 ElapsedMilliseconds(std::chrono::high_resolution_clock::time_point begin)
+	{
+		return std::chrono::duration<f64, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+	void VulkanPresentEngine::createOffscreenImages()
+	{
+		m_imageCount = m_requestedImageCount;
+		for(u32 i = 0; i < m_imageCount; i++)
+		{
+			PvkImage image = pvkCreateImage(m_vkPhysicalDevice, m_vkDevice, 
+											VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+											PRESENT_ENGINE_COLOR_FORMAT, m_width, m_height, 
+											VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 
+											1, m_queueFamilyIndices);
+			m_offscreenImages.push_back(image);
+			m_offscreenImageViews.push_back(pvkCreateImageView(m_vkDevice, image.handle, PRESENT_ENGINE_COLOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT));
+			if(!m_readbackCallback)
+				continue;
+			// Tightly packed B8G8R8A8 pixels
+			const VkDeviceSize size = static_cast<VkDeviceSize>(m_width) * m_height * 4;
+			PvkBuffer buffer = pvkCreateBuffer(m_vkPhysicalDevice, m_vkDevice, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, 1, m_queueFamilyIndices);
+			void* ptr;
+			PVK_CHECK(vkMapMemory(m_vkDevice, buffer.memory, 0, size, 0, &ptr));
+			m_readbackBuffers.push_back(buffer);
+			m_readbackPtrs.push_back(ptr);
+		}
+		m_offscreenImageIndex = 0;
+	}
+
+	void VulkanPresentEngine::destroyOffscreenImages()
+	{
+		for(PvkBuffer& buffer : m_readbackBuffers)
+		{
+			vkUnmapMemory(m_vkDevice, buffer.memory);
+			pvkDestroyBuffer(m_vkDevice, buffer);
+		}
+		for(VkImageView imageView : m_offscreenImageViews)
+			vkDestroyImageView(m_vkDevice, imageView, NULL);
+		for(PvkImage& image : m_offscreenImages)
+			pvkDestroyImage(m_vkDevice, image);
+		m_readbackBuffers.clear();
+		m_readbackPtrs.clear();
+		m_offscreenImageViews.clear();
+		m_offscreenImages.clear();
+	}
+
+	void VulkanPresentEngine::destroyWindowRelatedVkObjects()
 	{
 		vkDestroyPipeline(m_vkDevice, m_vkPipeline, NULL);
-		pvkDestroyFramebuffers(m_vkDevice, PRESENT_ENGINE_IMAGE_COUNT, m_vkFramebuffers);
-		pvkDestroySwapchainImageViews(m_vkDevice, m_vkSwapchain, m_vkSwapchainImageViews);
-		vkDestroySwapchainKHR(m_vkDevice, m_vkSwapchain, NULL);
+		pvkDestroyFramebuffers(m_vkDevice, m_imageCount, m_vkFramebuffers);
+		if(m_isOffscreen)
+			destroyOffscreenImages();
+		else
+		{
+			pvkDestroySwapchainImageViews(m_vkDevice, m_vkSwapchain, m_vkSwapchainImageViews);
+			vkDestroySwapchainKHR(m_vkDevice, m_vkSwapchain, NULL);
+		}
 	}
 
-	void PresentEngine::createWindowRelatedVkObjects()
+	void VulkanPresentEngine::createWindowRelatedVkObjects()
 	{
-		m_vkSwapchain = pvkCreateSwapchain(m_vkDevice, m_vkSurface, PRESENT_ENGINE_IMAGE_COUNT,
-													m_window.getClientWidth(), m_window.getClientHeight(),
+		std::tie(m_width, m_height) = m_extentCallback();
+		if(m_isOffscreen)
+		{
+			createOffscreenImages();
+			m_vkFramebuffers = pvkCreateFramebuffers(m_vkDevice, m_vkRenderPass, m_width, m_height, m_imageCount, 1, m_offscreenImageViews.data());
+			m_vkPipeline = pvkCreateGraphicsPipelineProfile0(m_vkDevice, m_vkPipelineLayout, m_vkRenderPass, m_width, m_height, 2, (PvkShader) { m_vkVertShaderModule, PVK_SHADER_TYPE_VERTEX }, (PvkShader) { m_vkFragShaderModule, PVK_SHADER_TYPE_FRAGMENT });
+			return;
+		}
+		m_vkSwapchain = pvkCreateSwapchain(m_vkDevice, m_vkSurface, m_requestedImageCount,
+													m_width, m_height,
 													#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION 
 													VK_FORMAT_B8G8R8A8_UNORM, 
 													#else
 													VK_FORMAT_B8G8R8A8_SRGB,
 													#endif
 													VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, 
-													VK_PRESENT_MODE_FIFO_KHR,
+													m_vkPresentMode,
 													2, m_queueFamilyIndices, VK_NULL_HANDLE);
+		// Present ids are per-swapchain, so start over
+		m_presentId = 0;
 		u32 imageCount;
 		#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
 		m_vkSwapchainImageViews = pvkCreateSwapchainImageViews(m_vkDevice, m_vkSwapchain, VK_FORMAT_B8G8R8A8_UNORM, &imageCount);
 		#else
 		m_vkSwapchainImageViews = pvkCreateSwapchainImageViews(m_vkDevice, m_vkSwapchain, VK_FORMAT_B8G8R8A8_SRGB, &imageCount);
 		#endif
-		DEBUG_ASSERT(imageCount == PRESENT_ENGINE_IMAGE_COUNT);
+		// The implementation is allowed to create more images than requested, but the count mustn't change across recreations
+		// as the command buffers are allocated once
+		DEBUG_ASSERT((m_imageCount == 0) || (imageCount == m_imageCount));
+		m_imageCount = imageCount;
+
+		m_vkFramebuffers = pvkCreateFramebuffers(m_vkDevice, m_vkRenderPass, m_width, m_height, m_imageCount, 1, m_vkSwapchainImageViews);
+		m_vkPipeline = pvkCreateGraphicsPipelineProfile0(m_vkDevice, m_vkPipelineLayout, m_vkRenderPass, m_width, m_height, 2, (PvkShader) { m_vkVertShaderModule, PVK_SHADER_TYPE_VERTEX }, (PvkShader) { m_vkFragShaderModule, PVK_SHADER_TYPE_FRAGMENT });
+	}
+
+	VulkanPresentEngine::VulkanPresentEngine(const VkSurfaceKHRCreateCallback& surfaceCreateCallback, const ExtentCallback& extentCallback, PresentProfile profile) : 
+																		VulkanPresentEngine(surfaceCreateCallback, extentCallback, { }, profile)
+	{
+		DEBUG_ASSERT(static_cast<bool>(surfaceCreateCallback));
+	}
+
+	VulkanPresentEngine::VulkanPresentEngine(const ExtentCallback& extentCallback, const ReadbackCallback& readbackCallback, PresentProfile profile) : 
+																		VulkanPresentEngine({ }, extentCallback, readbackCallback, profile)
+	{
+	}
+
+	VulkanPresentEngine::VulkanPresentEngine(const VkSurfaceKHRCreateCallback& surfaceCreateCallback, const ExtentCallback& extentCallback, const ReadbackCallback& readbackCallback, PresentProfile profile) : 
+																		m_surfaceCreateCallback(surfaceCreateCallback),
+																		m_extentCallback(extentCallback),
+																		m_isOffscreen(!surfaceCreateCallback),
+																		m_readbackCallback(readbackCallback),
+																		m_offscreenImageIndex(0),
+																		m_width(0),
+																		m_height(0),
+																		m_profile(profile),
+																		m_vkPresentMode(VK_PRESENT_MODE_FIFO_KHR),
+																		m_requestedImageCount(PRESENT_ENGINE_IMAGE_COUNT),
+																		m_imageCount(0),
+																		m_isPresentWait(false),
+																		m_vkWaitForPresentKHR(NULL),
+																		m_presentId(0),
+																		m_refreshInterval(0),
+																		m_frameCost(0),
+																		m_isTimestamps(false),
+																		m_vkQueryPool(VK_NULL_HANDLE),
+																		m_timestampPeriod(0),
+																		m_timestampMask(~0ull),
+																		m_frameIndex(0),
+																		m_mapPtr(NULL),
+																		m_isReady(false),
+																		m_submitCount(0),
+																		m_latestSubmitIndex(0),
+																		m_snapshotRequestCount(0),
+																		m_isImageValid(false),
+																		m_cursorOverlay(NULL),
+																		m_cursorState { 0, false, 0, 0, { } },
+																		m_cursorImageIndex(-1),
+																		m_cursorUseCount(0)
+	{
+		#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+		m_frameSize = (HDMI_CAPTURE_WIDTH * HDMI_CAPTURE_HEIGHT * 3) >> 1;
+		#else
+		m_frameSize = HDMI_CAPTURE_WIDTH * HDMI_CAPTURE_HEIGHT * 4;
+		#endif
+		m_pooledFrames = std::make_unique<DataPool>([this]()
+		{
+			u8* data = new u8[m_frameSize];
+			return std::span <u8> { data, m_frameSize };
+		},
+		[](std::span<u8>& s)
+		{
+			delete[] s.data();
+		},
+		nullptr,
+		nullptr,
+		[](std::span<u8>& s1, std::span<u8>& s2) -> bool { return s1.data() == s2.data(); });
 
-		VkImageView attachments[PRESENT_ENGINE_IMAGE_COUNT];
-		for(u32 i = 0; i < PRESENT_ENGINE_IMAGE_COUNT; i++)
-			attachments[i] = m_vkSwapchainImageViews[i];
-		m_vkFramebuffers = pvkCreateFramebuffers(m_vkDevice, m_vkRenderPass, m_window.getClientWidth(), m_window.getClientHeight(), PRESENT_ENGINE_IMAGE_COUNT, 1, attachments);
-		m_vkPipeline = pvkCreateGraphicsPipelineProfile0(m_vkDevice, m_vkPipelineLayout, m_vkRenderPass, m_window.getClientWidth(), m_window.getClientHeight(), 2, (PvkShader) { m_vkVertShaderModule, PVK_SHADER_TYPE_VERTEX }, (PvkShader) { m_vkFragShaderModule, PVK_SHADER_TYPE_FRAGMENT });
+		m_initThread = std::thread(&VulkanPresentEngine::initialize, this);
 	}
 
-	PresentEngine::PresentEngine(const VkKHRSurfaceCreateCallback& surfaceCreateCallback) : 
-																		m_window(window),
-																		m_mapPtr(NULL)
+	void VulkanPresentEngine::waitUntilReady()
 	{
-		m_vkInstance = pvkCreateVulkanInstanceWithExtensions(2, "VK_KHR_win32_surface", "VK_KHR_surface");
-		m_vkSurface = surfaceCreateCallback(m_vkInstance);
-		m_vkPhysicalDevice = pvkGetPhysicalDevice(m_vkInstance, m_vkSurface, 
-														VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 
+		m_isReady.wait(false, std::memory_order_acquire);
+	}
+
+	void VulkanPresentEngine::initialize()
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		if(m_isOffscreen)
+		{
+			// No surface (and no window system) at all, so that it also runs on build machines and CPU implementations like lavapipe
+			m_vkInstance = pvkCreateVulkanInstanceWithExtensions(0);
+			m_vkSurface = VK_NULL_HANDLE;
+		}
+		else
+		{
+			m_vkInstance = pvkCreateVulkanInstanceWithExtensions(2, GetNativeSurfaceExtensionName(), "VK_KHR_surface");
+			m_vkSurface = m_surfaceCreateCallback(m_vkInstance);
+		}
+		m_vkPhysicalDevice = SelectPhysicalDevice(m_vkInstance, m_vkSurface, 
 														#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
 														VK_FORMAT_B8G8R8A8_UNORM,
 														#else
 														VK_FORMAT_B8G8R8A8_SRGB,
 														#endif 
 														VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, 
-														VK_PRESENT_MODE_FIFO_KHR,
-														PRESENT_ENGINE_IMAGE_COUNT,
 														#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
 														true
 														#else
@@ -209,27 +509,41 @@ namespace kvmio
 														#endif
 														);
 		u32 graphicsQueueFamilyIndex = pvkFindQueueFamilyIndex(m_vkPhysicalDevice, VK_QUEUE_GRAPHICS_BIT);
-		u32 presentQueueFamilyIndex = pvkFindQueueFamilyIndexWithPresentSupport(m_vkPhysicalDevice, m_vkSurface);
+		u32 presentQueueFamilyIndex = m_isOffscreen ? graphicsQueueFamilyIndex : pvkFindQueueFamilyIndexWithPresentSupport(m_vkPhysicalDevice, m_vkSurface);
 		m_queueFamilyIndices[0] = graphicsQueueFamilyIndex;
 		m_queueFamilyIndices[1] = presentQueueFamilyIndex;
-		m_vkDevice = pvkCreateLogicalDeviceWithExtensions(m_vkInstance, 
-																m_vkPhysicalDevice,
-																2, m_queueFamilyIndices, 
+
+		if(m_isOffscreen)
+		{
+			m_requestedImageCount = (m_profile == PresentProfile::Latency) ? PRESENT_ENGINE_LOW_LATENCY_IMAGE_COUNT : PRESENT_ENGINE_IMAGE_COUNT;
+			m_isPresentWait = false;
+		}
+		else
+		{
+			m_vkPresentMode = SelectPresentMode(m_vkPhysicalDevice, m_vkSurface, m_profile);
+			m_requestedImageCount = SelectImageCount(m_vkPhysicalDevice, m_vkSurface, (m_profile == PresentProfile::Latency) ? PRESENT_ENGINE_LOW_LATENCY_IMAGE_COUNT : PRESENT_ENGINE_IMAGE_COUNT);
+			m_isPresentWait = IsPresentWaitSupported(m_vkPhysicalDevice);
+		}
+		spdlog::info("Present mode: {}, requested image count: {}, present wait: {}", static_cast<u32>(m_vkPresentMode), m_requestedImageCount, m_isPresentWait);
+
+		m_vkDevice = CreateLogicalDevice(m_vkPhysicalDevice, m_queueFamilyIndices, !m_isOffscreen,
 							#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
-																true, 2, VK_KHR_SWAPCHAIN_EXTENSION_NAME, "VK_KHR_sampler_ycbcr_conversion"
+																true,
 							#else
-																false, 1, VK_KHR_SWAPCHAIN_EXTENSION_NAME
+																false,
 							#endif
-																);
+																m_isPresentWait);
+		if(m_isPresentWait)
+			m_vkWaitForPresentKHR = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(m_vkDevice, "vkWaitForPresentKHR"));
 		vkGetDeviceQueue(m_vkDevice, graphicsQueueFamilyIndex, 0, &m_vkGraphicsQueue);
 		vkGetDeviceQueue(m_vkDevice, presentQueueFamilyIndex, 0, &m_vkPresentQueue);
 
 		m_vkCommandPool = pvkCreateCommandPool(m_vkDevice, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, graphicsQueueFamilyIndex);
-		m_vkCommandBuffers = __pvkAllocateCommandBuffers(m_vkDevice, m_vkCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, PRESENT_ENGINE_IMAGE_COUNT);
 
 		m_pvkSemaphorePool = pvkCreateSemaphoreCircularPool(m_vkDevice, 2 * PRESENT_ENGINE_MAX_IMAGE_INFLIGHT_COUNT);
 		m_vkFence = pvkCreateFence(m_vkDevice, (VkFenceCreateFlags)(0));
-		m_vkRenderPass = CreateRenderPass(m_vkDevice);
+		// Offscreen images are left ready to be copied into the readback buffers
+		m_vkRenderPass = CreateRenderPass(m_vkDevice, m_isOffscreen ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
 		#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
 		m_vkConversion = CreateYUVConversion(m_vkDevice);
@@ -248,9 +562,6 @@ namespace kvmio
 		m_pvkBuffer = pvkCreateBuffer(m_vkPhysicalDevice, m_vkDevice, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, HDMI_CAPTURE_WIDTH * HDMI_CAPTURE_HEIGHT * 4, 2, m_queueFamilyIndices);
 		PVK_CHECK(vkMapMemory(m_vkDevice, m_pvkBuffer.memory, 0, HDMI_CAPTURE_WIDTH * HDMI_CAPTURE_HEIGHT * 4, 0, &m_mapPtr));
 		#endif
-		#ifdef USE_DIRECT_FRAME_DATA_COPY
-		m_decodeNetStream.addFrameDataStorage(m_mapPtr);
-		#endif
 
 		m_vkDescriptorPool = pvkCreateDescriptorPool(m_vkDevice, 1, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
 		#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
@@ -269,7 +580,7 @@ namespace kvmio
 		m_pvkImage = pvkCreateImage2(m_vkPhysicalDevice, m_vkDevice, 
 										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
 										VK_FORMAT_G8_B8R8_2PLANE_420_UNORM, HDMI_CAPTURE_WIDTH, HDMI_CAPTURE_HEIGHT, 
-										VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
+										VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 
 										2, m_queueFamilyIndices);
 		m_vkImageView = pvkCreateImageView2(m_vkDevice, m_pvkImage.handle, VK_FORMAT_G8_B8R8_2PLANE_420_UNORM, 
 													(VkImageAspectFlagBits) (VK_IMAGE_ASPECT_COLOR_BIT), 
@@ -278,18 +589,49 @@ namespace kvmio
 		m_pvkImage = pvkCreateImage(m_vkPhysicalDevice, m_vkDevice, 
 										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
 										VK_FORMAT_B8G8R8A8_SRGB, HDMI_CAPTURE_WIDTH, HDMI_CAPTURE_HEIGHT, 
-										VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
+										VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 
 										2, m_queueFamilyIndices);
 		m_vkImageView = pvkCreateImageView(m_vkDevice, m_pvkImage.handle, VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
 		#endif
 		pvkWriteImageViewToDescriptor(m_vkDevice, *m_vkDescriptorSet, 0, m_vkImageView, m_vkSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
 		createWindowRelatedVkObjects();
-		
+		createCursorObjects();
+
+		m_vkCommandBuffers = __pvkAllocateCommandBuffers(m_vkDevice, m_vkCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_imageCount);
+
+		u32 timestampValidBits = GetTimestampValidBits(m_vkPhysicalDevice, graphicsQueueFamilyIndex);
+		m_isTimestamps = timestampValidBits != 0;
+		if(m_isTimestamps)
+		{
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(m_vkPhysicalDevice, &properties);
+			m_timestampPeriod = properties.limits.timestampPeriod;
+			m_timestampMask = (timestampValidBits >= 64) ? ~0ull : ((1ull << timestampValidBits) - 1);
+			m_vkQueryPool = CreateTimestampQueryPool(m_vkDevice, m_imageCount * PRESENT_ENGINE_TIMESTAMP_COUNT);
+		}
+		else
+			spdlog::warn("Graphics queue doesn't support timestamps, GPU timings will not be available");
+
 		recordCommandBuffers();
+
+		if(!m_isOffscreen)
+			transitionSwapchainImagesToPresentLayout();
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime);
+		spdlog::info("Vulkan Present Engine is ready, took {} ms", elapsed.count());
+		m_isReady.store(true, std::memory_order_release);
+		m_isReady.notify_all();
 	}
 
-	void PresentEngine::recordCommandBuffers()
+	void VulkanPresentEngine::recordCommandBuffers()
+	{
+		m_recordedCommandBuffers.resize(m_imageCount);
+		for(u32 index = 0; index < m_imageCount; index++)
+			recordCommandBuffer(index, true);
+	}
+
+	void VulkanPresentEngine::recordCommandBuffer(u32 index, bool isUpload)
 	{
 		VkClearValue clearValue { };
 		clearValue.color.float32[0] = 0.1f;
@@ -297,9 +639,15 @@ namespace kvmio
 		clearValue.color.float32[2] = 0;
 		clearValue.color.float32[3] = 1;
 
-		for(int index = 0; index < PRESENT_ENGINE_IMAGE_COUNT; index++)
-		{
-			pvkBeginCommandBuffer(m_vkCommandBuffers[index], (VkCommandBufferUsageFlagBits)0);
+		const u32 queryBase = index * PRESENT_ENGINE_TIMESTAMP_COUNT;
+		pvkBeginCommandBuffer(m_vkCommandBuffers[index], (VkCommandBufferUsageFlagBits)0);
+			if(m_isTimestamps)
+			{
+				vkCmdResetQueryPool(m_vkCommandBuffers[index], m_vkQueryPool, queryBase, PRESENT_ENGINE_TIMESTAMP_COUNT);
+				vkCmdWriteTimestamp(m_vkCommandBuffers[index], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_vkQueryPool, queryBase + 0);
+			}
+			if(isUpload)
+			{
 				// Image Layout Transition: VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
 				VkImageMemoryBarrier imageMemoryBarrier = { };
 				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -319,13 +667,16 @@ namespace kvmio
 				imageMemoryBarrier.subresourceRange.levelCount = 1;
 				imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
 				imageMemoryBarrier.subresourceRange.layerCount = 1;
+				// Waits for a snapshot copy of the previous frame which may still be reading the image (and for its layout transition)
 				vkCmdPipelineBarrier(m_vkCommandBuffers[index],
-									VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
+									VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
 									VK_PIPELINE_STAGE_TRANSFER_BIT, 
 									VK_DEPENDENCY_BY_REGION_BIT,
 									0, NULL,
 									0, NULL,
 									1, &imageMemoryBarrier);
+				if(m_isTimestamps)
+					vkCmdWriteTimestamp(m_vkCommandBuffers[index], VK_PIPELINE_STAGE_TRANSFER_BIT, m_vkQueryPool, queryBase + 1);
 				#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
 				VkBufferImageCopy imageCopyInfos[2] = { };
 				imageCopyInfos[0].bufferOffset = 0;
@@ -344,6 +695,8 @@ namespace kvmio
 				imageCopyInfo.imageExtent = { HDMI_CAPTURE_WIDTH, HDMI_CAPTURE_HEIGHT, 1 };
 				vkCmdCopyBufferToImage(m_vkCommandBuffers[index], m_pvkBuffer.handle, m_pvkImage.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyInfo);
 				#endif
+				if(m_isTimestamps)
+					vkCmdWriteTimestamp(m_vkCommandBuffers[index], VK_PIPELINE_STAGE_TRANSFER_BIT, m_vkQueryPool, queryBase + 2);
 
 				imageMemoryBarrier = { };
 				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -370,19 +723,81 @@ namespace kvmio
 									0, NULL,
 									0, NULL,
 									1, &imageMemoryBarrier);
-				pvkBeginRenderPass(m_vkCommandBuffers[index], m_vkRenderPass, m_vkFramebuffers[index], m_window.getClientWidth(), m_window.getClientHeight(), 1, &clearValue);
-					vkCmdBindPipeline(m_vkCommandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, m_vkPipeline);
-					vkCmdBindDescriptorSets(m_vkCommandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, m_vkPipelineLayout, 0, 1, m_vkDescriptorSet, 0, NULL);
+			}
+			else if(m_isTimestamps)
+			{
+				// Nothing is uploaded, the barrier and upload timings come out as zero
+				vkCmdWriteTimestamp(m_vkCommandBuffers[index], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_vkQueryPool, queryBase + 1);
+				vkCmdWriteTimestamp(m_vkCommandBuffers[index], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_vkQueryPool, queryBase + 2);
+			}
+			pvkBeginRenderPass(m_vkCommandBuffers[index], m_vkRenderPass, m_vkFramebuffers[index], m_width, m_height, 1, &clearValue);
+				vkCmdBindPipeline(m_vkCommandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, m_vkPipeline);
+				vkCmdBindDescriptorSets(m_vkCommandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, m_vkPipelineLayout, 0, 1, m_vkDescriptorSet, 0, NULL);
+				vkCmdDraw(m_vkCommandBuffers[index], 6, 1, 0, 0);
+				if(m_cursorImageIndex >= 0)
+				{
+					// The frame is stretched over the whole framebuffer, and so is the cursor's position
+					const CursorRect rect = m_cursorState.getRect();
+					const f32 scaleX = static_cast<f32>(m_width) / HDMI_CAPTURE_WIDTH;
+					const f32 scaleY = static_cast<f32>(m_height) / HDMI_CAPTURE_HEIGHT;
+					VkViewport viewport { rect.x * scaleX, rect.y * scaleY, rect.width * scaleX, rect.height * scaleY, 0.0f, 1.0f };
+					VkRect2D scissor { { 0, 0 }, { m_width, m_height } };
+					vkCmdBindPipeline(m_vkCommandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, m_vkCursorPipeline);
+					vkCmdSetViewport(m_vkCommandBuffers[index], 0, 1, &viewport);
+					vkCmdSetScissor(m_vkCommandBuffers[index], 0, 1, &scissor);
+					vkCmdBindDescriptorSets(m_vkCommandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, m_vkCursorPipelineLayout, 0, 1, &m_cursorImages[m_cursorImageIndex].descriptorSet, 0, NULL);
 					vkCmdDraw(m_vkCommandBuffers[index], 6, 1, 0, 0);
-				pvkEndRenderPass(m_vkCommandBuffers[index]);
-			pvkEndCommandBuffer(m_vkCommandBuffers[index]);
-		}
+				}
+			pvkEndRenderPass(m_vkCommandBuffers[index]);
+			if(m_isTimestamps)
+				vkCmdWriteTimestamp(m_vkCommandBuffers[index], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_vkQueryPool, queryBase + 3);
+			if(!m_readbackBuffers.empty())
+			{
+				// The render pass has already transitioned the image to VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+				VkMemoryBarrier memoryBarrier = { };
+				memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				vkCmdPipelineBarrier(m_vkCommandBuffers[index],
+									VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+									VK_PIPELINE_STAGE_TRANSFER_BIT, 
+									0,
+									1, &memoryBarrier,
+									0, NULL,
+									0, NULL);
+				VkBufferImageCopy readbackCopyInfo = { };
+				readbackCopyInfo.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				readbackCopyInfo.imageSubresource.layerCount = 1;
+				readbackCopyInfo.imageExtent = { m_width, m_height, 1 };
+				vkCmdCopyImageToBuffer(m_vkCommandBuffers[index], m_offscreenImages[index].handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_readbackBuffers[index].handle, 1, &readbackCopyInfo);
+				memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+				vkCmdPipelineBarrier(m_vkCommandBuffers[index],
+									VK_PIPELINE_STAGE_TRANSFER_BIT, 
+									VK_PIPELINE_STAGE_HOST_BIT, 
+									0,
+									1, &memoryBarrier,
+									0, NULL,
+									0, NULL);
+			}
+		pvkEndCommandBuffer(m_vkCommandBuffers[index]);
+		m_recordedCommandBuffers[index] = { isUpload, m_cursorState.version };
 	}
 
-	PresentEngine::~PresentEngine()
+	VulkanPresentEngine::~VulkanPresentEngine()
 	{
+		if(m_initThread.joinable())
+			m_initThread.join();
 		PVK_CHECK(vkDeviceWaitIdle(m_vkDevice));
+		if(m_snapshotSlots)
+		{
+			// The snapshots already copied out are still delivered, the ones which are only requested are dropped
+			collectCompletedSnapshots();
+			m_snapshotWorker.reset();
+			destroySnapshotSlots();
+		}
 		destroyWindowRelatedVkObjects();
+		destroyCursorObjects();
 		vkDestroyImageView(m_vkDevice, m_vkImageView, NULL);
 		pvkDestroyImage(m_vkDevice, m_pvkImage);
 		vkDestroyPipelineLayout(m_vkDevice, m_vkPipelineLayout, NULL);
@@ -399,32 +814,37 @@ namespace kvmio
 		#endif
 		vkDestroyRenderPass(m_vkDevice, m_vkRenderPass, NULL);
 		vkDestroyFence(m_vkDevice, m_vkFence, NULL);
+		if(m_vkQueryPool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(m_vkDevice, m_vkQueryPool, NULL);
 		pvkDestroySemaphoreCircularPool(m_vkDevice, m_pvkSemaphorePool);
 		PVK_DELETE(m_vkCommandBuffers);
 		vkDestroyCommandPool(m_vkDevice, m_vkCommandPool, NULL);
 		vkDestroyDevice(m_vkDevice, NULL);
-		vkDestroySurfaceKHR(m_vkInstance, m_vkSurface, NULL);
+		if(m_vkSurface != VK_NULL_HANDLE)
+			vkDestroySurfaceKHR(m_vkInstance, m_vkSurface, NULL);
 		vkDestroyInstance(m_vkInstance, NULL);
+
+		if(m_latestFrame)
+			m_pooledFrames->put(*m_latestFrame);
 	}
 
-	void PresentEngine::recreate()
+	void VulkanPresentEngine::recreate()
 	{
+		// Present ids belong to the swapchain being destroyed
+		publishPresentedFrameTimings(true);
 		destroyWindowRelatedVkObjects();
 		createWindowRelatedVkObjects();
 		recordCommandBuffers();
 	}
 
-	void PresentEngine::runGameLoop(u32 frameRate, std::atomic<bool>& isLoop)
+	void VulkanPresentEngine::transitionSwapchainImagesToPresentLayout()
 	{
-		const f64 deltaTime = 1000.0 / frameRate;
-		auto startTime = std::chrono::high_resolution_clock::now();
-
 		/* Transition layout of swapchain images to VK_IMAGE_LAYOUT_PRESET_SRC_KHR
 		 * This layout transition is necessary for the case when there is no decoded frame available in the first iteration in the render loop,
 		 * in which case, there won't be any automatic transition as the actual frame rendering command buffers won't be dispatched */
 		VkCommandBuffer* cmdBuffer = __pvkAllocateCommandBuffers(m_vkDevice, m_vkCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
 		VkImage* images = pvkGetSwapchainImages(m_vkDevice, m_vkSwapchain, NULL);
-		for(u32 i = 0; i < PRESENT_ENGINE_IMAGE_COUNT; i++)
+		for(u32 i = 0; i < m_imageCount; i++)
 		{
 			pvkBeginCommandBuffer(*cmdBuffer, (VkCommandBufferUsageFlagBits)0);
 				// Image Layout Transition: VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
@@ -455,29 +875,613 @@ namespace kvmio
 			PVK_CHECK(vkResetFences(m_vkDevice, 1, &m_vkFence));
 		}
 		PVK_DELETE(images);
+		vkFreeCommandBuffers(m_vkDevice, m_vkCommandPool, 1, cmdBuffer);
 		PVK_DELETE(cmdBuffer);
+	}
+
+	void VulkanPresentEngine::submitFrame(std::span<const u8> frameData)
+	{
+		DEBUG_ASSERT(frameData.size() == m_frameSize);
+		DataPool::ElementType dstFrameData;
+		{
+			std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+			dstFrameData = m_pooledFrames->get();
+		}
+		std::span<u8>& t = dstFrameData;
+		std::memcpy(t.data(), frameData.data(), std::min<std::size_t>(frameData.size(), t.size()));
+		setLatestFrame(dstFrameData);
+	}
+
+	void VulkanPresentEngine::submitFramePlanes(const FramePlanes& planes)
+	{
+		DEBUG_ASSERT((planes.width == HDMI_CAPTURE_WIDTH) && (planes.height == HDMI_CAPTURE_HEIGHT));
+		DataPool::ElementType dstFrameData;
+		{
+			std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+			dstFrameData = m_pooledFrames->get();
+		}
+		std::span<u8>& t = dstFrameData;
+		#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+		// Packed on the way, the staging buffer holds the planes without padding
+		const std::size_t planeSize = static_cast<std::size_t>(HDMI_CAPTURE_WIDTH) * HDMI_CAPTURE_HEIGHT;
+		for(u32 y = 0; y < HDMI_CAPTURE_HEIGHT; y++)
+			std::memcpy(t.data() + static_cast<std::size_t>(y) * HDMI_CAPTURE_WIDTH, planes.yPlane + static_cast<std::size_t>(y) * planes.stride, HDMI_CAPTURE_WIDTH);
+		for(u32 y = 0; y < (HDMI_CAPTURE_HEIGHT / 2); y++)
+			std::memcpy(t.data() + planeSize + static_cast<std::size_t>(y) * HDMI_CAPTURE_WIDTH, planes.uvPlane + static_cast<std::size_t>(y) * planes.stride, HDMI_CAPTURE_WIDTH);
+		#else
+		ConvertNV12ToBGRA(planes.yPlane, planes.uvPlane, planes.stride, HDMI_CAPTURE_WIDTH, HDMI_CAPTURE_HEIGHT, t.data(), HDMI_CAPTURE_WIDTH * 4);
+		#endif
+		setLatestFrame(dstFrameData);
+	}
+
+	void VulkanPresentEngine::setLatestFrame(DataPool::ElementType& frame)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+			// Only the latest frame is worth displaying, recycle the one which couldn't be consumed in time
+			if(m_latestFrame)
+				m_pooledFrames->put(*m_latestFrame);
+			m_latestFrame = frame;
+			m_latestSubmitIndex = ++m_submitCount;
+		}
+		m_latestFrameCondition.notify_one();
+	}
+
+	std::optional<VulkanPresentEngine::DataPool::ElementType> VulkanPresentEngine::takeLatestFrame(u64& submitIndex)
+	{
+		std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+		std::optional<DataPool::ElementType> frame;
+		std::swap(frame, m_latestFrame);
+		submitIndex = frame ? m_latestSubmitIndex : 0;
+		return frame;
+	}
+
+	void VulkanPresentEngine::returnFrame(DataPool::ElementType& frame)
+	{
+		std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+		m_pooledFrames->put(frame);
+	}
+
+	void VulkanPresentEngine::paceFrame()
+	{
+		if(m_presentId == 0)
+			return;
+		// Timeout, out-of-date or lost surface; all of them are dealt with by the acquire/present that follows
+		if(m_vkWaitForPresentKHR(m_vkDevice, m_vkSwapchain, m_presentId, PRESENT_ENGINE_PRESENT_WAIT_TIMEOUT) != VK_SUCCESS)
+			return;
+
+		auto now = std::chrono::high_resolution_clock::now();
+		bool isFirstSample = m_lastPresentTime == std::chrono::high_resolution_clock::time_point { };
+		f64 interval = std::chrono::duration<f64, std::milli>(now - m_lastPresentTime).count();
+		m_lastPresentTime = now;
+		// Skip the samples where one or more vblanks were missed, they would inflate the estimate
+		if(isFirstSample)
+			return;
+		else if(m_refreshInterval == 0)
+			m_refreshInterval = interval;
+		else if(interval < (1.5 * m_refreshInterval))
+			m_refreshInterval = 0.9 * m_refreshInterval + 0.1 * interval;
+
+		f64 slack = m_refreshInterval - m_frameCost - PRESENT_ENGINE_PACING_MARGIN;
+		if(slack > 0)
+			std::this_thread::sleep_for(std::chrono::duration<f64, std::milli>(slack));
+	}
+
+	void VulkanPresentEngine::readGpuTimestamps(u32 imageIndex, FrameTimings& timings)
+	{
+		u64 timestamps[PRESENT_ENGINE_TIMESTAMP_COUNT];
+		VkResult result = vkGetQueryPoolResults(m_vkDevice, m_vkQueryPool, imageIndex * PRESENT_ENGINE_TIMESTAMP_COUNT, PRESENT_ENGINE_TIMESTAMP_COUNT,
+													sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT);
+		if(result != VK_SUCCESS)
+			return;
+		auto toMilliseconds = [this](u64 begin, u64 end) -> f64
+		{
+			return static_cast<f64>((end - begin) & m_timestampMask) * m_timestampPeriod / 1000000.0;
+		};
+		timings.gpuBarrier = toMilliseconds(timestamps[0], timestamps[1]);
+		timings.gpuUpload = toMilliseconds(timestamps[1], timestamps[2]);
+		timings.gpuDraw = toMilliseconds(timestamps[2], timestamps[3]);
+	}
+
+	void VulkanPresentEngine::publishFrameTimings(const FrameTimings& timings)
+	{
+		m_frameTimingRecorder.record(timings);
+		m_frameTimingsEvent.publish(timings);
+	}
+
+	void VulkanPresentEngine::publishPresentedFrameTimings(bool isFlush)
+	{
+		while(!m_pendingFrameTimings.empty())
+		{
+			PendingFrameTimings& pending = m_pendingFrameTimings.front();
+			// Zero timeout, only checks whether the presentation has completed
+			bool isPresented = !isFlush && (m_vkWaitForPresentKHR(m_vkDevice, m_vkSwapchain, pending.presentId, 0) == VK_SUCCESS);
+			if(!isPresented && !isFlush && (m_pendingFrameTimings.size() < PRESENT_ENGINE_MAX_PENDING_FRAME_TIMINGS))
+				break;
+			if(isPresented)
+			{
+				pending.timings.display = std::chrono::duration<f64, std::milli>(std::chrono::high_resolution_clock::now() - pending.presentTime).count();
+				pending.timings.displayTimestamp = static_cast<u64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+			}
+			publishFrameTimings(pending.timings);
+			m_pendingFrameTimings.pop_front();
+		}
+	}
+
+	void VulkanPresentEngine::renderFrame(u32 imageIndex, DataPool::ElementType* frame, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore, FrameTimings& timings)
+	{
+		// The command buffer is idle, the fence of its previous submission has been waited upon
+		const RecordedCommandBuffer& recorded = m_recordedCommandBuffers[imageIndex];
+		if((recorded.isUpload != (frame != NULL)) || (recorded.cursorVersion != m_cursorState.version))
+			recordCommandBuffer(imageIndex, frame != NULL);
+
+		if(frame)
+		{
+			std::span<u8>& frameData = *frame;
+			/* Takes: 1 ms to 4 ms */
+			auto copyStartTime = std::chrono::high_resolution_clock::now();
+			std::memcpy(m_mapPtr, frameData.data(), frameData.size());
+			timings.copy = ElapsedMilliseconds(copyStartTime);
+			returnFrame(*frame);
+		}
+
+		// execute commands
+		auto submitStartTime = std::chrono::high_resolution_clock::now();
+		pvkSubmit(m_vkCommandBuffers[imageIndex], m_vkGraphicsQueue, waitSemaphore, signalSemaphore, m_vkFence);
+		PVK_CHECK(vkWaitForFences(m_vkDevice, 1, &m_vkFence, VK_TRUE, UINT64_MAX));
+		PVK_CHECK(vkResetFences(m_vkDevice, 1, &m_vkFence));
+		timings.submit = ElapsedMilliseconds(submitStartTime);
+		if(m_isTimestamps)
+			readGpuTimestamps(imageIndex, timings);
+		m_isImageValid = true;
+	}
+
+	void VulkanPresentEngine::createCursorObjects()
+	{
+		m_vkCursorSampler = CreateCursorSampler(m_vkDevice);
+		m_vkCursorDescriptorSetLayout = CreateDescriptorSetLayout(m_vkDevice, VK_NULL_HANDLE);
+		m_vkCursorPipelineLayout = pvkCreatePipelineLayout(m_vkDevice, 1, &m_vkCursorDescriptorSetLayout);
+		m_vkCursorPipeline = CreateCursorPipeline(m_vkDevice, m_vkCursorPipelineLayout, m_vkRenderPass, m_vkVertShaderModule, m_vkFragShaderModule);
+		m_vkCursorDescriptorPool = CreateCursorDescriptorPool(m_vkDevice, PRESENT_ENGINE_CURSOR_CACHE_SIZE);
+
+		VkDescriptorSetLayout setLayouts[PRESENT_ENGINE_CURSOR_CACHE_SIZE];
+		std::fill_n(setLayouts, PRESENT_ENGINE_CURSOR_CACHE_SIZE, m_vkCursorDescriptorSetLayout);
+		VkDescriptorSet descriptorSets[PRESENT_ENGINE_CURSOR_CACHE_SIZE];
+		VkDescriptorSetAllocateInfo allocInfo { };
+		{
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = m_vkCursorDescriptorPool;
+			allocInfo.descriptorSetCount = PRESENT_ENGINE_CURSOR_CACHE_SIZE;
+			allocInfo.pSetLayouts = setLayouts;
+		};
+		PVK_CHECK(vkAllocateDescriptorSets(m_vkDevice, &allocInfo, descriptorSets));
+		m_cursorImages.resize(PRESENT_ENGINE_CURSOR_CACHE_SIZE);
+		for(u32 i = 0; i < PRESENT_ENGINE_CURSOR_CACHE_SIZE; i++)
+			m_cursorImages[i] = { 0, { }, VK_NULL_HANDLE, descriptorSets[i], 0 };
+
+		const u32 bufferSize = CursorOverlay::MaxShapeSize * CursorOverlay::MaxShapeSize * 4;
+		m_pvkCursorBuffer = pvkCreateBuffer(m_vkPhysicalDevice, m_vkDevice, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, bufferSize, 2, m_queueFamilyIndices);
+		PVK_CHECK(vkMapMemory(m_vkDevice, m_pvkCursorBuffer.memory, 0, bufferSize, 0, &m_cursorMapPtr));
+		m_vkCursorCommandBuffer = __pvkAllocateCommandBuffers(m_vkDevice, m_vkCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+	}
+
+	void VulkanPresentEngine::destroyCursorObjects()
+	{
+		vkFreeCommandBuffers(m_vkDevice, m_vkCommandPool, 1, m_vkCursorCommandBuffer);
+		PVK_DELETE(m_vkCursorCommandBuffer);
+		vkUnmapMemory(m_vkDevice, m_pvkCursorBuffer.memory);
+		pvkDestroyBuffer(m_vkDevice, m_pvkCursorBuffer);
+		for(CursorImage& cursorImage : m_cursorImages)
+		{
+			if(cursorImage.hash == 0)
+				continue;
+			vkDestroyImageView(m_vkDevice, cursorImage.imageView, NULL);
+			pvkDestroyImage(m_vkDevice, cursorImage.image);
+		}
+		m_cursorImages.clear();
+		// Frees the descriptor sets as well
+		vkDestroyDescriptorPool(m_vkDevice, m_vkCursorDescriptorPool, NULL);
+		vkDestroyPipeline(m_vkDevice, m_vkCursorPipeline, NULL);
+		vkDestroyPipelineLayout(m_vkDevice, m_vkCursorPipelineLayout, NULL);
+		vkDestroyDescriptorSetLayout(m_vkDevice, m_vkCursorDescriptorSetLayout, NULL);
+		vkDestroySampler(m_vkDevice, m_vkCursorSampler, NULL);
+	}
+
+	bool VulkanPresentEngine::updateCursor()
+	{
+		if((m_cursorOverlay == NULL) || (m_cursorOverlay->getVersion() == m_cursorState.version))
+			return false;
+		m_cursorState = m_cursorOverlay->getState();
+		m_cursorImageIndex = (m_cursorState.getRect().width == 0) ? -1 : getCursorImage(*m_cursorState.shape);
+		return true;
+	}
+
+	s32 VulkanPresentEngine::getCursorImage(const CursorOverlay::Shape& shape)
+	{
+		++m_cursorUseCount;
+		u32 index = 0;
+		for(u32 i = 0; i < m_cursorImages.size(); i++)
+		{
+			if(m_cursorImages[i].hash == shape.hash)
+			{
+				m_cursorImages[i].lastUse = m_cursorUseCount;
+				return static_cast<s32>(i);
+			}
+			// An empty one, or else the least recently used one
+			if(m_cursorImages[i].lastUse < m_cursorImages[index].lastUse)
+				index = i;
+		}
+
+		/* Not cached, replace the image; the device is idle between refreshes (every submission is waited upon)
+		 * and the command buffers referring to the old image are all recorded again as the cursor version has changed */
+		CursorImage& cursorImage = m_cursorImages[index];
+		if(cursorImage.hash != 0)
+		{
+			vkDestroyImageView(m_vkDevice, cursorImage.imageView, NULL);
+			pvkDestroyImage(m_vkDevice, cursorImage.image);
+		}
+		cursorImage.image = pvkCreateImage(m_vkPhysicalDevice, m_vkDevice, 
+										VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+										PRESENT_ENGINE_COLOR_FORMAT, shape.width, shape.height, 
+										VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
+										2, m_queueFamilyIndices);
+		cursorImage.imageView = pvkCreateImageView(m_vkDevice, cursorImage.image.handle, PRESENT_ENGINE_COLOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+		cursorImage.hash = shape.hash;
+		cursorImage.lastUse = m_cursorUseCount;
+		std::memcpy(m_cursorMapPtr, shape.pixels.data(), shape.pixels.size());
+
+		VkCommandBuffer commandBuffer = *m_vkCursorCommandBuffer;
+		pvkBeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+			// Image Layout Transition: VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+			VkImageMemoryBarrier imageMemoryBarrier = { };
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.srcAccessMask = 0;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.srcQueueFamilyIndex = m_queueFamilyIndices[0];
+			imageMemoryBarrier.dstQueueFamilyIndex = m_queueFamilyIndices[0];
+			imageMemoryBarrier.image = cursorImage.image.handle;
+			imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+			imageMemoryBarrier.subresourceRange.levelCount = 1;
+			imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+			imageMemoryBarrier.subresourceRange.layerCount = 1;
+			vkCmdPipelineBarrier(commandBuffer,
+								VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
+								VK_PIPELINE_STAGE_TRANSFER_BIT, 
+								0,
+								0, NULL,
+								0, NULL,
+								1, &imageMemoryBarrier);
+			VkBufferImageCopy imageCopyInfo = { };
+			imageCopyInfo.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageCopyInfo.imageSubresource.layerCount = 1;
+			imageCopyInfo.imageExtent = { shape.width, shape.height, 1 };
+			vkCmdCopyBufferToImage(commandBuffer, m_pvkCursorBuffer.handle, cursorImage.image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyInfo);
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			vkCmdPipelineBarrier(commandBuffer,
+								VK_PIPELINE_STAGE_TRANSFER_BIT, 
+								VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+								0,
+								0, NULL,
+								0, NULL,
+								1, &imageMemoryBarrier);
+		pvkEndCommandBuffer(commandBuffer);
+		pvkSubmit(commandBuffer, m_vkGraphicsQueue, VK_NULL_HANDLE, VK_NULL_HANDLE, m_vkFence);
+		PVK_CHECK(vkWaitForFences(m_vkDevice, 1, &m_vkFence, VK_TRUE, UINT64_MAX));
+		PVK_CHECK(vkResetFences(m_vkDevice, 1, &m_vkFence));
+
+		pvkWriteImageViewToDescriptor(m_vkDevice, cursorImage.descriptorSet, 0, cursorImage.imageView, m_vkCursorSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		return static_cast<s32>(index);
+	}
+
+	void VulkanPresentEngine::requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		std::lock_guard<std::mutex> lock(m_snapshotRequestsMutex);
+		m_snapshotRequests.push_back({ region, format, std::move(callback) });
+		m_snapshotRequestCount.fetch_add(1, std::memory_order_release);
+	}
+
+	void VulkanPresentEngine::createSnapshotSlots()
+	{
+		m_snapshotSlots = std::make_unique<SnapshotSlot[]>(PRESENT_ENGINE_SNAPSHOT_SLOT_COUNT);
+		VkCommandBuffer* commandBuffers = __pvkAllocateCommandBuffers(m_vkDevice, m_vkCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, PRESENT_ENGINE_SNAPSHOT_SLOT_COUNT);
+		for(u32 i = 0; i < PRESENT_ENGINE_SNAPSHOT_SLOT_COUNT; i++)
+		{
+			SnapshotSlot& slot = m_snapshotSlots[i];
+			// Large enough for the whole frame in the format it is sampled in
+			slot.buffer = pvkCreateBuffer(m_vkPhysicalDevice, m_vkDevice, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_frameSize, 1, m_queueFamilyIndices);
+			PVK_CHECK(vkMapMemory(m_vkDevice, slot.buffer.memory, 0, m_frameSize, 0, &slot.mapPtr));
+			slot.commandBuffer = commandBuffers[i];
+			slot.fence = pvkCreateFence(m_vkDevice, (VkFenceCreateFlags)(0));
+			slot.isInFlight = false;
+			slot.isBusy.store(false, std::memory_order_relaxed);
+		}
+		PVK_DELETE(commandBuffers);
+		m_snapshotWorker = std::make_unique<SnapshotWorker>();
+	}
+
+	void VulkanPresentEngine::destroySnapshotSlots()
+	{
+		for(u32 i = 0; i < PRESENT_ENGINE_SNAPSHOT_SLOT_COUNT; i++)
+		{
+			SnapshotSlot& slot = m_snapshotSlots[i];
+			vkUnmapMemory(m_vkDevice, slot.buffer.memory);
+			pvkDestroyBuffer(m_vkDevice, slot.buffer);
+			vkDestroyFence(m_vkDevice, slot.fence, NULL);
+			vkFreeCommandBuffers(m_vkDevice, m_vkCommandPool, 1, &slot.commandBuffer);
+		}
+		m_snapshotSlots.reset();
+	}
+
+	void VulkanPresentEngine::collectCompletedSnapshots()
+	{
+		for(u32 i = 0; i < PRESENT_ENGINE_SNAPSHOT_SLOT_COUNT; i++)
+		{
+			SnapshotSlot& slot = m_snapshotSlots[i];
+			if(!slot.isInFlight || (vkGetFenceStatus(m_vkDevice, slot.fence) != VK_SUCCESS))
+				continue;
+			PVK_CHECK(vkResetFences(m_vkDevice, 1, &slot.fence));
+			slot.isInFlight = false;
+			SnapshotWorker* worker = m_snapshotWorker.get();
+			worker->post([worker, &slot]()
+			{
+				const SnapshotRegion& copied = slot.copiedRegion;
+				SnapshotRegion region = ClipSnapshotRegion(slot.request.region, HDMI_CAPTURE_WIDTH, HDMI_CAPTURE_HEIGHT);
+				region.x -= copied.x;
+				region.y -= copied.y;
+				#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+				const SnapshotSourceFormat sourceFormat = SnapshotSourceFormat::NV12;
+				const std::size_t size = (static_cast<std::size_t>(copied.width) * copied.height * 3) >> 1;
+				#else
+				const SnapshotSourceFormat sourceFormat = SnapshotSourceFormat::BGRA;
+				const std::size_t size = static_cast<std::size_t>(copied.width) * copied.height * 4;
+				#endif
+				worker->deliver({ reinterpret_cast<const u8*>(slot.mapPtr), size }, sourceFormat, copied.width, copied.height, region, slot.request.format, slot.request.callback);
+				slot.request.callback = { };
+				slot.isBusy.store(false, std::memory_order_release);
+			});
+		}
+	}
+
+	void VulkanPresentEngine::submitSnapshots()
+	{
+		if(!m_snapshotSlots)
+		{
+			if(m_snapshotRequestCount.load(std::memory_order_acquire) == 0)
+				return;
+			createSnapshotSlots();
+		}
+		collectCompletedSnapshots();
+		// Snapshots of the sampled image are only meaningful once it holds a frame, until then the requests stay queued
+		if(!m_isImageValid || (m_snapshotRequestCount.load(std::memory_order_acquire) == 0))
+			return;
+		for(u32 i = 0; i < PRESENT_ENGINE_SNAPSHOT_SLOT_COUNT; i++)
+		{
+			SnapshotSlot& slot = m_snapshotSlots[i];
+			if(slot.isBusy.load(std::memory_order_acquire))
+				continue;
+			{
+				std::lock_guard<std::mutex> lock(m_snapshotRequestsMutex);
+				if(m_snapshotRequests.empty())
+					break;
+				slot.request = std::move(m_snapshotRequests.front());
+				m_snapshotRequests.pop_front();
+				m_snapshotRequestCount.fetch_sub(1, std::memory_order_relaxed);
+			}
+			submitSnapshotCopy(slot);
+		}
+	}
+
+	void VulkanPresentEngine::submitSnapshotCopy(SnapshotSlot& slot)
+	{
+		SnapshotRegion region = ClipSnapshotRegion(slot.request.region, HDMI_CAPTURE_WIDTH, HDMI_CAPTURE_HEIGHT);
+		#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+		// The chroma plane is subsampled by 2 in both directions, so the copy has to start and end at even coordinates
+		if((region.width != 0) && (region.height != 0))
+		{
+			u32 right = std::min<u32>((region.x + region.width + 1) & ~1u, HDMI_CAPTURE_WIDTH);
+			u32 bottom = std::min<u32>((region.y + region.height + 1) & ~1u, HDMI_CAPTURE_HEIGHT);
+			region.x &= ~1u;
+			region.y &= ~1u;
+			region.width = right - region.x;
+			region.height = bottom - region.y;
+		}
+		#endif
+		slot.copiedRegion = region;
+		slot.isBusy.store(true, std::memory_order_relaxed);
+
+		// Nothing of the requested region is inside the frame, there is nothing to copy
+		if((region.width == 0) || (region.height == 0))
+		{
+			SnapshotWorker* worker = m_snapshotWorker.get();
+			worker->post([&slot]()
+			{
+				slot.request.callback({ slot.request.format, 0, 0, { } });
+				slot.request.callback = { };
+				slot.isBusy.store(false, std::memory_order_release);
+			});
+			return;
+		}
+
+		VkCommandBuffer commandBuffer = slot.commandBuffer;
+		pvkBeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+			// Image Layout Transition: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL to VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+			VkImageMemoryBarrier imageMemoryBarrier = { };
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.srcQueueFamilyIndex = m_queueFamilyIndices[0];
+			imageMemoryBarrier.dstQueueFamilyIndex = m_queueFamilyIndices[0];
+			imageMemoryBarrier.image = m_pvkImage.handle;
+			imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+			imageMemoryBarrier.subresourceRange.levelCount = 1;
+			imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+			imageMemoryBarrier.subresourceRange.layerCount = 1;
+			vkCmdPipelineBarrier(commandBuffer,
+								VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+								VK_PIPELINE_STAGE_TRANSFER_BIT, 
+								0,
+								0, NULL,
+								0, NULL,
+								1, &imageMemoryBarrier);
+			#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+			VkBufferImageCopy imageCopyInfos[2] = { };
+			imageCopyInfos[0].bufferOffset = 0;
+			imageCopyInfos[0].imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT;
+			imageCopyInfos[0].imageSubresource.layerCount = 1;
+			imageCopyInfos[0].imageOffset = { static_cast<s32>(region.x), static_cast<s32>(region.y), 0 };
+			imageCopyInfos[0].imageExtent = { region.width, region.height, 1 };
+			imageCopyInfos[1].bufferOffset = static_cast<VkDeviceSize>(region.width) * region.height;
+			imageCopyInfos[1].imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT;
+			imageCopyInfos[1].imageSubresource.layerCount = 1;
+			imageCopyInfos[1].imageOffset = { static_cast<s32>(region.x >> 1), static_cast<s32>(region.y >> 1), 0 };
+			imageCopyInfos[1].imageExtent = { region.width >> 1, region.height >> 1, 1 };
+			vkCmdCopyImageToBuffer(commandBuffer, m_pvkImage.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.handle, 2, imageCopyInfos);
+			#else
+			VkBufferImageCopy imageCopyInfo = { };
+			imageCopyInfo.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageCopyInfo.imageSubresource.layerCount = 1;
+			imageCopyInfo.imageOffset = { static_cast<s32>(region.x), static_cast<s32>(region.y), 0 };
+			imageCopyInfo.imageExtent = { region.width, region.height, 1 };
+			vkCmdCopyImageToBuffer(commandBuffer, m_pvkImage.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.handle, 1, &imageCopyInfo);
+			#endif
+
+			// Back to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL as the image is sampled again if no new frame arrives, 
+			// and make the copy visible to the host
+			imageMemoryBarrier.srcAccessMask = 0;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			VkMemoryBarrier memoryBarrier = { };
+			memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer,
+								VK_PIPELINE_STAGE_TRANSFER_BIT, 
+								VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 
+								0,
+								1, &memoryBarrier,
+								0, NULL,
+								1, &imageMemoryBarrier);
+		pvkEndCommandBuffer(commandBuffer);
+		// Not waited upon here, collectCompletedSnapshots() polls the fence on the following iterations
+		pvkSubmit(commandBuffer, m_vkGraphicsQueue, VK_NULL_HANDLE, VK_NULL_HANDLE, slot.fence);
+		slot.isInFlight = true;
+	}
+
+	void VulkanPresentEngine::renderOffscreenFrame()
+	{
+		// Nothing is ever presented, so the frame is only rendered again if the cursor drawn over it has changed
+		u64 submitIndex;
+		auto frame = takeLatestFrame(submitIndex);
+		bool isCursorChanged = updateCursor();
+		if(!frame && !(isCursorChanged && m_isImageValid))
+			return;
+
+		FrameTimings timings = { };
+		timings.submitIndex = submitIndex;
+		timings.frameIndex = m_frameIndex++;
+		timings.gpuBarrier = timings.gpuUpload = timings.gpuDraw = timings.present = timings.display = -1.0;
+
+		// The images are used round-robin, there is no acquire step
+		u32 index = m_offscreenImageIndex;
+		m_offscreenImageIndex = (m_offscreenImageIndex + 1) % m_imageCount;
+		timings.acquire = 0;
+		renderFrame(index, frame ? &*frame : NULL, VK_NULL_HANDLE, VK_NULL_HANDLE, timings);
+
+		// The fence has been waited upon in renderFrame(), so the readback buffer is up to date
+		if(m_readbackCallback)
+			m_readbackCallback({ reinterpret_cast<const u8*>(m_readbackPtrs[index]), static_cast<std::size_t>(m_width) * m_height * 4 }, m_width, m_height);
+		publishFrameTimings(timings);
+	}
+
+	void VulkanPresentEngine::runGameLoop(u32 frameRate, const IterationCallback& iterationCallback)
+	{
+		const f64 deltaTime = (frameRate == 0) ? 0.0 : (1000.0 / frameRate);
+		const auto frameDuration = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<f64, std::milli>(deltaTime));
+		const auto idleTimeout = std::chrono::milliseconds(PRESENT_ENGINE_IDLE_WAIT_TIMEOUT);
+
+		// The window is serviced by its own thread meanwhile, submitted frames stay buffered until the background initialization completes
+		waitUntilReady();
+		auto startTime = std::chrono::high_resolution_clock::now();
 
 		/* Rendering & Presentation */
-		while(isLoop && (!m_window.shouldClose(false)))
+		while(iterationCallback())
 		{
-			if((m_window.getClientWidth() == 0) || (m_window.getClientHeight() == 0))
+			// Polled on every iteration (not only once per frame, see below) so that the display time is measured with a fine granularity
+			if(m_isPresentWait)
+				publishPresentedFrameTimings();
+			submitSnapshots();
+
+			auto extent = m_extentCallback();
+			// Minimized, nothing is presented until the window is restored
+			if((extent.first == 0) || (extent.second == 0))
 			{
-				m_window.pollEvents();
+				std::this_thread::sleep_for(idleTimeout);
 				continue;
 			}
+			// There is no surface to report VK_ERROR_OUT_OF_DATE_KHR, so the size change has to be detected here
+			if(m_isOffscreen && ((extent.first != m_width) || (extent.second != m_height)))
+			{
+				PVK_CHECK(vkDeviceWaitIdle(m_vkDevice));
+				recreate();
+			}
+			// Sleeps until the next frame is due rather than polling the clock, waking up in between only to observe the presentations
+			auto nextTime = startTime + frameDuration;
+			if(m_isPresentWait && !m_pendingFrameTimings.empty())
+				nextTime = std::min<std::chrono::high_resolution_clock::time_point>(nextTime, std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(PRESENT_ENGINE_PRESENT_POLL_INTERVAL));
+			std::this_thread::sleep_until(nextTime);
 			auto time = std::chrono::high_resolution_clock::now();
-			if(std::chrono::duration_cast<std::chrono::milliseconds>(time - startTime).count() >= deltaTime)
+			if((time - startTime) >= frameDuration)
 			{
-				/* Takes: 2 ms to 4 ms - same as Win32 Blit */
+				/* Takes: 2 ms to 4 ms - same as Win32 Blit, see getFrameTimingStatistics() for the measured breakdown */
 
 				startTime = time;
 
-				auto frame = m_decodeNetStream.borrowFrameData();
+				// Unpaced, so the refresh waits for a new frame rather than coming around again right away;
+				// a cursor change alone is drawn once the wait times out
+				if(frameRate == 0)
+				{
+					std::unique_lock<std::mutex> lock(m_pooledFramesMutex);
+					m_latestFrameCondition.wait_for(lock, idleTimeout, [this] { return m_latestFrame.has_value(); });
+				}
+
+				if(m_isOffscreen)
+				{
+					renderOffscreenFrame();
+					continue;
+				}
+
+				if(m_isPresentWait && (m_profile == PresentProfile::Latency))
+				{
+					paceFrame();
+					publishPresentedFrameTimings();
+				}
+				auto frameStartTime = std::chrono::high_resolution_clock::now();
+
+				using Clock = std::chrono::high_resolution_clock;
+				FrameTimings timings = { };
+				timings.frameIndex = m_frameIndex++;
+				timings.copy = timings.submit = timings.gpuBarrier = timings.gpuUpload = timings.gpuDraw = timings.display = -1.0;
+
+				auto frame = takeLatestFrame(timings.submitIndex);
+				// A changed cursor is drawn over the frame already in the sampled image, without waiting for (or uploading) a new one
+				bool isCursorChanged = updateCursor();
+				bool isRender = frame || (isCursorChanged && m_isImageValid);
 				uint32_t semaphoreIndex;
 				VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
-				if(frame)
+				if(isRender)
 					imageAvailableSemaphore = pvkSemaphoreCircularPoolAcquire(m_pvkSemaphorePool, &semaphoreIndex);
 
+				auto acquireStartTime = Clock::now();
 				uint32_t index;
 				while(!pvkAcquireNextImageKHR(m_vkDevice, m_vkSwapchain, UINT64_MAX, imageAvailableSemaphore, m_vkFence, &index))
 				{
@@ -490,36 +1494,34 @@ namespace kvmio
 
 				PVK_CHECK(vkWaitForFences(m_vkDevice, 1, &m_vkFence, VK_TRUE, UINT64_MAX));
 				PVK_CHECK(vkResetFences(m_vkDevice, 1, &m_vkFence));
+				timings.acquire = ElapsedMilliseconds(acquireStartTime);
 
 				VkSemaphore renderFinishSemaphore = VK_NULL_HANDLE;
-				if(frame)
+				if(isRender)
 				{
 					renderFinishSemaphore = pvkSemaphoreCircularPoolAcquire(m_pvkSemaphorePool, NULL);
-					
-					#ifndef USE_DIRECT_FRAME_DATA_COPY
-					auto frameData = FIFOPool<HDMIDecodeNetStream::FrameData>::GetValue(frame);
-					DEBUG_ASSERT(frameData.has_value());
-					// DEBUG_ASSERT(frameData->getSize() == drawSurface->getBufferSize());
-					/* Takes: 1 ms to 4 ms */
-					memcpy(m_mapPtr, frameData->getPtr(), frameData->getSize());
-					#endif 
-
-					// execute commands
-					pvkSubmit(m_vkCommandBuffers[index], m_vkGraphicsQueue, imageAvailableSemaphore, renderFinishSemaphore, m_vkFence);
-					PVK_CHECK(vkWaitForFences(m_vkDevice, 1, &m_vkFence, VK_TRUE, UINT64_MAX));
-					m_decodeNetStream.returnFrameData(frame);
-					PVK_CHECK(vkResetFences(m_vkDevice, 1, &m_vkFence));
+					renderFrame(index, frame ? &*frame : NULL, imageAvailableSemaphore, renderFinishSemaphore, timings);
+
+					f64 frameCost = std::chrono::duration<f64, std::milli>(std::chrono::high_resolution_clock::now() - frameStartTime).count();
+					m_frameCost = (m_frameCost == 0) ? frameCost : (0.9 * m_frameCost + 0.1 * frameCost);
 				}
 
 
 				// present the output image
-				if(!pvkPresent(index, m_vkSwapchain, m_vkPresentQueue, (renderFinishSemaphore == VK_NULL_HANDLE) ? 0 : 1, &renderFinishSemaphore))
+				u64 presentId = m_isPresentWait ? ++m_presentId : 0;
+				auto presentStartTime = Clock::now();
+				bool isPresented = QueuePresent(m_vkPresentQueue, m_vkSwapchain, index, (renderFinishSemaphore == VK_NULL_HANDLE) ? 0 : 1, &renderFinishSemaphore, presentId);
+				timings.present = ElapsedMilliseconds(presentStartTime);
+				if(m_isPresentWait && isPresented)
+					m_pendingFrameTimings.push_back({ presentId, presentStartTime, timings });
+				else
+					publishFrameTimings(timings);
+				if(!isPresented)
 				{
 					PVK_CHECK(vkDeviceWaitIdle(m_vkDevice));
 					recreate();
 				}
 			}
-			m_window.pollEvents();
 		}
 	}
 }
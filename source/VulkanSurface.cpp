@@ -0,0 +1,59 @@
+#include <common/platform.h>
+
+// Selects the platform surface API of vulkan.h, before PlayVk includes it
+#if defined(PLATFORM_WINDOWS)
+#	define VK_USE_PLATFORM_WIN32_KHR
+#elif defined(PLATFORM_LINUX) && defined(KVMIO_USE_WAYLAND)
+#	define VK_USE_PLATFORM_WAYLAND_KHR
+#elif defined(PLATFORM_LINUX)
+#	define VK_USE_PLATFORM_XLIB_KHR
+#endif
+
+#include <kvmio/NativeWindow.hpp>
+#include <kvmio/VulkanSurface.hpp>
+
+#include <spdlog/spdlog.h>
+
+namespace kvmio
+{
+	const char* GetNativeSurfaceExtensionName()
+	{
+		#if defined(VK_USE_PLATFORM_WIN32_KHR)
+		return VK_KHR_WIN32_SURFACE_EXTENSION_NAME;
+		#elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
+		return VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME;
+		#else
+		return VK_KHR_XLIB_SURFACE_EXTENSION_NAME;
+		#endif
+	}
+
+	VkSurfaceKHR CreateNativeSurface(VkInstance instance, NativeWindow& window)
+	{
+		VkSurfaceKHR surface = VK_NULL_HANDLE;
+		#if defined(VK_USE_PLATFORM_WIN32_KHR)
+		VkWin32SurfaceCreateInfoKHR createInfo { };
+		createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+		createInfo.hinstance = GetModuleHandle(NULL);
+		createInfo.hwnd = window.getNativeHandle();
+		VkResult result = vkCreateWin32SurfaceKHR(instance, &createInfo, NULL, &surface);
+		#elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
+		VkWaylandSurfaceCreateInfoKHR createInfo { };
+		createInfo.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
+		createInfo.display = window.getNativeDisplay();
+		createInfo.surface = window.getNativeHandle();
+		VkResult result = vkCreateWaylandSurfaceKHR(instance, &createInfo, NULL, &surface);
+		#else
+		VkXlibSurfaceCreateInfoKHR createInfo { };
+		createInfo.sType = VK_STRUCTURE_TYPE_XLIB_SURFACE_CREATE_INFO_KHR;
+		createInfo.dpy = window.getNativeDisplay();
+		createInfo.window = window.getNativeHandle();
+		VkResult result = vkCreateXlibSurfaceKHR(instance, &createInfo, NULL, &surface);
+		#endif
+		if(result != VK_SUCCESS)
+		{
+			spdlog::critical("Failed to create the {} surface, VkResult: {}", GetNativeSurfaceExtensionName(), static_cast<s32>(result));
+			exit(EXIT_FAILURE);
+		}
+		return surface;
+	}
+}
@@ -0,0 +1,257 @@
+#include <kvmio/VulkanUtility.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm> // for std::min, std::max, std::find
+#include <cstring> // for strcmp
+#include <vector>
+
+namespace kvmio
+{
+	// Higher is better; CPU implementations (e.g. lavapipe) are still accepted so that the renderers run on hosts without a GPU
+	static u32 GetPhysicalDeviceTypeRank(VkPhysicalDeviceType type)
+	{
+		switch(type)
+		{
+			case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+			case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+			case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+			case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+			default: return 0;
+		}
+	}
+
+	bool IsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName)
+	{
+		u32 count = 0;
+		PVK_CHECK(vkEnumerateDeviceExtensionProperties(device, NULL, &count, NULL));
+		std::vector<VkExtensionProperties> properties(count);
+		PVK_CHECK(vkEnumerateDeviceExtensionProperties(device, NULL, &count, properties.data()));
+		for(const VkExtensionProperties& property : properties)
+			if(strcmp(property.extensionName, extensionName) == 0)
+				return true;
+		return false;
+	}
+
+	// surface = VK_NULL_HANDLE checks for offscreen rendering instead, i.e. the format must be renderable and copyable to a buffer
+	static bool IsPhysicalDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface, VkFormat format, VkColorSpaceKHR colorSpace, bool isYcbcrConversion)
+	{
+		u32 queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+		bool isGraphics = false;
+		bool isPresent = surface == VK_NULL_HANDLE;
+		for(u32 i = 0; i < queueFamilyCount; i++)
+		{
+			isGraphics = isGraphics || ((queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == VK_QUEUE_GRAPHICS_BIT);
+			if(surface == VK_NULL_HANDLE)
+				continue;
+			VkBool32 isSupported = VK_FALSE;
+			PVK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &isSupported));
+			isPresent = isPresent || (isSupported == VK_TRUE);
+		}
+		if(!isGraphics || !isPresent)
+			return false;
+
+		if(surface == VK_NULL_HANDLE)
+		{
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(device, format, &formatProperties);
+			const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT;
+			if((formatProperties.optimalTilingFeatures & requiredFeatures) != requiredFeatures)
+				return false;
+		}
+		else
+		{
+			if(!IsDeviceExtensionSupported(device, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+				return false;
+
+			u32 formatCount = 0;
+			PVK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, NULL));
+			std::vector<VkSurfaceFormatKHR> formats(formatCount);
+			PVK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, formats.data()));
+			if(std::find_if(formats.begin(), formats.end(), [format, colorSpace](const VkSurfaceFormatKHR& f) { return (f.format == format) && (f.colorSpace == colorSpace); }) == formats.end())
+				return false;
+		}
+
+		if(isYcbcrConversion)
+		{
+			VkPhysicalDeviceSamplerYcbcrConversionFeatures ycbcrFeatures { };
+			ycbcrFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES;
+			VkPhysicalDeviceFeatures2 features { };
+			features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features.pNext = &ycbcrFeatures;
+			vkGetPhysicalDeviceFeatures2(device, &features);
+			if(ycbcrFeatures.samplerYcbcrConversion != VK_TRUE)
+				return false;
+		}
+		return true;
+	}
+
+	// Ranks every physical device by its type and picks the best one which can render and present to the surface
+	// (or just render, if there is no surface), instead of insisting on a discrete GPU
+	VkPhysicalDevice SelectPhysicalDevice(VkInstance instance, VkSurfaceKHR surface, VkFormat format, VkColorSpaceKHR colorSpace, bool isYcbcrConversion)
+	{
+		u32 count = 0;
+		PVK_CHECK(vkEnumeratePhysicalDevices(instance, &count, NULL));
+		std::vector<VkPhysicalDevice> devices(count);
+		PVK_CHECK(vkEnumeratePhysicalDevices(instance, &count, devices.data()));
+
+		VkPhysicalDevice bestDevice = VK_NULL_HANDLE;
+		VkPhysicalDeviceProperties bestProperties { };
+		u32 bestRank = 0;
+		for(VkPhysicalDevice device : devices)
+		{
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(device, &properties);
+			if(!IsPhysicalDeviceSuitable(device, surface, format, colorSpace, isYcbcrConversion))
+			{
+				spdlog::info("Skipping physical device: {}, it doesn't meet the requirements", properties.deviceName);
+				continue;
+			}
+			// +1 so that even VK_PHYSICAL_DEVICE_TYPE_OTHER is preferred over no device at all
+			u32 rank = GetPhysicalDeviceTypeRank(properties.deviceType) + 1;
+			if(rank > bestRank)
+			{
+				bestRank = rank;
+				bestDevice = device;
+				bestProperties = properties;
+			}
+		}
+
+		if(bestDevice == VK_NULL_HANDLE)
+		{
+			spdlog::critical("No suitable Vulkan physical device found, enumerated {} device(s)", count);
+			exit(EXIT_FAILURE);
+		}
+		spdlog::info("Selected physical device: {}, type: {}", bestProperties.deviceName, static_cast<u32>(bestProperties.deviceType));
+		return bestDevice;
+	}
+
+	VkPresentModeKHR SelectPresentMode(VkPhysicalDevice device, VkSurfaceKHR surface, PresentProfile profile)
+	{
+		// FIFO is the only mode which is guaranteed to be supported
+		if(profile == PresentProfile::Throughput)
+			return VK_PRESENT_MODE_FIFO_KHR;
+
+		u32 count = 0;
+		PVK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count, NULL));
+		std::vector<VkPresentModeKHR> modes(count);
+		PVK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count, modes.data()));
+		auto isSupported = [&modes](VkPresentModeKHR mode) { return std::find(modes.begin(), modes.end(), mode) != modes.end(); };
+		// MAILBOX doesn't tear and doesn't block, IMMEDIATE may tear but that's acceptable for a KVM operator
+		if(isSupported(VK_PRESENT_MODE_MAILBOX_KHR))
+			return VK_PRESENT_MODE_MAILBOX_KHR;
+		if(isSupported(VK_PRESENT_MODE_IMMEDIATE_KHR))
+			return VK_PRESENT_MODE_IMMEDIATE_KHR;
+		return VK_PRESENT_MODE_FIFO_KHR;
+	}
+
+	u32 SelectImageCount(VkPhysicalDevice device, VkSurfaceKHR surface, u32 preferredImageCount)
+	{
+		VkSurfaceCapabilitiesKHR capabilities;
+		PVK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &capabilities));
+		u32 imageCount = std::max(preferredImageCount, capabilities.minImageCount);
+		// maxImageCount == 0 means there is no upper limit
+		if(capabilities.maxImageCount != 0)
+			imageCount = std::min(imageCount, capabilities.maxImageCount);
+		return imageCount;
+	}
+
+	bool IsPresentWaitSupported(VkPhysicalDevice device)
+	{
+		if(!IsDeviceExtensionSupported(device, VK_KHR_PRESENT_ID_EXTENSION_NAME) || !IsDeviceExtensionSupported(device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+			return false;
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures { };
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures { };
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+		VkPhysicalDeviceFeatures2 features { };
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+		return (presentIdFeatures.presentId == VK_TRUE) && (presentWaitFeatures.presentWait == VK_TRUE);
+	}
+
+	VkDevice CreateLogicalDevice(VkPhysicalDevice physicalDevice, const uint32_t queueFamilyIndices[2], bool isSwapchain, bool isYcbcrConversion, bool isPresentWait)
+	{
+		std::vector<const char*> extensions;
+		if(isSwapchain)
+			extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		void* featuresChain = NULL;
+
+		VkPhysicalDeviceSamplerYcbcrConversionFeatures ycbcrFeatures { };
+		ycbcrFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES;
+		if(isYcbcrConversion)
+		{
+			extensions.push_back("VK_KHR_sampler_ycbcr_conversion");
+			ycbcrFeatures.samplerYcbcrConversion = VK_TRUE;
+			ycbcrFeatures.pNext = featuresChain;
+			featuresChain = &ycbcrFeatures;
+		}
+
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures { };
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures { };
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		if(isPresentWait)
+		{
+			extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			presentIdFeatures.presentId = VK_TRUE;
+			presentIdFeatures.pNext = featuresChain;
+			presentWaitFeatures.presentWait = VK_TRUE;
+			presentWaitFeatures.pNext = &presentIdFeatures;
+			featuresChain = &presentWaitFeatures;
+		}
+
+		const float queuePriority = 1.0f;
+		VkDeviceQueueCreateInfo queueCreateInfos[2] = { };
+		u32 queueCreateInfoCount = (queueFamilyIndices[0] == queueFamilyIndices[1]) ? 1 : 2;
+		for(u32 i = 0; i < queueCreateInfoCount; i++)
+		{
+			queueCreateInfos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfos[i].queueFamilyIndex = queueFamilyIndices[i];
+			queueCreateInfos[i].queueCount = 1;
+			queueCreateInfos[i].pQueuePriorities = &queuePriority;
+		}
+
+		VkDeviceCreateInfo cInfo { };
+		{
+			cInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+			cInfo.pNext = featuresChain;
+			cInfo.queueCreateInfoCount = queueCreateInfoCount;
+			cInfo.pQueueCreateInfos = queueCreateInfos;
+			cInfo.enabledExtensionCount = static_cast<u32>(extensions.size());
+			cInfo.ppEnabledExtensionNames = extensions.data();
+		};
+		VkDevice device;
+		PVK_CHECK(vkCreateDevice(physicalDevice, &cInfo, NULL, &device));
+		return device;
+	}
+
+	// Same as pvkPresent() but optionally tags the presentation with an id (VK_KHR_present_id), presentId = 0 means no id
+	bool QueuePresent(VkQueue queue, VkSwapchainKHR swapchain, u32 imageIndex, u32 waitSemaphoreCount, const VkSemaphore* waitSemaphores, u64 presentId)
+	{
+		VkPresentIdKHR presentIdInfo { };
+		presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentIdInfo.swapchainCount = 1;
+		presentIdInfo.pPresentIds = &presentId;
+
+		VkPresentInfoKHR presentInfo { };
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.pNext = (presentId == 0) ? NULL : &presentIdInfo;
+		presentInfo.waitSemaphoreCount = waitSemaphoreCount;
+		presentInfo.pWaitSemaphores = waitSemaphores;
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &swapchain;
+		presentInfo.pImageIndices = &imageIndex;
+		VkResult result = vkQueuePresentKHR(queue, &presentInfo);
+		if((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR))
+			return false;
+		PVK_CHECK(result);
+		return true;
+	}
+}
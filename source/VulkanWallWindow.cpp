@@ -0,0 +1,88 @@
+#include <kvmio/VulkanWallWindow.hpp>
+
+#include <libassert/assert.hpp>
+
+// In milliseconds, how long the window's thread sleeps at most without a message before checking the loop predicate again
+#define VULKAN_WALL_WINDOW_EVENT_WAIT_TIMEOUT 10
+
+namespace kvmio
+{
+	VulkanWallWindow::VulkanWallWindow(u32 width, u32 height, std::string_view title, u32 feedCount, u32 feedWidth, u32 feedHeight) :
+																										NativeWindow(width, height, title),
+																										m_renderThread(getClientWidth(), getClientHeight()),
+																										m_cursorOverlay(feedWidth, feedHeight)
+	{
+		m_feedConverters.reserve(feedCount);
+		for(u32 i = 0; i < feedCount; i++)
+			m_feedConverters.push_back(std::make_unique<FeedConverter>());
+		m_vkCompositor = std::make_unique<VulkanCompositor>([this](VkInstance& vkInstance) -> VkSurfaceKHR
+		{
+			return CreateNativeSurface(vkInstance, *this);
+		},
+		[this]() -> std::pair<u32, u32>
+		{
+			return m_renderThread.getExtent();
+		},
+		feedCount, feedWidth, feedHeight);
+	}
+
+	VulkanWallWindow::~VulkanWallWindow()
+	{
+		m_renderThread.stop();
+		// Destroy the Vulkan objects (and the surface) before the native window goes away
+		m_vkCompositor.reset();
+	}
+
+	void VulkanWallWindow::runGameLoop()
+	{
+		runGameLoop(60);
+	}
+
+	void VulkanWallWindow::runGameLoop(u32 frameRate, const Predicate& isLoop)
+	{
+		m_renderThread.setExtent(getClientWidth(), getClientHeight());
+		m_renderThread.start([this, frameRate]()
+		{
+			m_vkCompositor->runGameLoop(frameRate, [this]() -> bool
+			{
+				return m_renderThread.isRunning();
+			});
+		});
+		while(isLoop() && !shouldClose())
+		{
+			waitEvents(VULKAN_WALL_WINDOW_EVENT_WAIT_TIMEOUT);
+			auto [width, height] = getClientSize();
+			m_renderThread.setExtent(width, height);
+		}
+		m_renderThread.stop();
+	}
+
+	void VulkanWallWindow::presentFeed(u32 feedIndex, std::span<const u8> frameData)
+	{
+		if(shouldClose())
+			return;
+		DEBUG_ASSERT(feedIndex < m_feedConverters.size());
+		FeedConverter& feedConverter = *m_feedConverters[feedIndex];
+		// Held until submitFeedFrame() has copied the output out, the next conversion of this feed overwrites it
+		std::lock_guard<std::mutex> lock(feedConverter.mutex);
+		if(!feedConverter.converter)
+			feedConverter.converter = std::make_unique<NV12ToRGBConverter>(m_vkCompositor->getFeedWidth(), m_vkCompositor->getFeedHeight(), 60, 1, 32);
+		u8* data = feedConverter.converter->convert(frameData.data(), frameData.size());
+		m_vkCompositor->submitFeedFrame(feedIndex, { data, feedConverter.converter->getRGBDataSize() });
+	}
+
+	void VulkanWallWindow::present(std::span<const u8> frameData)
+	{
+		presentFeed(0, frameData);
+	}
+
+	void VulkanWallWindow::requestFeedSnapshot(u32 feedIndex, const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		m_vkCompositor->requestFeedSnapshot(feedIndex, region, format, std::move(callback));
+	}
+
+	void VulkanWallWindow::requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		requestFeedSnapshot(0, region, format, std::move(callback));
+	}
+}
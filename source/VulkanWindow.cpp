@@ -1,12 +1,84 @@
 #include <kvmio/VulkanWindow.hpp>
 
+// In milliseconds, how long the window's thread sleeps at most without a message before checking the loop predicate again
+#define VULKAN_WINDOW_EVENT_WAIT_TIMEOUT 10
+
 namespace kvmio
 {
-	VulkanWindow::VulkanWindow(u32 width, u32 height, std::string_view title) : NativeWindow(width, height, title)
+	VulkanWindow::VulkanWindow(u32 width, u32 height, std::string_view title, PresentProfile presentProfile) : NativeWindow(width, height, title),
+																												m_renderThread(getClientWidth(), getClientHeight())
 	{
+		#ifndef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+		m_nv12ToRGBConverter = std::make_unique<NV12ToRGBConverter>(1920, 1080, 60, 1, 32);
+		#endif
 		m_vkPresentEngine = std::make_unique<VulkanPresentEngine>([this](VkInstance& vkInstance) -> VkSurfaceKHR
 		{
-			return pvkCreateSurface(vkInstance, GetModuleHandle(NULL), this->getNativeHandle());
+			return CreateNativeSurface(vkInstance, *this);
+		},
+		[this]() -> std::pair<u32, u32>
+		{
+			// Called from the render (or the initialization) thread, so not directly from the window
+			return m_renderThread.getExtent();
+		},
+		presentProfile);
+		m_vkPresentEngine->setCursorOverlay(&getCursorOverlay());
+	}
+
+	VulkanWindow::~VulkanWindow()
+	{
+		m_renderThread.stop();
+		// Destroy the Vulkan objects (and the surface) before the native window goes away
+		m_vkPresentEngine.reset();
+	}
+
+	void VulkanWindow::runGameLoop()
+	{
+		runGameLoop(60);
+	}
+
+	void VulkanWindow::runGameLoop(u32 frameRate, const Predicate& isLoop)
+	{
+		m_renderThread.setExtent(getClientWidth(), getClientHeight());
+		m_renderThread.start([this, frameRate]()
+		{
+			m_vkPresentEngine->runGameLoop(frameRate, [this]() -> bool
+			{
+				return m_renderThread.isRunning();
+			});
 		});
+		// Messages (i.e. input) are handled as soon as they arrive, no matter how long the render thread waits on the GPU or for vsync
+		while(isLoop() && !shouldClose())
+		{
+			waitEvents(VULKAN_WINDOW_EVENT_WAIT_TIMEOUT);
+			auto [width, height] = getClientSize();
+			m_renderThread.setExtent(width, height);
+		}
+		m_renderThread.stop();
+	}
+
+	void VulkanWindow::present(std::span<const u8> frameData)
+	{
+		if(shouldClose())
+			return;
+		#ifdef USE_VULKAN_FOR_COLOR_SPACE_CONVERSION
+		// NV12 is uploaded as it is, the YCbCr sampler does the conversion on the GPU
+		m_vkPresentEngine->submitFrame(frameData);
+		#else
+		std::lock_guard<std::mutex> lock(m_converterMutex);
+		u8* data = m_nv12ToRGBConverter->convert(frameData.data(), frameData.size());
+		m_vkPresentEngine->submitFrame({ data, m_nv12ToRGBConverter->getRGBDataSize() });
+		#endif
+	}
+
+	void VulkanWindow::presentPlanes(const FramePlanes& planes)
+	{
+		if(shouldClose())
+			return;
+		m_vkPresentEngine->submitFramePlanes(planes);
+	}
+
+	void VulkanWindow::requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		m_vkPresentEngine->requestSnapshot(region, format, std::move(callback));
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,122 @@
+#include <kvmio/Wayland/WaylandBufferRing.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <libassert/assert.hpp>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring> // for std::memset
+
+namespace kvmio::Wayland
+{
+	WaylandBufferRing::WaylandBufferRing(wl_shm* shm, u32 width, u32 height, u32 count, u32 format) :
+											m_fd(-1),
+											m_memory(NULL),
+											m_size(static_cast<std::size_t>(width) * height * 4 * count),
+											m_pool(NULL),
+											m_width(width),
+											m_height(height),
+											m_buffers(count),
+											m_readyIndex(-1)
+	{
+		m_fd = memfd_create("kvmio-wayland-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if(m_fd < 0)
+			kvmio_Internal_ErrorExit("memfd_create");
+		if(ftruncate(m_fd, static_cast<off_t>(m_size)) < 0)
+			kvmio_Internal_ErrorExit("ftruncate");
+		// The compositor maps it too, it mustn't be able to shrink under it
+		fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL);
+		void* memory = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if(memory == MAP_FAILED)
+			kvmio_Internal_ErrorExit("mmap");
+		m_memory = static_cast<u8*>(memory);
+		std::memset(m_memory, 0, m_size);
+
+		m_pool = wl_shm_create_pool(shm, m_fd, static_cast<int32_t>(m_size));
+		static const wl_buffer_listener listener = { .release = OnRelease };
+		for(u32 i = 0; i < count; i++)
+		{
+			Buffer& buffer = m_buffers[i];
+			const std::size_t offset = static_cast<std::size_t>(i) * width * height * 4;
+			buffer.handle = wl_shm_pool_create_buffer(m_pool, static_cast<int32_t>(offset), static_cast<int32_t>(width), static_cast<int32_t>(height),
+														static_cast<int32_t>(getStride()), format);
+			buffer.pixels = m_memory + offset;
+			buffer.state = State::Free;
+			buffer.serial = 0;
+			wl_buffer_add_listener(buffer.handle, &listener, this);
+		}
+	}
+
+	WaylandBufferRing::~WaylandBufferRing()
+	{
+		for(Buffer& buffer : m_buffers)
+			wl_buffer_destroy(buffer.handle);
+		wl_shm_pool_destroy(m_pool);
+		munmap(m_memory, m_size);
+		close(m_fd);
+	}
+
+	void WaylandBufferRing::OnRelease(void* userData, wl_buffer* handle)
+	{
+		WaylandBufferRing* ring = static_cast<WaylandBufferRing*>(userData);
+		std::lock_guard<std::mutex> lock(ring->m_mutex);
+		for(Buffer& buffer : ring->m_buffers)
+		{
+			if(buffer.handle != handle)
+				continue;
+			DEBUG_ASSERT(buffer.state == State::Attached);
+			buffer.state = State::Free;
+			return;
+		}
+	}
+
+	s32 WaylandBufferRing::acquire()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(std::size_t i = 0; i < m_buffers.size(); i++)
+		{
+			if(m_buffers[i].state != State::Free)
+				continue;
+			m_buffers[i].state = State::Writing;
+			return static_cast<s32>(i);
+		}
+		// Nothing free, the ready frame hasn't made it to the screen and is about to be superseded anyway
+		if(m_readyIndex < 0)
+			return -1;
+		s32 index = m_readyIndex;
+		m_readyIndex = -1;
+		m_buffers[index].state = State::Writing;
+		return index;
+	}
+
+	void WaylandBufferRing::markReady(s32 index, u64 serial)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		DEBUG_ASSERT(m_buffers[index].state == State::Writing);
+		if(m_readyIndex >= 0)
+			m_buffers[m_readyIndex].state = State::Free;
+		m_buffers[index].state = State::Ready;
+		m_buffers[index].serial = serial;
+		m_readyIndex = index;
+	}
+
+	void WaylandBufferRing::cancel(s32 index)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		DEBUG_ASSERT(m_buffers[index].state == State::Writing);
+		m_buffers[index].state = State::Free;
+	}
+
+	s32 WaylandBufferRing::takeReady()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		s32 index = m_readyIndex;
+		if(index < 0)
+			return -1;
+		m_readyIndex = -1;
+		m_buffers[index].state = State::Attached;
+		return index;
+	}
+}
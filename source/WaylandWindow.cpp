@@ -0,0 +1,491 @@
+#include <kvmio/WaylandWindow.hpp>
+#include <kvmio/ColorConversion.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm> // for std::min, std::clamp
+#include <chrono>
+#include <cstring>
+#include <cerrno> // for errno
+
+// In milliseconds, how often the event loop wakes up without any event to check for a changed cursor (which has no fd to wait on)
+#define WAYLAND_WINDOW_CURSOR_POLL_INTERVAL 2
+
+namespace kvmio
+{
+	WaylandWindow::WaylandWindow(u32 width, u32 height, std::string_view title) :
+											m_registry(NULL),
+											m_compositor(NULL),
+											m_subcompositor(NULL),
+											m_shm(NULL),
+											m_wmBase(NULL),
+											m_frameCallback(NULL),
+											m_isConfigured(false),
+											m_isAttached(false),
+											m_width(width),
+											m_height(height),
+											m_isFullScreen(false),
+											m_isWindowShouldClose(false),
+											m_isDestroyed(false),
+											m_frameSerial(0),
+											m_cursorOverlay(1920, 1080),
+											m_cursorSurface(NULL),
+											m_cursorSubsurface(NULL),
+											m_cursorVersion(0),
+											m_cursorShapeHash(0),
+											m_isCursorAttached(false)
+	{
+		m_display = wl_display_connect(NULL);
+		if(m_display == NULL)
+		{
+			spdlog::critical("Unable to connect to the Wayland display, is WAYLAND_DISPLAY set?");
+			exit(-1);
+		}
+		m_registry = wl_display_get_registry(m_display);
+		static const wl_registry_listener registryListener = { .global = OnRegistryGlobal, .global_remove = OnRegistryGlobalRemove };
+		wl_registry_add_listener(m_registry, &registryListener, this);
+		wl_display_roundtrip(m_display);
+		if((m_compositor == NULL) || (m_shm == NULL) || (m_wmBase == NULL))
+		{
+			spdlog::critical("The Wayland compositor lacks wl_compositor (version 4 or later), wl_shm or xdg_wm_base");
+			exit(-1);
+		}
+
+		m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if(m_wakeFd < 0)
+			kvmio_Internal_ErrorExit("eventfd");
+
+		m_surface = wl_compositor_create_surface(m_compositor);
+		m_xdgSurface = xdg_wm_base_get_xdg_surface(m_wmBase, m_surface);
+		static const xdg_surface_listener surfaceListener = { .configure = OnSurfaceConfigure };
+		xdg_surface_add_listener(m_xdgSurface, &surfaceListener, this);
+		m_toplevel = xdg_surface_get_toplevel(m_xdgSurface);
+		// Value initialized, the events of later versions (never sent to a version 1 binding) stay null whatever the generated header has
+		static const xdg_toplevel_listener toplevelListener = []()
+		{
+			xdg_toplevel_listener listener { };
+			listener.configure = OnToplevelConfigure;
+			listener.close = OnToplevelClose;
+			return listener;
+		}();
+		xdg_toplevel_add_listener(m_toplevel, &toplevelListener, this);
+		std::string name { title };
+		xdg_toplevel_set_title(m_toplevel, name.c_str());
+		xdg_toplevel_set_app_id(m_toplevel, "kvmio");
+
+		m_buffers = std::make_unique<Wayland::WaylandBufferRing>(m_shm, 1920, 1080, BufferCount);
+		DEBUG_ASSERT(((m_buffers->getHeight() + DamageBandHeight - 1) / DamageBandHeight) <= MaxDamageBands);
+
+		// Without wl_subcompositor the cursor overlay isn't shown, the frames still are
+		if(m_subcompositor != NULL)
+		{
+			m_cursorSurface = wl_compositor_create_surface(m_compositor);
+			// Pointer input goes through to the window underneath
+			wl_region* emptyRegion = wl_compositor_create_region(m_compositor);
+			wl_surface_set_input_region(m_cursorSurface, emptyRegion);
+			wl_region_destroy(emptyRegion);
+			m_cursorSubsurface = wl_subcompositor_get_subsurface(m_subcompositor, m_cursorSurface, m_surface);
+			wl_subsurface_set_desync(m_cursorSubsurface);
+			m_cursorBuffers = std::make_unique<Wayland::WaylandBufferRing>(m_shm, CursorOverlay::MaxShapeSize, CursorOverlay::MaxShapeSize, 2, WL_SHM_FORMAT_ARGB8888);
+		}
+		else
+			spdlog::warn("The Wayland compositor lacks wl_subcompositor, the remote cursor won't be drawn");
+	}
+
+	WaylandWindow::~WaylandWindow()
+	{
+		_destroy();
+	}
+
+	void WaylandWindow::_destroy()
+	{
+		if(m_isDestroyed)
+			return;
+		m_isDestroyed = true;
+		{
+			// A concurrent present() may be writing into a buffer
+			std::lock_guard<std::mutex> lock(m_presentMutex);
+			if(m_cursorSubsurface != NULL)
+			{
+				wl_subsurface_destroy(m_cursorSubsurface);
+				wl_surface_destroy(m_cursorSurface);
+				m_cursorBuffers.reset();
+			}
+			if(m_frameCallback != NULL)
+				wl_callback_destroy(m_frameCallback);
+			xdg_toplevel_destroy(m_toplevel);
+			xdg_surface_destroy(m_xdgSurface);
+			wl_surface_destroy(m_surface);
+			m_buffers.reset();
+		}
+		xdg_wm_base_destroy(m_wmBase);
+		wl_shm_destroy(m_shm);
+		if(m_subcompositor != NULL)
+			wl_subcompositor_destroy(m_subcompositor);
+		wl_compositor_destroy(m_compositor);
+		wl_registry_destroy(m_registry);
+		wl_display_disconnect(m_display);
+		close(m_wakeFd);
+	}
+
+	void WaylandWindow::OnRegistryGlobal(void* userData, wl_registry* registry, uint32_t name, const char* interface, uint32_t version)
+	{
+		WaylandWindow* window = static_cast<WaylandWindow*>(userData);
+		if((std::strcmp(interface, "wl_compositor") == 0) && (version >= 4))
+			// Version 4 for wl_surface.damage_buffer
+			window->m_compositor = static_cast<wl_compositor*>(wl_registry_bind(registry, name, &wl_compositor_interface, 4));
+		else if(std::strcmp(interface, "wl_subcompositor") == 0)
+			window->m_subcompositor = static_cast<wl_subcompositor*>(wl_registry_bind(registry, name, &wl_subcompositor_interface, 1));
+		else if(std::strcmp(interface, "wl_shm") == 0)
+			window->m_shm = static_cast<wl_shm*>(wl_registry_bind(registry, name, &wl_shm_interface, 1));
+		else if(std::strcmp(interface, "xdg_wm_base") == 0)
+		{
+			// Version 1 is all that is used, binding a later one would bring events (e.g. configure_bounds) we don't listen to
+			window->m_wmBase = static_cast<xdg_wm_base*>(wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
+			static const xdg_wm_base_listener wmBaseListener = { .ping = OnPing };
+			xdg_wm_base_add_listener(window->m_wmBase, &wmBaseListener, window);
+		}
+	}
+
+	void WaylandWindow::OnRegistryGlobalRemove(void*, wl_registry*, uint32_t)
+	{
+	}
+
+	void WaylandWindow::OnPing(void*, xdg_wm_base* wmBase, uint32_t serial)
+	{
+		xdg_wm_base_pong(wmBase, serial);
+	}
+
+	void WaylandWindow::OnSurfaceConfigure(void* userData, xdg_surface* xdgSurface, uint32_t serial)
+	{
+		WaylandWindow* window = static_cast<WaylandWindow*>(userData);
+		xdg_surface_ack_configure(xdgSurface, serial);
+		window->m_isConfigured = true;
+		// The acknowledgement takes effect with the next commit, which otherwise only comes with the next frame
+		if(window->m_isAttached)
+			wl_surface_commit(window->m_surface);
+	}
+
+	void WaylandWindow::OnToplevelConfigure(void* userData, xdg_toplevel*, int32_t width, int32_t height, wl_array*)
+	{
+		WaylandWindow* window = static_cast<WaylandWindow*>(userData);
+		// Zero leaves the size up to us, i.e. the size of the frames
+		if((width > 0) && (height > 0))
+		{
+			window->m_width = static_cast<u32>(width);
+			window->m_height = static_cast<u32>(height);
+		}
+	}
+
+	void WaylandWindow::OnToplevelClose(void* userData, xdg_toplevel*)
+	{
+		static_cast<WaylandWindow*>(userData)->m_isWindowShouldClose = true;
+	}
+
+	void WaylandWindow::OnFrameDone(void* userData, wl_callback* callback, uint32_t)
+	{
+		WaylandWindow* window = static_cast<WaylandWindow*>(userData);
+		DEBUG_ASSERT(callback == window->m_frameCallback);
+		wl_callback_destroy(callback);
+		window->m_frameCallback = NULL;
+	}
+
+	void WaylandWindow::runGameLoop()
+	{
+		while(!shouldClose())
+		{
+			updateCursor();
+			commitFrame();
+			waitEvents(WAYLAND_WINDOW_CURSOR_POLL_INTERVAL);
+		}
+	}
+
+	void WaylandWindow::runGameLoop(u32 frameRate, const std::function<bool(void)>& isLoop)
+	{
+		// The frame callbacks already pace the commits to the compositor's refresh, the frame rate only caps them further
+		const auto deltaTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<f64>(1.0 / frameRate));
+		auto nextFrameTime = std::chrono::steady_clock::now();
+		while(isLoop() && (!shouldClose()))
+		{
+			// At the input rate, the frame rate only applies to the frames
+			updateCursor();
+			auto time = std::chrono::steady_clock::now();
+			if(time >= nextFrameTime)
+			{
+				bool isCommitted = (m_frameCallback == NULL);
+				commitFrame();
+				if(isCommitted && (m_frameCallback != NULL))
+					nextFrameTime = time + deltaTime;
+			}
+			auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(nextFrameTime - std::chrono::steady_clock::now()).count();
+			waitEvents(static_cast<u32>(std::clamp<s64>(timeout, 0, WAYLAND_WINDOW_CURSOR_POLL_INTERVAL)));
+		}
+	}
+
+	WaylandWindow::DamageBands WaylandWindow::getChangedBands(std::span<const u8> frameData) const
+	{
+		const u32 width = m_buffers->getWidth();
+		const u32 height = m_buffers->getHeight();
+		const u32 bandCount = (height + DamageBandHeight - 1) / DamageBandHeight;
+		DamageBands bands;
+		if(!m_displayedFrame)
+		{
+			for(u32 i = 0; i < bandCount; i++)
+				bands.set(i);
+			return bands;
+		}
+		const u8* yPlane = frameData.data();
+		const u8* uvPlane = yPlane + static_cast<std::size_t>(width) * height;
+		const u8* previousYPlane = m_displayedFrame->data();
+		const u8* previousUVPlane = previousYPlane + static_cast<std::size_t>(width) * height;
+		for(u32 i = 0; i < bandCount; i++)
+		{
+			const u32 y = i * DamageBandHeight;
+			const u32 rows = std::min(DamageBandHeight, height - y);
+			const std::size_t yOffset = static_cast<std::size_t>(y) * width;
+			const std::size_t uvOffset = static_cast<std::size_t>(y >> 1) * width;
+			if((std::memcmp(yPlane + yOffset, previousYPlane + yOffset, static_cast<std::size_t>(rows) * width) != 0)
+				|| (std::memcmp(uvPlane + uvOffset, previousUVPlane + uvOffset, static_cast<std::size_t>(rows >> 1) * width) != 0))
+				bands.set(i);
+		}
+		return bands;
+	}
+
+	void WaylandWindow::present(std::span<const u8> frameData)
+	{
+		if(m_isDestroyed)
+			return;
+		std::lock_guard<std::mutex> lock(m_presentMutex);
+		if(m_isDestroyed)
+			return;
+		const u32 width = m_buffers->getWidth();
+		const u32 height = m_buffers->getHeight();
+		DEBUG_ASSERT(frameData.size() >= ((static_cast<std::size_t>(width) * height * 3) >> 1));
+
+		const DamageBands changedBands = getChangedBands(frameData);
+		if(changedBands.none())
+			return;
+		s32 index = m_buffers->acquire();
+		// The compositor holds every buffer, the frame is dropped (and the next one compared against the one before it)
+		if(index < 0)
+			return;
+
+		// The buffer holds an older frame, everything which changed since then has to be converted into it
+		DamageBands staleBands = changedBands;
+		const u64 bufferSerial = m_buffers->getSerial(index);
+		if((bufferSerial == 0) || ((m_frameSerial - bufferSerial) >= DamageHistorySize))
+			staleBands.set();
+		else
+		{
+			for(u64 serial = bufferSerial + 1; serial <= m_frameSerial; serial++)
+				staleBands |= m_damageHistory[serial % DamageHistorySize];
+		}
+		const u8* yPlane = frameData.data();
+		const u8* uvPlane = yPlane + static_cast<std::size_t>(width) * height;
+		u8* pixels = m_buffers->getPixels(index);
+		const u32 stride = m_buffers->getStride();
+		for(u32 y = 0; y < height; y += DamageBandHeight)
+		{
+			if(!staleBands.test(y / DamageBandHeight))
+				continue;
+			const u32 rows = std::min(DamageBandHeight, height - y);
+			ConvertNV12ToBGRA(yPlane + static_cast<std::size_t>(y) * width, uvPlane + static_cast<std::size_t>(y >> 1) * width, width, width, rows,
+								pixels + static_cast<std::size_t>(y) * stride, stride);
+		}
+
+		m_frameSerial++;
+		m_damageHistory[m_frameSerial % DamageHistorySize] = changedBands;
+		{
+			std::lock_guard<std::mutex> lock(m_damageMutex);
+			// Accumulated, a ready frame superseded before being committed still has to have its bands damaged
+			m_pendingDamage |= changedBands;
+			m_buffers->markReady(index, m_frameSerial);
+		}
+		setDisplayedFrame(frameData);
+
+		const u64 value = 1;
+		if(write(m_wakeFd, &value, sizeof(value)) < 0)
+			DEBUG_ASSERT(errno == EAGAIN);
+	}
+
+	void WaylandWindow::commitFrame()
+	{
+		if(!m_isConfigured || (m_frameCallback != NULL))
+			return;
+		s32 index;
+		DamageBands damage;
+		{
+			std::lock_guard<std::mutex> lock(m_damageMutex);
+			index = m_buffers->takeReady();
+			if(index < 0)
+				return;
+			std::swap(damage, m_pendingDamage);
+		}
+		wl_surface_attach(m_surface, m_buffers->getHandle(index), 0, 0);
+		const u32 height = m_buffers->getHeight();
+		const u32 bandCount = (height + DamageBandHeight - 1) / DamageBandHeight;
+		// One rectangle per run of changed bands
+		for(u32 i = 0; i < bandCount;)
+		{
+			if(m_isAttached && !damage.test(i))
+			{
+				i++;
+				continue;
+			}
+			u32 end = i + 1;
+			while((end < bandCount) && (!m_isAttached || damage.test(end)))
+				end++;
+			const u32 y = i * DamageBandHeight;
+			wl_surface_damage_buffer(m_surface, 0, static_cast<int32_t>(y), static_cast<int32_t>(m_buffers->getWidth()),
+										static_cast<int32_t>(std::min(end * DamageBandHeight, height) - y));
+			i = end;
+		}
+		m_frameCallback = wl_surface_frame(m_surface);
+		static const wl_callback_listener frameListener = { .done = OnFrameDone };
+		wl_callback_add_listener(m_frameCallback, &frameListener, this);
+		wl_surface_commit(m_surface);
+		m_isAttached = true;
+	}
+
+	void WaylandWindow::updateCursor()
+	{
+		if((m_cursorSurface == NULL) || (m_cursorOverlay.getVersion() == m_cursorVersion))
+			return;
+		CursorOverlay::State state = m_cursorOverlay.getState();
+		if(!state.isVisible || !state.shape)
+		{
+			if(m_isCursorAttached)
+			{
+				wl_surface_attach(m_cursorSurface, NULL, 0, 0);
+				wl_surface_commit(m_cursorSurface);
+				m_isCursorAttached = false;
+			}
+			m_cursorVersion = state.version;
+			return;
+		}
+
+		if(!m_isCursorAttached || (state.shape->hash != m_cursorShapeHash))
+		{
+			s32 index = m_cursorBuffers->acquire();
+			// Retried on the next iteration, once the compositor has released one
+			if(index < 0)
+				return;
+			// ARGB8888 is premultiplied, the shapes are straight alpha; the rest of the buffer stays transparent
+			const CursorOverlay::Shape& shape = *state.shape;
+			u8* pixels = m_cursorBuffers->getPixels(index);
+			const u32 stride = m_cursorBuffers->getStride();
+			std::memset(pixels, 0, static_cast<std::size_t>(stride) * m_cursorBuffers->getHeight());
+			for(u32 y = 0; y < shape.height; y++)
+			{
+				const u8* src = shape.pixels.data() + static_cast<std::size_t>(y) * shape.width * 4;
+				u8* dst = pixels + static_cast<std::size_t>(y) * stride;
+				for(u32 x = 0; x < shape.width; x++, src += 4, dst += 4)
+				{
+					const u32 alpha = src[3];
+					for(u32 c = 0; c < 3; c++)
+						dst[c] = static_cast<u8>((src[c] * alpha + 127) / 255);
+					dst[3] = static_cast<u8>(alpha);
+				}
+			}
+			m_cursorBuffers->markReady(index, 0);
+			index = m_cursorBuffers->takeReady();
+			wl_surface_attach(m_cursorSurface, m_cursorBuffers->getHandle(index), 0, 0);
+			wl_surface_damage_buffer(m_cursorSurface, 0, 0, static_cast<int32_t>(shape.width), static_cast<int32_t>(shape.height));
+			wl_surface_commit(m_cursorSurface);
+			m_cursorShapeHash = shape.hash;
+			m_isCursorAttached = true;
+		}
+		CursorRect rect = state.getRect();
+		wl_subsurface_set_position(m_cursorSubsurface, rect.x, rect.y);
+		// The position is state of the parent, it takes effect with the parent's next commit even for a desynchronized subsurface
+		wl_surface_commit(m_surface);
+		m_cursorVersion = state.version;
+	}
+
+	void WaylandWindow::setDisplayedFrame(std::span<const u8> frameData)
+	{
+		std::shared_ptr<std::vector<u8>> frame = std::move(m_spareFrame);
+		// Still referred to by a snapshot
+		if(!frame || (frame.use_count() > 1))
+			frame = std::make_shared<std::vector<u8>>();
+		frame->assign(frameData.begin(), frameData.end());
+		m_snapshotSource.setFrame(frame, *frame, SnapshotSourceFormat::NV12, m_buffers->getWidth(), m_buffers->getHeight());
+		m_spareFrame = std::move(m_displayedFrame);
+		m_displayedFrame = std::move(frame);
+	}
+
+	void WaylandWindow::requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		m_snapshotSource.request(region, format, std::move(callback));
+	}
+
+	bool WaylandWindow::shouldClose()
+	{
+		return m_isWindowShouldClose || m_isDestroyed;
+	}
+
+	void WaylandWindow::show()
+	{
+		// The initial commit without a buffer, the compositor answers with the first configure and the window gets mapped with the first frame
+		wl_surface_commit(m_surface);
+		wl_display_flush(m_display);
+	}
+
+	void WaylandWindow::setFullScreen(bool isFullScreen)
+	{
+		m_isFullScreen = isFullScreen;
+		if(isFullScreen)
+			xdg_toplevel_set_fullscreen(m_toplevel, NULL);
+		else
+			xdg_toplevel_unset_fullscreen(m_toplevel);
+		wl_display_flush(m_display);
+	}
+
+	void WaylandWindow::dispatchEvents(s32 timeout)
+	{
+		while(wl_display_prepare_read(m_display) != 0)
+			wl_display_dispatch_pending(m_display);
+		wl_display_flush(m_display);
+
+		pollfd fds[2] = { { wl_display_get_fd(m_display), POLLIN, 0 }, { m_wakeFd, POLLIN, 0 } };
+		s32 result = poll(fds, 2, timeout);
+		if((result < 0) && (errno != EINTR))
+			kvmio_Internal_ErrorExit("poll");
+		if((result > 0) && (fds[0].revents & POLLIN))
+			wl_display_read_events(m_display);
+		else
+			wl_display_cancel_read(m_display);
+		if((result > 0) && (fds[1].revents & POLLIN))
+		{
+			u64 value;
+			if(read(m_wakeFd, &value, sizeof(value)) < 0)
+				DEBUG_ASSERT(errno == EAGAIN);
+		}
+		if(wl_display_dispatch_pending(m_display) < 0)
+		{
+			spdlog::error("Lost the connection to the Wayland compositor (error {})", wl_display_get_error(m_display));
+			m_isWindowShouldClose = true;
+		}
+	}
+
+	void WaylandWindow::pollEvents(bool isBlock)
+	{
+		dispatchEvents(isBlock ? -1 : 0);
+	}
+
+	void WaylandWindow::waitEvents(u32 timeout)
+	{
+		dispatchEvents(static_cast<s32>(timeout));
+	}
+
+	std::pair<u32, u32> WaylandWindow::getSize() const
+	{
+		return { m_width, m_height };
+	}
+} // namespace kvmio
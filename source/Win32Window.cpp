@@ -7,6 +7,7 @@
 #include <libassert/assert.hpp>
 #include <spdlog/spdlog.h>
 
+#include <algorithm> // for std::find_if
 #include <chrono>
 #include <cstring>
 
@@ -33,7 +34,10 @@ namespace kvmio
 											m_isFullScreen(false),
 											m_isLocked(false),
 											m_isWindowShouldClose(false),
-											m_isDestroyed(false)
+											m_isDestroyed(false),
+											m_cursorOverlay(1920, 1080),
+											m_isSurfaceValid(false),
+										m_inputEventRing(nullptr)
 	{
 		m_handle = Win32::Win32CreateWindow(width, height, std::string { name }.c_str(), WindowProc);
 		setSize(width, height);
@@ -48,6 +52,9 @@ namespace kvmio
 
 		GetClipCursor(&m_saveClipRect);
 
+		m_curKeyComb.reserve(KeyChordEngine::MaxHeldKeys);
+		m_virtualKeyHeldCounts.fill(0);
+
 		m_rgbFrameSize = 1920 * 1080 * 4;
 
 		m_pooledFrames = std::make_unique<DataPool>([this]()
@@ -87,6 +94,7 @@ namespace kvmio
 		while(!shouldClose())
 		{
 			invalidateRect();
+			invalidateCursor();
 			pollEvents(false);
 		}
 	}
@@ -103,6 +111,8 @@ namespace kvmio
 				invalidateRect();	
 				startTime = time;
 			}
+			// At the input rate, the frame rate only applies to the frames
+			invalidateCursor();
 			
 			pollEvents(false);
 		}
@@ -125,6 +135,69 @@ namespace kvmio
 		m_inFlightFramesBuffer.push(dstFrameData);
 	}
 
+	void Win32Window::invalidateCursor()
+	{
+		if(!m_isSurfaceValid || (m_cursorOverlay.getVersion() == m_softwareCursor.getDrawnVersion()))
+			return;
+		auto invalidate = [this](const CursorRect& rect)
+		{
+			if(rect.width == 0)
+				return;
+			RECT r = { rect.x, rect.y, rect.x + static_cast<LONG>(rect.width), rect.y + static_cast<LONG>(rect.height) };
+			invalidateRect(&r);
+		};
+		invalidate(m_softwareCursor.getDrawnRect());
+		invalidate(m_cursorOverlay.getState().getRect());
+	}
+
+	void Win32Window::paint(const PAINTSTRUCT& paintStruct)
+	{
+		bool isNewFrame = !m_inFlightFramesBuffer.isEmpty();
+		if(isNewFrame)
+		{
+			auto frameData = m_inFlightFramesBuffer.pop();
+			std::span<u8>& t = frameData;
+			DEBUG_ASSERT(t.size() == m_drawSurface->getBufferSize());
+			memcpy(m_drawSurface->getPixels(), reinterpret_cast<const char*>(t.data()), t.size());
+			setDisplayedFrame(frameData);
+			// The cursor drawn over the previous frame has been overwritten along with it
+			m_softwareCursor.invalidate();
+			m_isSurfaceValid = true;
+		}
+		if(!m_isSurfaceValid)
+			return;
+
+		auto [width, height] = m_drawSurface->getSize();
+		if(isNewFrame || (m_cursorOverlay.getVersion() != m_softwareCursor.getDrawnVersion()))
+		{
+			m_softwareCursor.restore(m_drawSurface->getPixels(), width, height);
+			m_softwareCursor.draw(m_drawSurface->getPixels(), width, height, m_cursorOverlay.getState());
+		}
+		// Only the invalidated area, which is just the cursor's when it moved without a new frame
+		const RECT& rect = paintStruct.rcPaint;
+		BitBlt(paintStruct.hdc, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, m_drawSurface->getHDC(), rect.left, rect.top, SRCCOPY);
+	}
+
+	void Win32Window::setDisplayedFrame(DataPool::ElementType& frame)
+	{
+		std::shared_ptr<DataPool::ElementType> displayedFrame(new DataPool::ElementType(frame), [this](DataPool::ElementType* frame)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+				m_pooledFrames->put(*frame);
+			}
+			delete frame;
+		});
+		auto [width, height] = m_drawSurface->getSize();
+		const std::span<u8>& pixels = *displayedFrame;
+		m_snapshotSource.setFrame(std::move(displayedFrame), pixels, SnapshotSourceFormat::BGRA, width, height);
+	}
+
+	void Win32Window::requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		m_snapshotSource.request(region, format, std::move(callback));
+	}
+
 	bool Win32Window::shouldClose()
 	{
 		return m_isWindowShouldClose || m_isDestroyed;
@@ -241,6 +314,17 @@ namespace kvmio
 		DispatchMessage(&m_msg);
 	}
 
+	void Win32Window::waitEvents(u32 timeout)
+	{
+		if(MsgWaitForMultipleObjectsEx(0, NULL, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE) == WAIT_FAILED)
+			kvmio_Internal_ErrorExit("MsgWaitForMultipleObjectsEx");
+		while(PeekMessage(&m_msg, NULL, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&m_msg);
+			DispatchMessage(&m_msg);
+		}
+	}
+
 	void Win32Window::setMouseCapture()
 	{
 		SetCapture(m_handle);
@@ -328,11 +412,106 @@ namespace kvmio
 			kvmio_Internal_ErrorExit("UnhookWindowsHookEx");
 	}
 
+	KeyChordEngine::ChordId Win32Window::addKeyCombination(const KeyComb& keyComb)
+	{
+		std::vector<u8> keys(keyComb.begin(), keyComb.end());
+		KeyChordEngine::ChordId id = m_keyChords.addChord(keys, KeyChordEngine::ChordType::Ordered);
+		if(id == KeyChordEngine::InvalidChord)
+		{
+			spdlog::critical("Unable to register the key combination");
+			exit(-1);
+		}
+		// Every chord gets an event, left without subscribers if only subscribeKeyCombinationAsync() registered it, so any chord can index it
+		while(m_keyCombEvents.size() <= id)
+			m_keyCombEvents.emplace_back();
+		return id;
+	}
+
 	com::Event<com::no_publish_ptr_t, Win32Window::KeyInputComb>& Win32Window::createKeyCombinationEvent(const KeyComb& keyComb)
 	{
-		std::size_t index = m_keyCombs.size();
-		m_keyCombs.push_back({ keyComb, com::Event<com::no_publish_ptr_t, KeyInputComb>() });
-		return m_keyCombs[index].second;
+		// The same combination registered again shares the event
+		return m_keyCombEvents[addKeyCombination(keyComb)];
+	}
+
+	InputDispatcher::SubscriptionId Win32Window::subscribeKeyCombinationAsync(const KeyComb& keyComb, InputDispatcher::KeyCombinationCallback callback,
+																				u32 capacity, DispatchOverflow overflow)
+	{
+		return m_inputDispatcher.subscribeKeyCombination(addKeyCombination(keyComb), std::move(callback), capacity, overflow);
+	}
+
+	void Win32Window::dispatchMouseInput(const Win32::MouseInput& mouseInput)
+	{
+		const u64 timestamp = GetInputTimestamp();
+		if(m_inputEventRing != nullptr)
+			m_inputEventRing->pushMouse(mouseInput, timestamp);
+		m_inputDispatcher.publishMouse(mouseInput, timestamp);
+		m_mouseEvent.publish(mouseInput);
+	}
+
+	void Win32Window::dispatchKeyboardInput(const Win32::KeyboardInput& keyboardInput)
+	{
+		const u8 virtualKey = static_cast<u8>(keyboardInput.virtualKey);
+		const u32 keyIndex = GetKeyIndex(keyboardInput.makeCode, keyboardInput.isExtended0, keyboardInput.isExtended1);
+		const bool isPressed = keyboardInput.keyStatus == Win32::KeyStatus::Pressed;
+		if(isPressed)
+		{
+			if(m_pressedKeys.test(keyIndex))
+				/* skip as the key is already pressed */
+				return;
+			m_pressedKeys.set(keyIndex);
+		}
+
+		if(isPressed)
+		{
+			// m_keyChords works on virtual keys: it gets the first press and the last release of a pair sharing one
+			if(m_virtualKeyHeldCounts[virtualKey]++ == 0)
+			{
+				if(m_curKeyComb.size() < KeyChordEngine::MaxHeldKeys)
+					m_curKeyComb.push_back(keyboardInput);
+
+				KeyChordEngine::ChordId chord = m_keyChords.onKey(virtualKey, true);
+				if(chord != KeyChordEngine::InvalidChord)
+				{
+					m_inputDispatcher.publishKeyCombination(chord, m_curKeyComb);
+					m_keyCombEvents[chord].publish(m_curKeyComb);
+					// Only the combination is published, the press completing it goes to none of the keyboard subscribers
+					return;
+				}
+			}
+		}
+		else
+		{
+			DEBUG_ASSERT(keyboardInput.keyStatus == Win32::KeyStatus::Released);
+			// A key held since before the window had the focus has its release reported only, there is no state to update
+			if(m_pressedKeys.test(keyIndex))
+			{
+				m_pressedKeys.reset(keyIndex);
+				if(--m_virtualKeyHeldCounts[virtualKey] == 0)
+				{
+					m_keyChords.onKey(virtualKey, false);
+					// The keys pressed after it stay held, in the same order
+					auto it = std::find_if(m_curKeyComb.begin(), m_curKeyComb.end(), [virtualKey](const Win32::KeyboardInput& input) { return input.virtualKey == virtualKey; });
+					if(it != m_curKeyComb.end())
+						m_curKeyComb.erase(it);
+				}
+			}
+		}
+		// The ring and the asynchronous subscribers get what m_keyboardEvent gets, whichever way a subscriber is attached
+		const u64 timestamp = GetInputTimestamp();
+		if(m_inputEventRing != nullptr)
+			m_inputEventRing->pushKeyboard(keyboardInput, timestamp);
+		m_inputDispatcher.publishKeyboard(keyboardInput, timestamp);
+		m_keyboardEvent.publish(keyboardInput);
+	}
+
+	void Win32Window::dispatchInput(const InputEvent& event)
+	{
+		switch(event.type)
+		{
+			case WindowEventType::KeyboardInput: dispatchKeyboardInput(event.keyboard); break;
+			case WindowEventType::MouseInput: dispatchMouseInput(event.mouse); break;
+			default: break;
+		}
 	}
 
 	LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
@@ -355,6 +534,8 @@ namespace kvmio
 					kvmio_Internal_ErrorExit("AdjustWindowRect");
 				window->m_clientWidth = rect.right;
 				window->m_clientHeight = rect.bottom;
+				if(window->m_inputEventRing != nullptr)
+					window->m_inputEventRing->pushResize(rect.right, rect.bottom, GetInputTimestamp());
 				if(window->isLocked())
 				{
 					RECT winRect;
@@ -387,67 +568,14 @@ namespace kvmio
 					case RIM_TYPEMOUSE:
 					{
 						RAWMOUSE* rawMouse = &rawInput->data.mouse;
-						Win32::MouseInput mouseInput = Win32::DecodeRawMouseInput(rawMouse);
-						window->getMouseEvent().publish(mouseInput);
+						window->dispatchMouseInput(Win32::DecodeRawMouseInput(rawMouse));
 						break;
 					}
 
 					case RIM_TYPEKEYBOARD:
 					{
 						RAWKEYBOARD* rawKeyboard = &rawInput->data.keyboard;
-						Win32::KeyboardInput keyboardInput = Win32::DecodeRawKeyboardInput(rawKeyboard);
-						std::vector<Win32::KeyboardInput>& curKeyComb = window->m_curKeyComb;
-						auto& m_pressedKeys = window->m_pressedKeys;
-						if(keyboardInput.keyStatus == Win32::KeyStatus::Pressed)
-						{
-							if(m_pressedKeys.find(keyboardInput.makeCode) != m_pressedKeys.end())
-								/* skip as the key is already pressed */
-								break;
-							else
-								m_pressedKeys.insert({keyboardInput.makeCode, Win32::KeyStatus::Pressed});
-
-							curKeyComb.push_back(keyboardInput);
-
-							bool isKeyComb = false;
-							for(auto& keyCombEventPair : window->m_keyCombs)
-							{
-								std::vector<Win32::KeyCode>& keyComb = keyCombEventPair.first;
-								if(keyComb.size() != curKeyComb.size())
-									continue;
-								else
-								{
-									bool isMatched = true;
-									for(std::size_t i = 0; i < curKeyComb.size(); i++)
-									{
-										if(com::IntToEnumClass<Win32::KeyCode>(static_cast<u8>(curKeyComb[i].virtualKey)) != keyComb[i])
-										{
-											isMatched = false;
-											break;
-										}
-									}
-									if(!isMatched)
-										continue;
-									keyCombEventPair.second.publish(curKeyComb);
-									isKeyComb = true;
-									break;
-								}
-							}
-							if(isKeyComb)
-								break;
-						}
-						else
-						{
-							auto result = m_pressedKeys.erase(keyboardInput.makeCode);
-							DEBUG_ASSERT(result == 1);
-
-							DEBUG_ASSERT(keyboardInput.keyStatus == Win32::KeyStatus::Released);
-							Win32::KeyCode virtualKey = com::IntToEnumClass<Win32::KeyCode>(static_cast<u8>(curKeyComb.back().virtualKey));
-							if(virtualKey == keyboardInput.virtualKey)
-								curKeyComb.pop_back();
-							else
-								curKeyComb.clear();
-						}
-						window->getKeyboardEvent().publish(keyboardInput);
+						window->dispatchKeyboardInput(Win32::DecodeRawKeyboardInput(rawKeyboard));
 						break;
 					}
 
@@ -468,22 +596,8 @@ namespace kvmio
 				if(BeginPaint(hwnd, &paintStruct) == NULL)
 					kvmio_Internal_ErrorExit("BeginPaint");
 
-				if(!window->m_inFlightFramesBuffer.isEmpty())
-				{
-					Win32::WindowPaintInfo paintInfo = { paintStruct.hdc, paintStruct.rcPaint };
-					auto frameData = window->m_inFlightFramesBuffer.pop();
-					std::span<u8>& t = frameData;
-					DEBUG_ASSERT(t.size() == window->m_drawSurface->getBufferSize());
-					memcpy(window->m_drawSurface->getPixels(), reinterpret_cast<const char*>(t.data()), t.size());
-					{
-						std::lock_guard<std::mutex> lock(window->m_pooledFramesMutex);
-						window->m_pooledFrames->put(frameData);
-					}
-					
-					auto drawSurfaceSize = window->m_drawSurface->getSize();
-					// Do Paint
-					BitBlt(paintInfo.deviceContext, 0, 0, drawSurfaceSize.first, drawSurfaceSize.second, window->m_drawSurface->getHDC(), 0, 0, SRCCOPY);
-				}
+				// Do Paint
+				window->paint(paintStruct);
 
 				// End Paint
 				EndPaint(hwnd, &paintStruct);
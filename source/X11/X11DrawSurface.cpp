@@ -0,0 +1,153 @@
+#include <kvmio/X11/X11DrawSurface.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <cstring> // for std::memset
+#include <cstdlib> // for std::calloc
+
+namespace kvmio::X11
+{
+	// XShmAttach() is checked for failure (e.g. a remote server advertising MIT-SHM) by trapping the X error it raises
+	static bool gIsShmAttachFailed = false;
+
+	static int ShmAttachErrorHandler(Display*, XErrorEvent*)
+	{
+		gIsShmAttachFailed = true;
+		return 0;
+	}
+
+	X11DrawSurface::X11DrawSurface(Display* display, ::Window window, u32 width, u32 height) :
+											m_display(display),
+											m_window(window),
+											m_image(NULL),
+											m_shmInfo { },
+											m_isShm(false),
+											m_shmEventBase(0),
+											m_isPutPending(false),
+											m_width(width),
+											m_height(height)
+	{
+		XWindowAttributes attributes;
+		XGetWindowAttributes(display, window, &attributes);
+		// The pixels are written as B8G8R8A8, which is what a 24 (or 32) bit TrueColor visual is on a little endian machine
+		if((attributes.visual->c_class != TrueColor) || (attributes.depth < 24) || (attributes.visual->red_mask != 0xFF0000)
+			|| (attributes.visual->green_mask != 0x00FF00) || (attributes.visual->blue_mask != 0x0000FF))
+		{
+			spdlog::critical("Unsupported X11 visual of depth {}, a 24 bit TrueColor visual is required", attributes.depth);
+			exit(-1);
+		}
+
+		m_gc = XCreateGC(display, window, 0, NULL);
+
+		s32 shmOpcode, shmError;
+		if(XShmQueryExtension(display) && XQueryExtension(display, "MIT-SHM", &shmOpcode, &m_shmEventBase, &shmError))
+			m_isShm = createShmImage(attributes.visual, static_cast<u32>(attributes.depth));
+		if(!m_isShm)
+		{
+			spdlog::warn("MIT-SHM is not available, the frames will be copied through the X11 connection");
+			char* data = static_cast<char*>(std::calloc(getBufferSize(), 1));
+			m_image = XCreateImage(display, attributes.visual, static_cast<u32>(attributes.depth), ZPixmap, 0, data, width, height, 32, 0);
+			if(m_image == NULL)
+			{
+				spdlog::critical("XCreateImage failed");
+				exit(-1);
+			}
+		}
+		std::memset(m_image->data, 0xFF, getBufferSize());
+	}
+
+	bool X11DrawSurface::createShmImage(Visual* visual, u32 depth)
+	{
+		m_image = XShmCreateImage(m_display, visual, depth, ZPixmap, NULL, &m_shmInfo, m_width, m_height);
+		if(m_image == NULL)
+			return false;
+		DEBUG_ASSERT(m_image->bits_per_pixel == 32);
+		m_shmInfo.shmid = shmget(IPC_PRIVATE, static_cast<std::size_t>(m_image->bytes_per_line) * m_image->height, IPC_CREAT | 0600);
+		if(m_shmInfo.shmid < 0)
+		{
+			XDestroyImage(m_image);
+			m_image = NULL;
+			return false;
+		}
+		m_shmInfo.shmaddr = m_image->data = static_cast<char*>(shmat(m_shmInfo.shmid, NULL, 0));
+		m_shmInfo.readOnly = False;
+
+		gIsShmAttachFailed = false;
+		auto oldHandler = XSetErrorHandler(ShmAttachErrorHandler);
+		XShmAttach(m_display, &m_shmInfo);
+		XSync(m_display, False);
+		XSetErrorHandler(oldHandler);
+		// Marked for removal right away, it goes away along with the last attachment (this process's or the server's)
+		shmctl(m_shmInfo.shmid, IPC_RMID, NULL);
+		if(gIsShmAttachFailed)
+		{
+			shmdt(m_shmInfo.shmaddr);
+			m_image->data = NULL;
+			XDestroyImage(m_image);
+			m_image = NULL;
+			return false;
+		}
+		return true;
+	}
+
+	X11DrawSurface::~X11DrawSurface()
+	{
+		if(m_isShm)
+		{
+			XShmDetach(m_display, &m_shmInfo);
+			XSync(m_display, False);
+			shmdt(m_shmInfo.shmaddr);
+			m_image->data = NULL;
+		}
+		// Frees the data as well for the non-shm image
+		XDestroyImage(m_image);
+		XFreeGC(m_display, m_gc);
+	}
+
+	u8* X11DrawSurface::getPixels()
+	{
+		DEBUG_ASSERT(!m_isPutPending, "The X server may still be reading the pixels");
+		return reinterpret_cast<u8*>(m_image->data);
+	}
+
+	std::pair<u32, u32> X11DrawSurface::getSize() const
+	{
+		return std::pair<u32, u32> { m_width, m_height };
+	}
+
+	u32 X11DrawSurface::getStride() const
+	{
+		return static_cast<u32>(m_image->bytes_per_line);
+	}
+
+	u32 X11DrawSurface::getBufferSize() const
+	{
+		return m_width * m_height * 4;
+	}
+
+	void X11DrawSurface::put(s32 x, s32 y, u32 width, u32 height)
+	{
+		if(m_isShm)
+		{
+			// Only the one with the completion event requested can be pending at a time
+			DEBUG_ASSERT(!m_isPutPending);
+			XShmPutImage(m_display, m_window, m_gc, m_image, x, y, x, y, width, height, True);
+			m_isPutPending = true;
+		}
+		else
+			XPutImage(m_display, m_window, m_gc, m_image, x, y, x, y, width, height);
+		XFlush(m_display);
+	}
+
+	bool X11DrawSurface::handleEvent(const XEvent& event)
+	{
+		if(!m_isShm || (event.type != (m_shmEventBase + ShmCompletion)))
+			return false;
+		m_isPutPending = false;
+		return true;
+	}
+}
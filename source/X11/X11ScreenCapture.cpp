@@ -0,0 +1,274 @@
+#include <kvmio/X11/X11ScreenCapture.hpp>
+#include <kvmio/ColorConversion.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <poll.h>
+
+#include <algorithm> // for std::min, std::max
+#include <chrono>
+#include <thread> // for std::this_thread::sleep_for
+#include <cerrno> // for errno
+
+// Beyond this many damaged rectangles their bounding box is read instead, as every rectangle is a round trip to the server
+#define X11_SCREEN_CAPTURE_MAX_RECTS 32
+// How long run() waits for damage before checking the predicate again, in milliseconds
+#define X11_SCREEN_CAPTURE_RUN_TIMEOUT 100
+
+namespace kvmio::X11
+{
+	// XShmAttach() is checked for failure (e.g. a remote server advertising MIT-SHM) by trapping the X error it raises
+	static bool gIsShmAttachFailed = false;
+
+	static int ShmAttachErrorHandler(Display*, XErrorEvent*)
+	{
+		gIsShmAttachFailed = true;
+		return 0;
+	}
+
+	X11ScreenCapture::X11ScreenCapture(const char* displayName) :
+											m_image(NULL),
+											m_shmInfo { },
+											m_isShm(false),
+											m_isDamageSupported(false),
+											m_damageEventBase(0),
+											m_damage(None),
+											m_damageRegion(None),
+											m_isDamaged(true),
+											m_sequence(0)
+	{
+		m_display = XOpenDisplay(displayName);
+		if(m_display == NULL)
+		{
+			spdlog::critical("Unable to open the X display {}", XDisplayName(displayName));
+			exit(-1);
+		}
+		s32 screen = DefaultScreen(m_display);
+		m_root = RootWindow(m_display, screen);
+		m_visual = DefaultVisual(m_display, screen);
+		m_depth = static_cast<u32>(DefaultDepth(m_display, screen));
+		// The pixels are read as B8G8R8A8, which is what a 24 (or 32) bit TrueColor visual is on a little endian machine
+		if((m_visual->c_class != TrueColor) || (m_depth < 24) || (m_visual->red_mask != 0xFF0000)
+			|| (m_visual->green_mask != 0x00FF00) || (m_visual->blue_mask != 0x0000FF))
+		{
+			spdlog::critical("Unsupported X11 visual of depth {}, a 24 bit TrueColor visual is required", m_depth);
+			exit(-1);
+		}
+		// NV12 frames have even dimensions, the odd last row or column (if any) is left out
+		m_width = static_cast<u32>(DisplayWidth(m_display, screen)) & ~1u;
+		m_height = static_cast<u32>(DisplayHeight(m_display, screen)) & ~1u;
+		m_frame.resize(static_cast<std::size_t>(m_width) * m_height * 3 / 2);
+
+		if(XShmQueryExtension(m_display))
+			m_isShm = createShmImage();
+		if(!m_isShm)
+			spdlog::warn("MIT-SHM is not available, the screen will be copied through the X11 connection");
+
+		s32 damageErrorBase, fixesEventBase, fixesErrorBase;
+		if(XDamageQueryExtension(m_display, &m_damageEventBase, &damageErrorBase) && XFixesQueryExtension(m_display, &fixesEventBase, &fixesErrorBase))
+		{
+			// A single notify until the damage is subtracted, however many changes happen in between
+			m_damage = XDamageCreate(m_display, m_root, XDamageReportNonEmpty);
+			m_damageRegion = XFixesCreateRegion(m_display, NULL, 0);
+			m_isDamageSupported = true;
+		}
+		else
+			spdlog::warn("XDamage is not available, every frame will be a full one");
+		spdlog::info("Capturing the X11 screen of {}x{}", m_width, m_height);
+	}
+
+	bool X11ScreenCapture::createShmImage()
+	{
+		m_image = XShmCreateImage(m_display, m_visual, m_depth, ZPixmap, NULL, &m_shmInfo, m_width, m_height);
+		if(m_image == NULL)
+			return false;
+		DEBUG_ASSERT(m_image->bits_per_pixel == 32);
+		m_shmInfo.shmid = shmget(IPC_PRIVATE, static_cast<std::size_t>(m_image->bytes_per_line) * m_image->height, IPC_CREAT | 0600);
+		if(m_shmInfo.shmid < 0)
+		{
+			XDestroyImage(m_image);
+			m_image = NULL;
+			return false;
+		}
+		m_shmInfo.shmaddr = m_image->data = static_cast<char*>(shmat(m_shmInfo.shmid, NULL, 0));
+		// Written by the server
+		m_shmInfo.readOnly = False;
+
+		gIsShmAttachFailed = false;
+		auto oldHandler = XSetErrorHandler(ShmAttachErrorHandler);
+		XShmAttach(m_display, &m_shmInfo);
+		XSync(m_display, False);
+		XSetErrorHandler(oldHandler);
+		// Marked for removal right away, it goes away along with the last attachment (this process's or the server's)
+		shmctl(m_shmInfo.shmid, IPC_RMID, NULL);
+		if(gIsShmAttachFailed)
+		{
+			shmdt(m_shmInfo.shmaddr);
+			m_image->data = NULL;
+			XDestroyImage(m_image);
+			m_image = NULL;
+			return false;
+		}
+		return true;
+	}
+
+	X11ScreenCapture::~X11ScreenCapture()
+	{
+		if(m_isDamageSupported)
+		{
+			XFixesDestroyRegion(m_display, m_damageRegion);
+			XDamageDestroy(m_display, m_damage);
+		}
+		if(m_isShm)
+		{
+			XShmDetach(m_display, &m_shmInfo);
+			XSync(m_display, False);
+			shmdt(m_shmInfo.shmaddr);
+			m_image->data = NULL;
+			XDestroyImage(m_image);
+		}
+		XCloseDisplay(m_display);
+	}
+
+	void X11ScreenCapture::processEvents()
+	{
+		while(XPending(m_display) > 0)
+		{
+			XEvent event;
+			XNextEvent(m_display, &event);
+			if(m_isDamageSupported && (event.type == (m_damageEventBase + XDamageNotify)))
+				m_isDamaged = true;
+		}
+	}
+
+	static DamageRect AlignRect(s32 x, s32 y, s32 width, s32 height, u32 maxWidth, u32 maxHeight)
+	{
+		// Grown to whole 2x2 blocks and clipped to the frame
+		s32 left = std::max<s32>(x, 0) & ~1;
+		s32 top = std::max<s32>(y, 0) & ~1;
+		s32 right = std::min<s32>((x + width + 1) & ~1, static_cast<s32>(maxWidth));
+		s32 bottom = std::min<s32>((y + height + 1) & ~1, static_cast<s32>(maxHeight));
+		if((left >= right) || (top >= bottom))
+			return { 0, 0, 0, 0 };
+		return { static_cast<u32>(left), static_cast<u32>(top), static_cast<u32>(right - left), static_cast<u32>(bottom - top) };
+	}
+
+	void X11ScreenCapture::takeDamage()
+	{
+		m_damageRects.clear();
+		// The first frame is a full one, as are all of them without XDamage
+		if(!m_isDamageSupported || (m_sequence == 0))
+		{
+			if(m_isDamageSupported)
+				XDamageSubtract(m_display, m_damage, None, None);
+			m_damageRects.push_back({ 0, 0, m_width, m_height });
+			return;
+		}
+		// Moves the accumulated damage into the region and clears it, so the next change raises a notify again
+		XDamageSubtract(m_display, m_damage, None, m_damageRegion);
+		s32 count = 0;
+		XRectangle* rects = XFixesFetchRegion(m_display, m_damageRegion, &count);
+		if(rects == NULL)
+			return;
+		if(count > X11_SCREEN_CAPTURE_MAX_RECTS)
+		{
+			s32 left = rects[0].x, top = rects[0].y, right = rects[0].x + rects[0].width, bottom = rects[0].y + rects[0].height;
+			for(s32 i = 1; i < count; i++)
+			{
+				left = std::min<s32>(left, rects[i].x);
+				top = std::min<s32>(top, rects[i].y);
+				right = std::max<s32>(right, rects[i].x + rects[i].width);
+				bottom = std::max<s32>(bottom, rects[i].y + rects[i].height);
+			}
+			DamageRect rect = AlignRect(left, top, right - left, bottom - top, m_width, m_height);
+			if(rect.width != 0)
+				m_damageRects.push_back(rect);
+		}
+		else
+		{
+			for(s32 i = 0; i < count; i++)
+			{
+				DamageRect rect = AlignRect(rects[i].x, rects[i].y, rects[i].width, rects[i].height, m_width, m_height);
+				if(rect.width != 0)
+					m_damageRects.push_back(rect);
+			}
+		}
+		XFree(rects);
+	}
+
+	void X11ScreenCapture::readRect(const DamageRect& rect)
+	{
+		const std::size_t planeSize = static_cast<std::size_t>(m_width) * m_height;
+		u8* yPlane = m_frame.data() + static_cast<std::size_t>(rect.y) * m_width + rect.x;
+		u8* uvPlane = m_frame.data() + planeSize + static_cast<std::size_t>(rect.y / 2) * m_width + rect.x;
+		if(m_isShm)
+		{
+			// The image is narrowed down to the rectangle for the request, so the server writes only its pixels (tightly packed)
+			// at the start of the segment instead of a whole screen's worth
+			const s32 width = m_image->width, height = m_image->height, bytesPerLine = m_image->bytes_per_line;
+			m_image->width = static_cast<s32>(rect.width);
+			m_image->height = static_cast<s32>(rect.height);
+			m_image->bytes_per_line = static_cast<s32>(rect.width * 4);
+			XShmGetImage(m_display, m_root, m_image, static_cast<s32>(rect.x), static_cast<s32>(rect.y), AllPlanes);
+			ConvertBGRAToNV12(reinterpret_cast<const u8*>(m_image->data), rect.width * 4, rect.width, rect.height, yPlane, uvPlane, m_width);
+			m_image->width = width;
+			m_image->height = height;
+			m_image->bytes_per_line = bytesPerLine;
+			return;
+		}
+		XImage* image = XGetImage(m_display, m_root, static_cast<s32>(rect.x), static_cast<s32>(rect.y), rect.width, rect.height, AllPlanes, ZPixmap);
+		if(image == NULL)
+		{
+			spdlog::error("XGetImage failed for {}x{} at ({}, {})", rect.width, rect.height, rect.x, rect.y);
+			return;
+		}
+		DEBUG_ASSERT(image->bits_per_pixel == 32);
+		ConvertBGRAToNV12(reinterpret_cast<const u8*>(image->data), static_cast<u32>(image->bytes_per_line), rect.width, rect.height, yPlane, uvPlane, m_width);
+		XDestroyImage(image);
+	}
+
+	bool X11ScreenCapture::capture(u32 timeout)
+	{
+		processEvents();
+		if(!m_isDamaged)
+		{
+			pollfd pollFd { ConnectionNumber(m_display), POLLIN, 0 };
+			if(poll(&pollFd, 1, static_cast<s32>(timeout)) < 0)
+			{
+				if(errno != EINTR)
+					spdlog::error("poll on the X11 connection failed");
+				return false;
+			}
+			processEvents();
+			if(!m_isDamaged)
+				return false;
+		}
+		// Stays set without XDamage, so that every call captures a full frame
+		m_isDamaged = !m_isDamageSupported;
+
+		takeDamage();
+		if(m_damageRects.empty())
+			return false;
+		for(const DamageRect& rect : m_damageRects)
+			readRect(rect);
+
+		const u64 timestamp = static_cast<u64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		m_frameEvent.publish({ m_frame, m_width, m_height, m_damageRects, m_sequence++, timestamp });
+		return true;
+	}
+
+	void X11ScreenCapture::run(u32 frameRate, const Window::Predicate& isLoop)
+	{
+		const auto deltaTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<f64>(1.0 / frameRate));
+		while(isLoop())
+		{
+			if(!capture(X11_SCREEN_CAPTURE_RUN_TIMEOUT))
+				continue;
+			// The changes made meanwhile accumulate in the server's damage, without any notify beyond the first
+			std::this_thread::sleep_for(deltaTime);
+		}
+	}
+}
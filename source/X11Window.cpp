@@ -0,0 +1,377 @@
+#include <kvmio/X11Window.hpp>
+#include <kvmio/ColorConversion.hpp>
+#include <kvmio/ErrorHandling.hpp>
+
+#include <libassert/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include <X11/Xatom.h>
+
+#include <poll.h>
+
+#include <algorithm> // for std::min, std::max
+#include <chrono>
+#include <cstring>
+#include <cerrno> // for errno
+
+// In milliseconds, how often the event loop wakes up without any X event to check for a changed cursor (which has no fd to wait on)
+#define X11_WINDOW_CURSOR_POLL_INTERVAL 2
+
+namespace kvmio
+{
+	X11Window::X11Window(u32 width, u32 height, std::string_view title) :
+											m_width(width),
+											m_height(height),
+											m_isMapped(false),
+											m_isFullScreen(false),
+											m_isWindowShouldClose(false),
+											m_isDestroyed(false),
+											m_cursorOverlay(1920, 1080),
+											m_isSurfaceValid(false),
+											m_isFrameDue(false),
+											m_damage { 0, 0, 0, 0 }
+	{
+		// The Vulkan renderers present to the window from their own thread through the same connection
+		XInitThreads();
+		m_display = XOpenDisplay(NULL);
+		if(m_display == NULL)
+		{
+			spdlog::critical("Unable to open the X display {}", XDisplayName(NULL));
+			exit(-1);
+		}
+		s32 screen = DefaultScreen(m_display);
+		m_handle = XCreateSimpleWindow(m_display, RootWindow(m_display, screen), 0, 0, width, height, 0, BlackPixel(m_display, screen), BlackPixel(m_display, screen));
+		XSelectInput(m_display, m_handle, ExposureMask | StructureNotifyMask);
+
+		std::string name { title };
+		XStoreName(m_display, m_handle, name.c_str());
+		XChangeProperty(m_display, m_handle, XInternAtom(m_display, "_NET_WM_NAME", False), XInternAtom(m_display, "UTF8_STRING", False), 8,
+						PropModeReplace, reinterpret_cast<const unsigned char*>(name.data()), static_cast<int>(name.size()));
+
+		// Closing from the window manager is reported as a client message instead of the window being destroyed under us
+		m_wmDeleteWindow = XInternAtom(m_display, "WM_DELETE_WINDOW", False);
+		XSetWMProtocols(m_display, m_handle, &m_wmDeleteWindow, 1);
+		m_netWmState = XInternAtom(m_display, "_NET_WM_STATE", False);
+		m_netWmStateFullScreen = XInternAtom(m_display, "_NET_WM_STATE_FULLSCREEN", False);
+
+		m_drawSurface = std::make_unique<X11::X11DrawSurface>(m_display, m_handle, 1920, 1080);
+
+		m_rgbFrameSize = 1920 * 1080 * 4;
+
+		m_pooledFrames = std::make_unique<DataPool>([this]()
+		{
+			u8* data = new u8[m_rgbFrameSize];
+			return std::span <u8> { data, m_rgbFrameSize };
+		},
+		[](std::span<u8>& s)
+		{
+			delete[] s.data();
+		},
+		nullptr,
+		nullptr,
+		[](std::span<u8>& s1, std::span<u8>& s2) -> bool { return s1.data() == s2.data(); });
+	}
+
+	X11Window::~X11Window()
+	{
+		_destroy();
+	}
+
+	void X11Window::_destroy()
+	{
+		if(m_isDestroyed)
+			return;
+		// Detaches the shared memory segment, so it must go before the connection
+		m_drawSurface.reset();
+		XDestroyWindow(m_display, m_handle);
+		XCloseDisplay(m_display);
+		m_isDestroyed = true;
+	}
+
+	void X11Window::runGameLoop()
+	{
+		while(!shouldClose())
+		{
+			m_isFrameDue = true;
+			invalidateCursor();
+			paint();
+			waitEvents(X11_WINDOW_CURSOR_POLL_INTERVAL);
+		}
+	}
+
+	void X11Window::runGameLoop(u32 frameRate, const std::function<bool(void)>& isLoop)
+	{
+		const auto deltaTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<f64>(1.0 / frameRate));
+		auto nextFrameTime = std::chrono::steady_clock::now();
+		while(isLoop() && (!shouldClose()))
+		{
+			auto time = std::chrono::steady_clock::now();
+			if(time >= nextFrameTime)
+			{
+				m_isFrameDue = true;
+				nextFrameTime = time + deltaTime;
+			}
+			// At the input rate, the frame rate only applies to the frames
+			invalidateCursor();
+			paint();
+
+			auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(nextFrameTime - std::chrono::steady_clock::now()).count();
+			waitEvents(static_cast<u32>(std::clamp<s64>(timeout, 0, X11_WINDOW_CURSOR_POLL_INTERVAL)));
+		}
+	}
+
+	void X11Window::present(std::span<const u8> frameData)
+	{
+		DEBUG_ASSERT(frameData.size() >= (1920 * 1080 * 3 / 2));
+		presentPlanes({ frameData.data(), frameData.data() + 1920 * 1080, 1920, 1920, 1080 });
+	}
+
+	void X11Window::presentPlanes(const FramePlanes& planes)
+	{
+		if(m_isDestroyed)
+			return;
+		DEBUG_ASSERT((planes.width == 1920) && (planes.height == 1080));
+		DataPool::ElementType dstFrameData;
+		{
+			std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+			dstFrameData = m_pooledFrames->get();
+		}
+		std::span<u8>& t = dstFrameData;
+		// On the presenting thread, so the event loop only copies the converted pixels
+		ConvertNV12ToBGRA(planes.yPlane, planes.uvPlane, planes.stride, 1920, 1080, t.data(), 1920 * 4);
+		t = { t.data(), m_rgbFrameSize };
+		m_inFlightFramesBuffer.push(dstFrameData);
+	}
+
+	void X11Window::addDamage(const CursorRect& rect)
+	{
+		if(rect.width == 0)
+			return;
+		if(m_damage.width == 0)
+		{
+			m_damage = rect;
+			return;
+		}
+		s32 left = std::min(m_damage.x, rect.x);
+		s32 top = std::min(m_damage.y, rect.y);
+		s32 right = std::max(m_damage.x + static_cast<s32>(m_damage.width), rect.x + static_cast<s32>(rect.width));
+		s32 bottom = std::max(m_damage.y + static_cast<s32>(m_damage.height), rect.y + static_cast<s32>(rect.height));
+		m_damage = { left, top, static_cast<u32>(right - left), static_cast<u32>(bottom - top) };
+	}
+
+	void X11Window::invalidateCursor()
+	{
+		if(!m_isSurfaceValid || (m_cursorOverlay.getVersion() == m_softwareCursor.getDrawnVersion()))
+			return;
+		addDamage(m_softwareCursor.getDrawnRect());
+		addDamage(m_cursorOverlay.getState().getRect());
+	}
+
+	void X11Window::paint()
+	{
+		// Neither the frame nor the cursor can be written while the server is reading the surface, the damage is kept until then
+		if(!m_drawSurface->isWritable())
+			return;
+
+		auto [width, height] = m_drawSurface->getSize();
+		bool isNewFrame = m_isFrameDue && !m_inFlightFramesBuffer.isEmpty();
+		if(isNewFrame)
+		{
+			m_isFrameDue = false;
+			auto frameData = m_inFlightFramesBuffer.pop();
+			// Only the latest frame is displayed, the ones which have been queued up behind it go back to the pool
+			while(!m_inFlightFramesBuffer.isEmpty())
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+					m_pooledFrames->put(frameData);
+				}
+				frameData = m_inFlightFramesBuffer.pop();
+			}
+			std::span<u8>& t = frameData;
+			DEBUG_ASSERT(t.size() == m_drawSurface->getBufferSize());
+			u8* pixels = m_drawSurface->getPixels();
+			const u32 stride = m_drawSurface->getStride();
+			if(stride == (width * 4))
+				std::memcpy(pixels, t.data(), t.size());
+			else
+			{
+				for(u32 y = 0; y < height; y++)
+					std::memcpy(pixels + static_cast<std::size_t>(y) * stride, t.data() + static_cast<std::size_t>(y) * width * 4, width * 4);
+			}
+			setDisplayedFrame(frameData);
+			// The cursor drawn over the previous frame has been overwritten along with it
+			m_softwareCursor.invalidate();
+			m_isSurfaceValid = true;
+			addDamage({ 0, 0, width, height });
+		}
+		if(!m_isSurfaceValid)
+			return;
+
+		if(isNewFrame || (m_cursorOverlay.getVersion() != m_softwareCursor.getDrawnVersion()))
+		{
+			// SoftwareCursor assumes tightly packed rows, which is what MIT-SHM gives for a 32 bits per pixel image
+			DEBUG_ASSERT(m_drawSurface->getStride() == (width * 4));
+			addDamage(m_softwareCursor.restore(m_drawSurface->getPixels(), width, height));
+			addDamage(m_softwareCursor.draw(m_drawSurface->getPixels(), width, height, m_cursorOverlay.getState()));
+		}
+
+		// Only the damaged area, which is just the cursor's when it moved without a new frame
+		s32 left = std::max<s32>(m_damage.x, 0);
+		s32 top = std::max<s32>(m_damage.y, 0);
+		s32 right = std::min<s32>(m_damage.x + static_cast<s32>(m_damage.width), static_cast<s32>(std::min(width, m_width)));
+		s32 bottom = std::min<s32>(m_damage.y + static_cast<s32>(m_damage.height), static_cast<s32>(std::min(height, m_height)));
+		m_damage = { 0, 0, 0, 0 };
+		if((left >= right) || (top >= bottom) || !m_isMapped)
+			return;
+		m_drawSurface->put(left, top, static_cast<u32>(right - left), static_cast<u32>(bottom - top));
+	}
+
+	void X11Window::setDisplayedFrame(DataPool::ElementType& frame)
+	{
+		std::shared_ptr<DataPool::ElementType> displayedFrame(new DataPool::ElementType(frame), [this](DataPool::ElementType* frame)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_pooledFramesMutex);
+				m_pooledFrames->put(*frame);
+			}
+			delete frame;
+		});
+		auto [width, height] = m_drawSurface->getSize();
+		const std::span<u8>& pixels = *displayedFrame;
+		m_snapshotSource.setFrame(std::move(displayedFrame), pixels, SnapshotSourceFormat::BGRA, width, height);
+	}
+
+	void X11Window::requestSnapshot(const SnapshotRegion& region, SnapshotFormat format, SnapshotCallback callback)
+	{
+		m_snapshotSource.request(region, format, std::move(callback));
+	}
+
+	bool X11Window::shouldClose()
+	{
+		return m_isWindowShouldClose || m_isDestroyed;
+	}
+
+	void X11Window::show()
+	{
+		XMapRaised(m_display, m_handle);
+		XFlush(m_display);
+	}
+
+	void X11Window::setFullScreen(bool isFullScreen)
+	{
+		m_isFullScreen = isFullScreen;
+		if(!m_isMapped)
+		{
+			// The window manager picks the initial state up from the property when the window gets mapped
+			if(isFullScreen)
+				XChangeProperty(m_display, m_handle, m_netWmState, XA_ATOM, 32, PropModeReplace, reinterpret_cast<const unsigned char*>(&m_netWmStateFullScreen), 1);
+			else
+				XDeleteProperty(m_display, m_handle, m_netWmState);
+			return;
+		}
+
+		// EWMH: a mapped window asks the window manager to change its state
+		XEvent event { };
+		event.xclient.type = ClientMessage;
+		event.xclient.window = m_handle;
+		event.xclient.message_type = m_netWmState;
+		event.xclient.format = 32;
+		event.xclient.data.l[0] = isFullScreen ? 1 /* _NET_WM_STATE_ADD */ : 0 /* _NET_WM_STATE_REMOVE */;
+		event.xclient.data.l[1] = static_cast<long>(m_netWmStateFullScreen);
+		event.xclient.data.l[2] = 0;
+		// Normal application
+		event.xclient.data.l[3] = 1;
+		XSendEvent(m_display, DefaultRootWindow(m_display), False, SubstructureRedirectMask | SubstructureNotifyMask, &event);
+		XFlush(m_display);
+	}
+
+	void X11Window::handleEvent(XEvent& event)
+	{
+		if(m_drawSurface->handleEvent(event))
+			return;
+		switch(event.type)
+		{
+			case Expose:
+			{
+				addDamage({ event.xexpose.x, event.xexpose.y, static_cast<u32>(event.xexpose.width), static_cast<u32>(event.xexpose.height) });
+				break;
+			}
+
+			case ConfigureNotify:
+			{
+				m_width = static_cast<u32>(event.xconfigure.width);
+				m_height = static_cast<u32>(event.xconfigure.height);
+				break;
+			}
+
+			case MapNotify:
+			{
+				m_isMapped = true;
+				break;
+			}
+
+			case UnmapNotify:
+			{
+				m_isMapped = false;
+				break;
+			}
+
+			case ClientMessage:
+			{
+				if(static_cast<Atom>(event.xclient.data.l[0]) == m_wmDeleteWindow)
+					m_isWindowShouldClose = true;
+				break;
+			}
+		}
+	}
+
+	void X11Window::pollEvents(bool isBlock)
+	{
+		if(!isBlock && (XPending(m_display) == 0))
+			return;
+		XEvent event;
+		XNextEvent(m_display, &event);
+		handleEvent(event);
+	}
+
+	void X11Window::waitEvents(u32 timeout)
+	{
+		if(XPending(m_display) == 0)
+		{
+			pollfd fd = { ConnectionNumber(m_display), POLLIN, 0 };
+			if((poll(&fd, 1, static_cast<int>(timeout)) < 0) && (errno != EINTR))
+				kvmio_Internal_ErrorExit("poll");
+		}
+		while(XPending(m_display) > 0)
+		{
+			XEvent event;
+			XNextEvent(m_display, &event);
+			handleEvent(event);
+		}
+	}
+
+	void X11Window::setSize(u32 width, u32 height)
+	{
+		XResizeWindow(m_display, m_handle, width, height);
+		m_width = width;
+		m_height = height;
+	}
+
+	std::pair<u32, u32> X11Window::getSize() const
+	{
+		return { m_width, m_height };
+	}
+
+	void X11Window::setPosition(s32 x, s32 y)
+	{
+		XMoveWindow(m_display, m_handle, x, y);
+	}
+
+	void X11Window::setSizeAndPosition(s32 x, s32 y, u32 width, u32 height)
+	{
+		XMoveResizeWindow(m_display, m_handle, x, y, width, height);
+		m_width = width;
+		m_height = height;
+	}
+} // namespace kvmio